@@ -0,0 +1,6 @@
+// What the vertex shader passes on to the pixel shader.
+struct INTERPOLANTS {
+    float4 pos : SV_POSITION;
+    float3 normal : NORMAL;
+    float2 texcoord : TEXCOORD0;
+};
@@ -1,8 +1,12 @@
-struct PS_INPUT {
-    float4 pos : SV_POSITION;
-    float4 color : COLOR;
-};
+#include "common.hlsli"
 
-float4 main(PS_INPUT input) : SV_Target {
-    return input.color;
+Texture2D albedo : register(t1);
+SamplerState linearSampler : register(s0);
+
+static const float3 LIGHT_DIRECTION = float3(0.3, 0.8, 0.5);
+
+float4 main(INTERPOLANTS input) : SV_Target {
+    float3 color = albedo.Sample(linearSampler, input.texcoord).rgb;
+    float diffuse = saturate(dot(normalize(input.normal), normalize(LIGHT_DIRECTION)));
+    return float4(color * (0.3 + 0.7 * diffuse), 1.0);
 }
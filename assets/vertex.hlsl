@@ -1,21 +1,41 @@
+#include "common.hlsli"
+
 struct VS_INPUT {
     float3 pos : POSITION;
     float3 normal : NORMAL;
     float2 texcoord : TEXCOORD0;
+    uint4 joints : BLENDINDICES;
+    float4 weights : BLENDWEIGHT;
 };
 
-struct VS_OUTPUT {
-    float4 pos : SV_POSITION;
-    float4 color: COLOR;
+#define MAX_OBJECTS 1024
+#define MAX_JOINTS 64
+
+cbuffer ConstantsPerFrame : register(b0) {
+    float4x4 worldViewProj[MAX_OBJECTS];
 };
 
-cbuffer ConstantsPerObject : register(b0) {
-    float4x4 worldViewProj;
+cbuffer ConstantsPerDraw : register(b1) {
+    uint objectId;
 };
 
-VS_OUTPUT main(VS_INPUT vertex) {
-    VS_OUTPUT output;
-    output.pos = mul(worldViewProj, float4(vertex.pos, 1.0));
-    output.color = float4(vertex.normal, 1.0);
+// MAX_JOINTS skinning matrices per object, from the rest pose to the current pose
+StructuredBuffer<float3x4> skinMatrices : register(t0);
+
+INTERPOLANTS main(VS_INPUT vertex) {
+    uint base = objectId * MAX_JOINTS;
+    float3x4 skin =
+        vertex.weights.x * skinMatrices[base + vertex.joints.x] +
+        vertex.weights.y * skinMatrices[base + vertex.joints.y] +
+        vertex.weights.z * skinMatrices[base + vertex.joints.z] +
+        vertex.weights.w * skinMatrices[base + vertex.joints.w];
+
+    float3 pos = mul(skin, float4(vertex.pos, 1.0));
+    float3 normal = normalize(mul((float3x3)skin, vertex.normal));
+
+    INTERPOLANTS output;
+    output.pos = mul(worldViewProj[objectId], float4(pos, 1.0));
+    output.normal = normal;
+    output.texcoord = vertex.texcoord;
     return output;
 }
@@ -0,0 +1,266 @@
+#include "capture.h"
+#include "indirect.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static const uint32_t NO_STATE = 0xffffffff;
+static const uint32_t MAX_ROOT_PARAMETERS = 64;
+static const uint32_t MAX_VERTEX_BUFFERS = 32;
+
+struct Report {
+	uint64_t frames;
+	uint64_t commands;
+	uint64_t stateChanges;
+	uint64_t redundantStateChanges;
+	uint64_t rootSignatureChanges;
+	uint64_t pipelineChanges;
+	uint64_t barrierBatches;
+	uint64_t barriers;
+	uint64_t aliasingBarriers;
+	uint64_t indirectCalls;
+	uint64_t draws;
+	uint64_t boundBytes;
+	uint64_t uploadBytes;
+};
+
+// What the command list has bound, to tell changes from redundant ones. Changing the root
+// signature clears the root parameters, as it does in D3D12.
+struct BindState {
+	uint32_t rootSignature = NO_STATE;
+	uint32_t pipeline = NO_STATE;
+	uint64_t rootParameters[MAX_ROOT_PARAMETERS];
+	uint64_t vertexBuffers[MAX_VERTEX_BUFFERS];
+	uint32_t vertexBufferSizes[MAX_VERTEX_BUFFERS];
+	uint64_t indexBuffer = 0;
+	uint32_t indexBufferSize = 0;
+
+	BindState() {
+		memset(this->rootParameters, 0, sizeof(this->rootParameters));
+		memset(this->vertexBuffers, 0, sizeof(this->vertexBuffers));
+		memset(this->vertexBufferSizes, 0, sizeof(this->vertexBufferSizes));
+	}
+};
+
+static bool setState(uint32_t *state, uint32_t value, Report *report) {
+	report->stateChanges++;
+	if (*state == value) {
+		report->redundantStateChanges++;
+		return false;
+	}
+	*state = value;
+	return true;
+}
+
+static bool setAddress(uint64_t *state, uint64_t value, Report *report) {
+	report->stateChanges++;
+	if (*state == value) {
+		report->redundantStateChanges++;
+		return false;
+	}
+	*state = value;
+	return true;
+}
+
+static bool setView(
+	uint64_t *address, uint32_t *size, const CaptureCommand *command, Report *report
+) {
+	report->stateChanges++;
+	if (*address == command->address && *size == command->size) {
+		report->redundantStateChanges++;
+		return false;
+	}
+	*address = command->address;
+	*size = command->size;
+	return true;
+}
+
+// Root buffers count as the rest of the upload they point into, since that is what the shader
+// can read through them.
+static uint64_t getBoundSize(const CaptureFrame *frame, uint64_t address) {
+	auto upload = frame->findUpload(address);
+	return upload ? upload->size - (address - upload->address) : 0;
+}
+
+static bool analyzeFrame(const CaptureFrame *frame, Report *report) {
+	BindState state;
+	for (auto &upload : frame->uploads) {
+		report->uploadBytes += upload.size;
+	}
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < frame->numCommands; i++) {
+		CaptureCommand command;
+		if (!frame->next(&offset, &command)) {
+			return false;
+		}
+		report->commands++;
+
+		switch (command.op) {
+		case CAPTURE_SET_ROOT_SIGNATURE:
+			if (setState(&state.rootSignature, command.id, report)) {
+				report->rootSignatureChanges++;
+				memset(state.rootParameters, 0, sizeof(state.rootParameters));
+			}
+			break;
+
+		case CAPTURE_SET_PIPELINE:
+			if (setState(&state.pipeline, command.id, report)) {
+				report->pipelineChanges++;
+			}
+			break;
+
+		case CAPTURE_SET_ROOT_CBV:
+		case CAPTURE_SET_ROOT_SRV:
+			if (command.index >= MAX_ROOT_PARAMETERS) {
+				return false;
+			}
+			if (setAddress(&state.rootParameters[command.index], command.address, report)) {
+				report->boundBytes += getBoundSize(frame, command.address);
+			}
+			break;
+
+		case CAPTURE_SET_ROOT_TABLE:
+			if (command.index >= MAX_ROOT_PARAMETERS) {
+				return false;
+			}
+			setAddress(&state.rootParameters[command.index], command.address, report);
+			break;
+
+		case CAPTURE_SET_VERTEX_BUFFER:
+			if (command.index >= MAX_VERTEX_BUFFERS) {
+				return false;
+			}
+			if (setView(
+				&state.vertexBuffers[command.index], &state.vertexBufferSizes[command.index],
+				&command, report
+			)) {
+				report->boundBytes += command.size;
+			}
+			break;
+
+		case CAPTURE_SET_INDEX_BUFFER:
+			if (setView(&state.indexBuffer, &state.indexBufferSize, &command, report)) {
+				report->boundBytes += command.size;
+			}
+			break;
+
+		case CAPTURE_EXECUTE_INDIRECT:
+			report->indirectCalls++;
+			report->draws += command.count;
+			report->boundBytes += (uint64_t)command.count * sizeof(IndirectCommand);
+			break;
+
+		case CAPTURE_BARRIERS:
+			report->barrierBatches++;
+			report->barriers += command.count;
+			for (uint32_t j = 0; j < command.count; j++) {
+				if (command.getBarrier(j).type == BARRIER_ALIASING) {
+					report->aliasingBarriers++;
+				}
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	report->frames++;
+	return true;
+}
+
+static bool analyze(const char *path, Report *report) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		fprintf(stderr, "couldn't read %s\n", path);
+		return false;
+	}
+	auto size = (size_t)file.tellg();
+	file.seekg(0, std::ios::beg);
+	std::vector<char> data(size);
+	file.read(data.data(), size);
+
+	*report = Report();
+	CaptureReader reader;
+	if (!CaptureReader::create(data.data(), data.size(), &reader)) {
+		fprintf(stderr, "%s is not a capture\n", path);
+		return false;
+	}
+
+	CaptureFrame frame;
+	for (uint32_t i = 0; i < reader.numFrames; i++) {
+		if (!reader.nextFrame(&frame) || !analyzeFrame(&frame, report)) {
+			fprintf(stderr, "%s is corrupt at frame %u\n", path, i);
+			return false;
+		}
+	}
+
+	return report->frames > 0;
+}
+
+static double perFrame(const Report *report, uint64_t value) {
+	return report->frames ? (double)value / report->frames : 0.0;
+}
+
+static void printRow(
+	const char *name, const Report *reports, size_t numReports, uint64_t Report::*field
+) {
+	printf("%-24s", name);
+	for (size_t i = 0; i < numReports; i++) {
+		printf(" %14.1f", perFrame(&reports[i], reports[i].*field));
+	}
+
+	// the second capture relative to the first
+	if (numReports == 2) {
+		auto before = perFrame(&reports[0], reports[0].*field);
+		auto after = perFrame(&reports[1], reports[1].*field);
+		if (before > 0.0) {
+			printf(" %+13.1f%%", 100.0 * (after - before) / before);
+		} else {
+			printf(" %14s", after > 0.0 ? "new" : "-");
+		}
+	}
+	printf("\n");
+}
+
+int main(int argc, const char *argv[]) {
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s capture [other capture]\n", argv[0]);
+		return 1;
+	}
+
+	Report reports[2];
+	size_t numReports = argc - 1;
+	for (size_t i = 0; i < numReports; i++) {
+		if (!analyze(argv[i + 1], &reports[i])) {
+			return 1;
+		}
+	}
+
+	printf("%-24s", "per frame");
+	for (size_t i = 0; i < numReports; i++) {
+		auto name = strrchr(argv[i + 1], '/');
+		printf(" %14.14s", name ? name + 1 : argv[i + 1]);
+	}
+	printf(numReports == 2 ? " %14s\n" : "\n", "change");
+
+	printRow("commands", reports, numReports, &Report::commands);
+	printRow("state changes", reports, numReports, &Report::stateChanges);
+	printRow("  redundant", reports, numReports, &Report::redundantStateChanges);
+	printRow("  root signatures", reports, numReports, &Report::rootSignatureChanges);
+	printRow("  pipelines", reports, numReports, &Report::pipelineChanges);
+	printRow("barrier batches", reports, numReports, &Report::barrierBatches);
+	printRow("barriers", reports, numReports, &Report::barriers);
+	printRow("  aliasing", reports, numReports, &Report::aliasingBarriers);
+	printRow("indirect calls", reports, numReports, &Report::indirectCalls);
+	printRow("draws", reports, numReports, &Report::draws);
+	printRow("bytes bound", reports, numReports, &Report::boundBytes);
+	printRow("bytes uploaded", reports, numReports, &Report::uploadBytes);
+
+	for (size_t i = 0; i < numReports; i++) {
+		printf("%s: %llu frames\n", argv[i + 1], (unsigned long long)reports[i].frames);
+	}
+	return 0;
+}
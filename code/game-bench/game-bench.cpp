@@ -0,0 +1,797 @@
+#include "accounting.h"
+#include "anim.h"
+#include "animation.h"
+#include "arena.h"
+#include "bvh.h"
+#include "capture.h"
+#include "draw.h"
+#include "indirect.h"
+#include "jobs.h"
+#include "occlusion.h"
+#include "range.h"
+#include "recording.h"
+#include "ring.h"
+#include "scene.h"
+#include "streaming.h"
+#include "transform.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Options {
+	uint32_t frames = 600;
+	uint32_t warmup = 60;
+	uint32_t crowdWidth = 32;
+	uint32_t crowdDepth = 32;
+	uint32_t groups = 2;
+	uint32_t materials = 4;
+	int32_t threads = -1;
+	const char *anim = NULL;
+	const char *capture = NULL;
+	bool micro = false;
+	bool noAllocations = false;
+	bool streaming = false;
+	bool expectEvictions = false;
+	uint32_t textures = 64;
+	uint32_t budget = 32;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(arg, "--micro") == 0) {
+			options->micro = true;
+			continue;
+		}
+		if (strcmp(arg, "--no-allocations") == 0) {
+			options->noAllocations = true;
+			continue;
+		}
+		if (strcmp(arg, "--streaming") == 0) {
+			options->streaming = true;
+			continue;
+		}
+		if (strcmp(arg, "--expect-evictions") == 0) {
+			options->expectEvictions = true;
+			continue;
+		}
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--frames") == 0) {
+			options->frames = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--warmup") == 0) {
+			options->warmup = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--width") == 0) {
+			options->crowdWidth = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--depth") == 0) {
+			options->crowdDepth = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--groups") == 0) {
+			options->groups = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--materials") == 0) {
+			options->materials = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--threads") == 0) {
+			options->threads = atoi(value);
+		} else if (strcmp(arg, "--anim") == 0) {
+			options->anim = value;
+		} else if (strcmp(arg, "--capture") == 0) {
+			options->capture = value;
+		} else if (strcmp(arg, "--textures") == 0) {
+			options->textures = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--budget") == 0) {
+			options->budget = (uint32_t)atoi(value);
+		} else {
+			return false;
+		}
+	}
+
+	return options->frames > 0 && options->crowdWidth > 0 && options->crowdDepth > 0 &&
+		options->groups > 0 && options->materials > 0 && options->textures > 0;
+}
+
+static std::vector<char> readFile(const char *path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return std::vector<char>();
+	}
+	auto size = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	std::vector<char> data(size);
+	file.read(data.data(), size);
+	return data;
+}
+
+// Builds a clip from the assets with the builder's animation stage, so that the clip has the key
+// reduction and quantization of a real one.
+static bool buildClip(const char *name, std::vector<char> *data) {
+	auto sourcePath = std::string(ASSET_DIR) + "/" + name + ".bvh";
+	auto targetPath = std::string(CLIP_DIR) + "/" + name + ".anim";
+	if (FAILED(buildAnimation(sourcePath.c_str(), targetPath.c_str()))) {
+		return false;
+	}
+	*data = readFile(targetPath.c_str());
+	return !data->empty();
+}
+
+// Writes a clip in the builder's format for a humanoid sized skeleton of a chain of joints, with
+// a rotation key every few frames, for when no built clip is at hand.
+static void makeClip(
+	uint32_t numJoints, uint32_t numFrames, uint32_t keyStep, float phase, std::vector<char> *data
+) {
+	AnimationHeader header = {};
+	header.magic = 'A' | 'N' << 8 | 'I' << 16 | 'M' << 24;
+	header.version = 1;
+	header.numJoints = numJoints;
+	header.numFrames = numFrames;
+	header.frameRate = 30.0f;
+
+	std::vector<AnimationJoint> joints(numJoints);
+	std::vector<AnimationTrack> tracks(2 * numJoints);
+	std::vector<AnimationKey> keys;
+	for (uint32_t j = 0; j < numJoints; j++) {
+		joints[j].parent = (int32_t)j - 1;
+		joints[j].translation[1] = j == 0 ? 0.9f : 0.1f;
+		joints[j].rotation[3] = 1.0f;
+
+		auto &rotation = tracks[2 * j];
+		rotation.firstKey = (uint32_t)keys.size();
+		rotation.min[0] = -0.2f;
+		rotation.extent[0] = 0.4f;
+		rotation.min[3] = 0.97f;
+		rotation.extent[3] = 0.03f;
+		for (uint32_t frame = 0; frame < numFrames; frame += keyStep) {
+			auto angle = 0.2f * sinf(6.2831853f * frame / numFrames + phase + 0.3f * j);
+			auto x = (sinf(0.5f * angle) - rotation.min[0]) / rotation.extent[0];
+			auto w = (cosf(0.5f * angle) - rotation.min[3]) / rotation.extent[3];
+			AnimationKey key = {};
+			key.frame = (uint16_t)frame;
+			key.values[0] = (uint16_t)(std::min(std::max(x, 0.0f), 1.0f) * UINT16_MAX);
+			key.values[3] = (uint16_t)(std::min(std::max(w, 0.0f), 1.0f) * UINT16_MAX);
+			keys.push_back(key);
+		}
+		rotation.numKeys = (uint32_t)keys.size() - rotation.firstKey;
+
+		auto &translation = tracks[2 * j + 1];
+		translation.firstKey = (uint32_t)keys.size();
+		translation.numKeys = 1;
+		memcpy(translation.min, joints[j].translation, sizeof(joints[j].translation));
+		keys.push_back(AnimationKey());
+	}
+	header.numKeys = (uint32_t)keys.size();
+
+	data->clear();
+	auto append = [&](const void *p, size_t size) {
+		data->insert(data->end(), (const char*)p, (const char*)p + size);
+	};
+	append(&header, sizeof(header));
+	append(joints.data(), joints.size() * sizeof(joints[0]));
+	append(tracks.data(), tracks.size() * sizeof(tracks[0]));
+	append(keys.data(), keys.size() * sizeof(keys[0]));
+}
+
+// Loads that have been started, which arrive a few frames later, as they would from disk.
+struct PendingLoad {
+	uint32_t texture;
+	uint32_t mip;
+	uint32_t frame;
+};
+
+// A streamer for textures like the builder's color textures, 1024 square BC7 with full mip chains.
+static void createStreamer(const Options *options, TextureStreamer *streamer) {
+	StreamerDesc desc = {};
+	desc.budget = (uint64_t)options->budget << 20;
+	desc.uploadBudget = 4 << 20;
+	desc.tailSize = 64;
+	desc.screenHeight = 1080.0f;
+	TextureStreamer::create(&desc, streamer);
+
+	const uint32_t SIZE = 1024;
+	uint64_t mipSizes[TextureStreamer::MAX_MIPS];
+	uint32_t numMips = 0;
+	for (auto size = SIZE; size > 0; size >>= 1) {
+		auto blocks = (uint64_t)std::max((size + 3) / 4, 1u);
+		mipSizes[numMips++] = 16 * blocks * blocks;
+	}
+	for (uint32_t i = 0; i < options->textures; i++) {
+		streamer->addTexture(SIZE, SIZE, numMips, mipSizes);
+	}
+}
+
+// Walks down the middle of the crowd and back while swaying from side to side, so that textures
+// keep coming close to the camera and falling behind it.
+static void moveCamera(float time, Scene *scene) {
+	auto depth = scene->desc.crowdDepth * 1.5f;
+	auto z = -4.0f + 0.5f * (depth + 4.0f) * (1.0f - cosf(0.5f * time));
+	auto x = 4.0f * sinf(1.3f * time);
+	const float eye[3] = { x, 1.2f, z };
+	const float target[3] = { 0.5f * x, 1.0f, z + 12.0f };
+	scene->setCamera(eye, target);
+}
+
+static double getPercentile(const std::vector<double> &sorted, double percentile) {
+	auto index = (size_t)(percentile / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Descriptors and geometry are sub-allocated and freed a few at a time as assets come and go, and
+// every frame takes its constants from a ring.
+static void benchmarkRanges() {
+	const uint32_t COUNT = 100000;
+	std::mt19937 random(1);
+	RangeAllocator allocator;
+	RangeAllocator::create(1 << 20, &allocator);
+
+	struct Allocation {
+		uint32_t offset;
+		uint32_t size;
+	};
+	std::vector<Allocation> allocations;
+	allocations.reserve(COUNT);
+	uint32_t numFailed = 0;
+	auto start = Clock::now();
+	for (uint32_t i = 0; i < COUNT; i++) {
+		if (allocations.empty() || random() % 2 != 0) {
+			Allocation allocation = { 0, (uint32_t)(1 + random() % 256) };
+			if (allocator.allocate(allocation.size, 1, &allocation.offset)) {
+				allocations.push_back(allocation);
+			} else {
+				numFailed++;
+			}
+			continue;
+		}
+		auto index = random() % allocations.size();
+		allocator.free(allocations[index].offset, allocations[index].size);
+		allocations[index] = allocations.back();
+		allocations.pop_back();
+	}
+	auto allocated = Clock::now();
+	auto stats = allocator.getStats();
+
+	const uint32_t FRAMES = 10000;
+	const uint32_t PER_FRAME = 64;
+	FrameRing ring;
+	FrameRing::create(4 << 20, &ring);
+	auto ringStart = Clock::now();
+	for (uint32_t frame = 1; frame <= FRAMES; frame++) {
+		for (uint32_t i = 0; i < PER_FRAME; i++) {
+			uint64_t offset;
+			if (!ring.allocate(256 + 256 * (random() % 64), 256, &offset)) {
+				numFailed++;
+			}
+		}
+		ring.finishFrame(frame);
+		ring.retire(frame > 2 ? frame - 2 : 0);
+	}
+	auto ringEnd = Clock::now();
+
+	printf(
+		"ranges: %u operations in %.2f ms, %u free ranges, %.1f%% fragmented\n",
+		COUNT, getMilliseconds(start, allocated), stats.numFreeRanges,
+		100.0f * stats.fragmentation
+	);
+	printf(
+		"ring: %u allocations in %.2f ms, %u failed overall\n",
+		FRAMES * PER_FRAME, getMilliseconds(ringStart, ringEnd), numFailed
+	);
+}
+
+// What the backends do for every batch, at the size of a crowd many times this one.
+static void benchmarkIndirect() {
+	const uint32_t COUNT = 100000;
+	const uint32_t REPEATS = 100;
+	std::vector<uint32_t> objectIds(COUNT);
+	std::vector<uint32_t> numIndices(COUNT, 3000);
+	std::vector<uint32_t> startIndices(COUNT);
+	std::vector<int32_t> baseVertices(COUNT);
+	for (uint32_t i = 0; i < COUNT; i++) {
+		objectIds[i] = i;
+		startIndices[i] = 3000 * (i % 4);
+		baseVertices[i] = 1000 * (i % 4);
+	}
+	IndirectDraws draws = {
+		objectIds.data(), numIndices.data(), startIndices.data(), baseVertices.data(), COUNT
+	};
+	std::vector<IndirectCommand> commands(COUNT);
+
+	auto start = Clock::now();
+	for (uint32_t r = 0; r < REPEATS; r++) {
+		packIndirectCommands(&draws, commands.data());
+	}
+	auto packed = Clock::now();
+
+	auto milliseconds = getMilliseconds(start, packed) / REPEATS;
+	printf(
+		"indirect: %u commands packed in %.3f ms (%.1f GB/s)\n",
+		COUNT, milliseconds, COUNT * sizeof(IndirectCommand) / (milliseconds * 1e6)
+	);
+}
+
+// A queue many times the size of the crowd's, in the order draws would be pushed in, with as many
+// pipelines and meshes as the key has room for.
+static void benchmarkDrawSort() {
+	const uint32_t COUNT = 100000;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+	DrawQueue queue;
+	queue.clear();
+	queue.reserve(COUNT);
+	for (uint32_t i = 0; i < COUNT; i++) {
+		DrawPacket packet = {};
+		packet.pass = random() % 2;
+		packet.rootSignature = random() % 4;
+		packet.pipeline = random() % 64;
+		packet.mesh = random() % 256;
+		packet.depth = depth(random);
+		packet.objectId = i;
+		packet.numIndices = 3000;
+		queue.push(&packet);
+	}
+
+	auto start = Clock::now();
+	queue.sort();
+	auto sorted = Clock::now();
+	queue.build();
+	auto built = Clock::now();
+
+	auto &before = queue.unsortedChanges;
+	auto &after = queue.sortedChanges;
+	printf(
+		"draw sort: %u packets, sort %.2f ms, build %.2f ms, %zu batches\n",
+		COUNT, getMilliseconds(start, sorted), getMilliseconds(sorted, built),
+		queue.batches.size()
+	);
+	printf(
+		"  state changes: %u/%u/%u root signatures/pipelines/meshes unsorted, %u/%u/%u sorted\n",
+		before.rootSignatures, before.pipelines, before.meshes,
+		after.rootSignatures, after.pipelines, after.meshes
+	);
+
+	queue.clear();
+	FrameArena::resetAll();
+}
+
+static void benchmarkBvh() {
+	const uint32_t COUNT = 100000;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+	std::vector<Bounds> bounds(COUNT);
+	for (auto &b : bounds) {
+		for (int i = 0; i < 3; i++) {
+			b.min[i] = position(random);
+			b.max[i] = b.min[i] + size(random);
+		}
+	}
+
+	auto start = Clock::now();
+	Bvh bvh;
+	Bvh::create(bounds.data(), COUNT, &bvh);
+	auto built = Clock::now();
+	bvh.refit(bounds.data());
+	auto refitted = Clock::now();
+
+	float viewProj[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, -1.0f, -0.1f,
+		0.0f, 0.0f, -1.0f, 0.0f,
+	};
+	Frustum frustum;
+	extractFrustum(viewProj, &frustum);
+	std::vector<uint32_t> visible;
+	bvh.cullFrustum(&frustum, &visible);
+	auto culled = Clock::now();
+
+	// rays start anywhere in the scene, so some are inside primitives and some leave it
+	const uint32_t NUM_RAYS = 100000;
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	std::vector<float> rays(6 * NUM_RAYS);
+	for (uint32_t i = 0; i < NUM_RAYS; i++) {
+		for (int j = 0; j < 3; j++) {
+			rays[6 * i + j] = position(random);
+			rays[6 * i + 3 + j] = direction(random);
+		}
+	}
+
+	auto cast = Clock::now();
+	uint32_t numHits = 0;
+	for (uint32_t i = 0; i < NUM_RAYS; i++) {
+		uint32_t primitive;
+		float t;
+		auto ray = &rays[6 * i];
+		numHits += bvh.intersectRay(ray, ray + 3, FLT_MAX, &primitive, &t) ? 1 : 0;
+	}
+	auto traced = Clock::now();
+
+	printf(
+		"bvh: %u primitives, build %.2f ms, refit %.2f ms, cull %.3f ms (%zu visible)\n",
+		COUNT, getMilliseconds(start, built), getMilliseconds(built, refitted),
+		getMilliseconds(refitted, culled), visible.size()
+	);
+	printf(
+		"  %u rays in %.2f ms (%u hits), depth %u\n",
+		NUM_RAYS, getMilliseconds(cast, traced), numHits, bvh.depth
+	);
+}
+
+static void benchmarkTransforms(JobSystem *jobs) {
+	const uint32_t COUNT = 100000;
+	std::vector<uint32_t> parents(COUNT);
+	for (uint32_t i = 0; i < COUNT; i++) {
+		parents[i] = i == 0 ? TransformHierarchy::NO_PARENT : (i - 1) / 8;
+	}
+
+	TransformHierarchy hierarchy;
+	TransformHierarchy::create(parents.data(), COUNT, &hierarchy);
+
+	const float translation[3] = { 0.1f, 0.2f, 0.3f };
+	const float rotation[4] = { 0.0f, 0.38268343f, 0.0f, 0.92387953f };
+	const float scale[3] = { 1.0f, 1.0f, 1.0f };
+	for (uint32_t i = 0; i < COUNT; i++) {
+		hierarchy.setLocal(i, translation, rotation, scale);
+	}
+
+	const float viewProj[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+	};
+	std::vector<float> out(16 * COUNT);
+
+	auto start = Clock::now();
+	hierarchy.update(jobs);
+	auto updated = Clock::now();
+	hierarchy.writeWorldViewProj(jobs, viewProj, 0, COUNT, out.data());
+	auto written = Clock::now();
+
+	printf(
+		"transforms: %u nodes, update %.2f ms, write %.2f ms\n",
+		COUNT, getMilliseconds(start, updated), getMilliseconds(updated, written)
+	);
+}
+
+static void benchmarkOcclusion(const Scene *scene) {
+	OcclusionBuffer occlusion;
+	OcclusionBuffer::create(&occlusion);
+
+	const uint32_t REPEATS = 100;
+	auto start = Clock::now();
+	for (uint32_t r = 0; r < REPEATS; r++) {
+		occlusion.clear();
+		for (uint32_t i = 0; i < scene->numOccluders; i++) {
+			occlusion.rasterize(
+				scene->occluderPositions, 8, scene->occluderIndices, 36,
+				&scene->occluderWorldViewProjs[16 * i]
+			);
+		}
+		occlusion.buildHierarchy();
+	}
+	auto rasterized = Clock::now();
+
+	uint32_t numVisible = 0;
+	for (uint32_t r = 0; r < REPEATS; r++) {
+		for (auto &bounds : scene->instanceBounds) {
+			numVisible += occlusion.isVisible(bounds.min, bounds.max, scene->viewProj) ? 1 : 0;
+		}
+	}
+	auto tested = Clock::now();
+
+	printf(
+		"occlusion: %u occluders in %.3f ms, %zu tests in %.3f ms (%u visible)\n",
+		scene->numOccluders, getMilliseconds(start, rasterized) / REPEATS,
+		scene->instanceBounds.size(), getMilliseconds(rasterized, tested) / REPEATS,
+		numVisible / REPEATS
+	);
+}
+
+static void benchmarkAnimation(
+	const Skeleton *skeleton, const AnimationClip *walk, const AnimationClip *idle,
+	const char *walkName, size_t compressedSize
+) {
+	const uint32_t COUNT = 10000;
+	std::vector<float> skinMatrices(12 * skeleton->numJoints);
+
+	Pose a;
+	Pose b;
+	Pose pose;
+	auto start = Clock::now();
+	for (uint32_t i = 0; i < COUNT; i++) {
+		walk->sample(0.013f * i, &a);
+		idle->sample(0.017f * i, &b);
+	}
+	auto sampled = Clock::now();
+	for (uint32_t i = 0; i < COUNT; i++) {
+		Pose::blend(&a, &b, (i % 16) / 15.0f, skeleton->numJoints, &pose);
+	}
+	auto blended = Clock::now();
+	for (uint32_t i = 0; i < COUNT; i++) {
+		skeleton->computeSkinMatrices(&pose, skinMatrices.data());
+	}
+	auto skinned = Clock::now();
+
+	auto rawSize = (size_t)walk->numFrames * walk->numJoints * 7 * sizeof(float);
+	printf(
+		"animation: %u joints, sample %.3f us, blend %.3f us, skin %.3f us per character\n",
+		skeleton->numJoints, 1000.0 * getMilliseconds(start, sampled) / (2 * COUNT),
+		1000.0 * getMilliseconds(sampled, blended) / COUNT,
+		1000.0 * getMilliseconds(blended, skinned) / COUNT
+	);
+	printf(
+		"animation: %s, %zu keys, %zu bytes raw, %zu compressed (%.1fx)\n",
+		walkName, walk->keys.size(), rawSize, compressedSize, (double)rawSize / compressedSize
+	);
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr,
+			"usage: %s [--frames n] [--warmup n] [--width n] [--depth n] [--groups n]\n"
+			"       [--materials n] [--threads n] [--anim path] [--capture path] [--micro]\n"
+			"       [--no-allocations] [--streaming] [--textures n] [--budget mb]\n"
+			"       [--expect-evictions]\n",
+			argv[0]
+		);
+		return 1;
+	}
+
+	std::vector<char> walkData;
+	std::vector<char> idleData;
+	auto walkName = "human.anim";
+	if (options.anim) {
+		walkData = readFile(options.anim);
+		idleData = walkData;
+		walkName = options.anim;
+	} else if (!buildClip("human", &walkData) || !buildClip("human-idle", &idleData)) {
+		fprintf(stderr, "couldn't build the clips from %s, so they're made up\n", ASSET_DIR);
+		makeClip(20, 32, 2, 0.0f, &walkData);
+		makeClip(20, 90, 6, 1.0f, &idleData);
+		walkName = "made up clip";
+	}
+
+	Skeleton skeleton;
+	AnimationClip walk;
+	AnimationClip idle;
+	if (
+		!Skeleton::create(walkData.data(), walkData.size(), &skeleton) ||
+		!AnimationClip::create(walkData.data(), walkData.size(), &skeleton, &walk) ||
+		!AnimationClip::create(idleData.data(), idleData.size(), &skeleton, &idle)
+	) {
+		fprintf(stderr, "invalid animation\n");
+		return 1;
+	}
+
+	JobSystem jobs;
+	auto numThreads = options.threads >= 0 ?
+		(uint32_t)options.threads : std::max(std::thread::hardware_concurrency(), 1u) - 1;
+	JobSystem::create(numThreads, &jobs);
+
+	// the bounds of human.obj, with each group a draw of a thousand triangles
+	Bounds meshBounds = { { -0.83f, 0.0f, -0.19f }, { 0.74f, 1.87f, 0.18f } };
+	std::vector<SceneGroup> groups;
+	for (uint32_t i = 0; i < options.groups; i++) {
+		SceneGroup group = { 3000, 3000 * i, (int32_t)(1000 * i) };
+		groups.push_back(group);
+	}
+
+	SceneDesc desc = {};
+	desc.crowdWidth = options.crowdWidth;
+	desc.crowdDepth = options.crowdDepth;
+	desc.numMaterials = options.materials;
+	desc.aspect = 16.0f / 9.0f;
+
+	Scene scene;
+	Scene::create(
+		&desc, groups.data(), groups.size(), &meshBounds, &skeleton, &walk, &idle, &scene
+	);
+
+	// constants, skin matrices and commands for the frames in flight, plus one for wrapping around
+	auto frameUploadSize = (uint64_t)scene.numInstances *
+		(16 + 12 * Pose::MAX_JOINTS) * sizeof(float) +
+		(uint64_t)scene.numInstances * options.groups * 64;
+	RecordingBackend backend;
+	RecordingBackend::create((RecordingBackend::FRAME_LATENCY + 2) * frameUploadSize, &backend);
+
+	// the measured frames, once warmup is over
+	CommandCapture capture;
+	CommandCapture::create(options.frames, &capture);
+
+	TextureStreamer streamer;
+	std::vector<PendingLoad> pending;
+	uint64_t peakUsed = 0;
+	if (options.streaming) {
+		createStreamer(&options, &streamer);
+		pending.reserve(options.textures);
+	}
+
+	std::vector<double> frameTimes;
+	std::vector<uint64_t> frameAllocations;
+	frameTimes.reserve(options.frames);
+	frameAllocations.reserve(options.frames);
+	uint64_t draws = 0;
+	uint64_t batches = 0;
+	MemoryStats measuredStats = {};
+	for (uint32_t i = 0; i < options.warmup + options.frames; i++) {
+		if (options.capture && i == options.warmup) {
+			backend.capture = &capture;
+		}
+
+		auto stats = getMemoryStats();
+		auto start = Clock::now();
+
+		FrameData frame;
+		if (options.streaming) {
+			moveCamera(i / 60.0f, &scene);
+			streamer.beginFrame();
+		}
+		if (!scene.update(1.0f / 60.0f, &jobs, &backend, &frame)) {
+			fprintf(stderr, "out of upload memory\n");
+			return 1;
+		}
+
+		if (options.streaming) {
+			const uint32_t LOAD_LATENCY = 3;
+			for (size_t j = 0; j < pending.size();) {
+				if (i - pending[j].frame < LOAD_LATENCY) {
+					j++;
+					continue;
+				}
+				streamer.completeLoad(pending[j].texture, pending[j].mip);
+				pending[j] = pending.back();
+				pending.pop_back();
+			}
+
+			for (size_t j = 0; j < scene.animated.size(); j++) {
+				streamer.request(scene.animated[j] % options.textures, scene.screenSizes[j]);
+			}
+			streamer.update();
+			for (auto &load : streamer.loads) {
+				PendingLoad pendingLoad = { load.texture, load.mip, i };
+				pending.push_back(pendingLoad);
+			}
+
+			peakUsed = std::max(peakUsed, streamer.used);
+			if (streamer.used > streamer.desc.budget) {
+				fprintf(stderr, "streaming went over budget in frame %u\n", i);
+				return 1;
+			}
+		}
+
+		if (!backend.renderFrame(&frame)) {
+			fprintf(stderr, "out of upload memory\n");
+			return 1;
+		}
+
+		auto end = Clock::now();
+		if (i >= options.warmup) {
+			auto endStats = getMemoryStats();
+			for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+				auto &counters = measuredStats.tags[tag];
+				counters.allocations += endStats.tags[tag].allocations - stats.tags[tag].allocations;
+				counters.bytes += endStats.tags[tag].bytes - stats.tags[tag].bytes;
+			}
+
+			frameTimes.push_back(getMilliseconds(start, end));
+			frameAllocations.push_back(endStats.getAllocations() - stats.getAllocations());
+			draws += backend.frameStats.draws;
+			batches += backend.frameStats.batches;
+		}
+	}
+
+	auto sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	uint64_t totalAllocations = 0;
+	uint64_t maxAllocations = 0;
+	for (auto allocations : frameAllocations) {
+		totalAllocations += allocations;
+		maxAllocations = std::max(maxAllocations, allocations);
+	}
+
+	printf(
+		"scene: %u instances, %u groups, %u materials, %u worker threads\n",
+		scene.numInstances, options.groups, options.materials, numThreads
+	);
+	printf(
+		"frame: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms over %u frames\n",
+		getPercentile(sorted, 50.0), getPercentile(sorted, 90.0), getPercentile(sorted, 99.0),
+		sorted.back(), options.frames
+	);
+	printf(
+		"draws: %.1f per frame in %.1f batches\n",
+		(double)draws / options.frames, (double)batches / options.frames
+	);
+	printf(
+		"allocations: %.2f per frame, %llu max\n",
+		(double)totalAllocations / options.frames, (unsigned long long)maxAllocations
+	);
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		auto &counters = measuredStats.tags[tag];
+		if (counters.allocations > 0) {
+			printf(
+				"  %s: %llu allocations, %llu bytes\n", getMemoryTagName((MemoryTag)tag),
+				(unsigned long long)counters.allocations, (unsigned long long)counters.bytes
+			);
+		}
+	}
+	printf("frame arena: %zu bytes at peak\n", FrameArena::getPeak());
+
+	if (options.streaming) {
+		uint64_t tailSize = 0;
+		uint64_t fullSize = 0;
+		for (uint32_t t = 0; t < options.textures; t++) {
+			auto &texture = streamer.textures[t];
+			tailSize += streamer.getTailSize(t);
+			for (uint32_t mip = 0; mip < texture.numMips; mip++) {
+				fullSize += texture.mipSizes[mip];
+			}
+		}
+
+		auto &stats = streamer.stats;
+		printf(
+			"streaming: %u textures, %.1f%% of %llu requests satisfied, %llu deferred\n",
+			options.textures, 100.0 * stats.satisfied / std::max(stats.requests, (uint64_t)1),
+			(unsigned long long)stats.requests, (unsigned long long)stats.deferred
+		);
+		printf(
+			"  %llu loads (%.1f MB), %llu evictions (%.1f MB)\n",
+			(unsigned long long)stats.loads, stats.loadedBytes / 1048576.0,
+			(unsigned long long)stats.evictions, stats.evictedBytes / 1048576.0
+		);
+		printf(
+			"  %.1f MB at peak of a %u MB budget, plus %.2f MB of tails, %.1f MB all resident\n",
+			peakUsed / 1048576.0, options.budget, tailSize / 1048576.0, fullSize / 1048576.0
+		);
+	}
+
+	if (options.capture) {
+		std::ofstream file(options.capture, std::ios::binary);
+		file.write((const char*)capture.stream.data(), capture.stream.size());
+		if (!file) {
+			fprintf(stderr, "couldn't write %s\n", options.capture);
+			return 1;
+		}
+		printf("capture: %u frames, %zu bytes\n", capture.numFrames, capture.stream.size());
+	}
+
+	if (options.micro) {
+		benchmarkRanges();
+		benchmarkIndirect();
+		benchmarkDrawSort();
+		benchmarkBvh();
+		benchmarkTransforms(&jobs);
+		benchmarkOcclusion(&scene);
+		benchmarkAnimation(&skeleton, &walk, &idle, walkName, walkData.size());
+	}
+
+	if (options.noAllocations && totalAllocations > 0) {
+		fprintf(stderr, "steady-state frames allocated from the heap\n");
+		return 1;
+	}
+
+	// a budget too small for what the camera sees has to evict, or it was never under pressure
+	if (options.expectEvictions && (!options.streaming || streamer.stats.evictions == 0)) {
+		fprintf(stderr, "streaming never evicted under a %u MB budget\n", options.budget);
+		return 1;
+	}
+
+	return 0;
+}
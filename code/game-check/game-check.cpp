@@ -0,0 +1,1332 @@
+#include "animation.h"
+#include "arena.h"
+#include "barrier.h"
+#include "bvh.h"
+#include "draw.h"
+#include "graph.h"
+#include "indirect.h"
+#include "occlusion.h"
+#include "placement.h"
+#include "range.h"
+#include "residency.h"
+#include "ring.h"
+#include "space.h"
+#include "tlsf.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Checks the parts of the game that decide where GPU memory goes and when it can be reused, which
+// are plain C++ under their D3D12 wrappers. A failed check is reported with its line, and the rest
+// still run, so that one run shows everything that broke.
+static int numFailures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		numFailures++; \
+	} \
+} while (false)
+
+static void checkRanges() {
+	RangeAllocator allocator;
+	RangeAllocator::create(1000, &allocator);
+
+	// allocations are split off the front of the free range, with padding left free
+	uint32_t a, b, c, d;
+	CHECK(allocator.allocate(100, 1, &a) && a == 0);
+	CHECK(allocator.allocate(50, 64, &b) && b == 128);
+	CHECK(allocator.freeRanges.size() == 2);
+	CHECK(allocator.freeRanges[0].offset == 100 && allocator.freeRanges[0].size == 28);
+	CHECK(allocator.freeRanges[1].offset == 178 && allocator.freeRanges[1].size == 822);
+
+	// best fit takes the hole that fits exactly over the large range
+	CHECK(allocator.allocate(28, 1, &c) && c == 100);
+	CHECK(allocator.freeRanges.size() == 1);
+	CHECK(allocator.allocate(822, 1, &d) && d == 178);
+	CHECK(allocator.freeRanges.empty() && allocator.used == 1000);
+
+	uint32_t none;
+	CHECK(!allocator.allocate(1, 1, &none));
+	CHECK(!allocator.allocate(0, 1, &none));
+
+	// frees coalesce with free neighbors on either side, whatever the order
+	allocator.free(c, 28);
+	allocator.free(d, 822);
+	CHECK(allocator.freeRanges.size() == 2);
+	allocator.free(a, 100);
+	CHECK(allocator.freeRanges.size() == 2);
+	CHECK(allocator.freeRanges[0].offset == 0 && allocator.freeRanges[0].size == 128);
+	auto fragmented = allocator.getStats();
+	CHECK(fragmented.numFreeRanges == 2 && fragmented.largestFreeRange == 822);
+	CHECK(fragmented.used == 50 && fragmented.fragmentation > 0.0f);
+	allocator.free(b, 50);
+	CHECK(allocator.freeRanges.size() == 1);
+	CHECK(allocator.freeRanges[0].offset == 0 && allocator.freeRanges[0].size == 1000);
+
+	auto stats = allocator.getStats();
+	CHECK(stats.used == 0 && stats.numFreeRanges == 1 && stats.fragmentation == 0.0f);
+
+	// random sizes, freed in random order, never overlap and end up as one range again
+	std::mt19937 random(1);
+	struct Allocation {
+		uint32_t offset;
+		uint32_t size;
+	};
+	std::vector<Allocation> allocations;
+	for (int i = 0; i < 10000; i++) {
+		if (allocations.empty() || random() % 3 != 0) {
+			Allocation allocation = { 0, (uint32_t)(1 + random() % 40) };
+			if (allocator.allocate(allocation.size, 1 << random() % 4, &allocation.offset)) {
+				allocations.push_back(allocation);
+			}
+			continue;
+		}
+		auto index = random() % allocations.size();
+		allocator.free(allocations[index].offset, allocations[index].size);
+		allocations[index] = allocations.back();
+		allocations.pop_back();
+	}
+
+	std::vector<bool> taken(1000);
+	auto overlaps = false;
+	for (auto &allocation : allocations) {
+		for (auto i = allocation.offset; i < allocation.offset + allocation.size; i++) {
+			overlaps = overlaps || taken[i];
+			taken[i] = true;
+		}
+	}
+	for (auto &range : allocator.freeRanges) {
+		for (auto i = range.offset; i < range.offset + range.size; i++) {
+			overlaps = overlaps || taken[i];
+			taken[i] = true;
+		}
+	}
+	CHECK(!overlaps);
+
+	for (auto &allocation : allocations) {
+		allocator.free(allocation.offset, allocation.size);
+	}
+	CHECK(allocator.used == 0 && allocator.freeRanges.size() == 1);
+
+	// deferred frees stay in use until the frame they were freed in has retired
+	RangeAllocator::create(100, &allocator);
+	CHECK(allocator.allocate(100, 1, &a));
+	allocator.freeDeferred(a, 100);
+	allocator.finishFrame(1);
+	allocator.finishFrame(2);
+	CHECK(!allocator.allocate(1, 1, &none));
+	allocator.retire(0);
+	CHECK(!allocator.allocate(1, 1, &none) && allocator.used == 100);
+	allocator.retire(1);
+	CHECK(allocator.used == 0 && allocator.allocate(100, 1, &a));
+
+	allocator.freeDeferred(a, 60);
+	allocator.finishFrame(3);
+	allocator.freeDeferred(a + 60, 40);
+	allocator.finishFrame(4);
+	allocator.retire(3);
+	CHECK(allocator.used == 40 && allocator.retiring.size() == 1);
+	allocator.retire(4);
+	CHECK(allocator.used == 0 && allocator.freeRanges.size() == 1);
+}
+
+static void checkRing() {
+	FrameRing ring;
+	FrameRing::create(1024, &ring);
+
+	uint64_t offset;
+	CHECK(!ring.allocate(2048, 1, &offset));
+	CHECK(ring.allocate(400, 1, &offset) && offset == 0);
+	CHECK(ring.allocate(100, 256, &offset) && offset == 512);
+	ring.finishFrame(1);
+
+	// an allocation that would run off the end starts over at the front, once that has retired
+	CHECK(!ring.allocate(500, 1, &offset));
+	ring.retire(0);
+	CHECK(!ring.allocate(500, 1, &offset));
+	ring.retire(1);
+	CHECK(ring.tail == 612);
+	CHECK(ring.allocate(500, 1, &offset) && offset == 0);
+	CHECK(ring.head == 1024 + 500);
+	ring.finishFrame(2);
+
+	// and then fills up to the tail from the other side
+	CHECK(ring.allocate(100, 1, &offset) && offset == 500);
+	CHECK(!ring.allocate(13, 1, &offset));
+	ring.finishFrame(3);
+	ring.retire(2);
+	CHECK(ring.head - ring.tail == 100);
+	ring.retire(3);
+	CHECK(ring.head == ring.tail);
+
+	// frames retire in order, each taking back what was allocated up to its end
+	FrameRing::create(1000, &ring);
+	for (uint64_t frame = 1; frame <= 4; frame++) {
+		CHECK(ring.allocate(200, 1, &offset) && offset == 200 * (frame - 1));
+		ring.finishFrame(frame);
+	}
+	CHECK(ring.numFrames == 4 && !ring.allocate(201, 1, &offset));
+	ring.retire(2);
+	CHECK(ring.numFrames == 2 && ring.tail == 400);
+	CHECK(ring.allocate(200, 1, &offset) && offset == 800);
+	CHECK(ring.allocate(400, 1, &offset) && offset == 0);
+	CHECK(!ring.allocate(1, 1, &offset));
+
+	// more frames than it keeps track of fold into the next, which only delays the oldest
+	FrameRing::create(1 << 20, &ring);
+	for (uint64_t frame = 1; frame <= FrameRing::MAX_FRAMES + 2; frame++) {
+		CHECK(ring.allocate(16, 1, &offset));
+		ring.finishFrame(frame);
+	}
+	CHECK(ring.numFrames == FrameRing::MAX_FRAMES);
+	ring.retire(1);
+	CHECK(ring.tail == 0);
+	ring.retire(3);
+	CHECK(ring.tail == 48);
+	ring.retire(FrameRing::MAX_FRAMES + 2);
+	CHECK(ring.numFrames == 0 && ring.head == ring.tail);
+}
+
+// Walks the blocks in address order, which have to tile the whole range without gaps, with no two
+// free blocks next to each other.
+static bool isTiled(const Tlsf *tlsf) {
+	auto first = Tlsf::NULL_BLOCK;
+	for (uint32_t i = 0; i < tlsf->blocks.size(); i++) {
+		auto &block = tlsf->blocks[i];
+		if (block.state != Tlsf::BLOCK_UNUSED && block.prevPhysical == Tlsf::NULL_BLOCK) {
+			first = i;
+		}
+	}
+
+	uint64_t end = 0;
+	auto previousFree = false;
+	for (auto i = first; i != Tlsf::NULL_BLOCK; i = tlsf->blocks[i].nextPhysical) {
+		auto &block = tlsf->blocks[i];
+		auto free = block.state == Tlsf::BLOCK_FREE;
+		if (block.offset != end || block.size == 0 || (free && previousFree)) {
+			return false;
+		}
+		end += block.size;
+		previousFree = free;
+	}
+	return end == tlsf->capacity;
+}
+
+static void checkTlsf() {
+	const uint64_t CAPACITY = 64 << 20;
+	const uint64_t GRANULARITY = 256;
+	Tlsf tlsf;
+	Tlsf::create(CAPACITY, GRANULARITY, &tlsf);
+
+	uint32_t block;
+	uint64_t offset;
+	CHECK(!tlsf.allocate(0, 1, &block, &offset));
+	CHECK(!tlsf.allocate(CAPACITY + 1, 1, &block, &offset));
+	CHECK(tlsf.allocate(CAPACITY, 1, &block, &offset) && offset == 0);
+	CHECK(!tlsf.allocate(1, 1, &block, &offset));
+	tlsf.free(block);
+
+	// sizes from a few bytes to megabytes, with the alignments textures and MSAA targets need, in
+	// and out at random
+	struct Allocation {
+		uint32_t block;
+		uint64_t offset;
+		uint64_t size;
+	};
+	std::vector<Allocation> allocations;
+	std::mt19937 random(1);
+	const uint64_t alignments[] = { 1, 256, 4096, 65536, 4 << 20 };
+	uint32_t numFailed = 0;
+	auto misaligned = false;
+	auto untiled = false;
+	auto overlaps = false;
+	for (int i = 0; i < 100000; i++) {
+		if (allocations.empty() || random() % 5 < 3) {
+			auto size = (uint64_t)1 << random() % 22;
+			size += random() % size;
+			auto alignment = alignments[random() % 5];
+
+			Allocation allocation;
+			if (!tlsf.allocate(size, alignment, &allocation.block, &allocation.offset)) {
+				numFailed++;
+				continue;
+			}
+			allocation.size = tlsf.blocks[allocation.block].size;
+			misaligned = misaligned || allocation.offset % alignment != 0 ||
+				allocation.size < size;
+			allocations.push_back(allocation);
+		} else {
+			auto index = random() % allocations.size();
+			tlsf.free(allocations[index].block);
+			allocations[index] = allocations.back();
+			allocations.pop_back();
+		}
+
+		if (i % 1000 != 0) {
+			continue;
+		}
+		untiled = untiled || !isTiled(&tlsf);
+
+		auto sorted = allocations;
+		std::sort(sorted.begin(), sorted.end(), [](const Allocation &a, const Allocation &b) {
+			return a.offset < b.offset;
+		});
+		for (size_t j = 1; j < sorted.size(); j++) {
+			overlaps = overlaps || sorted[j - 1].offset + sorted[j - 1].size > sorted[j].offset;
+		}
+	}
+	CHECK(!misaligned);
+	CHECK(!untiled);
+	CHECK(!overlaps);
+
+	// the heap has to have filled up, so that allocations had to fit in among the others
+	CHECK(numFailed > 0);
+
+	uint64_t used = 0;
+	for (auto &allocation : allocations) {
+		used += allocation.size;
+	}
+	CHECK(tlsf.used == used && tlsf.numAllocations == allocations.size());
+
+	// everything freed in any order coalesces back into the one block it started as
+	std::shuffle(allocations.begin(), allocations.end(), random);
+	for (auto &allocation : allocations) {
+		tlsf.free(allocation.block);
+	}
+	auto stats = tlsf.getStats();
+	CHECK(tlsf.isEmpty() && stats.used == 0);
+	CHECK(stats.numFreeBlocks == 1 && stats.largestFreeBlock == CAPACITY);
+	CHECK(stats.fragmentation == 0.0f && isTiled(&tlsf));
+	CHECK(tlsf.allocate(CAPACITY, 1, &block, &offset) && offset == 0);
+}
+
+static void checkPlacement() {
+	const uint64_t HEAP_SIZE = 16 << 20;
+	const uint64_t BLOCK_SIZE = HEAP_SIZE / 16;
+	const uint64_t GRANULARITY = 256;
+	const uint64_t ALIGNMENT = 64 << 10;
+	const uint64_t MSAA_ALIGNMENT = 4 << 20;
+
+	// an allocation only goes in a heap whose memory is aligned at least as strictly as it asks
+	PlacementPool pool;
+	Placement small, target;
+	CHECK(pool.addHeap(HEAP_SIZE, GRANULARITY, ALIGNMENT) == 0);
+	CHECK(pool.allocate(PlacementPool::NO_HEAP, 4096, ALIGNMENT, NULL, &small));
+	CHECK(!pool.allocate(PlacementPool::NO_HEAP, ALIGNMENT, MSAA_ALIGNMENT, NULL, &target));
+	CHECK(pool.addHeap(HEAP_SIZE, GRANULARITY, MSAA_ALIGNMENT) == 1);
+	CHECK(pool.allocate(PlacementPool::NO_HEAP, ALIGNMENT, MSAA_ALIGNMENT, NULL, &target));
+	CHECK(target.heap == 1 && target.offset == 0 && target.alignment == MSAA_ALIGNMENT);
+
+	// emptied heaps are released for the caller to free, except the first
+	CHECK(pool.free(&target) && !pool.heaps[1].live);
+	CHECK(!pool.free(&small) && pool.heaps[0].live);
+
+	// two heaps, with a quarter of the second filled past the first, and then the front half of
+	// the first freed again
+	int owners[16];
+	Placement placements[16];
+	for (int i = 0; i < 16; i++) {
+		if (i == 12) {
+			CHECK(pool.addHeap(HEAP_SIZE, GRANULARITY, ALIGNMENT) == 1);
+		}
+		auto skipHeap = i < 12 ? PlacementPool::NO_HEAP : 0;
+		CHECK(pool.allocate(skipHeap, BLOCK_SIZE, ALIGNMENT, &owners[i], &placements[i]));
+		CHECK(placements[i].heap == (i < 12 ? 0U : 1U));
+	}
+	for (int i = 0; i < 6; i++) {
+		CHECK(!pool.free(&placements[i]));
+	}
+
+	// the emptier heap is drained into the other, but only as far as the budget goes
+	uint64_t movedBytes = 0;
+	std::vector<PlacementMove> moves;
+	CHECK(!pool.beginDefragment(2 * BLOCK_SIZE, &movedBytes, &moves));
+	CHECK(moves.size() == 2 && movedBytes == 2 * BLOCK_SIZE);
+	auto placed = true;
+	for (auto &move : moves) {
+		auto index = move.owner ? (int*)move.owner - owners : -1;
+		placed = placed && index >= 12 && move.source.heap == 1 &&
+			move.source.offset == placements[index].offset && move.dest.heap == 0 &&
+			move.dest.alignment == ALIGNMENT && move.dest.offset % ALIGNMENT == 0 &&
+			pool.heaps[0].owners[move.dest.block] == move.owner;
+	}
+	CHECK(placed);
+
+	// finishing a move frees its source, and the last one out releases the heap
+	for (auto &move : moves) {
+		CHECK(!pool.free(&move.source));
+	}
+	moves.clear();
+	movedBytes = 0;
+	CHECK(pool.beginDefragment(UINT64_MAX, &movedBytes, &moves) && moves.size() == 2);
+	CHECK(!pool.free(&moves[0].source) && pool.free(&moves[1].source));
+	CHECK(!pool.heaps[1].live && pool.heaps[0].tlsf.numAllocations == 10);
+
+	// with one heap left there is nothing to drain it into
+	moves.clear();
+	CHECK(pool.beginDefragment(UINT64_MAX, &movedBytes, &moves) && moves.empty());
+}
+
+static void checkGeometry() {
+	GeometrySpace space;
+	GeometrySpace::create(1000, 3000, &space);
+
+	// meshes are packed one after another in both buffers
+	GeometryRange a, b, c;
+	CHECK(space.allocate(100, 300, &a) && a.baseVertex == 0 && a.startIndex == 0);
+	CHECK(space.allocate(200, 600, &b) && b.baseVertex == 100 && b.startIndex == 300);
+	CHECK(space.allocate(700, 900, &c) && c.baseVertex == 300 && c.startIndex == 900);
+
+	auto stats = space.getStats();
+	CHECK(stats.vertices.used == 1000 && stats.vertexOccupancy == 1.0f);
+	CHECK(stats.indices.used == 1800 && stats.indexOccupancy == 0.6f);
+
+	// a mesh that doesn't fit in one buffer takes nothing from the other
+	GeometryRange none;
+	CHECK(!space.allocate(1, 3, &none));
+	space.free(&c);
+	CHECK(!space.allocate(10, 2200, &none));
+	CHECK(space.getStats().vertices.used == 300);
+
+	// a hole in the middle is reported as fragmentation, until its neighbors are freed as well
+	space.free(&a);
+	stats = space.getStats();
+	CHECK(stats.vertices.numFreeRanges == 2 && stats.vertices.largestFreeRange == 700);
+	CHECK(stats.vertices.fragmentation > 0.0f && stats.indices.fragmentation > 0.0f);
+	CHECK(space.allocate(100, 300, &a) && a.baseVertex == 0 && a.startIndex == 0);
+	space.free(&a);
+	space.free(&b);
+	stats = space.getStats();
+	CHECK(stats.vertices.used == 0 && stats.indices.used == 0);
+	CHECK(stats.vertices.numFreeRanges == 1 && stats.indices.numFreeRanges == 1);
+	CHECK(stats.vertices.fragmentation == 0.0f && stats.vertexOccupancy == 0.0f);
+
+	// a released mesh keeps its geometry while the frames that drew it are in flight
+	CHECK(space.allocate(1000, 3000, &a));
+	space.freeDeferred(&a);
+	CHECK(!space.allocate(1, 3, &none));
+	space.finishFrame(5);
+	space.retire(4);
+	CHECK(space.getStats().vertexOccupancy == 1.0f);
+	space.retire(5);
+	stats = space.getStats();
+	CHECK(stats.vertices.used == 0 && stats.indices.used == 0);
+	CHECK(space.allocate(1000, 3000, &a));
+}
+
+static void checkIndirect() {
+	// the game's signature has to line up with the commands it packs
+	IndirectLayout layout;
+	getIndirectCommandLayout(&layout);
+	CHECK(layout.numArguments == 2 && layout.stride == sizeof(IndirectCommand));
+	CHECK(layout.arguments[0].type == INDIRECT_ARGUMENT_CONSTANT);
+	CHECK(layout.arguments[0].offset == offsetof(IndirectCommand, objectId));
+	CHECK(layout.arguments[1].type == INDIRECT_ARGUMENT_DRAW_INDEXED);
+	CHECK(layout.arguments[1].offset == offsetof(IndirectCommand, draw));
+	CHECK(layout.arguments[1].num32BitValues * sizeof(uint32_t) == sizeof(DrawIndexedArguments));
+	CHECK(layout.hasDraw());
+
+	// nothing can come after the draw, which ends the signature
+	CHECK(!layout.addConstant(2, 1));
+	CHECK(!layout.addDrawIndexed());
+	CHECK(layout.numArguments == 2 && layout.stride == sizeof(IndirectCommand));
+
+	// constants pack back to back ahead of the draw
+	layout = IndirectLayout();
+	CHECK(!layout.hasDraw());
+	CHECK(layout.addConstant(0, 4) && layout.addConstant(3, 2));
+	CHECK(!layout.addConstant(1, 0));
+	CHECK(layout.addDrawIndexed());
+	CHECK(layout.arguments[1].offset == 16 && layout.arguments[2].offset == 24);
+	CHECK(layout.stride == 24 + sizeof(DrawIndexedArguments));
+
+	// and there are only so many arguments
+	layout = IndirectLayout();
+	for (size_t i = 0; i < IndirectLayout::MAX_ARGUMENTS; i++) {
+		CHECK(layout.addConstant((uint32_t)i, 1));
+	}
+	CHECK(!layout.addConstant(0, 1) && !layout.addDrawIndexed());
+
+	// every draw becomes one command of a single instance, in order
+	const size_t COUNT = 37;
+	std::vector<uint32_t> objectIds(COUNT);
+	std::vector<uint32_t> numIndices(COUNT);
+	std::vector<uint32_t> startIndices(COUNT);
+	std::vector<int32_t> baseVertices(COUNT);
+	for (size_t i = 0; i < COUNT; i++) {
+		objectIds[i] = (uint32_t)(1000 + i);
+		numIndices[i] = (uint32_t)(3 * i + 3);
+		startIndices[i] = (uint32_t)(7 * i);
+		baseVertices[i] = (int32_t)(11 * i) - 100;
+	}
+	IndirectDraws draws = {
+		objectIds.data(), numIndices.data(), startIndices.data(), baseVertices.data(), COUNT
+	};
+
+	// one past the end stays untouched
+	std::vector<IndirectCommand> commands(COUNT + 1);
+	memset(commands.data(), 0xcd, commands.size() * sizeof(IndirectCommand));
+	packIndirectCommands(&draws, commands.data());
+	auto packed = true;
+	for (size_t i = 0; i < COUNT; i++) {
+		auto &command = commands[i];
+		packed = packed && command.objectId == objectIds[i] &&
+			command.draw.indexCountPerInstance == numIndices[i] &&
+			command.draw.instanceCount == 1 &&
+			command.draw.startIndexLocation == startIndices[i] &&
+			command.draw.baseVertexLocation == baseVertices[i] &&
+			command.draw.startInstanceLocation == 0;
+	}
+	CHECK(packed);
+	CHECK(commands[COUNT].objectId == 0xcdcdcdcd);
+}
+
+static void checkDrawSort() {
+	std::mt19937 random(1);
+	DrawQueue queue;
+	for (int run = 0; run < 2; run++) {
+		// few distinct values, so that most keys are shared by many draws, the order of which the
+		// sort has to keep; the second run is large enough for every byte of the key to vary
+		auto count = run == 0 ? 1000u : 100000u;
+		auto spread = run == 0 ? 3u : 1u << 12;
+		queue.clear();
+		queue.reserve(count);
+		for (uint32_t i = 0; i < count; i++) {
+			DrawPacket packet = {};
+			packet.pass = random() % 3;
+			packet.rootSignature = random() % 2;
+			packet.pipeline = random() % spread;
+			packet.mesh = random() % spread;
+			packet.depth = (random() % spread) / (float)spread;
+			packet.objectId = i;
+			queue.push(&packet);
+		}
+		queue.sort();
+
+		auto ordered = queue.entries.size() == count;
+		auto stable = true;
+		for (size_t i = 1; i < queue.entries.size(); i++) {
+			auto &previous = queue.entries[i - 1];
+			auto &entry = queue.entries[i];
+			ordered = ordered && previous.key <= entry.key;
+			stable = stable && (previous.key != entry.key || previous.packet < entry.packet);
+		}
+		CHECK(ordered);
+		CHECK(stable);
+
+		auto &before = queue.unsortedChanges;
+		auto &after = queue.sortedChanges;
+		CHECK(after.rootSignatures <= before.rootSignatures);
+		CHECK(after.pipelines <= before.pipelines);
+		CHECK(after.rootSignatures <= 3 * 2);
+	}
+
+	// the fields sort in order of significance, with depth clamped to its range
+	auto key = [](uint32_t pass, uint32_t pipeline, float depth) {
+		return makeSortKey(pass, 0, pipeline, 0, depth);
+	};
+	CHECK(key(0, 4095, 1.0f) < key(1, 0, 0.0f));
+	CHECK(key(0, 0, 1.0f) < key(0, 1, 0.0f));
+	CHECK(key(0, 0, 0.25f) < key(0, 0, 0.5f));
+	CHECK(key(0, 0, -1.0f) == key(0, 0, 0.0f) && key(0, 0, 2.0f) == key(0, 0, 1.0f));
+
+	// nothing to sort is fine too
+	queue.clear();
+	queue.sort();
+	CHECK(queue.entries.empty() && queue.sortedChanges.pipelines == 0);
+
+	queue.clear();
+	FrameArena::resetAll();
+}
+
+// Stands in for a command list, submitting every batch the tracker hands out the way the D3D12
+// context does, with one ResourceBarrier call per flush.
+struct BarrierRecorder {
+	std::vector<Barrier> barriers;
+	uint32_t numCalls = 0;
+	uint32_t numBarriers = 0;
+
+	// the barriers of the last call, or none if the flush had nothing to submit
+	size_t flush(StateTracker *states) {
+		if (!states->flush(&this->barriers)) {
+			return 0;
+		}
+		this->numCalls++;
+		this->numBarriers += (uint32_t)this->barriers.size();
+		return this->barriers.size();
+	}
+};
+
+static bool isBarrier(
+	const Barrier *barrier, void *resource, uint32_t subresource, uint32_t before, uint32_t after,
+	BarrierType type
+) {
+	return barrier->resource == resource && barrier->subresource == subresource &&
+		barrier->before == before && barrier->after == after && barrier->type == type;
+}
+
+static void checkBarriers() {
+	// the D3D12 values, which the tracker treats as opaque
+	const uint32_t RENDER_TARGET = 0x4;
+	const uint32_t SHADER_RESOURCE = 0x80;
+	const uint32_t COPY_DEST = 0x400;
+
+	StateTracker states;
+	BarrierRecorder recorder;
+	int a, b, c, d;
+	states.track(&a, 1, COPY_DEST);
+
+	// transitions of the same resource in one batch fold into one barrier
+	states.transition(&a, ALL_SUBRESOURCES, SHADER_RESOURCE);
+	states.transition(&a, ALL_SUBRESOURCES, SHADER_RESOURCE);
+	states.transition(&a, ALL_SUBRESOURCES, RENDER_TARGET);
+	CHECK(recorder.flush(&states) == 1);
+	auto barrier = &recorder.barriers[0];
+	CHECK(isBarrier(barrier, &a, ALL_SUBRESOURCES, COPY_DEST, RENDER_TARGET, BARRIER_FULL));
+
+	// and a round trip back to where it started needs none at all
+	states.transition(&a, ALL_SUBRESOURCES, SHADER_RESOURCE);
+	states.transition(&a, ALL_SUBRESOURCES, RENDER_TARGET);
+	CHECK(recorder.flush(&states) == 0);
+	uint32_t state = 0;
+	CHECK(states.getState(&a, ALL_SUBRESOURCES, &state) && state == RENDER_TARGET);
+
+	// one subresource moves on its own, and the rest follow it only where they differ
+	states.track(&b, 4, SHADER_RESOURCE);
+	states.transition(&b, 1, RENDER_TARGET);
+	CHECK(!states.resources[&b].uniform);
+	CHECK(states.getState(&b, 1, &state) && state == RENDER_TARGET);
+	CHECK(states.getState(&b, 0, &state) && state == SHADER_RESOURCE);
+	CHECK(recorder.flush(&states) == 1);
+	barrier = &recorder.barriers[0];
+	CHECK(isBarrier(barrier, &b, 1, SHADER_RESOURCE, RENDER_TARGET, BARRIER_FULL));
+
+	states.transition(&b, ALL_SUBRESOURCES, RENDER_TARGET);
+	CHECK(states.resources[&b].uniform);
+	CHECK(recorder.flush(&states) == 3);
+	auto covered = true;
+	for (auto &entry : recorder.barriers) {
+		covered = covered && entry.subresource != 1 && entry.subresource != ALL_SUBRESOURCES &&
+			entry.before == SHADER_RESOURCE && entry.after == RENDER_TARGET;
+	}
+	CHECK(covered);
+
+	// subresources that come back in line one at a time make the resource uniform again
+	states.transition(&b, 2, COPY_DEST);
+	states.transition(&b, 2, RENDER_TARGET);
+	CHECK(states.resources[&b].uniform && recorder.flush(&states) == 0);
+	for (uint32_t i = 0; i < 4; i++) {
+		states.transition(&b, i, COPY_DEST);
+		CHECK(states.resources[&b].uniform == (i == 3));
+	}
+	CHECK(states.getState(&b, ALL_SUBRESOURCES, &state) && state == COPY_DEST);
+	CHECK(recorder.flush(&states) == 4);
+
+	// a split barrier is begun in one batch and ended in a later one with the same states
+	states.track(&c, 1, RENDER_TARGET);
+	states.beginTransition(&c, SHADER_RESOURCE);
+	CHECK(recorder.flush(&states) == 1);
+	barrier = &recorder.barriers[0];
+	CHECK(isBarrier(barrier, &c, ALL_SUBRESOURCES, RENDER_TARGET, SHADER_RESOURCE, BARRIER_BEGIN));
+	states.transition(&c, ALL_SUBRESOURCES, SHADER_RESOURCE);
+	CHECK(recorder.flush(&states) == 1);
+	barrier = &recorder.barriers[0];
+	CHECK(isBarrier(barrier, &c, ALL_SUBRESOURCES, RENDER_TARGET, SHADER_RESOURCE, BARRIER_END));
+
+	// ending on the way somewhere else ends the split first, and nothing begins for no change
+	states.beginTransition(&c, SHADER_RESOURCE);
+	CHECK(recorder.flush(&states) == 0);
+	states.beginTransition(&c, RENDER_TARGET);
+	recorder.flush(&states);
+	states.transition(&c, ALL_SUBRESOURCES, COPY_DEST);
+	CHECK(recorder.flush(&states) == 2);
+	CHECK(isBarrier(
+		&recorder.barriers[0], &c, ALL_SUBRESOURCES, SHADER_RESOURCE, RENDER_TARGET, BARRIER_END
+	));
+	CHECK(isBarrier(
+		&recorder.barriers[1], &c, ALL_SUBRESOURCES, RENDER_TARGET, COPY_DEST, BARRIER_FULL
+	));
+
+	// aliased memory changes hands with an aliasing barrier
+	states.activate(&d);
+	CHECK(recorder.flush(&states) == 1 && recorder.barriers[0].type == BARRIER_ALIASING);
+
+	// a released resource takes its pending barriers with it, and is no longer known
+	states.transition(&a, ALL_SUBRESOURCES, COPY_DEST);
+	states.transition(&c, ALL_SUBRESOURCES, RENDER_TARGET);
+	states.untrack(&a);
+	CHECK(recorder.flush(&states) == 1 && recorder.barriers[0].resource == &c);
+	auto numResources = states.resources.size();
+	CHECK(!states.getState(&a, ALL_SUBRESOURCES, &state));
+	CHECK(!states.getState(&b, 4, &state));
+	CHECK(states.resources.size() == numResources);
+
+	// and transitions of unknown resources or subresources are turned away without a barrier
+	CHECK(!states.transition(&a, ALL_SUBRESOURCES, SHADER_RESOURCE));
+	CHECK(!states.transition(&a, 0, SHADER_RESOURCE));
+	CHECK(!states.beginTransition(&a, SHADER_RESOURCE));
+	CHECK(!states.transition(&b, 4, SHADER_RESOURCE));
+	CHECK(states.getState(&b, ALL_SUBRESOURCES, &state) && state == COPY_DEST);
+	CHECK(states.resources.size() == numResources && recorder.flush(&states) == 0);
+
+	// every batch with anything in it was one call
+	CHECK(recorder.numCalls == 10 && recorder.numBarriers == 16);
+	CHECK(states.numFlushes == recorder.numCalls && states.numBarriers == recorder.numBarriers);
+}
+
+static bool isGraphBarrier(
+	const GraphBarrier *barrier, GraphResource resource, uint32_t before, uint32_t after,
+	bool aliasing
+) {
+	return barrier->resource == resource && barrier->before == before &&
+		barrier->after == after && barrier->aliasing == aliasing;
+}
+
+static void checkGraph() {
+	const uint32_t PRESENT = 0x0;
+	const uint32_t RENDER_TARGET = 0x4;
+	const uint32_t SHADER_RESOURCE = 0x80;
+
+	auto describe = [](uint64_t size) {
+		GraphTextureDesc desc = {};
+		desc.width = 64;
+		desc.height = 64;
+		desc.size = size;
+		desc.alignment = 256;
+		return desc;
+	};
+
+	// a chain of passes into the back buffer, a chain whose end nobody reads, and a pass that
+	// nobody reads but that has side effects
+	RenderGraph graph;
+	graph.reset();
+	auto backBuffer = graph.importTexture(NULL, RENDER_TARGET, PRESENT);
+	auto descA = describe(1200);
+	auto descB = describe(1000);
+	auto descC = describe(600);
+	auto descUnused = describe(500);
+	auto descEffects = describe(300);
+	auto a = graph.createTexture(&descA);
+	auto b = graph.createTexture(&descB);
+	auto c = graph.createTexture(&descC);
+	auto unused1 = graph.createTexture(&descUnused);
+	auto unused2 = graph.createTexture(&descUnused);
+	auto effects = graph.createTexture(&descEffects);
+
+	auto p0 = graph.addPass("a", NULL);
+	graph.write(p0, a, RENDER_TARGET);
+	auto p1 = graph.addPass("b", NULL);
+	graph.read(p1, a, SHADER_RESOURCE);
+	graph.write(p1, b, RENDER_TARGET);
+	auto p2 = graph.addPass("c", NULL);
+	graph.read(p2, b, SHADER_RESOURCE);
+	graph.write(p2, c, RENDER_TARGET);
+	auto p3 = graph.addPass("final", NULL);
+	graph.read(p3, c, SHADER_RESOURCE);
+	graph.write(p3, backBuffer, RENDER_TARGET);
+	auto p4 = graph.addPass("unused1", NULL);
+	graph.write(p4, unused1, RENDER_TARGET);
+	auto p5 = graph.addPass("unused2", NULL);
+	graph.read(p5, unused1, SHADER_RESOURCE);
+	graph.write(p5, unused2, RENDER_TARGET);
+	auto p6 = graph.addPass("effects", NULL);
+	graph.write(p6, effects, RENDER_TARGET);
+	graph.setSideEffects(p6);
+	graph.compile();
+
+	// passes with no consumers go, and so do the passes that only fed them
+	auto &passes = graph.passes;
+	CHECK(graph.numCulledPasses == 2 && passes[p4].culled && passes[p5].culled);
+	CHECK(!passes[p0].culled && !passes[p1].culled && !passes[p2].culled);
+	CHECK(!passes[p3].culled && !passes[p6].culled);
+	CHECK(passes[p4].barriers.empty() && passes[p5].barriers.empty());
+
+	auto &textures = graph.textures;
+	CHECK(textures[unused1].firstPass == RenderGraph::NO_PASS);
+	CHECK(textures[unused2].firstPass == RenderGraph::NO_PASS);
+	CHECK(textures[a].firstPass == p0 && textures[a].lastPass == p1);
+	CHECK(textures[c].firstPass == p2 && textures[c].lastPass == p3);
+
+	// transients alive at the same time never share memory, and the rest do
+	auto disjoint = true;
+	auto aligned = true;
+	for (GraphResource i = 0; i < textures.size(); i++) {
+		auto &x = textures[i];
+		if (x.imported || x.firstPass == RenderGraph::NO_PASS) {
+			continue;
+		}
+		aligned = aligned && x.offset % x.desc.alignment == 0 &&
+			x.offset + x.desc.size <= graph.transientSize;
+		for (GraphResource j = i + 1; j < textures.size(); j++) {
+			auto &y = textures[j];
+			if (
+				y.imported || y.firstPass == RenderGraph::NO_PASS ||
+				x.lastPass < y.firstPass || y.lastPass < x.firstPass
+			) {
+				continue;
+			}
+			disjoint = disjoint && (
+				x.offset + x.desc.size <= y.offset || y.offset + y.desc.size <= x.offset
+			);
+		}
+	}
+	CHECK(disjoint && aligned);
+	CHECK(graph.unaliasedSize == 1200 + 1000 + 600 + 300);
+	CHECK(graph.transientSize < graph.unaliasedSize);
+	CHECK(textures[a].offset == 0 && textures[b].offset == 1280);
+	CHECK(textures[c].offset == 0 && textures[effects].offset == 0);
+	CHECK(graph.transientSize == 1280 + 1000);
+
+	// Transients start in the state of their first use, with an aliasing barrier where their
+	// memory is shared, and then move from one use to the next. Imported textures start and
+	// end where they were said to.
+	CHECK(passes[p0].barriers.size() == 1);
+	CHECK(isGraphBarrier(&passes[p0].barriers[0], a, RENDER_TARGET, RENDER_TARGET, true));
+	CHECK(passes[p1].barriers.size() == 2);
+	CHECK(isGraphBarrier(&passes[p1].barriers[0], a, RENDER_TARGET, SHADER_RESOURCE, false));
+	CHECK(isGraphBarrier(&passes[p1].barriers[1], b, RENDER_TARGET, RENDER_TARGET, false));
+	CHECK(passes[p2].barriers.size() == 2);
+	CHECK(isGraphBarrier(&passes[p2].barriers[0], b, RENDER_TARGET, SHADER_RESOURCE, false));
+	CHECK(isGraphBarrier(&passes[p2].barriers[1], c, RENDER_TARGET, RENDER_TARGET, true));
+	CHECK(passes[p3].barriers.size() == 1);
+	CHECK(isGraphBarrier(&passes[p3].barriers[0], c, RENDER_TARGET, SHADER_RESOURCE, false));
+	CHECK(passes[p6].barriers.size() == 1);
+	CHECK(isGraphBarrier(&passes[p6].barriers[0], effects, RENDER_TARGET, RENDER_TARGET, true));
+	CHECK(graph.finalBarriers.size() == 1);
+	CHECK(isGraphBarrier(&graph.finalBarriers[0], backBuffer, RENDER_TARGET, PRESENT, false));
+
+	// compiling again after a reset starts from nothing
+	graph.reset();
+	graph.compile();
+	CHECK(graph.transientSize == 0 && graph.numCulledPasses == 0 && graph.finalBarriers.empty());
+
+	// textures described the same way again reuse what the backend said the first time
+	GraphTextureSizes sizes;
+	auto desc = describe(4096);
+	CHECK(!sizes.find(&desc));
+	desc.alignment = 65536;
+	sizes.add(&desc);
+	auto again = describe(0);
+	CHECK(sizes.find(&again) && again.size == 4096 && again.alignment == 65536);
+	again.flags = 1;
+	CHECK(!sizes.find(&again));
+}
+
+static void checkResidency() {
+	ResidencySet set;
+	ResidencySet::create(UINT64_MAX, &set);
+	uint32_t objects[4];
+	for (auto &object : objects) {
+		object = set.add(100);
+	}
+	CHECK(set.residentBytes == 400);
+
+	std::vector<uint32_t> evict;
+	std::vector<uint32_t> makeResident;
+	auto update = [&](uint64_t completedFenceValue) {
+		evict.clear();
+		makeResident.clear();
+		set.update(completedFenceValue, &evict, &makeResident);
+	};
+
+	// the budget is what the OS gives, less what is in use outside the set
+	set.beginFrame(1);
+	for (auto object : objects) {
+		set.use(object);
+	}
+	set.setBudget(1000, 600);
+	CHECK(set.budget == 800);
+	update(0);
+	CHECK(evict.empty() && makeResident.empty());
+
+	// when it drops, the least recently used go first, but only once the GPU is done with them
+	set.beginFrame(2);
+	set.use(objects[3]);
+	set.setBudget(450, 600);
+	CHECK(set.budget == 250);
+	update(0);
+	CHECK(evict.empty() && set.residentBytes == 400);
+	update(1);
+	CHECK(evict.size() == 2 && evict[0] == objects[0] && evict[1] == objects[1]);
+	CHECK(makeResident.empty() && set.residentBytes == 200);
+
+	// when it comes back, evicted objects return as they are used
+	set.setBudget(2000, 400);
+	CHECK(set.budget == 1800);
+	set.beginFrame(3);
+	set.use(objects[0]);
+	update(2);
+	CHECK(evict.empty() && makeResident.size() == 1 && makeResident[0] == objects[0]);
+	CHECK(set.residentBytes == 300);
+
+	// what a frame uses is made resident even over budget, and only what it doesn't is evicted
+	set.setBudget(350, 500);
+	CHECK(set.budget == 150);
+	set.beginFrame(4);
+	set.use(objects[0]);
+	set.use(objects[1]);
+	update(3);
+	CHECK(evict.size() == 2 && evict[0] == objects[2] && evict[1] == objects[3]);
+	CHECK(makeResident.size() == 1 && makeResident[0] == objects[1]);
+	CHECK(set.residentBytes == 200);
+
+	auto stats = set.getStats();
+	CHECK(stats.numResident == 2 && stats.numEvicted == 2 && stats.evictedBytes == 200);
+
+	// a budget smaller than what is used outside the set leaves nothing for it
+	set.setBudget(100, 500);
+	CHECK(set.budget == 0);
+
+	// removed objects leave the set, and their slots are reused
+	set.remove(objects[1]);
+	CHECK(set.residentBytes == 100 && set.getStats().numResident == 1);
+	CHECK(set.add(50) == objects[1] && set.residentBytes == 150);
+}
+
+// A perspective projection looking down +z from the origin, with depth 0 at z = 1 and 1 at z = 100.
+static void makeProjection(float *matrix) {
+	const float nearZ = 1.0f;
+	const float farZ = 100.0f;
+	const float m[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, farZ / (farZ - nearZ), -nearZ * farZ / (farZ - nearZ),
+		0.0f, 0.0f, 1.0f, 0.0f,
+	};
+	memcpy(matrix, m, sizeof(m));
+}
+
+static void checkOcclusion() {
+	float viewProj[16];
+	makeProjection(viewProj);
+
+	OcclusionBuffer simd;
+	OcclusionBuffer::create(&simd);
+	OcclusionBuffer scalar;
+	OcclusionBuffer::create(&scalar);
+	scalar.useSimd = false;
+
+	// the same occluders go through both rasterizers, including some that leave the screen
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> across(-30.0f, 30.0f);
+	std::uniform_real_distribution<float> ahead(3.0f, 60.0f);
+	std::uniform_real_distribution<float> extent(0.5f, 8.0f);
+	float positions[8 * 3];
+	uint16_t indices[36];
+	for (int i = 0; i < 60; i++) {
+		float center[3] = { across(random), across(random), ahead(random) };
+		float boundsMin[3];
+		float boundsMax[3];
+		for (int j = 0; j < 3; j++) {
+			auto half = extent(random);
+			boundsMin[j] = center[j] - half;
+			boundsMax[j] = center[j] + half;
+		}
+		makeBoxOccluder(boundsMin, boundsMax, positions, indices);
+		simd.rasterize(positions, 8, indices, 36, viewProj);
+		scalar.rasterize(positions, 8, indices, 36, viewProj);
+	}
+	simd.buildHierarchy();
+	scalar.buildHierarchy();
+
+	CHECK(simd.stats.numTriangles == scalar.stats.numTriangles);
+	CHECK(simd.depth == scalar.depth);
+	CHECK(simd.pyramid == scalar.pyramid);
+	auto covered = std::count_if(
+		scalar.depth.begin(), scalar.depth.end(), [](float d) { return d < 1.0f; }
+	);
+	CHECK(covered > 0 && covered < (ptrdiff_t)scalar.depth.size());
+
+	// and bounds tested against either come out the same, with some of each
+	size_t numVisible = 0;
+	size_t numMismatched = 0;
+	for (int i = 0; i < 2000; i++) {
+		float center[3] = { across(random), across(random), ahead(random) };
+		float boundsMin[3];
+		float boundsMax[3];
+		for (int j = 0; j < 3; j++) {
+			auto half = 0.25f * extent(random);
+			boundsMin[j] = center[j] - half;
+			boundsMax[j] = center[j] + half;
+		}
+		auto visible = scalar.isVisible(boundsMin, boundsMax, viewProj);
+		numMismatched += visible != simd.isVisible(boundsMin, boundsMax, viewProj) ? 1 : 0;
+		numVisible += visible ? 1 : 0;
+	}
+	CHECK(numMismatched == 0);
+	CHECK(numVisible > 0 && numVisible < 2000);
+	CHECK(simd.stats.numOccluded == scalar.stats.numOccluded);
+
+	// a wall across the screen hides what is behind it, but not what is in front or reaches
+	// the camera
+	const float wallMin[3] = { -100.0f, -100.0f, 10.0f };
+	const float wallMax[3] = { 100.0f, 100.0f, 11.0f };
+	makeBoxOccluder(wallMin, wallMax, positions, indices);
+	const float behindMin[3] = { -1.0f, -1.0f, 20.0f };
+	const float behindMax[3] = { 1.0f, 1.0f, 22.0f };
+	const float frontMin[3] = { -1.0f, -1.0f, 5.0f };
+	const float frontMax[3] = { 1.0f, 1.0f, 7.0f };
+	const float nearMin[3] = { -1.0f, -1.0f, -1.0f };
+	const float nearMax[3] = { 1.0f, 1.0f, 22.0f };
+	for (auto buffer : { &simd, &scalar }) {
+		buffer->clear();
+		buffer->rasterize(positions, 8, indices, 36, viewProj);
+		buffer->buildHierarchy();
+		CHECK(!buffer->isVisible(behindMin, behindMax, viewProj));
+		CHECK(buffer->isVisible(frontMin, frontMax, viewProj));
+		CHECK(buffer->isVisible(nearMin, nearMax, viewProj));
+	}
+	CHECK(simd.depth == scalar.depth);
+}
+
+// The slab test on its own, for checking traversal against every primitive in turn.
+static bool intersectBoundsBruteForce(
+	const Bounds *bounds, const float *origin, const float *direction, float maxT, float *t
+) {
+	auto tmin = 0.0f;
+	auto tmax = maxT;
+	for (int i = 0; i < 3; i++) {
+		auto inverse = direction[i] != 0.0f ? 1.0f / direction[i] : FLT_MAX;
+		auto t0 = (bounds->min[i] - origin[i]) * inverse;
+		auto t1 = (bounds->max[i] - origin[i]) * inverse;
+		tmin = std::max(tmin, std::min(t0, t1));
+		tmax = std::min(tmax, std::max(t0, t1));
+	}
+	*t = tmin;
+	return tmin <= tmax;
+}
+
+static void checkBvh() {
+	Bvh empty;
+	Bvh::create(nullptr, 0, &empty);
+	const float origin[3] = {};
+	const float forward[3] = { 0.0f, 0.0f, 1.0f };
+	uint32_t primitive;
+	float t;
+	CHECK(!empty.intersectRay(origin, forward, FLT_MAX, &primitive, &t));
+	CHECK(empty.depth == 0 && empty.getStackSize() == 0);
+
+	const uint32_t COUNT = 2000;
+	std::mt19937 random(3);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> size(0.1f, 3.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<Bounds> bounds(COUNT);
+	for (auto &b : bounds) {
+		for (int i = 0; i < 3; i++) {
+			b.min[i] = position(random);
+			b.max[i] = b.min[i] + size(random);
+		}
+	}
+	Bvh bvh;
+	Bvh::create(bounds.data(), COUNT, &bvh);
+
+	// the stack size holds even if a traversal enters every node
+	std::vector<uint32_t> stack = { 0 };
+	size_t maxStackSize = 1;
+	while (!stack.empty()) {
+		auto &node = bvh.nodes[stack.back()];
+		stack.pop_back();
+		for (int slot = 0; slot < 4; slot++) {
+			if (node.children[slot] != Bvh::EMPTY && node.counts[slot] == 0) {
+				stack.push_back(node.children[slot]);
+			}
+		}
+		maxStackSize = std::max(maxStackSize, stack.size());
+	}
+	CHECK(bvh.depth > 1 && maxStackSize <= bvh.getStackSize());
+
+	// Rays from inside and outside the primitives find the nearest hit within maxT, including
+	// rays along an axis. Primitives around the origin tie at t = 0, so the hit is checked by
+	// its distance rather than its index.
+	uint32_t numHits = 0;
+	for (int r = 0; r < 1000; r++) {
+		float rayOrigin[3];
+		float direction[3];
+		for (int i = 0; i < 3; i++) {
+			rayOrigin[i] = 1.5f * position(random);
+			direction[i] = r % 4 == 0 && i != r % 3 ? 0.0f : unit(random);
+		}
+		auto maxT = r % 2 == 0 ? FLT_MAX : 40.0f;
+
+		auto expectedHit = false;
+		auto expectedT = maxT;
+		for (auto &b : bounds) {
+			float tb;
+			if (intersectBoundsBruteForce(&b, rayOrigin, direction, expectedT, &tb)) {
+				expectedHit = true;
+				expectedT = tb;
+			}
+		}
+
+		auto hit = bvh.intersectRay(rayOrigin, direction, maxT, &primitive, &t);
+		CHECK(hit == expectedHit);
+		if (hit && expectedHit) {
+			float tp;
+			CHECK(t == expectedT);
+			CHECK(intersectBoundsBruteForce(&bounds[primitive], rayOrigin, direction, maxT, &tp));
+			CHECK(tp == t);
+			numHits++;
+		}
+	}
+	CHECK(numHits > 0 && numHits < 1000);
+
+	// and a hit is only found within maxT
+	const float rayOrigin[3] = {
+		0.5f * (bounds[0].min[0] + bounds[0].max[0]),
+		0.5f * (bounds[0].min[1] + bounds[0].max[1]),
+		-100.0f,
+	};
+	CHECK(bvh.intersectRay(rayOrigin, forward, FLT_MAX, &primitive, &t));
+	CHECK(!bvh.intersectRay(rayOrigin, forward, 0.5f * t, &primitive, &t));
+}
+
+// A clip in the builder's format, with each track's keys given by the frames they fall on.
+struct ClipSource {
+	uint32_t numFrames;
+	std::vector<AnimationJoint> joints;
+	std::vector<AnimationTrack> tracks;
+	std::vector<AnimationKey> keys;
+
+	void write(std::vector<char> *data) const {
+		AnimationHeader header = {};
+		header.magic = 'A' | 'N' << 8 | 'I' << 16 | 'M' << 24;
+		header.version = 1;
+		header.numJoints = (uint32_t)this->joints.size();
+		header.numFrames = this->numFrames;
+		header.frameRate = 30.0f;
+		header.numKeys = (uint32_t)this->keys.size();
+
+		auto jointsSize = this->joints.size() * sizeof(AnimationJoint);
+		auto tracksSize = this->tracks.size() * sizeof(AnimationTrack);
+		auto keysSize = this->keys.size() * sizeof(AnimationKey);
+		data->resize(sizeof(header) + jointsSize + tracksSize + keysSize);
+		auto out = data->data();
+		memcpy(out, &header, sizeof(header));
+		memcpy(out + sizeof(header), this->joints.data(), jointsSize);
+		memcpy(out + sizeof(header) + jointsSize, this->tracks.data(), tracksSize);
+		memcpy(out + sizeof(header) + jointsSize + tracksSize, this->keys.data(), keysSize);
+	}
+};
+
+// Random keys on random frames for every track, with rotations spread over both hemispheres so
+// that interpolation has to take the short way.
+static void makeClipSource(
+	uint32_t numJoints, uint32_t numFrames, std::mt19937 *random, ClipSource *clip
+) {
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<uint32_t> value(0, UINT16_MAX);
+	clip->numFrames = numFrames;
+	clip->joints.assign(numJoints, AnimationJoint());
+	clip->tracks.assign(2 * numJoints, AnimationTrack());
+	clip->keys.clear();
+	for (uint32_t j = 0; j < numJoints; j++) {
+		clip->joints[j].parent = (int32_t)j - 1;
+		clip->joints[j].rotation[3] = 1.0f;
+		for (uint32_t t = 0; t < 2; t++) {
+			auto &track = clip->tracks[2 * j + t];
+			track.firstKey = (uint32_t)clip->keys.size();
+			for (int i = 0; i < 4; i++) {
+				track.min[i] = t == 0 ? -1.0f : unit(*random);
+				track.extent[i] = t == 0 ? 2.0f : 0.5f * (unit(*random) + 1.0f);
+			}
+
+			// some tracks are a single key, held for the whole clip
+			uint32_t frame = 0;
+			while (frame < numFrames) {
+				AnimationKey key = {};
+				key.frame = (uint16_t)frame;
+				for (auto &v : key.values) {
+					v = (uint16_t)value(*random);
+				}
+				clip->keys.push_back(key);
+				frame += j % 3 == 0 ? numFrames : 1 + (*random)() % 7;
+			}
+			track.numKeys = (uint32_t)clip->keys.size() - track.firstKey;
+		}
+	}
+}
+
+// Normalized lerp, one component at a time, and flipping b for rotations on the far side.
+static void nlerpReference(const float *a, const float *b, float t, int numComponents, float *out) {
+	auto dot = 0.0f;
+	for (int i = 0; i < numComponents; i++) {
+		dot += a[i] * b[i];
+	}
+	auto sign = numComponents == 4 && dot < 0.0f ? -1.0f : 1.0f;
+	auto length = 0.0f;
+	for (int i = 0; i < numComponents; i++) {
+		out[i] = a[i] + t * (sign * b[i] - a[i]);
+		length += out[i] * out[i];
+	}
+	for (int i = 0; i < numComponents && numComponents == 4; i++) {
+		out[i] /= sqrtf(length);
+	}
+}
+
+// Samples a track by walking its keys, for checking the binary search and the SIMD interpolation.
+static void sampleReference(
+	const ClipSource *clip, const AnimationTrack *track, float frame, int numComponents,
+	float *out
+) {
+	auto first = &clip->keys[track->firstKey];
+	uint32_t k = 0;
+	while (k + 1 < track->numKeys && first[k + 1].frame <= frame) {
+		k++;
+	}
+	auto wraps = k + 1 == track->numKeys;
+	auto &key = first[k];
+	auto &next = wraps ? first[0] : first[k + 1];
+	auto nextFrame = wraps ? (float)clip->numFrames : (float)next.frame;
+	auto t = nextFrame > key.frame ? (frame - key.frame) / (nextFrame - key.frame) : 0.0f;
+
+	float a[4];
+	float b[4];
+	for (int i = 0; i < 4; i++) {
+		auto extent = track->extent[i] * (1.0f / UINT16_MAX);
+		a[i] = track->min[i] + extent * key.values[i];
+		b[i] = track->min[i] + extent * next.values[i];
+	}
+	nlerpReference(a, b, t, numComponents, out);
+}
+
+static bool isClose(float a, float b) {
+	return fabsf(a - b) <= 1e-5f;
+}
+
+static void checkAnimation() {
+	// joints that don't fill the last group of four check the padding too
+	const uint32_t NUM_JOINTS = 7;
+	const uint32_t NUM_FRAMES = 40;
+	std::mt19937 random(11);
+	ClipSource source;
+	makeClipSource(NUM_JOINTS, NUM_FRAMES, &random, &source);
+	std::vector<char> data;
+	source.write(&data);
+
+	Skeleton skeleton;
+	AnimationClip clip;
+	CHECK(Skeleton::create(data.data(), data.size(), &skeleton));
+	CHECK(AnimationClip::create(data.data(), data.size(), &skeleton, &clip));
+
+	// on keys, between them, wrapping past the end of the clip, and before its start
+	size_t numMismatched = 0;
+	Pose pose;
+	for (int s = -40; s < 200; s++) {
+		auto time = s * 0.37f / 30.0f;
+		clip.sample(time, &pose);
+		auto frame = fmodf(time * 30.0f, (float)NUM_FRAMES);
+		frame += frame < 0.0f ? NUM_FRAMES : 0.0f;
+		for (uint32_t j = 0; j < NUM_JOINTS; j++) {
+			float rotation[4];
+			float translation[3];
+			sampleReference(&source, &source.tracks[2 * j], frame, 4, rotation);
+			sampleReference(&source, &source.tracks[2 * j + 1], frame, 3, translation);
+			for (int i = 0; i < 4; i++) {
+				numMismatched += isClose(pose.rotation[i][j], rotation[i]) ? 0 : 1;
+			}
+			for (int i = 0; i < 3; i++) {
+				numMismatched += isClose(pose.translation[i][j], translation[i]) ? 0 : 1;
+			}
+		}
+		for (uint32_t j = NUM_JOINTS; j < 8; j++) {
+			numMismatched += pose.rotation[3][j] == 1.0f && pose.translation[0][j] == 0.0f ? 0 : 1;
+		}
+	}
+	CHECK(numMismatched == 0);
+
+	// blends between two poses, including ones whose rotations are on opposite hemispheres
+	Pose a;
+	Pose b;
+	Pose blended;
+	clip.sample(0.1f, &a);
+	clip.sample(0.8f, &b);
+	for (uint32_t j = 0; j < NUM_JOINTS; j += 2) {
+		for (int i = 0; i < 4; i++) {
+			b.rotation[i][j] = -a.rotation[i][j];
+		}
+	}
+	numMismatched = 0;
+	for (int w = 0; w <= 8; w++) {
+		auto weight = w / 8.0f;
+		Pose::blend(&a, &b, weight, NUM_JOINTS, &blended);
+		for (uint32_t j = 0; j < NUM_JOINTS; j++) {
+			float qa[4];
+			float qb[4];
+			float ta[3];
+			float tb[3];
+			float rotation[4];
+			float translation[3];
+			for (int i = 0; i < 4; i++) {
+				qa[i] = a.rotation[i][j];
+				qb[i] = b.rotation[i][j];
+			}
+			for (int i = 0; i < 3; i++) {
+				ta[i] = a.translation[i][j];
+				tb[i] = b.translation[i][j];
+			}
+			nlerpReference(qa, qb, weight, 4, rotation);
+			nlerpReference(ta, tb, weight, 3, translation);
+			for (int i = 0; i < 4; i++) {
+				numMismatched += isClose(blended.rotation[i][j], rotation[i]) ? 0 : 1;
+			}
+			for (int i = 0; i < 3; i++) {
+				numMismatched += isClose(blended.translation[i][j], translation[i]) ? 0 : 1;
+			}
+		}
+	}
+	CHECK(numMismatched == 0);
+
+	// tracks have to start on frame 0 and go up within the clip, or sampling would read past them
+	auto rejects = [&](void (*edit)(ClipSource *clip)) {
+		auto edited = source;
+		edit(&edited);
+		edited.write(&data);
+		AnimationClip rejected;
+		return !AnimationClip::create(data.data(), data.size(), &skeleton, &rejected);
+	};
+	CHECK(rejects([](ClipSource *clip) { clip->keys[clip->tracks[1].firstKey].frame = 1; }));
+	CHECK(rejects([](ClipSource *clip) {
+		auto &track = clip->tracks[1];
+		clip->keys[track.firstKey + 1].frame = clip->keys[track.firstKey + 2].frame;
+	}));
+	CHECK(rejects([](ClipSource *clip) {
+		auto &track = clip->tracks[1];
+		clip->keys[track.firstKey + track.numKeys - 1].frame = (uint16_t)clip->numFrames;
+	}));
+	CHECK(rejects([](ClipSource *clip) { clip->tracks[1].numKeys = 0; }));
+	CHECK(rejects([](ClipSource *clip) { clip->tracks[1].firstKey = UINT32_MAX; }));
+	CHECK(rejects([](ClipSource *clip) {
+		clip->tracks.back().numKeys = (uint32_t)clip->keys.size();
+	}));
+	CHECK(!rejects([](ClipSource *) {}));
+}
+
+int main() {
+	checkRanges();
+	checkAnimation();
+	checkRing();
+	checkTlsf();
+	checkPlacement();
+	checkGeometry();
+	checkIndirect();
+	checkDrawSort();
+	checkBvh();
+	checkBarriers();
+	checkGraph();
+	checkResidency();
+	checkOcclusion();
+
+	if (numFailures > 0) {
+		fprintf(stderr, "%d checks failed\n", numFailures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
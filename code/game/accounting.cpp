@@ -0,0 +1,63 @@
+#include "accounting.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations[MEMORY_TAG_COUNT];
+static std::atomic<uint64_t> bytes[MEMORY_TAG_COUNT];
+static thread_local MemoryTag currentTag = MEMORY_UNTAGGED;
+
+const char *getMemoryTagName(MemoryTag tag) {
+	static const char *const names[MEMORY_TAG_COUNT] = {
+		"untagged", "assets", "scene", "animation", "render", "capture", "arena",
+	};
+	return tag < MEMORY_TAG_COUNT ? names[tag] : "unknown";
+}
+
+uint64_t MemoryStats::getAllocations() const {
+	uint64_t total = 0;
+	for (auto &counters : this->tags) {
+		total += counters.allocations;
+	}
+	return total;
+}
+
+MemoryStats getMemoryStats() {
+	MemoryStats stats;
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+		stats.tags[i].allocations = allocations[i].load(std::memory_order_relaxed);
+		stats.tags[i].bytes = bytes[i].load(std::memory_order_relaxed);
+	}
+	return stats;
+}
+
+void countAllocation(size_t size) {
+	allocations[currentTag].fetch_add(1, std::memory_order_relaxed);
+	bytes[currentTag].fetch_add(size, std::memory_order_relaxed);
+}
+
+MemoryScope::MemoryScope(MemoryTag tag) {
+	this->previous = currentTag;
+	currentTag = tag;
+}
+
+MemoryScope::~MemoryScope() {
+	currentTag = this->previous;
+}
+
+// Array and nothrow forms forward to these, so every default allocation is counted.
+void *operator new(size_t size) {
+	countAllocation(size);
+	if (auto p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
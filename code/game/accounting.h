@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// The subsystems heap allocations are counted against.
+enum MemoryTag {
+	MEMORY_UNTAGGED,
+	MEMORY_ASSETS,
+	MEMORY_SCENE,
+	MEMORY_ANIMATION,
+	MEMORY_RENDER,
+	MEMORY_CAPTURE,
+	MEMORY_ARENA,
+	MEMORY_TAG_COUNT,
+};
+
+const char *getMemoryTagName(MemoryTag tag);
+
+struct MemoryCounters {
+	uint64_t allocations;
+	uint64_t bytes;
+};
+
+// Every allocation made through operator new since startup, by the tag of the thread that made it.
+struct MemoryStats {
+	MemoryCounters tags[MEMORY_TAG_COUNT];
+
+	uint64_t getAllocations() const;
+};
+
+MemoryStats getMemoryStats();
+
+void countAllocation(size_t size);
+
+// Counts the heap allocations the calling thread makes while it is alive against a subsystem.
+// Scopes nest, and the innermost one wins.
+struct MemoryScope {
+	MemoryTag previous;
+
+	explicit MemoryScope(MemoryTag tag);
+	~MemoryScope();
+
+	MemoryScope(const MemoryScope&) = delete;
+	MemoryScope &operator=(const MemoryScope&) = delete;
+};
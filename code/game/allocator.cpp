@@ -0,0 +1,271 @@
+#include "allocator.h"
+#include "util.h"
+#include <algorithm>
+
+static Placement getPlacement(const GpuAllocation *allocation) {
+	Placement placement;
+	placement.heap = allocation->heap;
+	placement.block = allocation->block;
+	placement.offset = allocation->offset;
+	placement.size = allocation->size;
+	placement.alignment = allocation->alignment;
+	return placement;
+}
+
+static GpuAllocation getAllocation(UINT heapType, UINT pool, const Placement *placement) {
+	GpuAllocation allocation;
+	allocation.heapType = heapType;
+	allocation.pool = pool;
+	allocation.heap = placement->heap;
+	allocation.block = placement->block;
+	allocation.offset = placement->offset;
+	allocation.size = placement->size;
+	allocation.alignment = placement->alignment;
+	return allocation;
+}
+
+HRESULT GpuAllocator::create(
+	ID3D12Device *device, ResidencyManager *residency, GpuAllocator *allocator
+) {
+	allocator->device = device;
+	allocator->residency = residency;
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	TRY(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+	allocator->tier = options.ResourceHeapTier;
+
+	D3D12_HEAP_FLAGS poolFlags[GPU_POOL_COUNT] = {
+		D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+		D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES,
+	};
+	for (UINT type = 0; type < GpuAllocator::HEAP_TYPE_COUNT; type++) {
+		for (UINT kind = 0; kind < GPU_POOL_COUNT; kind++) {
+			auto &pool = allocator->pools[type][kind];
+			pool.type = (D3D12_HEAP_TYPE)(D3D12_HEAP_TYPE_DEFAULT + type);
+			pool.flags = allocator->tier == D3D12_RESOURCE_HEAP_TIER_1 ?
+				poolFlags[kind] : D3D12_HEAP_FLAG_ALLOW_ALL_BUFFERS_AND_TEXTURES;
+		}
+	}
+
+	return S_OK;
+}
+
+HRESULT GpuAllocator::allocate(
+	UINT heapType, UINT pool, UINT64 size, UINT64 alignment, void *owner,
+	GpuAllocation *allocation
+) {
+	auto &p = this->pools[heapType][pool];
+	Placement placement;
+	if (p.placement.allocate(PlacementPool::NO_HEAP, size, alignment, owner, &placement)) {
+		*allocation = getAllocation(heapType, pool, &placement);
+		return S_OK;
+	}
+
+	// resources larger than a heap get a heap of their own, which is released when they are. On
+	// tier 2 MSAA targets share the buffer pool, so one can need more alignment than the pool.
+	auto heapAlignment = (UINT64)D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	if (pool == GPU_POOL_TARGETS) {
+		heapAlignment = D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT;
+	}
+	heapAlignment = std::max(heapAlignment, alignment);
+	auto heapSize = (size + heapAlignment - 1) / heapAlignment * heapAlignment;
+	if (heapSize < GpuAllocator::HEAP_SIZE) {
+		heapSize = GpuAllocator::HEAP_SIZE;
+	}
+
+	D3D12_HEAP_DESC hd = {};
+	hd.SizeInBytes = heapSize;
+	hd.Properties.Type = p.type;
+	hd.Alignment = heapAlignment;
+	hd.Flags = p.flags;
+
+	GpuAllocator::Heap heap;
+	TRY(this->device->CreateHeap(&hd, IID_PPV_ARGS(&heap.heap)));
+	heap.residency = ResidencySet::NULL_OBJECT;
+	if (p.type == D3D12_HEAP_TYPE_DEFAULT) {
+		heap.residency = this->residency->add(heap.heap.Get(), heapSize);
+	}
+
+	auto index = p.placement.addHeap(
+		heapSize, D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT, heapAlignment
+	);
+	if (index == p.heaps.size()) {
+		p.heaps.emplace_back();
+	}
+	p.heaps[index] = std::move(heap);
+
+	if (!p.placement.allocate(PlacementPool::NO_HEAP, size, alignment, owner, &placement)) {
+		return E_OUTOFMEMORY;
+	}
+
+	*allocation = getAllocation(heapType, pool, &placement);
+	return S_OK;
+}
+
+HRESULT GpuAllocator::createResource(
+	D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC *desc,
+	D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue,
+	void *owner, ID3D12Resource **resource, GpuAllocation *allocation
+) {
+	auto isTarget = (desc->Flags & (
+		D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL
+	)) != 0;
+
+	UINT pool = GPU_POOL_BUFFERS;
+	if (this->tier == D3D12_RESOURCE_HEAP_TIER_1 && desc->Dimension != D3D12_RESOURCE_DIMENSION_BUFFER) {
+		pool = isTarget ? GPU_POOL_TARGETS : GPU_POOL_TEXTURES;
+	}
+
+	auto rd = *desc;
+	D3D12_RESOURCE_ALLOCATION_INFO info = {};
+	if (rd.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER && !isTarget && rd.SampleDesc.Count == 1) {
+		rd.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+		info = this->device->GetResourceAllocationInfo(0, 1, &rd);
+	}
+	if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) {
+		rd.Alignment = 0;
+		info = this->device->GetResourceAllocationInfo(0, 1, &rd);
+	}
+
+	TRY(this->allocate(
+		heapType - D3D12_HEAP_TYPE_DEFAULT, pool, info.SizeInBytes, info.Alignment, owner,
+		allocation
+	));
+
+	HRESULT hr = this->createPlacedResource(allocation, &rd, initialState, clearValue, resource);
+	if (FAILED(hr)) {
+		this->free(allocation);
+		return hr;
+	}
+
+	return S_OK;
+}
+
+HRESULT GpuAllocator::createPlacedResource(
+	const GpuAllocation *allocation, const D3D12_RESOURCE_DESC *desc,
+	D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue,
+	ID3D12Resource **resource
+) {
+	auto rd = *desc;
+	if (allocation->offset % D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT != 0) {
+		rd.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+	}
+
+	auto &heap = this->pools[allocation->heapType][allocation->pool].heaps[allocation->heap];
+	TRY(this->device->CreatePlacedResource(
+		heap.heap.Get(), allocation->offset, &rd, initialState, clearValue,
+		IID_PPV_ARGS(resource)
+	));
+
+	return S_OK;
+}
+
+void GpuAllocator::free(GpuAllocation *allocation) {
+	if (allocation->block == Tlsf::NULL_BLOCK) {
+		return;
+	}
+
+	auto &pool = this->pools[allocation->heapType][allocation->pool];
+	auto placement = getPlacement(allocation);
+	if (pool.placement.free(&placement)) {
+		auto &heap = pool.heaps[allocation->heap];
+		if (heap.residency != ResidencySet::NULL_OBJECT) {
+			this->residency->remove(heap.residency);
+		}
+		heap.heap.Reset();
+	}
+
+	*allocation = GpuAllocation();
+}
+
+void GpuAllocator::use(const GpuAllocation *allocation) {
+	if (allocation->block == Tlsf::NULL_BLOCK) {
+		return;
+	}
+
+	auto &heap = this->pools[allocation->heapType][allocation->pool].heaps[allocation->heap];
+	if (heap.residency != ResidencySet::NULL_OBJECT) {
+		this->residency->use(heap.residency);
+	}
+}
+
+void GpuAllocator::beginDefragment(UINT64 maxBytes, std::vector<GpuMove> *moves) {
+	UINT64 movedBytes = 0;
+	std::vector<PlacementMove> placementMoves;
+	for (UINT type = 0; type < GpuAllocator::HEAP_TYPE_COUNT; type++) {
+		for (UINT kind = 0; kind < GPU_POOL_COUNT; kind++) {
+			placementMoves.clear();
+			auto withinBudget = this->pools[type][kind].placement.beginDefragment(
+				maxBytes, &movedBytes, &placementMoves
+			);
+			for (auto &placementMove : placementMoves) {
+				GpuMove move;
+				move.owner = placementMove.owner;
+				move.source = getAllocation(type, kind, &placementMove.source);
+				move.dest = getAllocation(type, kind, &placementMove.dest);
+				moves->push_back(move);
+			}
+			if (!withinBudget) {
+				return;
+			}
+		}
+	}
+}
+
+void GpuAllocator::endDefragment(std::vector<GpuMove> *moves) {
+	for (auto &move : *moves) {
+		this->free(&move.source);
+	}
+	moves->clear();
+}
+
+GpuAllocator::Stats GpuAllocator::getPoolStats(D3D12_HEAP_TYPE heapType, GpuPoolKind kind) {
+	Stats stats = {};
+
+	UINT64 totalFree = 0;
+	for (auto &heap : this->pools[heapType - D3D12_HEAP_TYPE_DEFAULT][kind].placement.heaps) {
+		if (!heap.live) {
+			continue;
+		}
+
+		auto heapStats = heap.tlsf.getStats();
+		stats.numHeaps++;
+		stats.numAllocations += heapStats.numAllocations;
+		stats.reserved += heapStats.capacity;
+		stats.used += heapStats.used;
+		stats.largestFreeBlock = std::max(stats.largestFreeBlock, heapStats.largestFreeBlock);
+		totalFree += heapStats.capacity - heapStats.used;
+	}
+
+	if (totalFree > 0) {
+		stats.fragmentation = 1.0f - (float)((double)stats.largestFreeBlock / totalFree);
+	}
+
+	return stats;
+}
+
+GpuAllocator::Stats GpuAllocator::getStats() {
+	Stats stats = {};
+
+	UINT64 totalFree = 0;
+	for (UINT type = 0; type < GpuAllocator::HEAP_TYPE_COUNT; type++) {
+		for (UINT kind = 0; kind < GPU_POOL_COUNT; kind++) {
+			auto poolStats = this->getPoolStats(
+				(D3D12_HEAP_TYPE)(D3D12_HEAP_TYPE_DEFAULT + type), (GpuPoolKind)kind
+			);
+			stats.numHeaps += poolStats.numHeaps;
+			stats.numAllocations += poolStats.numAllocations;
+			stats.reserved += poolStats.reserved;
+			stats.used += poolStats.used;
+			stats.largestFreeBlock = std::max(stats.largestFreeBlock, poolStats.largestFreeBlock);
+			totalFree += poolStats.reserved - poolStats.used;
+		}
+	}
+
+	if (totalFree > 0) {
+		stats.fragmentation = 1.0f - (float)((double)stats.largestFreeBlock / totalFree);
+	}
+
+	return stats;
+}
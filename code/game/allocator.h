@@ -0,0 +1,98 @@
+#pragma once
+#include "budget.h"
+#include "placement.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+
+enum GpuPoolKind {
+	GPU_POOL_BUFFERS,
+	GPU_POOL_TEXTURES,
+	GPU_POOL_TARGETS,
+	GPU_POOL_COUNT,
+};
+
+struct GpuAllocation {
+	UINT heapType = 0;
+	UINT pool = 0;
+	UINT heap = 0;
+	UINT32 block = Tlsf::NULL_BLOCK;
+	UINT64 offset = 0;
+	UINT64 size = 0;
+	UINT64 alignment = 0;
+};
+
+// A request to move one allocation during defragmentation. The owner recreates its resource at
+// the destination, copies the contents, and returns the move to endDefragment once the copy has
+// retired on the GPU.
+struct GpuMove {
+	void *owner;
+	GpuAllocation source;
+	GpuAllocation dest;
+};
+
+struct GpuAllocator {
+	static const UINT64 HEAP_SIZE = 64 * 1024 * 1024;
+	static const UINT HEAP_TYPE_COUNT = 3;
+
+	struct Heap {
+		Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+		UINT32 residency;
+	};
+
+	// heaps and placement.heaps are indexed alike
+	struct Pool {
+		D3D12_HEAP_TYPE type;
+		D3D12_HEAP_FLAGS flags;
+		PlacementPool placement;
+		std::vector<Heap> heaps;
+	};
+
+	struct Stats {
+		UINT numHeaps;
+		UINT numAllocations;
+		UINT64 reserved;
+		UINT64 used;
+		UINT64 largestFreeBlock;
+		float fragmentation;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> device;
+	D3D12_RESOURCE_HEAP_TIER tier;
+	Pool pools[HEAP_TYPE_COUNT][GPU_POOL_COUNT];
+
+	// default heaps are registered for residency management, upload and readback heaps live in
+	// system memory and stay resident
+	ResidencyManager *residency;
+
+	static HRESULT create(
+		ID3D12Device *device, ResidencyManager *residency, GpuAllocator *allocator
+	);
+
+	HRESULT createResource(
+		D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC *desc,
+		D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue,
+		void *owner, ID3D12Resource **resource, GpuAllocation *allocation
+	);
+	HRESULT createPlacedResource(
+		const GpuAllocation *allocation, const D3D12_RESOURCE_DESC *desc,
+		D3D12_RESOURCE_STATES initialState, const D3D12_CLEAR_VALUE *clearValue,
+		ID3D12Resource **resource
+	);
+	void free(GpuAllocation *allocation);
+
+	void use(const GpuAllocation *allocation);
+
+	void beginDefragment(UINT64 maxBytes, std::vector<GpuMove> *moves);
+	void endDefragment(std::vector<GpuMove> *moves);
+
+	Stats getStats();
+	Stats getPoolStats(D3D12_HEAP_TYPE heapType, GpuPoolKind kind);
+
+	HRESULT allocate(
+		UINT heapType, UINT pool, UINT64 size, UINT64 alignment, void *owner,
+		GpuAllocation *allocation
+	);
+};
@@ -0,0 +1,443 @@
+#include "animation.h"
+#include "accounting.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const uint32_t ANIMATION_MAGIC = 'A' | 'N' << 8 | 'I' << 16 | 'M' << 24;
+static const uint32_t ANIMATION_VERSION = 1;
+
+static bool readHeader(const char *data, size_t size, AnimationHeader *header) {
+	if (size < sizeof(*header)) {
+		return false;
+	}
+	memcpy(header, data, sizeof(*header));
+
+	auto expected = sizeof(*header) + header->numJoints * sizeof(AnimationJoint) +
+		2 * header->numJoints * sizeof(AnimationTrack) + header->numKeys * sizeof(AnimationKey);
+	return header->magic == ANIMATION_MAGIC && header->version == ANIMATION_VERSION &&
+		header->numJoints > 0 && header->numJoints <= Pose::MAX_JOINTS &&
+		header->numFrames > 0 && header->frameRate > 0.0f && size == expected;
+}
+
+static uint32_t getPaddedCount(uint32_t numJoints) {
+	return (numJoints + 3) & ~3u;
+}
+
+static void multiplyAffine(const float *a, const float *b, float *out) {
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 4; c++) {
+			out[4 * r + c] = a[4 * r + 0] * b[c] + a[4 * r + 1] * b[4 + c] +
+				a[4 * r + 2] * b[8 + c] + (c == 3 ? a[4 * r + 3] : 0.0f);
+		}
+	}
+}
+
+static void rigidMatrix(
+	float tx, float ty, float tz, float qx, float qy, float qz, float qw, float *m
+) {
+	m[0] = 1.0f - 2.0f * (qy * qy + qz * qz);
+	m[1] = 2.0f * (qx * qy - qw * qz);
+	m[2] = 2.0f * (qx * qz + qw * qy);
+	m[3] = tx;
+	m[4] = 2.0f * (qx * qy + qw * qz);
+	m[5] = 1.0f - 2.0f * (qx * qx + qz * qz);
+	m[6] = 2.0f * (qy * qz - qw * qx);
+	m[7] = ty;
+	m[8] = 2.0f * (qx * qz - qw * qy);
+	m[9] = 2.0f * (qy * qz + qw * qx);
+	m[10] = 1.0f - 2.0f * (qx * qx + qy * qy);
+	m[11] = tz;
+}
+
+// Writes the local matrices of all (padded) joints as rows of 12 floats.
+static void computeLocalMatrices(const Pose *pose, uint32_t numJoints, float (*local)[12]) {
+	auto end = getPaddedCount(numJoints);
+	uint32_t j = 0;
+
+#if defined(SIMD_SSE)
+	auto one = _mm_set1_ps(1.0f);
+	auto two = _mm_set1_ps(2.0f);
+	for (; j < end; j += 4) {
+		auto qx = _mm_load_ps(&pose->rotation[0][j]);
+		auto qy = _mm_load_ps(&pose->rotation[1][j]);
+		auto qz = _mm_load_ps(&pose->rotation[2][j]);
+		auto qw = _mm_load_ps(&pose->rotation[3][j]);
+
+		auto xx = _mm_mul_ps(qx, qx);
+		auto yy = _mm_mul_ps(qy, qy);
+		auto zz = _mm_mul_ps(qz, qz);
+		auto xy = _mm_mul_ps(qx, qy);
+		auto xz = _mm_mul_ps(qx, qz);
+		auto yz = _mm_mul_ps(qy, qz);
+		auto wx = _mm_mul_ps(qw, qx);
+		auto wy = _mm_mul_ps(qw, qy);
+		auto wz = _mm_mul_ps(qw, qz);
+
+		__m128 m[12];
+		m[0] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		m[1] = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+		m[2] = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+		m[3] = _mm_load_ps(&pose->translation[0][j]);
+		m[4] = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+		m[5] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		m[6] = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+		m[7] = _mm_load_ps(&pose->translation[1][j]);
+		m[8] = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+		m[9] = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+		m[10] = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+		m[11] = _mm_load_ps(&pose->translation[2][j]);
+
+		// lanes are joints, so each transpose turns four columns into one row of four matrices
+		for (int r = 0; r < 3; r++) {
+			_MM_TRANSPOSE4_PS(m[4 * r + 0], m[4 * r + 1], m[4 * r + 2], m[4 * r + 3]);
+			for (int lane = 0; lane < 4; lane++) {
+				_mm_storeu_ps(&local[j + lane][4 * r], m[4 * r + lane]);
+			}
+		}
+	}
+#endif
+
+	for (; j < end; j++) {
+		rigidMatrix(
+			pose->translation[0][j], pose->translation[1][j], pose->translation[2][j],
+			pose->rotation[0][j], pose->rotation[1][j], pose->rotation[2][j], pose->rotation[3][j],
+			local[j]
+		);
+	}
+}
+
+static void setIdentity(Pose *pose, uint32_t first) {
+	for (auto j = first; j < Pose::MAX_JOINTS; j++) {
+		for (int i = 0; i < 3; i++) {
+			pose->translation[i][j] = 0.0f;
+		}
+		for (int i = 0; i < 4; i++) {
+			pose->rotation[i][j] = i == 3 ? 1.0f : 0.0f;
+		}
+	}
+}
+
+bool Skeleton::create(const char *data, size_t size, Skeleton *skeleton) {
+	MemoryScope scope(MEMORY_ASSETS);
+	AnimationHeader header;
+	if (!readHeader(data, size, &header)) {
+		return false;
+	}
+
+	auto joints = (const AnimationJoint*)(data + sizeof(header));
+	skeleton->numJoints = header.numJoints;
+	skeleton->parents.resize(header.numJoints);
+	for (uint32_t j = 0; j < header.numJoints; j++) {
+		AnimationJoint joint;
+		memcpy(&joint, &joints[j], sizeof(joint));
+		if (joint.parent < -1 || joint.parent >= (int32_t)j) {
+			return false;
+		}
+
+		skeleton->parents[j] = joint.parent;
+		for (int i = 0; i < 3; i++) {
+			skeleton->restPose.translation[i][j] = joint.translation[i];
+		}
+		for (int i = 0; i < 4; i++) {
+			skeleton->restPose.rotation[i][j] = joint.rotation[i];
+		}
+	}
+	setIdentity(&skeleton->restPose, header.numJoints);
+
+	float local[Pose::MAX_JOINTS][12];
+	float world[Pose::MAX_JOINTS][12];
+	computeLocalMatrices(&skeleton->restPose, header.numJoints, local);
+
+	// bind matrices are rigid, so the inverse is the transposed rotation and rotated translation
+	skeleton->inverseBind.resize(12 * header.numJoints);
+	for (uint32_t j = 0; j < header.numJoints; j++) {
+		auto parent = skeleton->parents[j];
+		if (parent < 0) {
+			memcpy(world[j], local[j], sizeof(world[j]));
+		} else {
+			multiplyAffine(world[parent], local[j], world[j]);
+		}
+
+		auto m = world[j];
+		auto inverse = &skeleton->inverseBind[12 * j];
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				inverse[4 * r + c] = m[4 * c + r];
+			}
+			inverse[4 * r + 3] = -(m[r] * m[3] + m[4 + r] * m[7] + m[8 + r] * m[11]);
+		}
+	}
+
+	return true;
+}
+
+void Skeleton::computeSkinMatrices(const Pose *pose, float *out) const {
+	float local[Pose::MAX_JOINTS][12];
+	float world[Pose::MAX_JOINTS][12];
+	computeLocalMatrices(pose, this->numJoints, local);
+
+	for (uint32_t j = 0; j < this->numJoints; j++) {
+		auto parent = this->parents[j];
+		if (parent < 0) {
+			memcpy(world[j], local[j], sizeof(world[j]));
+		} else {
+			multiplyAffine(world[parent], local[j], world[j]);
+		}
+		multiplyAffine(world[j], &this->inverseBind[12 * j], &out[12 * j]);
+	}
+}
+
+bool AnimationClip::create(
+	const char *data, size_t size, const Skeleton *skeleton, AnimationClip *clip
+) {
+	MemoryScope scope(MEMORY_ASSETS);
+	AnimationHeader header;
+	if (!readHeader(data, size, &header) || header.numJoints != skeleton->numJoints) {
+		return false;
+	}
+
+	clip->numJoints = header.numJoints;
+	clip->numFrames = header.numFrames;
+	clip->frameRate = header.frameRate;
+
+	auto tracks = data + sizeof(header) + header.numJoints * sizeof(AnimationJoint);
+	clip->tracks.resize(2 * header.numJoints);
+	memcpy(clip->tracks.data(), tracks, clip->tracks.size() * sizeof(AnimationTrack));
+
+	auto keys = tracks + clip->tracks.size() * sizeof(AnimationTrack);
+	clip->keys.resize(header.numKeys);
+	memcpy(clip->keys.data(), keys, clip->keys.size() * sizeof(AnimationKey));
+
+	// Sampling looks keys up by frame, so each track has to start at frame 0 and go up from
+	// there, staying within the clip.
+	for (auto &track : clip->tracks) {
+		if (
+			track.numKeys == 0 || track.firstKey > header.numKeys ||
+			track.numKeys > header.numKeys - track.firstKey
+		) {
+			return false;
+		}
+		auto first = &clip->keys[track.firstKey];
+		if (first[0].frame != 0 || first[track.numKeys - 1].frame >= header.numFrames) {
+			return false;
+		}
+		for (uint32_t i = 1; i < track.numKeys; i++) {
+			if (first[i].frame <= first[i - 1].frame) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+float AnimationClip::getDuration() const {
+	return this->numFrames / this->frameRate;
+}
+
+// Dequantized key pairs of four tracks, with components in rows and tracks in lanes.
+struct TrackSamples {
+	alignas(16) float a[4][4];
+	alignas(16) float b[4][4];
+	alignas(16) float t[4];
+};
+
+static void gatherTrack(
+	const AnimationClip *clip, const AnimationTrack *track, float frame, uint32_t lane,
+	TrackSamples *samples
+) {
+	auto first = clip->keys.data() + track->firstKey;
+	auto last = first + track->numKeys;
+	auto key = std::upper_bound(first, last, frame, [](float frame, const AnimationKey &key) {
+		return frame < key.frame;
+	}) - 1;
+
+	// past the last key the track wraps around to the first one
+	auto next = key + 1 == last ? first : key + 1;
+	auto nextFrame = key + 1 == last ? (float)clip->numFrames : (float)next->frame;
+	samples->t[lane] = nextFrame > key->frame ?
+		(frame - key->frame) / (nextFrame - key->frame) : 0.0f;
+
+	const auto scale = 1.0f / UINT16_MAX;
+	for (int i = 0; i < 4; i++) {
+		auto extent = track->extent[i] * scale;
+		samples->a[i][lane] = track->min[i] + extent * key->values[i];
+		samples->b[i][lane] = track->min[i] + extent * next->values[i];
+	}
+}
+
+static void gatherIdentity(uint32_t lane, TrackSamples *samples) {
+	samples->t[lane] = 0.0f;
+	for (int i = 0; i < 4; i++) {
+		samples->a[i][lane] = samples->b[i][lane] = i == 3 ? 1.0f : 0.0f;
+	}
+}
+
+#if defined(SIMD_SSE)
+static __m128 dot4(const __m128 *a, const __m128 *b) {
+	return _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])),
+		_mm_add_ps(_mm_mul_ps(a[2], b[2]), _mm_mul_ps(a[3], b[3]))
+	);
+}
+
+// Normalized lerp of four quaternions at once, flipping b where it is on the far hemisphere.
+static void nlerp4(const __m128 *a, const __m128 *b, __m128 t, float *const *out, uint32_t j) {
+	auto sign = _mm_and_ps(dot4(a, b), _mm_set1_ps(-0.0f));
+
+	__m128 q[4];
+	for (int i = 0; i < 4; i++) {
+		auto target = _mm_xor_ps(b[i], sign);
+		q[i] = _mm_add_ps(a[i], _mm_mul_ps(t, _mm_sub_ps(target, a[i])));
+	}
+
+	auto scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(dot4(q, q)));
+	for (int i = 0; i < 4; i++) {
+		_mm_store_ps(&out[i][j], _mm_mul_ps(q[i], scale));
+	}
+}
+
+static void lerp3(const __m128 *a, const __m128 *b, __m128 t, float *const *out, uint32_t j) {
+	for (int i = 0; i < 3; i++) {
+		_mm_store_ps(&out[i][j], _mm_add_ps(a[i], _mm_mul_ps(t, _mm_sub_ps(b[i], a[i]))));
+	}
+}
+#endif
+
+static void nlerp(
+	const float *a, const float *b, float t, float *const *out, uint32_t j, int numComponents
+) {
+	auto sign = 1.0f;
+	if (numComponents == 4 && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f) {
+		sign = -1.0f;
+	}
+
+	float q[4];
+	auto length = 0.0f;
+	for (int i = 0; i < numComponents; i++) {
+		q[i] = a[i] + t * (sign * b[i] - a[i]);
+		length += q[i] * q[i];
+	}
+
+	auto scale = numComponents == 4 ? 1.0f / sqrtf(length) : 1.0f;
+	for (int i = 0; i < numComponents; i++) {
+		out[i][j] = q[i] * scale;
+	}
+}
+
+// Interpolates the lanes of a gather into joints j to j + 3 of the pose.
+static void interpolateSamples(
+	const TrackSamples *samples, float *const *out, uint32_t j, bool rotation
+) {
+#if defined(SIMD_SSE)
+	__m128 a[4];
+	__m128 b[4];
+	for (int i = 0; i < 4; i++) {
+		a[i] = _mm_load_ps(samples->a[i]);
+		b[i] = _mm_load_ps(samples->b[i]);
+	}
+	auto t = _mm_load_ps(samples->t);
+	if (rotation) {
+		nlerp4(a, b, t, out, j);
+	} else {
+		lerp3(a, b, t, out, j);
+	}
+#else
+	for (uint32_t lane = 0; lane < 4; lane++) {
+		float a[4];
+		float b[4];
+		for (int i = 0; i < 4; i++) {
+			a[i] = samples->a[i][lane];
+			b[i] = samples->b[i][lane];
+		}
+		nlerp(a, b, samples->t[lane], out, j + lane, rotation ? 4 : 3);
+	}
+#endif
+}
+
+void AnimationClip::sample(float time, Pose *pose) const {
+	auto frame = fmodf(time * this->frameRate, (float)this->numFrames);
+	if (frame < 0.0f) {
+		frame += this->numFrames;
+	}
+
+	float *const rotation[4] = {
+		pose->rotation[0], pose->rotation[1], pose->rotation[2], pose->rotation[3]
+	};
+	float *const translation[3] = {
+		pose->translation[0], pose->translation[1], pose->translation[2]
+	};
+
+	// key lookup is scalar per track, and the interpolation runs on four joints at a time
+	auto end = getPaddedCount(this->numJoints);
+	for (uint32_t j = 0; j < end; j += 4) {
+		TrackSamples rotations;
+		TrackSamples translations;
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			auto joint = j + lane;
+			if (joint < this->numJoints) {
+				gatherTrack(this, &this->tracks[2 * joint], frame, lane, &rotations);
+				gatherTrack(this, &this->tracks[2 * joint + 1], frame, lane, &translations);
+			} else {
+				gatherIdentity(lane, &rotations);
+				gatherIdentity(lane, &translations);
+			}
+		}
+
+		interpolateSamples(&rotations, rotation, j, true);
+		interpolateSamples(&translations, translation, j, false);
+	}
+}
+
+void Pose::blend(const Pose *a, const Pose *b, float weight, uint32_t numJoints, Pose *out) {
+	float *const rotation[4] = {
+		out->rotation[0], out->rotation[1], out->rotation[2], out->rotation[3]
+	};
+	float *const translation[3] = {
+		out->translation[0], out->translation[1], out->translation[2]
+	};
+
+	auto end = getPaddedCount(numJoints);
+	uint32_t j = 0;
+
+#if defined(SIMD_SSE)
+	auto t = _mm_set1_ps(weight);
+	for (; j < end; j += 4) {
+		__m128 qa[4];
+		__m128 qb[4];
+		for (int i = 0; i < 4; i++) {
+			qa[i] = _mm_load_ps(&a->rotation[i][j]);
+			qb[i] = _mm_load_ps(&b->rotation[i][j]);
+		}
+		nlerp4(qa, qb, t, rotation, j);
+
+		__m128 ta[3];
+		__m128 tb[3];
+		for (int i = 0; i < 3; i++) {
+			ta[i] = _mm_load_ps(&a->translation[i][j]);
+			tb[i] = _mm_load_ps(&b->translation[i][j]);
+		}
+		lerp3(ta, tb, t, translation, j);
+	}
+#endif
+
+	for (; j < end; j++) {
+		float qa[4];
+		float qb[4];
+		for (int i = 0; i < 4; i++) {
+			qa[i] = a->rotation[i][j];
+			qb[i] = b->rotation[i][j];
+		}
+		nlerp(qa, qb, weight, rotation, j, 4);
+
+		float ta[3];
+		float tb[3];
+		for (int i = 0; i < 3; i++) {
+			ta[i] = a->translation[i][j];
+			tb[i] = b->translation[i][j];
+		}
+		nlerp(ta, tb, weight, translation, j, 3);
+	}
+}
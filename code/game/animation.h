@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AnimationHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numJoints;
+	uint32_t numFrames;
+	float frameRate;
+	uint32_t numKeys;
+};
+
+struct AnimationJoint {
+	int32_t parent;
+	float translation[3];
+	float rotation[4];
+};
+
+// Keys of one rotation or translation track, quantized to 16 bits over the track's own range.
+struct AnimationTrack {
+	uint32_t firstKey;
+	uint32_t numKeys;
+	float min[4];
+	float extent[4];
+};
+
+struct AnimationKey {
+	uint16_t frame;
+	uint16_t values[4];
+};
+
+// Local joint transforms of one character in SoA layout, padded so that joints are sampled,
+// blended and turned into matrices four at a time.
+struct Pose {
+	static const uint32_t MAX_JOINTS = 64;
+
+	alignas(16) float translation[3][MAX_JOINTS];
+	alignas(16) float rotation[4][MAX_JOINTS];
+
+	// Blends from a to b with nlerp, taking the short way between rotations.
+	static void blend(const Pose *a, const Pose *b, float weight, uint32_t numJoints, Pose *out);
+};
+
+// Joint hierarchy in parent before child order, with the rest pose the mesh was skinned in.
+struct Skeleton {
+	uint32_t numJoints = 0;
+	std::vector<int32_t> parents;
+	Pose restPose;
+
+	// 3x4 per joint, row major like the rest of the transforms
+	std::vector<float> inverseBind;
+
+	static bool create(const char *data, size_t size, Skeleton *skeleton);
+
+	// Writes one 3x4 skinning matrix per joint, from the rest pose to the pose.
+	void computeSkinMatrices(const Pose *pose, float *out) const;
+};
+
+// A looping clip, so the last key of each track interpolates back to the first.
+struct AnimationClip {
+	uint32_t numJoints;
+	uint32_t numFrames;
+	float frameRate;
+	std::vector<AnimationTrack> tracks;
+	std::vector<AnimationKey> keys;
+
+	static bool create(const char *data, size_t size, const Skeleton *skeleton, AnimationClip *clip);
+
+	float getDuration() const;
+	void sample(float time, Pose *pose) const;
+};
@@ -0,0 +1,266 @@
+#include "archive.h"
+#include "accounting.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t ARCHIVE_MAGIC = 'P' | 'A' << 8 | 'C' << 16 | 'K' << 24;
+static const uint32_t ARCHIVE_VERSION = 1;
+
+static const uint32_t ARCHIVE_ENTRY_USED = 1;
+static const uint32_t ARCHIVE_ENTRY_COMPRESSED = 2;
+
+static const size_t MIN_MATCH = 4;
+static const size_t COPY_CHUNK = 16;
+
+// FNV-1a, as the asset builder hashes names
+static uint64_t hashName(const char *name, size_t length) {
+	auto hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)name[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static bool readLength(const uint8_t **in, const uint8_t *end, size_t *length) {
+	uint8_t byte;
+	do {
+		if (*in == end) {
+			return false;
+		}
+		byte = *(*in)++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+// Decodes an LZ4 block, checking every length and offset against both buffers.
+static bool decompressBlock(
+	const uint8_t *source, size_t size, uint8_t *target, size_t targetSize
+) {
+	auto in = source;
+	auto end = source + size;
+	size_t out = 0;
+	while (in < end) {
+		auto token = *in++;
+
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !readLength(&in, end, &numLiterals)) {
+			return false;
+		}
+		if (numLiterals > (size_t)(end - in) || numLiterals > targetSize - out) {
+			return false;
+		}
+
+		// Short runs are copied a whole chunk at a time while there's room for the excess. The
+		// literals fit in the source, so what is left of it is never negative.
+		if (
+			numLiterals <= COPY_CHUNK && (size_t)(end - in) >= COPY_CHUNK &&
+			targetSize - out >= COPY_CHUNK
+		) {
+			memcpy(target + out, in, COPY_CHUNK);
+		} else {
+			memcpy(target + out, in, numLiterals);
+		}
+		in += numLiterals;
+		out += numLiterals;
+
+		// the last sequence has no match
+		if (in == end) {
+			break;
+		}
+
+		if (end - in < 2) {
+			return false;
+		}
+		size_t offset = in[0] | in[1] << 8;
+		in += 2;
+		size_t matchLength = token & 15;
+		if (matchLength == 15 && !readLength(&in, end, &matchLength)) {
+			return false;
+		}
+		matchLength += MIN_MATCH;
+		if (offset == 0 || offset > out || matchLength > targetSize - out) {
+			return false;
+		}
+
+		// matches may overlap what they copy, to repeat a run, and then go a byte at a time
+		auto match = target + out - offset;
+		if (offset >= COPY_CHUNK && targetSize - out >= matchLength + COPY_CHUNK) {
+			for (size_t i = 0; i < matchLength; i += COPY_CHUNK) {
+				memcpy(target + out + i, match + i, COPY_CHUNK);
+			}
+		} else if (offset >= matchLength) {
+			memcpy(target + out, match, matchLength);
+		} else {
+			for (size_t i = 0; i < matchLength; i++) {
+				target[out + i] = match[i];
+			}
+		}
+		out += matchLength;
+	}
+	return out == targetSize;
+}
+
+static bool mapFile(const char *path, Archive *archive) {
+#ifdef _WIN32
+	// delete sharing lets the asset builder move a new archive over this one while it's mapped
+	auto file = CreateFileA(
+		path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL
+	);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	archive->file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		return false;
+	}
+	archive->size = (uint64_t)size.QuadPart;
+
+	archive->mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (archive->mapping == NULL) {
+		return false;
+	}
+	archive->data = (const uint8_t*)MapViewOfFile(archive->mapping, FILE_MAP_READ, 0, 0, 0);
+	return archive->data != NULL;
+#else
+	auto file = ::open(path, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	// the mapping keeps the file open by itself
+	struct stat status;
+	auto mapped = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size > 0) {
+		archive->size = (uint64_t)status.st_size;
+		mapped = mmap(NULL, (size_t)archive->size, PROT_READ, MAP_SHARED, file, 0);
+	}
+	::close(file);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	archive->data = (const uint8_t*)mapped;
+	return true;
+#endif
+}
+
+static bool getEntryValid(const Archive *archive, const Archive::Entry *entry) {
+	auto header = archive->header;
+	auto compressed = (entry->flags & ARCHIVE_ENTRY_COMPRESSED) != 0;
+	return
+		entry->nameOffset < header->namesSize &&
+		entry->nameSize < header->namesSize - entry->nameOffset &&
+		entry->offset <= archive->size && entry->storedSize <= archive->size - entry->offset &&
+		(compressed || entry->storedSize == entry->size);
+}
+
+bool Archive::open(const char *path, Archive *archive) {
+	if (!mapFile(path, archive)) {
+		archive->close();
+		return false;
+	}
+
+	auto header = (const Archive::Header*)archive->data;
+	auto valid = archive->size >= sizeof(*header);
+	if (valid) {
+		auto numSlots = (uint64_t)header->numSlots;
+		auto tableEnd = sizeof(*header) + numSlots * sizeof(Archive::Entry);
+		valid =
+			header->magic == ARCHIVE_MAGIC && header->version == ARCHIVE_VERSION &&
+			numSlots > 0 && (numSlots & (numSlots - 1)) == 0 && header->numEntries < numSlots &&
+			tableEnd <= header->namesOffset && header->namesOffset <= archive->size &&
+			header->namesSize <= archive->size - header->namesOffset;
+	}
+
+	if (valid) {
+		archive->header = header;
+		archive->entries = (const Archive::Entry*)(header + 1);
+		archive->names = (const char*)archive->data + header->namesOffset;
+
+		uint32_t numEntries = 0;
+		for (uint32_t i = 0; valid && i < header->numSlots; i++) {
+			auto &entry = archive->entries[i];
+			if (entry.flags & ARCHIVE_ENTRY_USED) {
+				valid = getEntryValid(archive, &entry);
+				numEntries++;
+			}
+		}
+
+		// a free slot ends every probe, so a full table would never stop looking for a miss
+		valid = valid && numEntries == header->numEntries;
+	}
+
+	if (!valid) {
+		archive->close();
+	}
+	return valid;
+}
+
+const Archive::Entry *Archive::find(const char *name) const {
+	auto length = strlen(name);
+	auto nameHash = hashName(name, length);
+	auto mask = this->header->numSlots - 1;
+	for (auto slot = (uint32_t)nameHash & mask;; slot = (slot + 1) & mask) {
+		auto &entry = this->entries[slot];
+		if (!(entry.flags & ARCHIVE_ENTRY_USED)) {
+			return NULL;
+		}
+		if (
+			entry.nameHash == nameHash && entry.nameSize == length &&
+			memcmp(this->names + entry.nameOffset, name, length) == 0
+		) {
+			return &entry;
+		}
+	}
+}
+
+const uint8_t *Archive::getData(const Archive::Entry *entry) const {
+	if (entry->flags & ARCHIVE_ENTRY_COMPRESSED) {
+		return NULL;
+	}
+	return this->data + entry->offset;
+}
+
+bool Archive::read(const Archive::Entry *entry, std::vector<char> *data) const {
+	MemoryScope scope(MEMORY_ASSETS);
+	data->resize((size_t)entry->size);
+	auto stored = this->data + entry->offset;
+	if (!(entry->flags & ARCHIVE_ENTRY_COMPRESSED)) {
+		memcpy(data->data(), stored, data->size());
+		return true;
+	}
+	return decompressBlock(
+		stored, (size_t)entry->storedSize, (uint8_t*)data->data(), data->size()
+	);
+}
+
+void Archive::close() {
+#ifdef _WIN32
+	if (this->data) {
+		UnmapViewOfFile(this->data);
+	}
+	if (this->mapping) {
+		CloseHandle(this->mapping);
+	}
+	if (this->file && this->file != INVALID_HANDLE_VALUE) {
+		CloseHandle(this->file);
+	}
+#else
+	if (this->data) {
+		munmap((void*)this->data, (size_t)this->size);
+	}
+#endif
+	*this = Archive();
+}
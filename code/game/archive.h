@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// The archive the asset builder packs every asset into, mapped whole so that opening it is the
+// only file operation. Its table of entries is a hash table keyed by the names' hashes, which is
+// probed in place. Entries that aren't compressed can be read straight out of the mapping, and
+// the OS pages them in as they are touched.
+struct Archive {
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t numSlots;
+		uint32_t numEntries;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	struct Entry {
+		uint64_t nameHash;
+		uint64_t offset;
+		uint64_t size;
+		uint64_t storedSize;
+		uint32_t nameOffset;
+		uint32_t nameSize;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	const uint8_t *data = NULL;
+	uint64_t size = 0;
+	const Header *header = NULL;
+	const Entry *entries = NULL;
+	const char *names = NULL;
+
+	// the file and mapping handles on Windows
+	void *file = NULL;
+	void *mapping = NULL;
+
+	// Checks the table up front, so the entries it finds can be trusted to lie within the file.
+	static bool open(const char *path, Archive *archive);
+
+	const Entry *find(const char *name) const;
+
+	// The entry's data in the mapping, or NULL when it's compressed.
+	const uint8_t *getData(const Entry *entry) const;
+
+	// Copies the entry out of the mapping, or decompresses it, and fails if it's damaged.
+	bool read(const Entry *entry, std::vector<char> *data) const;
+
+	void close();
+};
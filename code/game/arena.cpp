@@ -0,0 +1,101 @@
+#include "arena.h"
+#include "accounting.h"
+#include <algorithm>
+#include <mutex>
+
+static std::mutex registryMutex;
+static std::vector<FrameArena*> registry;
+
+FrameArena::FrameArena() {
+	MemoryScope scope(MEMORY_ARENA);
+	std::lock_guard<std::mutex> lock(registryMutex);
+	registry.push_back(this);
+}
+
+FrameArena::~FrameArena() {
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		registry.erase(std::find(registry.begin(), registry.end(), this));
+	}
+
+	for (auto &block : this->blocks) {
+		delete[] block.data;
+	}
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment) {
+	while (this->block < this->blocks.size()) {
+		auto &current = this->blocks[this->block];
+		auto address = (uintptr_t)current.data + this->offset;
+		auto aligned = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		auto start = this->offset + (aligned - address);
+		if (start + size <= current.size) {
+			this->offset = start + size;
+			this->used += size;
+			return current.data + start;
+		}
+
+		this->block++;
+		this->offset = 0;
+	}
+
+	MemoryScope scope(MEMORY_ARENA);
+	Block block;
+	block.size = size + alignment > FrameArena::BLOCK_SIZE ?
+		size + alignment : FrameArena::BLOCK_SIZE;
+	block.data = new uint8_t[block.size];
+	this->blocks.push_back(block);
+	return this->allocate(size, alignment);
+}
+
+void FrameArena::reset() {
+	this->peak = std::max(this->peak, this->used);
+
+	// the frame didn't fit, so make the first block big enough for all of it
+	if (this->block > 0) {
+		MemoryScope scope(MEMORY_ARENA);
+		auto capacity = this->getCapacity();
+		for (auto &block : this->blocks) {
+			delete[] block.data;
+		}
+		this->blocks.clear();
+
+		Block block;
+		block.size = capacity;
+		block.data = new uint8_t[block.size];
+		this->blocks.push_back(block);
+	}
+
+	this->block = 0;
+	this->offset = 0;
+	this->used = 0;
+}
+
+size_t FrameArena::getCapacity() const {
+	size_t capacity = 0;
+	for (auto &block : this->blocks) {
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+FrameArena *FrameArena::get() {
+	static thread_local FrameArena arena;
+	return &arena;
+}
+
+void FrameArena::resetAll() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (auto arena : registry) {
+		arena->reset();
+	}
+}
+
+size_t FrameArena::getPeak() {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	size_t peak = 0;
+	for (auto arena : registry) {
+		peak += std::max(arena->peak, arena->used);
+	}
+	return peak;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A linear allocator for memory that only lives until the end of the frame. Every thread has its
+// own, and they are all reset together once the frame has been submitted. Blocks are kept from
+// one frame to the next, and a frame that spills out of the first block has them merged into one
+// at reset, so steady-state frames never touch the heap.
+struct FrameArena {
+	static const size_t BLOCK_SIZE = 256 * 1024;
+
+	struct Block {
+		uint8_t *data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t block = 0;
+	size_t offset = 0;
+
+	// bytes handed out this frame, and the most in any frame
+	size_t used = 0;
+	size_t peak = 0;
+
+	FrameArena();
+	~FrameArena();
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena &operator=(const FrameArena&) = delete;
+
+	void *allocate(size_t size, size_t alignment);
+	void reset();
+
+	size_t getCapacity() const;
+
+	// the calling thread's arena
+	static FrameArena *get();
+
+	// Resets every thread's arena. Nothing may be allocating from them at the time.
+	static void resetAll();
+	static size_t getPeak();
+};
+
+// Lets STL containers allocate from a frame arena, the calling thread's unless given another.
+// Memory is only ever released by the reset, so a container must not outlive the frame.
+template <typename T>
+struct FrameAllocator {
+	typedef T value_type;
+
+	FrameArena *arena;
+
+	FrameAllocator() : arena(FrameArena::get()) {}
+	explicit FrameAllocator(FrameArena *arena) : arena(arena) {}
+
+	template <typename U>
+	FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+	T *allocate(size_t n) {
+		return (T*)this->arena->allocate(n * sizeof(T), alignof(T));
+	}
+
+	void deallocate(T*, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T> &a, const FrameAllocator<U> &b) {
+	return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T> &a, const FrameAllocator<U> &b) {
+	return a.arena != b.arena;
+}
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,24 @@
+#pragma once
+#include "draw.h"
+#include <cstdint>
+
+// Everything a frame hands to the backend once the CPU side is done. Addresses are into memory
+// the backend handed out with allocateUpload during the same frame.
+struct FrameData {
+	const DrawQueue *queue;
+	uint64_t constants;
+	uint64_t skinMatrices;
+};
+
+// What the frame loop needs from a renderer. The D3D12 renderer records and presents real
+// command lists, and the recording backend runs the same frames headless.
+struct RenderBackend {
+	virtual ~RenderBackend() {}
+
+	// Memory the GPU reads this frame, which stays valid until the frame has been rendered.
+	virtual bool allocateUpload(
+		uint64_t size, uint64_t alignment, void **data, uint64_t *address
+	) = 0;
+
+	virtual bool renderFrame(const FrameData *frame) = 0;
+};
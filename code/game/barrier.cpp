@@ -0,0 +1,170 @@
+#include "barrier.h"
+
+void StateTracker::track(void *resource, uint32_t numSubresources, uint32_t state) {
+	Resource tracked;
+	tracked.uniform = true;
+	tracked.state = state;
+	tracked.states.assign(numSubresources, state);
+	tracked.splitState = NO_SPLIT;
+	this->resources[resource] = tracked;
+}
+
+void StateTracker::untrack(void *resource) {
+	this->resources.erase(resource);
+
+	// barriers on a released resource would reference freed memory
+	size_t j = 0;
+	for (size_t i = 0; i < this->pending.size(); i++) {
+		if (this->pending[i].resource != resource) {
+			this->pending[j++] = this->pending[i];
+		}
+	}
+	this->pending.resize(j);
+}
+
+bool StateTracker::getState(void *resource, uint32_t subresource, uint32_t *state) const {
+	auto found = this->resources.find(resource);
+	if (found == this->resources.end()) {
+		return false;
+	}
+
+	auto &tracked = found->second;
+	if (subresource != ALL_SUBRESOURCES && subresource >= tracked.states.size()) {
+		return false;
+	}
+	*state = tracked.uniform || subresource == ALL_SUBRESOURCES ?
+		tracked.state : tracked.states[subresource];
+	return true;
+}
+
+void StateTracker::addBarrier(void *resource, uint32_t subresource, uint32_t before, uint32_t after) {
+	// fold a transition into one already pending for the same subresource in this batch
+	for (size_t i = 0; i < this->pending.size(); i++) {
+		auto &barrier = this->pending[i];
+		if (barrier.resource != resource || barrier.subresource != subresource) {
+			continue;
+		}
+		if (barrier.type != BARRIER_FULL || barrier.after != before) {
+			continue;
+		}
+
+		if (barrier.before == after) {
+			this->pending.erase(this->pending.begin() + i);
+		} else {
+			barrier.after = after;
+		}
+		return;
+	}
+
+	this->pending.push_back(Barrier { resource, subresource, before, after, BARRIER_FULL });
+}
+
+void StateTracker::endSplit(void *resource, Resource *tracked) {
+	if (tracked->splitState == NO_SPLIT) {
+		return;
+	}
+
+	this->pending.push_back(Barrier {
+		resource, ALL_SUBRESOURCES, tracked->state, tracked->splitState, BARRIER_END
+	});
+
+	tracked->state = tracked->splitState;
+	for (auto &state : tracked->states) {
+		state = tracked->splitState;
+	}
+	tracked->splitState = NO_SPLIT;
+}
+
+bool StateTracker::transition(void *resource, uint32_t subresource, uint32_t after) {
+	auto found = this->resources.find(resource);
+	if (found == this->resources.end()) {
+		return false;
+	}
+
+	auto &tracked = found->second;
+	if (subresource != ALL_SUBRESOURCES && subresource >= tracked.states.size()) {
+		return false;
+	}
+	this->endSplit(resource, &tracked);
+
+	if (subresource == ALL_SUBRESOURCES) {
+		if (tracked.uniform) {
+			if (tracked.state != after) {
+				this->addBarrier(resource, ALL_SUBRESOURCES, tracked.state, after);
+			}
+		} else {
+			for (uint32_t i = 0; i < tracked.states.size(); i++) {
+				if (tracked.states[i] != after) {
+					this->addBarrier(resource, i, tracked.states[i], after);
+				}
+			}
+		}
+
+		tracked.uniform = true;
+		tracked.state = after;
+		for (auto &state : tracked.states) {
+			state = after;
+		}
+		return true;
+	}
+
+	auto before = tracked.uniform ? tracked.state : tracked.states[subresource];
+	if (before == after) {
+		return true;
+	}
+
+	this->addBarrier(resource, subresource, before, after);
+	tracked.states[subresource] = after;
+
+	tracked.uniform = true;
+	for (auto state : tracked.states) {
+		if (state != after) {
+			tracked.uniform = false;
+			break;
+		}
+	}
+	if (tracked.uniform) {
+		tracked.state = after;
+	}
+	return true;
+}
+
+bool StateTracker::beginTransition(void *resource, uint32_t after) {
+	auto found = this->resources.find(resource);
+	if (found == this->resources.end()) {
+		return false;
+	}
+
+	auto &tracked = found->second;
+	this->endSplit(resource, &tracked);
+
+	// split barriers only cover whole resources, so bring any stragglers in line first
+	if (!tracked.uniform) {
+		return this->transition(resource, ALL_SUBRESOURCES, after);
+	}
+	if (tracked.state == after) {
+		return true;
+	}
+
+	this->pending.push_back(Barrier {
+		resource, ALL_SUBRESOURCES, tracked.state, after, BARRIER_BEGIN
+	});
+	tracked.splitState = after;
+	return true;
+}
+
+void StateTracker::activate(void *resource) {
+	this->pending.push_back(Barrier { resource, ALL_SUBRESOURCES, 0, 0, BARRIER_ALIASING });
+}
+
+bool StateTracker::flush(std::vector<Barrier> *barriers) {
+	barriers->clear();
+	if (this->pending.empty()) {
+		return false;
+	}
+
+	barriers->swap(this->pending);
+	this->numFlushes++;
+	this->numBarriers += barriers->size();
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// Resource states and subresource indices use the D3D12 values, but are kept opaque here so the
+// tracker can run against any backend.
+static const uint32_t ALL_SUBRESOURCES = 0xffffffff;
+
+enum BarrierType {
+	BARRIER_FULL,
+	BARRIER_BEGIN,
+	BARRIER_END,
+	BARRIER_ALIASING,
+};
+
+struct Barrier {
+	void *resource;
+	uint32_t subresource;
+	uint32_t before;
+	uint32_t after;
+	BarrierType type;
+};
+
+struct StateTracker {
+	static const uint32_t NO_SPLIT = 0xffffffff;
+
+	struct Resource {
+		bool uniform = true;
+		uint32_t state = 0;
+		std::vector<uint32_t> states;
+
+		// the target of a begun split barrier on the whole resource
+		uint32_t splitState = NO_SPLIT;
+	};
+
+	std::unordered_map<void*, Resource> resources;
+	std::vector<Barrier> pending;
+
+	size_t numFlushes = 0;
+	size_t numBarriers = 0;
+
+	void track(void *resource, uint32_t numSubresources, uint32_t state);
+	void untrack(void *resource);
+
+	// Fails for resources that aren't tracked, which is a mistake on the caller's part.
+	bool getState(void *resource, uint32_t subresource, uint32_t *state) const;
+
+	// Like getState, these fail for untracked resources and subresources out of range, and then
+	// record nothing.
+	bool transition(void *resource, uint32_t subresource, uint32_t after);
+	bool beginTransition(void *resource, uint32_t after);
+	void activate(void *resource);
+
+	// hands the pending barriers to the caller, which must submit them as one batch
+	bool flush(std::vector<Barrier> *barriers);
+
+	void addBarrier(void *resource, uint32_t subresource, uint32_t before, uint32_t after);
+	void endSplit(void *resource, Resource *state);
+};
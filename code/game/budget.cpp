@@ -0,0 +1,96 @@
+#include "budget.h"
+#include "util.h"
+
+HRESULT ResidencyManager::create(
+	ID3D12Device *device, IDXGIAdapter3 *adapter, ResidencyManager *manager
+) {
+	manager->device = device;
+	manager->adapter = adapter;
+	ResidencySet::create(UINT64_MAX, &manager->set);
+
+	manager->budgetEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (manager->budgetEvent == NULL) {
+		return GetLastError();
+	}
+	TRY(adapter->RegisterVideoMemoryBudgetChangeNotificationEvent(
+		manager->budgetEvent, &manager->budgetCookie
+	));
+	manager->registered = true;
+
+	TRY(manager->updateBudget());
+	return S_OK;
+}
+
+ResidencyManager::~ResidencyManager() {
+	this->destroy();
+}
+
+void ResidencyManager::destroy() {
+	if (this->registered) {
+		this->adapter->UnregisterVideoMemoryBudgetChangeNotification(this->budgetCookie);
+		this->registered = false;
+	}
+	if (this->budgetEvent != NULL) {
+		CloseHandle(this->budgetEvent);
+		this->budgetEvent = NULL;
+	}
+}
+
+UINT32 ResidencyManager::add(ID3D12Pageable *pageable, UINT64 size) {
+	auto object = this->set.add(size);
+	if (this->pageables.size() <= object) {
+		this->pageables.resize(object + 1);
+	}
+	this->pageables[object] = pageable;
+	return object;
+}
+
+void ResidencyManager::remove(UINT32 object) {
+	this->set.remove(object);
+	this->pageables[object] = NULL;
+}
+
+void ResidencyManager::beginFrame(UINT64 fenceValue) {
+	this->set.beginFrame(fenceValue);
+}
+
+void ResidencyManager::use(UINT32 object) {
+	this->set.use(object);
+}
+
+HRESULT ResidencyManager::updateBudget() {
+	TRY(this->adapter->QueryVideoMemoryInfo(
+		0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &this->memoryInfo
+	));
+
+	this->set.setBudget(this->memoryInfo.Budget, this->memoryInfo.CurrentUsage);
+	return S_OK;
+}
+
+HRESULT ResidencyManager::apply(UINT64 completedFenceValue) {
+	if (WaitForSingleObjectEx(this->budgetEvent, 0, FALSE) == WAIT_OBJECT_0) {
+		TRY(this->updateBudget());
+	}
+
+	this->evictObjects.clear();
+	this->residentObjects.clear();
+	this->set.update(completedFenceValue, &this->evictObjects, &this->residentObjects);
+
+	if (!this->evictObjects.empty()) {
+		this->batch.clear();
+		for (auto object : this->evictObjects) {
+			this->batch.push_back(this->pageables[object]);
+		}
+		TRY(this->device->Evict((UINT)this->batch.size(), this->batch.data()));
+	}
+
+	if (!this->residentObjects.empty()) {
+		this->batch.clear();
+		for (auto object : this->residentObjects) {
+			this->batch.push_back(this->pageables[object]);
+		}
+		TRY(this->device->MakeResident((UINT)this->batch.size(), this->batch.data()));
+	}
+
+	return S_OK;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "residency.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <dxgi1_5.h>
+#include <wrl/client.h>
+#include <vector>
+
+// Keeps the heaps it manages within the adapter's local memory budget by evicting the least
+// recently used ones ahead of submission, rather than leaving paging decisions to the driver.
+struct ResidencyManager {
+	Microsoft::WRL::ComPtr<ID3D12Device> device;
+	Microsoft::WRL::ComPtr<IDXGIAdapter3> adapter;
+	HANDLE budgetEvent = NULL;
+	DWORD budgetCookie = 0;
+	bool registered = false;
+	DXGI_QUERY_VIDEO_MEMORY_INFO memoryInfo;
+
+	ResidencySet set;
+	std::vector<ID3D12Pageable*> pageables;
+
+	std::vector<UINT32> evictObjects;
+	std::vector<UINT32> residentObjects;
+	std::vector<ID3D12Pageable*> batch;
+
+	~ResidencyManager();
+
+	static HRESULT create(ID3D12Device *device, IDXGIAdapter3 *adapter, ResidencyManager *manager);
+	void destroy();
+
+	UINT32 add(ID3D12Pageable *pageable, UINT64 size);
+	void remove(UINT32 object);
+
+	void beginFrame(UINT64 fenceValue);
+	void use(UINT32 object);
+
+	HRESULT updateBudget();
+	HRESULT apply(UINT64 completedFenceValue);
+};
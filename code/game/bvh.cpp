@@ -0,0 +1,528 @@
+#include "bvh.h"
+#include "simd.h"
+#include <algorithm>
+#include <cfloat>
+
+struct BuildNode {
+	Bounds bounds;
+	uint32_t left;
+	uint32_t right;
+	uint32_t first;
+	uint32_t count;
+};
+
+static void emptyBounds(Bounds *bounds) {
+	for (int i = 0; i < 3; i++) {
+		bounds->min[i] = FLT_MAX;
+		bounds->max[i] = -FLT_MAX;
+	}
+}
+
+static void growBounds(Bounds *bounds, const Bounds *other) {
+	for (int i = 0; i < 3; i++) {
+		bounds->min[i] = std::min(bounds->min[i], other->min[i]);
+		bounds->max[i] = std::max(bounds->max[i], other->max[i]);
+	}
+}
+
+static float surfaceArea(const Bounds *bounds) {
+	auto x = bounds->max[0] - bounds->min[0];
+	auto y = bounds->max[1] - bounds->min[1];
+	auto z = bounds->max[2] - bounds->min[2];
+	if (x < 0.0f || y < 0.0f || z < 0.0f) {
+		return 0.0f;
+	}
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static float centroid(const Bounds *bounds, int axis) {
+	return 0.5f * (bounds->min[axis] + bounds->max[axis]);
+}
+
+static uint32_t buildBinary(
+	const Bounds *bounds, uint32_t *primitives, uint32_t first, uint32_t count,
+	std::vector<BuildNode> *buildNodes
+) {
+	BuildNode node = {};
+	node.first = first;
+	node.count = count;
+	node.left = Bvh::EMPTY;
+	node.right = Bvh::EMPTY;
+
+	Bounds centroids;
+	emptyBounds(&node.bounds);
+	emptyBounds(&centroids);
+	for (uint32_t i = first; i < first + count; i++) {
+		auto &b = bounds[primitives[i]];
+		growBounds(&node.bounds, &b);
+		for (int axis = 0; axis < 3; axis++) {
+			centroids.min[axis] = std::min(centroids.min[axis], centroid(&b, axis));
+			centroids.max[axis] = std::max(centroids.max[axis], centroid(&b, axis));
+		}
+	}
+
+	auto index = (uint32_t)buildNodes->size();
+	buildNodes->push_back(node);
+	if (count <= 1) {
+		return index;
+	}
+
+	int axis = 0;
+	for (int i = 1; i < 3; i++) {
+		if (centroids.max[i] - centroids.min[i] > centroids.max[axis] - centroids.min[axis]) {
+			axis = i;
+		}
+	}
+	auto extent = centroids.max[axis] - centroids.min[axis];
+
+	uint32_t split = first + count / 2;
+	if (extent > 0.0f) {
+		struct Bin {
+			Bounds bounds;
+			uint32_t count;
+		};
+		Bin bins[Bvh::NUM_BINS];
+		for (auto &bin : bins) {
+			emptyBounds(&bin.bounds);
+			bin.count = 0;
+		}
+
+		auto scale = Bvh::NUM_BINS / extent;
+		auto binOf = [&](uint32_t primitive) {
+			auto bin = (uint32_t)((centroid(&bounds[primitive], axis) - centroids.min[axis]) * scale);
+			return std::min(bin, Bvh::NUM_BINS - 1);
+		};
+		for (uint32_t i = first; i < first + count; i++) {
+			auto &bin = bins[binOf(primitives[i])];
+			growBounds(&bin.bounds, &bounds[primitives[i]]);
+			bin.count++;
+		}
+
+		// sweep from the right to get the cost of every plane between bins in one pass
+		float rightArea[Bvh::NUM_BINS];
+		uint32_t rightCount[Bvh::NUM_BINS];
+		Bounds right;
+		emptyBounds(&right);
+		uint32_t numRight = 0;
+		for (auto i = Bvh::NUM_BINS - 1; i > 0; i--) {
+			growBounds(&right, &bins[i].bounds);
+			numRight += bins[i].count;
+			rightArea[i] = surfaceArea(&right);
+			rightCount[i] = numRight;
+		}
+
+		Bounds left;
+		emptyBounds(&left);
+		uint32_t numLeft = 0;
+		auto bestCost = FLT_MAX;
+		uint32_t bestBin = 0;
+		for (uint32_t i = 1; i < Bvh::NUM_BINS; i++) {
+			growBounds(&left, &bins[i - 1].bounds);
+			numLeft += bins[i - 1].count;
+			if (numLeft == 0 || rightCount[i] == 0) {
+				continue;
+			}
+
+			auto cost = surfaceArea(&left) * numLeft + rightArea[i] * rightCount[i];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestBin = i;
+			}
+		}
+
+		// a split costs one more traversal step, measured against intersecting every primitive
+		auto leafCost = surfaceArea(&node.bounds) * count;
+		auto splitCost = surfaceArea(&node.bounds) + bestCost;
+		if (count <= Bvh::MAX_LEAF_SIZE && leafCost <= splitCost) {
+			return index;
+		}
+
+		if (bestBin > 0) {
+			auto middle = std::partition(
+				primitives + first, primitives + first + count,
+				[&](uint32_t primitive) { return binOf(primitive) < bestBin; }
+			);
+			split = (uint32_t)(middle - primitives);
+		}
+	} else if (count <= Bvh::MAX_LEAF_SIZE) {
+		return index;
+	}
+
+	// identical centroids leave nothing to bin, so fall back to splitting by count
+	if (split == first || split == first + count) {
+		split = first + count / 2;
+		std::nth_element(
+			primitives + first, primitives + split, primitives + first + count,
+			[&](uint32_t a, uint32_t b) {
+				return centroid(&bounds[a], axis) < centroid(&bounds[b], axis);
+			}
+		);
+	}
+
+	auto left = buildBinary(bounds, primitives, first, split - first, buildNodes);
+	auto right = buildBinary(bounds, primitives, split, first + count - split, buildNodes);
+	(*buildNodes)[index].left = left;
+	(*buildNodes)[index].right = right;
+	return index;
+}
+
+static void setChildBounds(Bvh::Node *node, int slot, const Bounds *bounds) {
+	node->minX[slot] = bounds->min[0];
+	node->minY[slot] = bounds->min[1];
+	node->minZ[slot] = bounds->min[2];
+	node->maxX[slot] = bounds->max[0];
+	node->maxY[slot] = bounds->max[1];
+	node->maxZ[slot] = bounds->max[2];
+}
+
+static void getChildBounds(const Bvh::Node *node, int slot, Bounds *bounds) {
+	bounds->min[0] = node->minX[slot];
+	bounds->min[1] = node->minY[slot];
+	bounds->min[2] = node->minZ[slot];
+	bounds->max[0] = node->maxX[slot];
+	bounds->max[1] = node->maxY[slot];
+	bounds->max[2] = node->maxZ[slot];
+}
+
+// Collapses a binary node and up to its grandchildren into one 4-wide node, always opening the
+// child with the largest surface area. Binned SAH does not bound the depth of the tree, so the
+// deepest level reached is recorded for traversal.
+static uint32_t collapse(
+	const std::vector<BuildNode> *buildNodes, uint32_t buildIndex, uint32_t level,
+	std::vector<Bvh::Node> *nodes, uint32_t *depth
+) {
+	*depth = std::max(*depth, level);
+
+	auto index = (uint32_t)nodes->size();
+	nodes->emplace_back();
+
+	uint32_t children[4];
+	int numChildren = 0;
+	auto &root = (*buildNodes)[buildIndex];
+	if (root.left == Bvh::EMPTY) {
+		children[numChildren++] = buildIndex;
+	} else {
+		children[numChildren++] = root.left;
+		children[numChildren++] = root.right;
+	}
+
+	while (numChildren < 4) {
+		int best = -1;
+		float bestArea = -1.0f;
+		for (int i = 0; i < numChildren; i++) {
+			auto &child = (*buildNodes)[children[i]];
+			auto area = surfaceArea(&child.bounds);
+			if (child.left != Bvh::EMPTY && area > bestArea) {
+				best = i;
+				bestArea = area;
+			}
+		}
+		if (best < 0) {
+			break;
+		}
+
+		auto &opened = (*buildNodes)[children[best]];
+		children[best] = opened.left;
+		children[numChildren++] = opened.right;
+	}
+
+	Bvh::Node node = {};
+	Bounds empty;
+	emptyBounds(&empty);
+	for (int slot = 0; slot < 4; slot++) {
+		if (slot >= numChildren) {
+			setChildBounds(&node, slot, &empty);
+			node.children[slot] = Bvh::EMPTY;
+			node.counts[slot] = 0;
+			continue;
+		}
+
+		auto &child = (*buildNodes)[children[slot]];
+		setChildBounds(&node, slot, &child.bounds);
+		if (child.left == Bvh::EMPTY) {
+			node.children[slot] = child.first;
+			node.counts[slot] = child.count;
+		} else {
+			node.children[slot] = collapse(buildNodes, children[slot], level + 1, nodes, depth);
+			node.counts[slot] = 0;
+		}
+	}
+
+	(*nodes)[index] = node;
+	return index;
+}
+
+void Bvh::create(const Bounds *bounds, uint32_t count, Bvh *bvh) {
+	*bvh = Bvh();
+	bvh->bounds.assign(bounds, bounds + count);
+	bvh->primitives.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		bvh->primitives[i] = i;
+	}
+	if (count == 0) {
+		return;
+	}
+
+	std::vector<BuildNode> buildNodes;
+	buildNodes.reserve(2 * count);
+	buildBinary(bounds, bvh->primitives.data(), 0, count, &buildNodes);
+	collapse(&buildNodes, 0, 1, &bvh->nodes, &bvh->depth);
+}
+
+// Each level pops one node and pushes at most four, and the deepest level pushes none.
+uint32_t Bvh::getStackSize() const {
+	return this->depth == 0 ? 0 : 3 * (this->depth - 1) + 1;
+}
+
+void Bvh::refit(const Bounds *bounds) {
+	this->bounds.assign(bounds, bounds + this->bounds.size());
+
+	for (auto i = this->nodes.size(); i-- > 0; ) {
+		auto &node = this->nodes[i];
+		for (int slot = 0; slot < 4; slot++) {
+			if (node.children[slot] == Bvh::EMPTY) {
+				continue;
+			}
+
+			Bounds b;
+			emptyBounds(&b);
+			if (node.counts[slot] > 0) {
+				auto first = node.children[slot];
+				for (auto p = first; p < first + node.counts[slot]; p++) {
+					growBounds(&b, &bounds[this->primitives[p]]);
+				}
+			} else {
+				auto &child = this->nodes[node.children[slot]];
+				for (int c = 0; c < 4; c++) {
+					if (child.children[c] == Bvh::EMPTY) {
+						continue;
+					}
+
+					Bounds cb;
+					getChildBounds(&child, c, &cb);
+					growBounds(&b, &cb);
+				}
+			}
+			setChildBounds(&node, slot, &b);
+		}
+	}
+}
+
+static bool isOutside(const Frustum *frustum, const Bounds *bounds) {
+	for (auto &plane : frustum->planes) {
+		auto distance = plane[3];
+		for (int i = 0; i < 3; i++) {
+			distance += std::max(plane[i] * bounds->min[i], plane[i] * bounds->max[i]);
+		}
+		if (distance < 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns a bit per child whose bounds are at least partly inside the frustum. The farthest
+// corner along each plane's normal is found with a max, which avoids branching on its sign.
+static int testFrustum(const Frustum *frustum, const Bvh::Node *node) {
+#if defined(SIMD_SSE)
+	auto minX = _mm_loadu_ps(node->minX);
+	auto minY = _mm_loadu_ps(node->minY);
+	auto minZ = _mm_loadu_ps(node->minZ);
+	auto maxX = _mm_loadu_ps(node->maxX);
+	auto maxY = _mm_loadu_ps(node->maxY);
+	auto maxZ = _mm_loadu_ps(node->maxZ);
+
+	auto outside = _mm_setzero_ps();
+	for (auto &plane : frustum->planes) {
+		auto a = _mm_set1_ps(plane[0]);
+		auto b = _mm_set1_ps(plane[1]);
+		auto c = _mm_set1_ps(plane[2]);
+		auto distance = _mm_add_ps(
+			_mm_add_ps(
+				_mm_max_ps(_mm_mul_ps(a, minX), _mm_mul_ps(a, maxX)),
+				_mm_max_ps(_mm_mul_ps(b, minY), _mm_mul_ps(b, maxY))
+			),
+			_mm_add_ps(
+				_mm_max_ps(_mm_mul_ps(c, minZ), _mm_mul_ps(c, maxZ)),
+				_mm_set1_ps(plane[3])
+			)
+		);
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+	}
+	return ~_mm_movemask_ps(outside) & 0xf;
+#else
+	int mask = 0;
+	for (int slot = 0; slot < 4; slot++) {
+		Bounds b;
+		getChildBounds(node, slot, &b);
+		if (!isOutside(frustum, &b)) {
+			mask |= 1 << slot;
+		}
+	}
+	return mask;
+#endif
+}
+
+void Bvh::cullFrustum(const Frustum *frustum, std::vector<uint32_t> *visible) const {
+	if (this->nodes.empty()) {
+		return;
+	}
+
+	uint32_t localStack[Bvh::LOCAL_STACK_SIZE];
+	std::vector<uint32_t> heapStack;
+	auto stack = localStack;
+	if (this->getStackSize() > Bvh::LOCAL_STACK_SIZE) {
+		heapStack.resize(this->getStackSize());
+		stack = heapStack.data();
+	}
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		auto &node = this->nodes[stack[--stackSize]];
+		auto mask = testFrustum(frustum, &node);
+		for (int slot = 0; slot < 4; slot++) {
+			if (!(mask & (1 << slot)) || node.children[slot] == Bvh::EMPTY) {
+				continue;
+			}
+
+			if (node.counts[slot] == 0) {
+				stack[stackSize++] = node.children[slot];
+				continue;
+			}
+
+			auto first = node.children[slot];
+			for (auto p = first; p < first + node.counts[slot]; p++) {
+				auto primitive = this->primitives[p];
+				if (!isOutside(frustum, &this->bounds[primitive])) {
+					visible->push_back(primitive);
+				}
+			}
+		}
+	}
+}
+
+static bool intersectBounds(
+	const Bounds *bounds, const float *origin, const float *inverse, float maxT, float *t
+) {
+	auto tmin = 0.0f;
+	auto tmax = maxT;
+	for (int i = 0; i < 3; i++) {
+		auto t0 = (bounds->min[i] - origin[i]) * inverse[i];
+		auto t1 = (bounds->max[i] - origin[i]) * inverse[i];
+		tmin = std::max(tmin, std::min(t0, t1));
+		tmax = std::min(tmax, std::max(t0, t1));
+	}
+	*t = tmin;
+	return tmin <= tmax;
+}
+
+bool Bvh::intersectRay(
+	const float *origin, const float *direction, float maxT, uint32_t *primitive, float *t
+) const {
+	if (this->nodes.empty()) {
+		return false;
+	}
+
+	// axis aligned rays divide by zero, which the slab test tolerates as long as it is not 0 * inf
+	float inverse[3];
+	for (int i = 0; i < 3; i++) {
+		inverse[i] = direction[i] != 0.0f ? 1.0f / direction[i] : FLT_MAX;
+	}
+
+	auto closest = maxT;
+	auto hit = Bvh::EMPTY;
+
+	uint32_t localStack[Bvh::LOCAL_STACK_SIZE];
+	std::vector<uint32_t> heapStack;
+	auto stack = localStack;
+	if (this->getStackSize() > Bvh::LOCAL_STACK_SIZE) {
+		heapStack.resize(this->getStackSize());
+		stack = heapStack.data();
+	}
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		auto &node = this->nodes[stack[--stackSize]];
+
+		int mask = 0;
+#if defined(SIMD_SSE)
+		auto tmin = _mm_setzero_ps();
+		auto tmax = _mm_set1_ps(closest);
+		const float *mins[] = { node.minX, node.minY, node.minZ };
+		const float *maxs[] = { node.maxX, node.maxY, node.maxZ };
+		for (int i = 0; i < 3; i++) {
+			auto o = _mm_set1_ps(origin[i]);
+			auto inv = _mm_set1_ps(inverse[i]);
+			auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(mins[i]), o), inv);
+			auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(maxs[i]), o), inv);
+			tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+			tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+		}
+		mask = _mm_movemask_ps(_mm_cmple_ps(tmin, tmax));
+#else
+		for (int slot = 0; slot < 4; slot++) {
+			Bounds b;
+			getChildBounds(&node, slot, &b);
+			float tb;
+			if (intersectBounds(&b, origin, inverse, closest, &tb)) {
+				mask |= 1 << slot;
+			}
+		}
+#endif
+
+		for (int slot = 0; slot < 4; slot++) {
+			if (!(mask & (1 << slot)) || node.children[slot] == Bvh::EMPTY) {
+				continue;
+			}
+
+			if (node.counts[slot] == 0) {
+				stack[stackSize++] = node.children[slot];
+				continue;
+			}
+
+			auto first = node.children[slot];
+			for (auto p = first; p < first + node.counts[slot]; p++) {
+				float tp;
+				auto candidate = this->primitives[p];
+				if (intersectBounds(&this->bounds[candidate], origin, inverse, closest, &tp)) {
+					closest = tp;
+					hit = candidate;
+				}
+			}
+		}
+	}
+
+	if (hit == Bvh::EMPTY) {
+		return false;
+	}
+
+	*primitive = hit;
+	*t = closest;
+	return true;
+}
+
+void extractFrustum(const float *viewProj, Frustum *frustum) {
+	auto row = [&](int r, int c) { return viewProj[4 * r + c]; };
+	for (int c = 0; c < 4; c++) {
+		frustum->planes[0][c] = row(3, c) + row(0, c);
+		frustum->planes[1][c] = row(3, c) - row(0, c);
+		frustum->planes[2][c] = row(3, c) + row(1, c);
+		frustum->planes[3][c] = row(3, c) - row(1, c);
+		frustum->planes[4][c] = row(2, c);
+		frustum->planes[5][c] = row(3, c) - row(2, c);
+	}
+}
+
+void transformBounds(const float *matrix, const Bounds *local, Bounds *world) {
+	for (int r = 0; r < 3; r++) {
+		auto m = &matrix[4 * r];
+		world->min[r] = m[3];
+		world->max[r] = m[3];
+		for (int c = 0; c < 3; c++) {
+			auto a = m[c] * local->min[c];
+			auto b = m[c] * local->max[c];
+			world->min[r] += std::min(a, b);
+			world->max[r] += std::max(a, b);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct Bounds {
+	float min[3];
+	float max[3];
+};
+
+// Planes are (a, b, c, d) with a * x + b * y + c * z + d >= 0 on the inside.
+struct Frustum {
+	float planes[6][4];
+};
+
+// Matrices are row major and transform column vectors, the same layout the vertex shader reads.
+void extractFrustum(const float *viewProj, Frustum *frustum);
+void transformBounds(const float *matrix, const Bounds *local, Bounds *world);
+
+// A bounding volume hierarchy over primitive bounds, built with binned SAH and stored as 4-wide
+// nodes with their children's bounds in SoA layout, so that traversal tests all four at once.
+// Nodes are in depth first order, which lets refit walk them backwards to update children
+// before their parents.
+struct Bvh {
+	static const uint32_t EMPTY = UINT32_MAX;
+	static const uint32_t MAX_LEAF_SIZE = 4;
+	static const uint32_t NUM_BINS = 16;
+
+	// traversal keeps its stack in a local array unless the tree is too deep for it
+	static const uint32_t LOCAL_STACK_SIZE = 256;
+
+	struct Node {
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+
+		// an inner child is a node index with a count of 0, and a leaf is a range of primitives
+		uint32_t children[4];
+		uint32_t counts[4];
+	};
+
+	std::vector<Node> nodes;
+	std::vector<uint32_t> primitives;
+	std::vector<Bounds> bounds;
+
+	// levels of 4-wide nodes, which bounds how many a traversal can have pending
+	uint32_t depth = 0;
+
+	static void create(const Bounds *bounds, uint32_t count, Bvh *bvh);
+
+	void refit(const Bounds *bounds);
+	uint32_t getStackSize() const;
+
+	void cullFrustum(const Frustum *frustum, std::vector<uint32_t> *visible) const;
+	bool intersectRay(
+		const float *origin, const float *direction, float maxT, uint32_t *primitive, float *t
+	) const;
+};
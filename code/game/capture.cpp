@@ -0,0 +1,327 @@
+#include "capture.h"
+#include "accounting.h"
+#include <cstring>
+
+template <typename T>
+static void append(std::vector<uint8_t> *stream, const T *value) {
+	auto bytes = (const uint8_t*)value;
+	stream->insert(stream->end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static bool read(const uint8_t *data, size_t size, size_t *offset, T *value) {
+	if (size - *offset < sizeof(T)) {
+		return false;
+	}
+	memcpy(value, data + *offset, sizeof(T));
+	*offset += sizeof(T);
+	return true;
+}
+
+void CommandCapture::create(uint32_t maxFrames, CommandCapture *capture) {
+	capture->maxFrames = maxFrames;
+
+	CaptureHeader header = { CommandCapture::MAGIC, CommandCapture::VERSION, 0 };
+	append(&capture->stream, &header);
+}
+
+bool CommandCapture::isComplete() const {
+	return this->numFrames >= this->maxFrames;
+}
+
+void CommandCapture::beginFrame() {
+	this->recording = !this->isComplete();
+	this->commands.clear();
+	this->numCommands = 0;
+}
+
+void CommandCapture::endFrame() {
+	if (!this->recording) {
+		this->uploads.clear();
+		return;
+	}
+	this->recording = false;
+
+	MemoryScope scope(MEMORY_CAPTURE);
+
+	CaptureFrameHeader header = { (uint32_t)this->uploads.size(), this->numCommands, 0, 0 };
+	for (auto &upload : this->uploads) {
+		header.uploadBytes += sizeof(CaptureUploadHeader) + upload.size;
+	}
+	header.commandBytes = this->commands.size();
+	append(&this->stream, &header);
+
+	for (auto &upload : this->uploads) {
+		CaptureUploadHeader uploadHeader = { upload.address, upload.size };
+		append(&this->stream, &uploadHeader);
+		auto data = (const uint8_t*)upload.data;
+		this->stream.insert(this->stream.end(), data, data + upload.size);
+	}
+	this->stream.insert(this->stream.end(), this->commands.begin(), this->commands.end());
+	this->uploads.clear();
+
+	this->numFrames++;
+	auto streamHeader = (CaptureHeader*)this->stream.data();
+	streamHeader->numFrames = this->numFrames;
+}
+
+void CommandCapture::addUpload(uint64_t address, uint64_t size, const void *data) {
+	// uploads are allocated before the frame's commands begin
+	if (this->isComplete()) {
+		return;
+	}
+
+	MemoryScope scope(MEMORY_CAPTURE);
+	PendingUpload upload = { address, size, data };
+	this->uploads.push_back(upload);
+}
+
+void CommandCapture::setRootSignature(uint32_t id) {
+	this->write(CAPTURE_SET_ROOT_SIGNATURE, &id, sizeof(id));
+}
+
+void CommandCapture::setPipeline(uint32_t id) {
+	this->write(CAPTURE_SET_PIPELINE, &id, sizeof(id));
+}
+
+#pragma pack(push, 4)
+struct CaptureRootBuffer {
+	uint32_t index;
+	uint64_t address;
+};
+
+struct CaptureBufferView {
+	uint64_t address;
+	uint32_t size;
+	uint32_t strideOrFormat;
+};
+
+struct CaptureVertexBuffer {
+	uint32_t slot;
+	uint64_t address;
+	uint32_t size;
+	uint32_t stride;
+};
+
+struct CaptureIndirect {
+	uint32_t signature;
+	uint32_t count;
+	uint64_t address;
+};
+#pragma pack(pop)
+
+void CommandCapture::setRootConstantBuffer(uint32_t index, uint64_t address) {
+	CaptureRootBuffer payload = { index, address };
+	this->write(CAPTURE_SET_ROOT_CBV, &payload, sizeof(payload));
+}
+
+void CommandCapture::setRootShaderResource(uint32_t index, uint64_t address) {
+	CaptureRootBuffer payload = { index, address };
+	this->write(CAPTURE_SET_ROOT_SRV, &payload, sizeof(payload));
+}
+
+void CommandCapture::setRootDescriptorTable(uint32_t index, uint64_t handle) {
+	CaptureRootBuffer payload = { index, handle };
+	this->write(CAPTURE_SET_ROOT_TABLE, &payload, sizeof(payload));
+}
+
+void CommandCapture::setVertexBuffer(
+	uint32_t slot, uint64_t address, uint32_t size, uint32_t stride
+) {
+	CaptureVertexBuffer payload = { slot, address, size, stride };
+	this->write(CAPTURE_SET_VERTEX_BUFFER, &payload, sizeof(payload));
+}
+
+void CommandCapture::setIndexBuffer(uint64_t address, uint32_t size, uint32_t format) {
+	CaptureBufferView payload = { address, size, format };
+	this->write(CAPTURE_SET_INDEX_BUFFER, &payload, sizeof(payload));
+}
+
+void CommandCapture::executeIndirect(uint32_t signature, uint32_t count, uint64_t address) {
+	CaptureIndirect payload = { signature, count, address };
+	this->write(CAPTURE_EXECUTE_INDIRECT, &payload, sizeof(payload));
+}
+
+void CommandCapture::addBarriers(const Barrier *barriers, size_t numBarriers) {
+	if (!this->recording) {
+		return;
+	}
+
+	MemoryScope scope(MEMORY_CAPTURE);
+	auto count = (uint32_t)numBarriers;
+	this->write(CAPTURE_BARRIERS, &count, sizeof(count));
+	for (size_t i = 0; i < numBarriers; i++) {
+		auto &barrier = barriers[i];
+		CaptureBarrier captured = {
+			this->getResource(barrier.resource), barrier.subresource,
+			barrier.before, barrier.after, (uint32_t)barrier.type
+		};
+		append(&this->commands, &captured);
+	}
+}
+
+void CommandCapture::write(CaptureOp op, const void *data, size_t size) {
+	if (!this->recording) {
+		return;
+	}
+
+	MemoryScope scope(MEMORY_CAPTURE);
+	this->commands.push_back(op);
+	auto bytes = (const uint8_t*)data;
+	this->commands.insert(this->commands.end(), bytes, bytes + size);
+	this->numCommands++;
+}
+
+uint32_t CommandCapture::getResource(void *resource) {
+	auto result = this->resources.emplace(resource, (uint32_t)this->resources.size());
+	return result.first->second;
+}
+
+bool CaptureReader::create(const void *data, size_t size, CaptureReader *reader) {
+	reader->data = (const uint8_t*)data;
+	reader->size = size;
+	reader->offset = 0;
+
+	CaptureHeader header;
+	if (
+		!read(reader->data, size, &reader->offset, &header) ||
+		header.magic != CommandCapture::MAGIC || header.version != CommandCapture::VERSION
+	) {
+		return false;
+	}
+
+	reader->numFrames = header.numFrames;
+	return true;
+}
+
+bool CaptureReader::nextFrame(CaptureFrame *frame) {
+	CaptureFrameHeader header;
+	if (!read(this->data, this->size, &this->offset, &header)) {
+		return false;
+	}
+	if (
+		header.uploadBytes > this->size - this->offset ||
+		header.commandBytes > this->size - this->offset - header.uploadBytes
+	) {
+		return false;
+	}
+
+	frame->uploads.clear();
+	auto uploadsEnd = this->offset + header.uploadBytes;
+	for (uint32_t i = 0; i < header.numUploads; i++) {
+		CaptureUploadHeader uploadHeader;
+		if (
+			!read(this->data, uploadsEnd, &this->offset, &uploadHeader) ||
+			uploadHeader.size > uploadsEnd - this->offset
+		) {
+			return false;
+		}
+
+		CaptureUpload upload = {
+			uploadHeader.address, uploadHeader.size, this->data + this->offset
+		};
+		frame->uploads.push_back(upload);
+		this->offset += uploadHeader.size;
+	}
+	if (this->offset != uploadsEnd) {
+		return false;
+	}
+
+	frame->numCommands = header.numCommands;
+	frame->commands = this->data + this->offset;
+	frame->commandBytes = header.commandBytes;
+	this->offset += header.commandBytes;
+	return true;
+}
+
+bool CaptureFrame::next(size_t *offset, CaptureCommand *command) const {
+	uint8_t op;
+	if (!read(this->commands, this->commandBytes, offset, &op) || op >= CAPTURE_OP_COUNT) {
+		return false;
+	}
+
+	*command = CaptureCommand();
+	command->op = (CaptureOp)op;
+	switch (command->op) {
+	case CAPTURE_SET_ROOT_SIGNATURE:
+	case CAPTURE_SET_PIPELINE:
+		return read(this->commands, this->commandBytes, offset, &command->id);
+
+	case CAPTURE_SET_ROOT_CBV:
+	case CAPTURE_SET_ROOT_SRV:
+	case CAPTURE_SET_ROOT_TABLE: {
+		CaptureRootBuffer payload;
+		if (!read(this->commands, this->commandBytes, offset, &payload)) {
+			return false;
+		}
+		command->index = payload.index;
+		command->address = payload.address;
+		return true;
+	}
+
+	case CAPTURE_SET_VERTEX_BUFFER: {
+		CaptureVertexBuffer payload;
+		if (!read(this->commands, this->commandBytes, offset, &payload)) {
+			return false;
+		}
+		command->index = payload.slot;
+		command->address = payload.address;
+		command->size = payload.size;
+		command->stride = payload.stride;
+		return true;
+	}
+
+	case CAPTURE_SET_INDEX_BUFFER: {
+		CaptureBufferView payload;
+		if (!read(this->commands, this->commandBytes, offset, &payload)) {
+			return false;
+		}
+		command->address = payload.address;
+		command->size = payload.size;
+		command->stride = payload.strideOrFormat;
+		return true;
+	}
+
+	case CAPTURE_EXECUTE_INDIRECT: {
+		CaptureIndirect payload;
+		if (!read(this->commands, this->commandBytes, offset, &payload)) {
+			return false;
+		}
+		command->id = payload.signature;
+		command->count = payload.count;
+		command->address = payload.address;
+		return true;
+	}
+
+	case CAPTURE_BARRIERS: {
+		if (!read(this->commands, this->commandBytes, offset, &command->count)) {
+			return false;
+		}
+		auto size = (size_t)command->count * sizeof(CaptureBarrier);
+		if (size > this->commandBytes - *offset) {
+			return false;
+		}
+		command->barriers = this->commands + *offset;
+		*offset += size;
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+CaptureBarrier CaptureCommand::getBarrier(uint32_t i) const {
+	CaptureBarrier barrier;
+	memcpy(&barrier, this->barriers + i * sizeof(CaptureBarrier), sizeof(barrier));
+	return barrier;
+}
+
+const CaptureUpload *CaptureFrame::findUpload(uint64_t address) const {
+	for (auto &upload : this->uploads) {
+		if (address >= upload.address && address - upload.address < upload.size) {
+			return &upload;
+		}
+	}
+	return NULL;
+}
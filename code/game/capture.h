@@ -0,0 +1,144 @@
+#pragma once
+#include "barrier.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// Pipelines, root signatures and command signatures are ids into the renderer's material table,
+// resources are numbered in the order they are first seen, and addresses are GPU virtual
+// addresses, which a replay maps onto its own uploads. Descriptor tables are recorded by handle,
+// but a replay binds its own, since descriptors are created at load time.
+enum CaptureOp : uint8_t {
+	CAPTURE_SET_ROOT_SIGNATURE,
+	CAPTURE_SET_PIPELINE,
+	CAPTURE_SET_ROOT_CBV,
+	CAPTURE_SET_ROOT_SRV,
+	CAPTURE_SET_VERTEX_BUFFER,
+	CAPTURE_SET_INDEX_BUFFER,
+	CAPTURE_EXECUTE_INDIRECT,
+	CAPTURE_BARRIERS,
+	CAPTURE_SET_ROOT_TABLE,
+	CAPTURE_OP_COUNT,
+};
+
+struct CaptureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numFrames;
+};
+
+struct CaptureFrameHeader {
+	uint32_t numUploads;
+	uint32_t numCommands;
+	uint64_t uploadBytes;
+	uint64_t commandBytes;
+};
+
+struct CaptureUploadHeader {
+	uint64_t address;
+	uint64_t size;
+};
+
+struct CaptureBarrier {
+	uint32_t resource;
+	uint32_t subresource;
+	uint32_t before;
+	uint32_t after;
+	uint32_t type;
+};
+
+// One decoded command. Which fields are used depends on the op: an id for root signatures,
+// pipelines and command signatures, a root parameter or vertex buffer slot index, a buffer address
+// with its size and stride or format, a descriptor handle, a draw count, or a run of barriers.
+struct CaptureCommand {
+	CaptureOp op;
+	uint32_t id;
+	uint32_t index;
+	uint32_t size;
+	uint32_t stride;
+	uint32_t count;
+	uint64_t address;
+
+	// packed, and so not necessarily aligned
+	const uint8_t *barriers;
+	CaptureBarrier getBarrier(uint32_t i) const;
+};
+
+struct CaptureUpload {
+	uint64_t address;
+	uint64_t size;
+	const uint8_t *data;
+};
+
+struct CaptureFrame {
+	std::vector<CaptureUpload> uploads;
+	uint32_t numCommands;
+	const uint8_t *commands;
+	size_t commandBytes;
+
+	bool next(size_t *offset, CaptureCommand *command) const;
+
+	// the upload that an address points into, or NULL
+	const CaptureUpload *findUpload(uint64_t address) const;
+};
+
+// Walks the frames of a capture that is already in memory.
+struct CaptureReader {
+	const uint8_t *data;
+	size_t size;
+	size_t offset;
+	uint32_t numFrames;
+
+	static bool create(const void *data, size_t size, CaptureReader *reader);
+
+	bool nextFrame(CaptureFrame *frame);
+};
+
+// Records the commands of a frame, and the upload memory they reference, into a compact binary
+// stream. Commands go to a per-frame buffer and the uploads are only copied once the frame is
+// done, since they are written after they are allocated, so each frame in the stream is its
+// uploads followed by its commands.
+struct CommandCapture {
+	static const uint32_t MAGIC = 'C' | 'A' << 8 | 'P' << 16 | 'T' << 24;
+	static const uint32_t VERSION = 2;
+
+	std::vector<uint8_t> stream;
+	std::vector<uint8_t> commands;
+	uint32_t numCommands = 0;
+
+	struct PendingUpload {
+		uint64_t address;
+		uint64_t size;
+		const void *data;
+	};
+	std::vector<PendingUpload> uploads;
+
+	std::unordered_map<void*, uint32_t> resources;
+
+	uint32_t maxFrames;
+	uint32_t numFrames = 0;
+	bool recording = false;
+
+	static void create(uint32_t maxFrames, CommandCapture *capture);
+
+	bool isComplete() const;
+
+	void beginFrame();
+	void endFrame();
+
+	void addUpload(uint64_t address, uint64_t size, const void *data);
+
+	void setRootSignature(uint32_t id);
+	void setPipeline(uint32_t id);
+	void setRootConstantBuffer(uint32_t index, uint64_t address);
+	void setRootShaderResource(uint32_t index, uint64_t address);
+	void setRootDescriptorTable(uint32_t index, uint64_t handle);
+	void setVertexBuffer(uint32_t slot, uint64_t address, uint32_t size, uint32_t stride);
+	void setIndexBuffer(uint64_t address, uint32_t size, uint32_t format);
+	void executeIndirect(uint32_t signature, uint32_t count, uint64_t address);
+	void addBarriers(const Barrier *barriers, size_t numBarriers);
+
+	void write(CaptureOp op, const void *data, size_t size);
+	uint32_t getResource(void *resource);
+};
@@ -1,4 +1,6 @@
 #include "context.h"
+#include "arena.h"
+#include "mesh.h"
 #include "util.h"
 #include <dxgi1_5.h>
 
@@ -33,6 +35,21 @@ HRESULT Context::create(HWND hWnd, UINT width, UINT height, Context *context) {
 
 	TRY(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&context->device)));
 
+	TRY(ResidencyManager::create(context->device.Get(), adapter.Get(), &context->residency));
+	TRY(GpuAllocator::create(context->device.Get(), &context->residency, &context->allocator));
+	TRY(GeometryArena::create(
+		&context->allocator, VERTEX_STREAM_STRIDES, VERTEX_STREAM_COUNT,
+		Context::GEOMETRY_VERTEX_COUNT, Context::GEOMETRY_INDEX_COUNT,
+		&context->geometry
+	));
+	auto geometryState =
+		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER;
+	for (UINT i = 0; i < context->geometry.numVertexStreams; i++) {
+		context->states.track(context->geometry.vertexBuffers[i].Get(), 1, geometryState);
+	}
+	context->states.track(context->geometry.indexBuffer.Get(), 1, geometryState);
+	TRY(UploadRing::create(&context->allocator, Context::UPLOAD_RING_SIZE, &context->uploads));
+
 	D3D12_COMMAND_QUEUE_DESC cqd = {};
 	cqd.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
 	TRY(context->device->CreateCommandQueue(&cqd, IID_PPV_ARGS(&context->commandQueue)));
@@ -57,12 +74,13 @@ HRESULT Context::create(HWND hWnd, UINT width, UINT height, Context *context) {
 		context->rtvDescriptorSize = context->device->GetDescriptorHandleIncrementSize(dhd.Type);
 	}
 
-	{
-		D3D12_DESCRIPTOR_HEAP_DESC dhd = {};
-		dhd.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
-		dhd.NumDescriptors = 1;
-		TRY(context->device->CreateDescriptorHeap(&dhd, IID_PPV_ARGS(&context->dsvHeap)));
-	}
+	TRY(TransientHeap::create(context->device.Get(), &context->transients));
+
+	TRY(DescriptorHeap::create(
+		context->device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+		Context::PERSISTENT_DESCRIPTOR_COUNT, Context::TRANSIENT_DESCRIPTOR_COUNT,
+		&context->cbvSrvUavHeap
+	));
 
 	TRY(context->device->CreateFence(
 		context->fenceValues[0], D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&context->fence))
@@ -142,6 +160,7 @@ HRESULT chooseAdapter(IDXGIFactory5 *factory, IDXGIAdapter3 **result) {
 HRESULT Context::resize(UINT width, UINT height) {
 	this->waitForGpu();
 	for (int i = 0; i < Context::BUFFER_COUNT; i++) {
+		this->states.untrack(this->renderTargets[i].Get());
 		this->renderTargets[i].Reset();
 		this->fenceValues[i] = this->fenceValues[this->frameIndex];
 	}
@@ -157,9 +176,13 @@ HRESULT Context::resize(UINT width, UINT height) {
 }
 
 HRESULT getRenderTargets(Context *context, UINT width, UINT height) {
+	context->width = width;
+	context->height = height;
+
 	auto rtv = context->rtvHeap->GetCPUDescriptorHandleForHeapStart();
 	for (UINT i = 0; i < Context::BUFFER_COUNT; i++) {
 		TRY(context->swapChain->GetBuffer(i, IID_PPV_ARGS(&context->renderTargets[i])));
+		context->states.track(context->renderTargets[i].Get(), 1, D3D12_RESOURCE_STATE_PRESENT);
 
 		D3D12_RENDER_TARGET_VIEW_DESC rtvd = {};
 		rtvd.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
@@ -169,62 +192,85 @@ HRESULT getRenderTargets(Context *context, UINT width, UINT height) {
 		rtv.ptr += context->rtvDescriptorSize;
 	}
 
-	D3D12_HEAP_PROPERTIES hp = {};
-	hp.Type = D3D12_HEAP_TYPE_DEFAULT;
-
-	D3D12_RESOURCE_DESC rd = {};
-	rd.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	rd.Width = width;
-	rd.Height = height;
-	rd.DepthOrArraySize = 1;
-	rd.MipLevels = 1;
-	rd.Format = DXGI_FORMAT_D32_FLOAT;
-	rd.SampleDesc.Count = 1;
-	rd.Flags = D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-	rd.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-
-	D3D12_CLEAR_VALUE dscv = {};
-	dscv.Format = DXGI_FORMAT_D32_FLOAT;
-	dscv.DepthStencil.Depth = 1.0f;
-
-	TRY(context->device->CreateCommittedResource(
-		&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_DEPTH_WRITE, &dscv,
-		IID_PPV_ARGS(&context->depthStencil)
-	));
+	return S_OK;
+}
+
+void Context::transition(ID3D12Resource *resource, D3D12_RESOURCE_STATES after) {
+	this->states.transition(resource, ALL_SUBRESOURCES, after);
+}
+
+void Context::flushBarriers(ID3D12GraphicsCommandList *commandList) {
+	if (!this->states.flush(&this->barriers)) {
+		return;
+	}
 
-	auto dsv = context->dsvHeap->GetCPUDescriptorHandleForHeapStart();
-	D3D12_DEPTH_STENCIL_VIEW_DESC dsvd = {};
-	dsvd.Format = DXGI_FORMAT_D32_FLOAT;
-	dsvd.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-	context->device->CreateDepthStencilView(context->depthStencil.Get(), &dsvd, dsv);
+	this->resourceBarriers.resize(this->barriers.size());
+	for (size_t i = 0; i < this->barriers.size(); i++) {
+		auto &barrier = this->barriers[i];
 
-	return S_OK;
+		D3D12_RESOURCE_BARRIER rb = {};
+		if (barrier.type == BARRIER_ALIASING) {
+			rb.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+			rb.Aliasing.pResourceBefore = NULL;
+			rb.Aliasing.pResourceAfter = (ID3D12Resource*)barrier.resource;
+			this->resourceBarriers[i] = rb;
+			continue;
+		}
+
+		rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		if (barrier.type == BARRIER_BEGIN) {
+			rb.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+		} else if (barrier.type == BARRIER_END) {
+			rb.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+		}
+		rb.Transition.pResource = (ID3D12Resource*)barrier.resource;
+		rb.Transition.Subresource = barrier.subresource;
+		rb.Transition.StateBefore = (D3D12_RESOURCE_STATES)barrier.before;
+		rb.Transition.StateAfter = (D3D12_RESOURCE_STATES)barrier.after;
+		this->resourceBarriers[i] = rb;
+	}
+
+	commandList->ResourceBarrier((UINT)this->resourceBarriers.size(), this->resourceBarriers.data());
+	if (this->capture) {
+		this->capture->addBarriers(this->barriers.data(), this->barriers.size());
+	}
 }
 
 HRESULT Context::prepare() {
 	TRY(this->commandAllocators[this->frameIndex]->Reset());
 	TRY(this->commandList->Reset(this->commandAllocators[this->frameIndex].Get(), NULL));
 
-	D3D12_RESOURCE_BARRIER rb = {};
-	rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	rb.Transition.pResource = this->renderTargets[this->frameIndex].Get();
-	rb.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-	rb.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	this->commandList->ResourceBarrier(1, &rb);
+	if (this->capture) {
+		this->capture->beginFrame();
+	}
+
+	this->residency.beginFrame(this->fenceValues[this->frameIndex]);
+	for (UINT i = 0; i < this->geometry.numVertexStreams; i++) {
+		this->allocator.use(&this->geometry.vertexAllocations[i]);
+	}
+	this->allocator.use(&this->geometry.indexAllocation);
+
+	this->transition(this->renderTargets[this->frameIndex].Get(), D3D12_RESOURCE_STATE_RENDER_TARGET);
+	this->flushBarriers(this->commandList.Get());
+
+	this->cbvSrvUavHeap.commit(this->device.Get());
+	ID3D12DescriptorHeap *const heaps[] = { this->cbvSrvUavHeap.heap.Get() };
+	this->commandList->SetDescriptorHeaps(1, heaps);
 
 	return S_OK;
 }
 
 HRESULT Context::present() {
-	D3D12_RESOURCE_BARRIER rb = {};
-	rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	rb.Transition.pResource = this->renderTargets[this->frameIndex].Get();
-	rb.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	rb.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-	this->commandList->ResourceBarrier(1, &rb);
+	this->transition(this->renderTargets[this->frameIndex].Get(), D3D12_RESOURCE_STATE_PRESENT);
+	this->flushBarriers(this->commandList.Get());
+	if (this->capture) {
+		this->capture->endFrame();
+	}
 
 	TRY(this->commandList->Close());
 
+	TRY(this->residency.apply(this->fence->GetCompletedValue()));
+
 	ID3D12CommandList *const commandLists[] = { this->commandList.Get() };
 	this->commandQueue->ExecuteCommandLists(1, commandLists);
 
@@ -232,6 +278,9 @@ HRESULT Context::present() {
 
 	auto currentFenceValue = this->fenceValues[this->frameIndex];
 	TRY(this->commandQueue->Signal(this->fence.Get(), currentFenceValue));
+	this->cbvSrvUavHeap.finishFrame(currentFenceValue);
+	this->geometry.finishFrame(currentFenceValue);
+	this->uploads.finishFrame(currentFenceValue);
 
 	this->frameIndex = this->swapChain->GetCurrentBackBufferIndex();
 	auto nextFenceValue = this->fenceValues[this->frameIndex];
@@ -241,6 +290,14 @@ HRESULT Context::present() {
 	}
 	this->fenceValues[this->frameIndex] = currentFenceValue + 1;
 
+	auto completedFenceValue = this->fence->GetCompletedValue();
+	this->cbvSrvUavHeap.retire(completedFenceValue);
+	this->geometry.retire(completedFenceValue);
+	this->uploads.retire(completedFenceValue);
+
+	// the command list is closed, so nothing from this frame's arenas is needed anymore
+	FrameArena::resetAll();
+
 	return S_OK;
 }
 
@@ -1,20 +1,48 @@
+#pragma once
+#include "barrier.h"
+#include "budget.h"
+#include "capture.h"
+#include "descriptor.h"
+#include "allocator.h"
+#include "geometry.h"
+#include "transient.h"
+#include "upload.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <d3d12.h>
 #include <dxgi1_5.h>
 #include <wrl/client.h>
+#include <vector>
 
 struct Context {
 	static const size_t BUFFER_COUNT = 2;
+	static const UINT PERSISTENT_DESCRIPTOR_COUNT = 16384;
+	static const UINT TRANSIENT_DESCRIPTOR_COUNT = 16384;
+	static const UINT GEOMETRY_VERTEX_COUNT = 1024 * 1024;
+	static const UINT GEOMETRY_INDEX_COUNT = 4 * 1024 * 1024;
+	static const UINT64 UPLOAD_RING_SIZE = 4 * 1024 * 1024;
 	size_t frameIndex = 0;
+	UINT width;
+	UINT height;
 
 	Microsoft::WRL::ComPtr<ID3D12Device1> device;
 	Microsoft::WRL::ComPtr<ID3D12CommandQueue> commandQueue;
 	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> commandAllocators[BUFFER_COUNT];
 	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
 
+	ResidencyManager residency;
+
+	StateTracker states;
+	std::vector<Barrier> barriers;
+	std::vector<D3D12_RESOURCE_BARRIER> resourceBarriers;
+
+	GpuAllocator allocator;
+	GeometryArena geometry;
+	UploadRing uploads;
+
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> rtvHeap;
 	UINT rtvDescriptorSize;
-	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> dsvHeap;
+	DescriptorHeap cbvSrvUavHeap;
 
 	Microsoft::WRL::ComPtr<ID3D12Fence> fence;
 	UINT64 fenceValues[BUFFER_COUNT] = {};
@@ -22,11 +50,17 @@ struct Context {
 
 	Microsoft::WRL::ComPtr<IDXGISwapChain4> swapChain;
 	Microsoft::WRL::ComPtr<ID3D12Resource> renderTargets[BUFFER_COUNT];
-	Microsoft::WRL::ComPtr<ID3D12Resource> depthStencil;
+	TransientHeap transients;
+
+	// when set, records everything between prepare and present
+	CommandCapture *capture = NULL;
 
 	static HRESULT create(HWND hWnd, UINT width, UINT height, Context *context);
 	HRESULT resize(UINT width, UINT height);
 
+	void transition(ID3D12Resource *resource, D3D12_RESOURCE_STATES after);
+	void flushBarriers(ID3D12GraphicsCommandList *commandList);
+
 	HRESULT prepare();
 	HRESULT present();
 
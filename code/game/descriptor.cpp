@@ -0,0 +1,112 @@
+#include "descriptor.h"
+#include "util.h"
+
+HRESULT DescriptorHeap::create(
+	ID3D12Device *device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+	UINT numPersistent, UINT numTransient,
+	DescriptorHeap *heap
+) {
+	heap->type = type;
+	heap->descriptorSize = device->GetDescriptorHandleIncrementSize(type);
+	heap->numPersistent = numPersistent;
+
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC dhd = {};
+		dhd.Type = type;
+		dhd.NumDescriptors = numPersistent + numTransient;
+		dhd.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		TRY(device->CreateDescriptorHeap(&dhd, IID_PPV_ARGS(&heap->heap)));
+	}
+
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC dhd = {};
+		dhd.Type = type;
+		dhd.NumDescriptors = numPersistent;
+		TRY(device->CreateDescriptorHeap(&dhd, IID_PPV_ARGS(&heap->stagingHeap)));
+	}
+
+	RangeAllocator::create(numPersistent, &heap->persistent);
+	FrameRing::create(numTransient, &heap->transient);
+
+	return S_OK;
+}
+
+bool DescriptorHeap::allocate(UINT count, UINT *index) {
+	return this->persistent.allocate(count, 1, index);
+}
+
+void DescriptorHeap::free(UINT index, UINT count) {
+	this->persistent.freeDeferred(index, count);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorHeap::getStagingHandle(UINT index) {
+	auto handle = this->stagingHeap->GetCPUDescriptorHandleForHeapStart();
+	handle.ptr += (SIZE_T)index * this->descriptorSize;
+	return handle;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorHeap::getGpuHandle(UINT index) {
+	auto handle = this->heap->GetGPUDescriptorHandleForHeapStart();
+	handle.ptr += (UINT64)index * this->descriptorSize;
+	return handle;
+}
+
+void DescriptorHeap::markDirty(UINT index, UINT count) {
+	this->dirtyRanges.push_back(RangeAllocator::Range { index, count });
+}
+
+void DescriptorHeap::commit(ID3D12Device *device) {
+	if (this->dirtyRanges.empty()) {
+		return;
+	}
+
+	// the persistent region has the same layout in both heaps, so each range is its own source
+	auto dest = this->heap->GetCPUDescriptorHandleForHeapStart();
+	this->copyDestStarts.clear();
+	this->copySourceStarts.clear();
+	this->copySizes.clear();
+	for (auto &range : this->dirtyRanges) {
+		auto start = dest;
+		start.ptr += (SIZE_T)range.offset * this->descriptorSize;
+		this->copyDestStarts.push_back(start);
+		this->copySourceStarts.push_back(this->getStagingHandle(range.offset));
+		this->copySizes.push_back(range.size);
+	}
+
+	device->CopyDescriptors(
+		(UINT)this->copyDestStarts.size(), this->copyDestStarts.data(), this->copySizes.data(),
+		(UINT)this->copySourceStarts.size(), this->copySourceStarts.data(), this->copySizes.data(),
+		this->type
+	);
+
+	this->dirtyRanges.clear();
+}
+
+bool DescriptorHeap::copyTransient(
+	ID3D12Device *device, UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE *sources,
+	D3D12_GPU_DESCRIPTOR_HANDLE *table
+) {
+	UINT64 offset;
+	if (!this->transient.allocate(count, 1, &offset)) {
+		return false;
+	}
+
+	auto index = this->numPersistent + (UINT)offset;
+	auto dest = this->heap->GetCPUDescriptorHandleForHeapStart();
+	dest.ptr += (SIZE_T)index * this->descriptorSize;
+
+	device->CopyDescriptors(1, &dest, &count, count, sources, NULL, this->type);
+
+	*table = this->getGpuHandle(index);
+	return true;
+}
+
+void DescriptorHeap::finishFrame(UINT64 fenceValue) {
+	this->transient.finishFrame(fenceValue);
+	this->persistent.finishFrame(fenceValue);
+}
+
+void DescriptorHeap::retire(UINT64 completedFenceValue) {
+	this->transient.retire(completedFenceValue);
+	this->persistent.retire(completedFenceValue);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "range.h"
+#include "ring.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+
+// A shader-visible heap split into a persistent region, filled from a CPU staging heap, and a
+// transient region that is reused once the frames that referenced it have retired. Persistent
+// descriptors that are freed are held back the same way, since frames in flight may still read
+// them.
+struct DescriptorHeap {
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> stagingHeap;
+	D3D12_DESCRIPTOR_HEAP_TYPE type;
+	UINT descriptorSize;
+
+	UINT numPersistent;
+	RangeAllocator persistent;
+	std::vector<RangeAllocator::Range> dirtyRanges;
+
+	FrameRing transient;
+
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> copyDestStarts;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> copySourceStarts;
+	std::vector<UINT> copySizes;
+
+	static HRESULT create(
+		ID3D12Device *device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+		UINT numPersistent, UINT numTransient,
+		DescriptorHeap *heap
+	);
+
+	bool allocate(UINT count, UINT *index);
+	void free(UINT index, UINT count);
+
+	D3D12_CPU_DESCRIPTOR_HANDLE getStagingHandle(UINT index);
+	D3D12_GPU_DESCRIPTOR_HANDLE getGpuHandle(UINT index);
+	void markDirty(UINT index, UINT count);
+	void commit(ID3D12Device *device);
+
+	bool copyTransient(
+		ID3D12Device *device, UINT count, const D3D12_CPU_DESCRIPTOR_HANDLE *sources,
+		D3D12_GPU_DESCRIPTOR_HANDLE *table
+	);
+
+	void finishFrame(UINT64 fenceValue);
+	void retire(UINT64 completedFenceValue);
+};
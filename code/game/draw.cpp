@@ -0,0 +1,173 @@
+#include "draw.h"
+#include <cstring>
+
+uint64_t makeSortKey(
+	uint32_t pass, uint32_t rootSignature, uint32_t pipeline, uint32_t mesh, float depth
+) {
+	const uint32_t depthMax = (1U << SORT_KEY_DEPTH_BITS) - 1;
+
+	// depth is expected in [0, 1]; near draws sort first to make the most of early z
+	uint32_t depthBits;
+	if (!(depth > 0.0f)) {
+		depthBits = 0;
+	} else if (depth >= 1.0f) {
+		depthBits = depthMax;
+	} else {
+		depthBits = (uint32_t)(depth * depthMax);
+	}
+
+	uint64_t key = pass & ((1U << SORT_KEY_PASS_BITS) - 1);
+	key = (key << SORT_KEY_ROOT_SIGNATURE_BITS) | (rootSignature & ((1U << SORT_KEY_ROOT_SIGNATURE_BITS) - 1));
+	key = (key << SORT_KEY_PIPELINE_BITS) | (pipeline & ((1U << SORT_KEY_PIPELINE_BITS) - 1));
+	key = (key << SORT_KEY_MESH_BITS) | (mesh & ((1U << SORT_KEY_MESH_BITS) - 1));
+	key = (key << SORT_KEY_DEPTH_BITS) | depthBits;
+	return key;
+}
+
+// The arena has been reset since the last frame, so the old storage can't be reused.
+template <typename T>
+static void restart(FrameVector<T> *vector) {
+	FrameVector<T>().swap(*vector);
+}
+
+void DrawQueue::clear() {
+	restart(&this->packets);
+	restart(&this->entries);
+	restart(&this->scratch);
+	restart(&this->batches);
+	restart(&this->objectIds);
+	restart(&this->numIndices);
+	restart(&this->startIndices);
+	restart(&this->baseVertices);
+}
+
+void DrawQueue::reserve(size_t numPackets) {
+	this->packets.reserve(numPackets);
+	this->entries.reserve(numPackets);
+}
+
+void DrawQueue::push(const DrawPacket *packet) {
+	SortEntry entry;
+	entry.key = makeSortKey(
+		packet->pass, packet->rootSignature, packet->pipeline, packet->mesh, packet->depth
+	);
+	entry.packet = (uint32_t)this->packets.size();
+
+	this->packets.push_back(*packet);
+	this->entries.push_back(entry);
+}
+
+void DrawQueue::sort() {
+	this->unsortedChanges = this->countStateChanges(false);
+
+	auto count = this->entries.size();
+	this->scratch.resize(count);
+
+	// least significant digit radix sort, one byte per pass, with all histograms built up front
+	size_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (auto &entry : this->entries) {
+		for (int digit = 0; digit < 8; digit++) {
+			histograms[digit][(entry.key >> (digit * 8)) & 0xff]++;
+		}
+	}
+
+	auto source = this->entries.data();
+	auto dest = this->scratch.data();
+	for (int digit = 0; digit < 8; digit++) {
+		auto &histogram = histograms[digit];
+
+		// every key has the same byte here, so this pass would not move anything
+		if (count == 0 || histogram[(source[0].key >> (digit * 8)) & 0xff] == count) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (auto &bucket : histogram) {
+			auto size = bucket;
+			bucket = offset;
+			offset += size;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			auto byte = (source[i].key >> (digit * 8)) & 0xff;
+			dest[histogram[byte]++] = source[i];
+		}
+
+		auto temp = source;
+		source = dest;
+		dest = temp;
+	}
+
+	if (source != this->entries.data()) {
+		this->entries.swap(this->scratch);
+	}
+
+	this->sortedChanges = this->countStateChanges(true);
+}
+
+void DrawQueue::build() {
+	auto count = this->entries.size();
+	this->batches.clear();
+	this->objectIds.resize(count);
+	this->numIndices.resize(count);
+	this->startIndices.resize(count);
+	this->baseVertices.resize(count);
+
+	DrawBatch *batch = NULL;
+	for (size_t i = 0; i < count; i++) {
+		auto &packet = this->packets[this->entries[i].packet];
+		this->objectIds[i] = packet.objectId;
+		this->numIndices[i] = packet.numIndices;
+		this->startIndices[i] = packet.startIndex;
+		this->baseVertices[i] = packet.baseVertex;
+
+		if (batch != NULL &&
+			batch->rootSignature == packet.rootSignature && batch->pipeline == packet.pipeline) {
+			batch->count++;
+			continue;
+		}
+
+		DrawBatch next = {};
+		next.rootSignature = packet.rootSignature;
+		next.pipeline = packet.pipeline;
+		next.setRootSignature = batch == NULL || batch->rootSignature != packet.rootSignature;
+		next.setPipeline = batch == NULL || batch->pipeline != packet.pipeline;
+		next.first = i;
+		next.count = 1;
+
+		this->batches.push_back(next);
+		batch = &this->batches.back();
+	}
+}
+
+IndirectDraws DrawQueue::getIndirectDraws(const DrawBatch *batch) const {
+	IndirectDraws draws = {};
+	draws.objectIds = this->objectIds.data() + batch->first;
+	draws.numIndices = this->numIndices.data() + batch->first;
+	draws.startIndices = this->startIndices.data() + batch->first;
+	draws.baseVertices = this->baseVertices.data() + batch->first;
+	draws.count = batch->count;
+	return draws;
+}
+
+DrawStateChanges DrawQueue::countStateChanges(bool sorted) const {
+	DrawStateChanges changes = {};
+
+	const DrawPacket *last = NULL;
+	for (size_t i = 0; i < this->entries.size(); i++) {
+		auto &packet = this->packets[sorted ? this->entries[i].packet : i];
+		if (last == NULL || last->rootSignature != packet.rootSignature) {
+			changes.rootSignatures++;
+		}
+		if (last == NULL || last->pipeline != packet.pipeline) {
+			changes.pipelines++;
+		}
+		if (last == NULL || last->mesh != packet.mesh) {
+			changes.meshes++;
+		}
+		last = &packet;
+	}
+
+	return changes;
+}
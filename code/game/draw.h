@@ -0,0 +1,77 @@
+#pragma once
+#include "arena.h"
+#include "indirect.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// From most to least significant: pass, root signature, pipeline, mesh, depth.
+static const uint32_t SORT_KEY_PASS_BITS = 4;
+static const uint32_t SORT_KEY_ROOT_SIGNATURE_BITS = 8;
+static const uint32_t SORT_KEY_PIPELINE_BITS = 12;
+static const uint32_t SORT_KEY_MESH_BITS = 16;
+static const uint32_t SORT_KEY_DEPTH_BITS = 24;
+
+uint64_t makeSortKey(
+	uint32_t pass, uint32_t rootSignature, uint32_t pipeline, uint32_t mesh, float depth
+);
+
+struct DrawPacket {
+	uint32_t pass;
+	uint32_t rootSignature;
+	uint32_t pipeline;
+	uint32_t mesh;
+	float depth;
+
+	uint32_t objectId;
+	uint32_t numIndices;
+	uint32_t startIndex;
+	int32_t baseVertex;
+};
+
+// A run of draws that share a pipeline and root signature, and so can be one ExecuteIndirect.
+struct DrawBatch {
+	uint32_t rootSignature;
+	uint32_t pipeline;
+	bool setRootSignature;
+	bool setPipeline;
+	size_t first;
+	size_t count;
+};
+
+struct DrawStateChanges {
+	uint32_t rootSignatures;
+	uint32_t pipelines;
+	uint32_t meshes;
+};
+
+// Rebuilt every frame out of the frame arena, so it is only valid until the frame is submitted.
+struct DrawQueue {
+	struct SortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	FrameVector<DrawPacket> packets;
+	FrameVector<SortEntry> entries;
+	FrameVector<SortEntry> scratch;
+
+	FrameVector<DrawBatch> batches;
+	FrameVector<uint32_t> objectIds;
+	FrameVector<uint32_t> numIndices;
+	FrameVector<uint32_t> startIndices;
+	FrameVector<int32_t> baseVertices;
+
+	DrawStateChanges unsortedChanges;
+	DrawStateChanges sortedChanges;
+
+	void clear();
+	void reserve(size_t numPackets);
+	void push(const DrawPacket *packet);
+
+	void sort();
+	void build();
+
+	IndirectDraws getIndirectDraws(const DrawBatch *batch) const;
+	DrawStateChanges countStateChanges(bool sorted) const;
+};
@@ -1,21 +1,29 @@
 #include "mesh.h"
+#include "archive.h"
+#include "animation.h"
 #include "material.h"
 #include "context.h"
+#include "hotreload.h"
+#include "renderer.h"
+#include "scene.h"
+#include "texture.h"
 #include "util.h"
 
 #define WIN32_LEAN_AND_MEAN
-#include <DirectXMath.h>
 #include <d3d12.h>
 #include <dxgi1_5.h>
 #include <wrl/client.h>
 #include <ShellScalingApi.h>
 #include <Windows.h>
+#include <shellapi.h>
 #include <vector>
+#include <thread>
 #include <iterator>
 #include <fstream>
+#include <algorithm>
+#include <cstdio>
 
 using Microsoft::WRL::ComPtr;
-using namespace DirectX;
 
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
@@ -27,6 +35,63 @@ struct App {
 	Context context;
 };
 
+// -capture path [frames] writes the commands of the first frames to a file, and -replay path
+// re-submits a capture instead of running the scene and reports how long each frame took to record.
+// -reload port reloads the assets that the asset builder in watch mode reports on that port.
+struct Options {
+	LPCWSTR capturePath = NULL;
+	UINT captureFrames = 300;
+	LPCWSTR replayPath = NULL;
+	UINT reloadPort = 0;
+};
+
+bool parseOptions(int argc, LPWSTR *argv, Options *options) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc) {
+			return false;
+		}
+
+		if (wcscmp(argv[i], L"-capture") == 0) {
+			options->capturePath = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != L'-') {
+				options->captureFrames = (UINT)_wtoi(argv[++i]);
+			}
+		} else if (wcscmp(argv[i], L"-replay") == 0) {
+			options->replayPath = argv[++i];
+		} else if (wcscmp(argv[i], L"-reload") == 0) {
+			options->reloadPort = (UINT)_wtoi(argv[++i]);
+			if (options->reloadPort == 0 || options->reloadPort > 0xffff) {
+				return false;
+			}
+		} else {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void reportReplay(std::vector<LONGLONG> *recordTicks) {
+	if (recordTicks->empty()) {
+		return;
+	}
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	auto toMicroseconds = [&](LONGLONG ticks) { return 1e6 * ticks / frequency.QuadPart; };
+
+	auto &ticks = *recordTicks;
+	std::sort(ticks.begin(), ticks.end());
+	char message[256];
+	snprintf(
+		message, sizeof(message),
+		"replay: recorded %zu frames, p50 %.1f us, p90 %.1f us, max %.1f us\n",
+		ticks.size(), toMicroseconds(ticks[ticks.size() / 2]),
+		toMicroseconds(ticks[ticks.size() * 9 / 10]), toMicroseconds(ticks.back())
+	);
+	OutputDebugStringA(message);
+}
+
 float clamp(float x) { if (x < 0.0) return 0.0; else if (x > 1.0) return 1.0; return x; }
 
 int WINAPI wWinMain(
@@ -34,6 +99,14 @@ int WINAPI wWinMain(
 ) {
 	App app_data, *app = &app_data;
 
+	Options options;
+	int argc;
+	auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	if (argv == NULL || !parseOptions(argc, argv, &options)) {
+		printWindowsError(E_INVALIDARG);
+		return 1;
+	}
+
 	WNDCLASSEX wc = {};
 	wc.cbSize = sizeof(wc);
 	wc.lpfnWndProc = WindowProc;
@@ -65,24 +138,52 @@ int WINAPI wWinMain(
 		return 1;
 	}
 
-	auto vertexBinary = readFile("data/vertex.cso");
-	auto pixelBinary = readFile("data/pixel.cso");
+	// every asset comes out of the one archive, which stays mapped while textures stream from it
+	const char *archivePath = "data/assets.pak";
+	Archive archive;
+	if (!Archive::open(archivePath, &archive)) {
+		printWindowsError(HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT));
+		return 1;
+	}
+
+	std::vector<char> vertexBinary;
+	std::vector<char> pixelBinary;
+	std::vector<char> meshData;
+	std::vector<char> walkData;
+	std::vector<char> idleData;
+	if (
+		FAILED(hr = readAsset(&archive, "vertex.cso", &vertexBinary)) ||
+		FAILED(hr = readAsset(&archive, "pixel.cso", &pixelBinary)) ||
+		FAILED(hr = readAsset(&archive, "human.mesh", &meshData)) ||
+		FAILED(hr = readAsset(&archive, "human.anim", &walkData)) ||
+		FAILED(hr = readAsset(&archive, "human-idle.anim", &idleData))
+	) {
+		printWindowsError(hr);
+		return 1;
+	}
 
 	Material material;
-	hr = Material::create(&app->context, &vertexBinary, &pixelBinary, &material);
+	hr = Material::create(
+		&app->context, VERTEX_INPUTS_ALL, &vertexBinary, &pixelBinary, &material
+	);
+	if (FAILED(hr)) {
+		printWindowsError(hr);
+		return 1;
+	}
+
+	size_t uploadSize;
+	hr = Mesh::getUploadSize(meshData.data(), meshData.size(), &uploadSize);
 	if (FAILED(hr)) {
 		printWindowsError(hr);
 		return 1;
 	}
 
 	ComPtr<ID3D12Resource> uploadHeap;
+	GpuAllocation uploadAllocation;
 	{
-		D3D12_HEAP_PROPERTIES hp = {};
-		hp.Type = D3D12_HEAP_TYPE_UPLOAD;
-
 		D3D12_RESOURCE_DESC rd = {};
 		rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		rd.Width = 8 * 1024 * 1024;
+		rd.Width = uploadSize;
 		rd.Height = 1;
 		rd.DepthOrArraySize = 1;
 		rd.MipLevels = 1;
@@ -90,9 +191,9 @@ int WINAPI wWinMain(
 		rd.SampleDesc.Count = 1;
 		rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 
-		hr = app->context.device->CreateCommittedResource(
-			&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
-			IID_PPV_ARGS(&uploadHeap)
+		hr = app->context.allocator.createResource(
+			D3D12_HEAP_TYPE_UPLOAD, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, NULL,
+			&uploadHeap, &uploadAllocation
 		);
 		if (FAILED(hr)) {
 			printWindowsError(hr);
@@ -108,7 +209,25 @@ int WINAPI wWinMain(
 	}
 
 	Mesh mesh;
-	hr = Mesh::create(&app->context, commandList, uploadHeap.Get(), &mesh);
+	hr = Mesh::create(
+		&app->context, commandList, uploadHeap.Get(), meshData.data(), meshData.size(), &mesh
+	);
+	if (FAILED(hr)) {
+		printWindowsError(hr);
+		return 1;
+	}
+
+	// keeping tails of 32 texels, to have something to stream for the one small texture there is
+	StreamerDesc streamerDesc = {};
+	streamerDesc.budget = 16 * 1024 * 1024;
+	streamerDesc.uploadBudget = 1024 * 1024;
+	streamerDesc.tailSize = 32;
+	streamerDesc.screenHeight = (float)app->height;
+
+	TextureStreaming streaming;
+	TextureStreaming::create(&streamerDesc, &streaming);
+	UINT albedo;
+	hr = streaming.addTexture(&app->context, commandList, &archive, "human.dds", &albedo);
 	if (FAILED(hr)) {
 		printWindowsError(hr);
 		return 1;
@@ -127,69 +246,71 @@ int WINAPI wWinMain(
 		return 1;
 	}
 
-	struct ConstantsPerObject {
-		XMFLOAT4X4 worldViewProj;
-	};
+	Skeleton skeleton;
+	AnimationClip walk;
+	AnimationClip idle;
+	if (
+		!Skeleton::create(walkData.data(), walkData.size(), &skeleton) ||
+		!AnimationClip::create(walkData.data(), walkData.size(), &skeleton, &walk) ||
+		!AnimationClip::create(idleData.data(), idleData.size(), &skeleton, &idle)
+	) {
+		printWindowsError(HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT));
+		return 1;
+	}
 
-	auto proj = XMMatrixTranspose(
-		XMMatrixPerspectiveFovRH(0.5f * XM_PIDIV2, (float)app->width / app->height, 0.1f, 4.0f)
+	Material *materials[] = { &material };
+	Renderer renderer;
+	Renderer::create(
+		&app->context, materials, sizeof(materials) / sizeof(*materials),
+		&streaming, &renderer
 	);
 
-	auto position = XMFLOAT4(0.0f, 1.5f, -4.0, 1.0f);
-	auto target = XMFLOAT4(0.0f, 0.5f, 0.0f, 1.0f);
-	auto up = XMFLOAT4(0.0f, 1.0f, 0.0f, 0.0f);
-	auto view = XMMatrixTranspose(
-		XMMatrixLookAtRH(XMLoadFloat4(&position), XMLoadFloat4(&target), XMLoadFloat4(&up))
-	);
+	CommandCapture capture;
+	if (options.capturePath) {
+		CommandCapture::create(options.captureFrames, &capture);
+		app->context.capture = &capture;
+	}
 
-	auto rot = XMMatrixRotationY(0.0f);
+	std::vector<char> replayData;
+	CaptureReader replay;
+	std::vector<LONGLONG> replayTicks;
+	if (options.replayPath) {
+		std::ifstream file(options.replayPath, std::ios::binary);
+		replayData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		if (!CaptureReader::create(replayData.data(), replayData.size(), &replay)) {
+			printWindowsError(HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT));
+			return 1;
+		}
+	}
 
-	ComPtr<ID3D12Resource> constantHeaps[2];
-	void *constantBuffers[2];
-	for (int i = 0; i < 2; i++) {
-		D3D12_HEAP_PROPERTIES hp = {};
-		hp.Type = D3D12_HEAP_TYPE_UPLOAD;
+	JobSystem jobs;
+	auto numThreads = std::thread::hardware_concurrency();
+	JobSystem::create(numThreads > 1 ? numThreads - 1 : 0, &jobs);
 
-		D3D12_RESOURCE_DESC rd = {};
-		rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		rd.Width = 64 * 1024;
-		rd.Height = 1;
-		rd.DepthOrArraySize = 1;
-		rd.MipLevels = 1;
-		rd.Format = DXGI_FORMAT_UNKNOWN;
-		rd.SampleDesc.Count = 1;
-		rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	std::vector<SceneGroup> groups;
+	Bounds meshBounds;
+	getSceneMesh(&mesh, &groups, &meshBounds);
 
-		hr = app->context.device->CreateCommittedResource(
-			&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
-			IID_PPV_ARGS(&constantHeaps[i])
-		);
-		if (FAILED(hr)) {
-			printWindowsError(hr);
-			return 1;
-		}
+	SceneDesc desc = {};
+	desc.crowdWidth = 16;
+	desc.crowdDepth = 16;
+	desc.numMaterials = sizeof(materials) / sizeof(*materials);
+	desc.aspect = (float)app->width / app->height;
 
-		hr = constantHeaps[i]->Map(0, NULL, &constantBuffers[i]);
+	Scene scene;
+	Scene::create(
+		&desc, groups.data(), groups.size(), &meshBounds, &skeleton, &walk, &idle, &scene
+	);
+
+	HotReload hotReload;
+	if (options.reloadPort) {
+		hr = HotReload::create(&app->context, (uint16_t)options.reloadPort, &hotReload);
 		if (FAILED(hr)) {
 			printWindowsError(hr);
 			return 1;
 		}
 	}
 
-	D3D12_VIEWPORT viewport = {};
-	viewport.TopLeftX = 0.0f;
-	viewport.TopLeftY = 0.0f;
-	viewport.Width = (float)app->width;
-	viewport.Height = (float)app->height;
-	viewport.MinDepth = 0.0f;
-	viewport.MaxDepth = 0.0f;
-
-	D3D12_RECT scissor = {};
-	scissor.left = 0;
-	scissor.top = 0;
-	scissor.right = app->width;
-	scissor.bottom = app->height;
-
 	ShowWindow(hWnd, nCmdShow);
 
 	while (true) {
@@ -203,51 +324,66 @@ int WINAPI wWinMain(
 			DispatchMessage(&msg);
 		}
 
-		rot = XMMatrixRotationY(0.05f) * rot;
-
-		auto worldViewProj = proj * view * rot;
-		XMStoreFloat4x4((XMFLOAT4X4*)constantBuffers[app->context.frameIndex], worldViewProj);
+		if (options.replayPath) {
+			CaptureFrame frame;
+			if (!replay.nextFrame(&frame)) {
+				break;
+			}
 
-		hr = app->context.prepare();
-		if (FAILED(hr)) {
-			printWindowsError(hr);
-			return 1;
+			hr = renderer.replay(&frame);
+			if (FAILED(hr)) {
+				printWindowsError(hr);
+				return 1;
+			}
+			replayTicks.push_back(renderer.recordTicks);
+			continue;
 		}
-		commandList->SetPipelineState(material.pipelineState.Get());
-
-		auto rtv = app->context.rtvHeap->GetCPUDescriptorHandleForHeapStart();
-		rtv.ptr += app->context.frameIndex * app->context.rtvDescriptorSize;
-
-		auto dsv = app->context.dsvHeap->GetCPUDescriptorHandleForHeapStart();
-
-		commandList->OMSetRenderTargets(1, &rtv, FALSE, &dsv);
 
-		FLOAT clearColor[] = { 0.0f, 0.3f, 0.6f, 1.0f };
-		commandList->ClearRenderTargetView(rtv, clearColor, 0, NULL);
-		commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, NULL);
+		if (options.reloadPort) {
+			hr = hotReload.update(&app->context, archivePath, &material, &mesh, &scene);
+			if (FAILED(hr)) {
+				printWindowsError(hr);
+				return 1;
+			}
+		}
 
-		commandList->SetGraphicsRootSignature(material.rootSignature.Get());
+		FrameData frame;
+		streaming.streamer.beginFrame();
+		if (!scene.update(1.0f / 60.0f, &jobs, &renderer, &frame)) {
+			printWindowsError(renderer.result);
+			return 1;
+		}
 
-		commandList->RSSetViewports(1, &viewport);
-		commandList->RSSetScissorRects(1, &scissor);
-		commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		// every character wears the same texture, at the size of the nearest one
+		for (auto screenSize : scene.screenSizes) {
+			streaming.streamer.request(albedo, screenSize);
+		}
+		streaming.streamer.update();
 
-		auto cbv = constantHeaps[app->context.frameIndex]->GetGPUVirtualAddress();
-		commandList->SetGraphicsRootConstantBufferView(0, cbv);
+		if (!renderer.renderFrame(&frame)) {
+			printWindowsError(renderer.result);
+			return 1;
+		}
 
-		for (size_t i = 0; i < mesh.vertexBuffers.size(); i++) {
-			commandList->IASetVertexBuffers(0, 1, &mesh.vertexBuffers[i]);
-			commandList->IASetIndexBuffer(&mesh.indexBuffers[i]);
+		if (app->context.capture && capture.isComplete()) {
+			app->context.capture = NULL;
 
-			auto count = mesh.indexBuffers[i].SizeInBytes / sizeof(uint16_t);
-			commandList->DrawIndexedInstanced((UINT)count, 1, 0, 0, 0);
+			std::ofstream file(options.capturePath, std::ios::binary);
+			file.write((const char*)capture.stream.data(), capture.stream.size());
+			if (!file) {
+				printWindowsError(HRESULT_FROM_WIN32(ERROR_WRITE_FAULT));
+				return 1;
+			}
 		}
-
-		app->context.present();
 	}
 out:
+	reportReplay(&replayTicks);
+	LocalFree(argv);
 
 	app->context.waitForGpu();
+	if (options.reloadPort) {
+		hotReload.release(&app->context);
+	}
 	return 0;
 }
 
@@ -0,0 +1,79 @@
+#include "geometry.h"
+#include "util.h"
+
+HRESULT GeometryArena::create(
+	GpuAllocator *allocator, const UINT *vertexStrides, UINT numVertexStreams,
+	UINT maxVertices, UINT maxIndices, GeometryArena *arena
+) {
+	if (numVertexStreams == 0 || numVertexStreams > GeometryArena::MAX_VERTEX_STREAMS) {
+		return E_INVALIDARG;
+	}
+
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	rd.Height = 1;
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = 1;
+	rd.Format = DXGI_FORMAT_UNKNOWN;
+	rd.SampleDesc.Count = 1;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+	auto state = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER;
+
+	arena->numVertexStreams = numVertexStreams;
+	for (UINT i = 0; i < numVertexStreams; i++) {
+		rd.Width = (UINT64)maxVertices * vertexStrides[i];
+		TRY(allocator->createResource(
+			D3D12_HEAP_TYPE_DEFAULT, &rd, state, NULL, arena,
+			&arena->vertexBuffers[i], &arena->vertexAllocations[i]
+		));
+
+		auto &view = arena->vertexBufferViews[i];
+		view.BufferLocation = arena->vertexBuffers[i]->GetGPUVirtualAddress();
+		view.SizeInBytes = maxVertices * vertexStrides[i];
+		view.StrideInBytes = vertexStrides[i];
+	}
+
+	rd.Width = (UINT64)maxIndices * sizeof(uint16_t);
+	TRY(allocator->createResource(
+		D3D12_HEAP_TYPE_DEFAULT, &rd, state, NULL, arena,
+		&arena->indexBuffer, &arena->indexAllocation
+	));
+
+	arena->indexBufferView.BufferLocation = arena->indexBuffer->GetGPUVirtualAddress();
+	arena->indexBufferView.SizeInBytes = maxIndices * sizeof(uint16_t);
+	arena->indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+
+	GeometrySpace::create(maxVertices, maxIndices, &arena->space);
+
+	return S_OK;
+}
+
+bool GeometryArena::allocate(UINT numVertices, UINT numIndices, GeometryRange *range) {
+	return this->space.allocate(numVertices, numIndices, range);
+}
+
+void GeometryArena::free(const GeometryRange *range) {
+	this->space.free(range);
+}
+
+void GeometryArena::freeDeferred(const GeometryRange *range) {
+	this->space.freeDeferred(range);
+}
+
+void GeometryArena::finishFrame(UINT64 fenceValue) {
+	this->space.finishFrame(fenceValue);
+}
+
+void GeometryArena::retire(UINT64 completedFenceValue) {
+	this->space.retire(completedFenceValue);
+}
+
+void GeometryArena::bind(ID3D12GraphicsCommandList *commandList) {
+	commandList->IASetVertexBuffers(0, this->numVertexStreams, this->vertexBufferViews);
+	commandList->IASetIndexBuffer(&this->indexBufferView);
+}
+
+GeometrySpace::Stats GeometryArena::getStats() const {
+	return this->space.getStats();
+}
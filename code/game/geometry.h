@@ -0,0 +1,45 @@
+#pragma once
+#include "allocator.h"
+#include "space.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+
+// Shared vertex and index buffers that meshes are sub-allocated from, so that draws bind them
+// once and select their geometry with BaseVertexLocation and StartIndexLocation. Vertices can be
+// split into streams, each in a buffer of its own at the same vertex offsets, so that a pass binds
+// only the attributes it reads.
+struct GeometryArena {
+	static const UINT MAX_VERTEX_STREAMS = 4;
+
+	UINT numVertexStreams;
+	Microsoft::WRL::ComPtr<ID3D12Resource> vertexBuffers[MAX_VERTEX_STREAMS];
+	GpuAllocation vertexAllocations[MAX_VERTEX_STREAMS];
+	Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
+	GpuAllocation indexAllocation;
+
+	D3D12_VERTEX_BUFFER_VIEW vertexBufferViews[MAX_VERTEX_STREAMS];
+	D3D12_INDEX_BUFFER_VIEW indexBufferView;
+
+	GeometrySpace space;
+
+	// One vertex stream for each stride, in slot order.
+	static HRESULT create(
+		GpuAllocator *allocator, const UINT *vertexStrides, UINT numVertexStreams,
+		UINT maxVertices, UINT maxIndices, GeometryArena *arena
+	);
+
+	bool allocate(UINT numVertices, UINT numIndices, GeometryRange *range);
+	void free(const GeometryRange *range);
+
+	// Frees a range once the frames in flight that may draw from it have retired.
+	void freeDeferred(const GeometryRange *range);
+	void finishFrame(UINT64 fenceValue);
+	void retire(UINT64 completedFenceValue);
+
+	// Binds every vertex stream to the slot of the same number, and the indices.
+	void bind(ID3D12GraphicsCommandList *commandList);
+
+	GeometrySpace::Stats getStats() const;
+};
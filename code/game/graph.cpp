@@ -0,0 +1,281 @@
+#include "graph.h"
+#include <algorithm>
+
+bool GraphTextureSizes::find(GraphTextureDesc *desc) const {
+	for (auto &known : this->known) {
+		if (
+			known.width == desc->width && known.height == desc->height &&
+			known.format == desc->format && known.flags == desc->flags
+		) {
+			desc->size = known.size;
+			desc->alignment = known.alignment;
+			return true;
+		}
+	}
+	return false;
+}
+
+void GraphTextureSizes::add(const GraphTextureDesc *desc) {
+	this->known.push_back(*desc);
+}
+
+void RenderGraph::reset() {
+	this->textures.clear();
+	this->passes.clear();
+	this->finalBarriers.clear();
+	this->transientSize = 0;
+	this->unaliasedSize = 0;
+	this->numCulledPasses = 0;
+}
+
+GraphResource RenderGraph::createTexture(const GraphTextureDesc *desc) {
+	GraphTexture texture = {};
+	texture.desc = *desc;
+	texture.imported = false;
+	this->textures.push_back(texture);
+	return (GraphResource)(this->textures.size() - 1);
+}
+
+GraphResource RenderGraph::importTexture(void *external, uint32_t initialState, uint32_t finalState) {
+	GraphTexture texture = {};
+	texture.imported = true;
+	texture.external = external;
+	texture.initialState = initialState;
+	texture.finalState = finalState;
+	this->textures.push_back(texture);
+	return (GraphResource)(this->textures.size() - 1);
+}
+
+uint32_t RenderGraph::addPass(const char *name, std::function<void(GraphPassContext*)> execute) {
+	GraphPass pass;
+	pass.name = name;
+	pass.execute = std::move(execute);
+	pass.sideEffects = false;
+	pass.refCount = 0;
+	pass.culled = false;
+	this->passes.push_back(std::move(pass));
+	return (uint32_t)(this->passes.size() - 1);
+}
+
+void RenderGraph::read(uint32_t pass, GraphResource resource, uint32_t state) {
+	this->passes[pass].accesses.push_back(GraphAccess { resource, state, false });
+}
+
+void RenderGraph::write(uint32_t pass, GraphResource resource, uint32_t state) {
+	this->passes[pass].accesses.push_back(GraphAccess { resource, state, true });
+}
+
+void RenderGraph::setSideEffects(uint32_t pass) {
+	this->passes[pass].sideEffects = true;
+}
+
+void RenderGraph::compile() {
+	this->cull();
+	this->computeLifetimes();
+	this->alias();
+	this->deriveBarriers();
+}
+
+void RenderGraph::cull() {
+	for (auto &texture : this->textures) {
+		// imported resources are visible outside the graph, so they are always needed
+		texture.refCount = texture.imported ? 1 : 0;
+	}
+
+	for (auto &pass : this->passes) {
+		pass.refCount = pass.sideEffects ? 1 : 0;
+		pass.culled = false;
+		for (auto &access : pass.accesses) {
+			if (access.write) {
+				pass.refCount++;
+			} else {
+				this->textures[access.resource].refCount++;
+			}
+		}
+	}
+
+	std::vector<GraphResource> unused;
+	for (auto &pass : this->passes) {
+		if (pass.refCount > 0) {
+			continue;
+		}
+
+		pass.culled = true;
+		for (auto &access : pass.accesses) {
+			if (!access.write) {
+				this->textures[access.resource].refCount--;
+			}
+		}
+	}
+	for (GraphResource i = 0; i < this->textures.size(); i++) {
+		if (this->textures[i].refCount == 0) {
+			unused.push_back(i);
+		}
+	}
+
+	while (!unused.empty()) {
+		auto resource = unused.back();
+		unused.pop_back();
+
+		for (auto &pass : this->passes) {
+			if (pass.culled || pass.refCount == 0) {
+				continue;
+			}
+
+			bool writes = false;
+			for (auto &access : pass.accesses) {
+				writes |= access.write && access.resource == resource;
+			}
+			if (!writes || --pass.refCount > 0) {
+				continue;
+			}
+
+			pass.culled = true;
+			for (auto &access : pass.accesses) {
+				if (!access.write && --this->textures[access.resource].refCount == 0) {
+					unused.push_back(access.resource);
+				}
+			}
+		}
+	}
+
+	this->numCulledPasses = 0;
+	for (auto &pass : this->passes) {
+		if (pass.culled) {
+			this->numCulledPasses++;
+		}
+	}
+}
+
+void RenderGraph::computeLifetimes() {
+	for (auto &texture : this->textures) {
+		texture.firstPass = NO_PASS;
+		texture.lastPass = NO_PASS;
+	}
+
+	for (uint32_t i = 0; i < this->passes.size(); i++) {
+		if (this->passes[i].culled) {
+			continue;
+		}
+
+		for (auto &access : this->passes[i].accesses) {
+			auto &texture = this->textures[access.resource];
+			if (texture.firstPass == NO_PASS) {
+				texture.firstPass = i;
+			}
+			texture.lastPass = i;
+		}
+	}
+}
+
+void RenderGraph::alias() {
+	std::vector<GraphResource> order;
+	this->unaliasedSize = 0;
+	for (GraphResource i = 0; i < this->textures.size(); i++) {
+		auto &texture = this->textures[i];
+		if (texture.imported || texture.firstPass == NO_PASS) {
+			continue;
+		}
+
+		order.push_back(i);
+		this->unaliasedSize += texture.desc.size;
+	}
+
+	// placing the largest first leaves the smaller ones to fill the gaps between them
+	std::sort(order.begin(), order.end(), [this](GraphResource a, GraphResource b) {
+		return this->textures[a].desc.size > this->textures[b].desc.size;
+	});
+
+	struct Interval {
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	std::vector<GraphResource> placed;
+	std::vector<Interval> occupied;
+	this->transientSize = 0;
+	for (auto resource : order) {
+		auto &texture = this->textures[resource];
+
+		occupied.clear();
+		for (auto other : placed) {
+			auto &o = this->textures[other];
+			if (o.lastPass < texture.firstPass || texture.lastPass < o.firstPass) {
+				continue;
+			}
+			occupied.push_back(Interval { o.offset, o.offset + o.desc.size });
+		}
+		std::sort(occupied.begin(), occupied.end(), [](const Interval &a, const Interval &b) {
+			return a.begin < b.begin;
+		});
+
+		auto alignment = std::max(texture.desc.alignment, (uint64_t)1);
+		uint64_t offset = 0;
+		for (auto &interval : occupied) {
+			if (offset + texture.desc.size <= interval.begin) {
+				break;
+			}
+			offset = std::max(offset, (interval.end + alignment - 1) / alignment * alignment);
+		}
+
+		texture.offset = offset;
+		this->transientSize = std::max(this->transientSize, offset + texture.desc.size);
+		placed.push_back(resource);
+	}
+}
+
+void RenderGraph::deriveBarriers() {
+	const uint32_t UNKNOWN_STATE = 0xffffffff;
+
+	std::vector<uint32_t> states(this->textures.size(), UNKNOWN_STATE);
+	for (GraphResource i = 0; i < this->textures.size(); i++) {
+		if (this->textures[i].imported) {
+			states[i] = this->textures[i].initialState;
+		}
+	}
+
+	for (uint32_t i = 0; i < this->passes.size(); i++) {
+		auto &pass = this->passes[i];
+		pass.barriers.clear();
+		if (pass.culled) {
+			continue;
+		}
+
+		for (auto &access : pass.accesses) {
+			auto &state = states[access.resource];
+			auto &texture = this->textures[access.resource];
+
+			// a transient resource starts out in the state of its first use
+			if (state == UNKNOWN_STATE) {
+				// overlap with any other transient counts, as the previous frame may have left it there
+				bool aliasing = false;
+				for (auto &other : this->textures) {
+					if (&other == &texture || other.imported || other.firstPass == NO_PASS) {
+						continue;
+					}
+					aliasing |= other.offset < texture.offset + texture.desc.size &&
+						texture.offset < other.offset + other.desc.size;
+				}
+
+				pass.barriers.push_back(GraphBarrier {
+					access.resource, access.state, access.state, aliasing
+				});
+				state = access.state;
+				continue;
+			}
+
+			if (state != access.state) {
+				pass.barriers.push_back(GraphBarrier { access.resource, state, access.state, false });
+				state = access.state;
+			}
+		}
+	}
+
+	this->finalBarriers.clear();
+	for (GraphResource i = 0; i < this->textures.size(); i++) {
+		auto &texture = this->textures[i];
+		if (texture.imported && states[i] != texture.finalState) {
+			this->finalBarriers.push_back(GraphBarrier { i, states[i], texture.finalState, false });
+		}
+	}
+}
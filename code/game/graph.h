@@ -0,0 +1,99 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+typedef uint32_t GraphResource;
+
+// Defined by the backend that executes the graph.
+struct GraphPassContext;
+
+// Formats, flags and states use the backend's values. Size and alignment are the backend's
+// allocation requirements for the texture, and are what aliasing packs into the heap.
+struct GraphTextureDesc {
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t flags;
+	uint64_t size;
+	uint64_t alignment;
+};
+
+// The backend's allocation requirements by texture description, so that a texture described
+// again every frame only has to be asked about the first time.
+struct GraphTextureSizes {
+	std::vector<GraphTextureDesc> known;
+
+	// Fills in the size and alignment of a description with the same format, extent and flags.
+	bool find(GraphTextureDesc *desc) const;
+	void add(const GraphTextureDesc *desc);
+};
+
+struct GraphAccess {
+	GraphResource resource;
+	uint32_t state;
+	bool write;
+};
+
+struct GraphBarrier {
+	GraphResource resource;
+	uint32_t before;
+	uint32_t after;
+
+	// the resource takes over memory that another transient resource used earlier
+	bool aliasing;
+};
+
+struct GraphPass {
+	const char *name;
+	std::vector<GraphAccess> accesses;
+	std::function<void(GraphPassContext*)> execute;
+	bool sideEffects;
+
+	uint32_t refCount;
+	bool culled;
+	std::vector<GraphBarrier> barriers;
+};
+
+struct GraphTexture {
+	GraphTextureDesc desc;
+	bool imported;
+	void *external;
+	uint32_t initialState;
+	uint32_t finalState;
+
+	uint32_t refCount;
+	uint32_t firstPass;
+	uint32_t lastPass;
+	uint64_t offset;
+};
+
+struct RenderGraph {
+	static const uint32_t NO_PASS = 0xffffffff;
+
+	std::vector<GraphTexture> textures;
+	std::vector<GraphPass> passes;
+	std::vector<GraphBarrier> finalBarriers;
+
+	uint64_t transientSize = 0;
+	uint64_t unaliasedSize = 0;
+	uint32_t numCulledPasses = 0;
+
+	void reset();
+
+	GraphResource createTexture(const GraphTextureDesc *desc);
+	GraphResource importTexture(void *external, uint32_t initialState, uint32_t finalState);
+
+	uint32_t addPass(const char *name, std::function<void(GraphPassContext*)> execute);
+	void read(uint32_t pass, GraphResource resource, uint32_t state);
+	void write(uint32_t pass, GraphResource resource, uint32_t state);
+	void setSideEffects(uint32_t pass);
+
+	void compile();
+
+	void cull();
+	void computeLifetimes();
+	void alias();
+	void deriveBarriers();
+};
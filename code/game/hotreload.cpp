@@ -0,0 +1,201 @@
+#include "hotreload.h"
+#include "accounting.h"
+#include "archive.h"
+#include "context.h"
+#include "util.h"
+#include <cstdio>
+#include <cstring>
+
+void getSceneMesh(const Mesh *mesh, std::vector<SceneGroup> *groups, Bounds *bounds) {
+	groups->clear();
+	for (auto &range : mesh->groups) {
+		SceneGroup group = { range.numIndices, range.startIndex, (int32_t)range.baseVertex };
+		groups->push_back(group);
+	}
+	for (int i = 0; i < 3; i++) {
+		bounds->min[i] = mesh->boundsMin[i];
+		bounds->max[i] = mesh->boundsMax[i];
+	}
+}
+
+static bool hasExtension(const std::string &name, const char *extension) {
+	auto length = strlen(extension);
+	return name.size() >= length && name.compare(name.size() - length, length, extension) == 0;
+}
+
+static void reportReload(const char *name, const char *message) {
+	char line[256];
+	snprintf(line, sizeof(line), "reload: %s %s\n", name, message);
+	OutputDebugStringA(line);
+}
+
+HRESULT HotReload::create(Context *context, uint16_t port, HotReload *reload) {
+	if (!ReloadListener::create(port, &reload->listener)) {
+		return HRESULT_FROM_WIN32(ERROR_ADDRESS_ALREADY_ASSOCIATED);
+	}
+
+	TRY(context->device->CreateCommandAllocator(
+		D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&reload->commandAllocator)
+	));
+	TRY(context->device->CreateCommandList(
+		0, D3D12_COMMAND_LIST_TYPE_DIRECT, reload->commandAllocator.Get(), NULL,
+		IID_PPV_ARGS(&reload->commandList)
+	));
+	reload->commandList->Close();
+	reload->fenceValue = 0;
+	return S_OK;
+}
+
+// Creates the new mesh on the reload's own list and submits it ahead of the next frame, which
+// draws with it.
+static HRESULT reloadMesh(
+	HotReload *reload, Context *context, const std::vector<char> *data,
+	ID3D12Resource **uploadHeap, GpuAllocation *uploadAllocation, Mesh *mesh
+) {
+	size_t uploadSize;
+	TRY(Mesh::getUploadSize(data->data(), data->size(), &uploadSize));
+
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	rd.Width = uploadSize;
+	rd.Height = 1;
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = 1;
+	rd.Format = DXGI_FORMAT_UNKNOWN;
+	rd.SampleDesc.Count = 1;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	TRY(context->allocator.createResource(
+		D3D12_HEAP_TYPE_UPLOAD, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, NULL,
+		uploadHeap, uploadAllocation
+	));
+
+	auto commandList = reload->commandList.Get();
+	TRY(reload->commandAllocator->Reset());
+	TRY(commandList->Reset(reload->commandAllocator.Get(), NULL));
+	auto hr = Mesh::create(context, commandList, *uploadHeap, data->data(), data->size(), mesh);
+	commandList->Close();
+	if (FAILED(hr)) {
+		return hr;
+	}
+
+	ID3D12CommandList *commandLists[] = { commandList };
+	context->commandQueue->ExecuteCommandLists(1, commandLists);
+	return S_OK;
+}
+
+HRESULT HotReload::update(
+	Context *context, const char *archivePath, Material *material, Mesh *mesh, Scene *scene
+) {
+	MemoryScope scope(MEMORY_ASSETS);
+	auto completedFenceValue = context->fence->GetCompletedValue();
+	for (size_t i = 0; i < this->retired.size();) {
+		auto &retired = this->retired[i];
+		if (retired.fenceValue > completedFenceValue) {
+			i++;
+			continue;
+		}
+
+		retired.mesh.release(context);
+		if (retired.uploadHeap) {
+			retired.uploadHeap.Reset();
+			context->allocator.free(&retired.uploadAllocation);
+		}
+		retired = std::move(this->retired.back());
+		this->retired.pop_back();
+	}
+
+	// names pile up until the last reload's copies are done with the command allocator
+	this->listener.poll(&this->request);
+	if (this->request.names.empty() || completedFenceValue < this->fenceValue) {
+		return S_OK;
+	}
+
+	auto reloadShaders = false;
+	auto reloadMeshes = false;
+	for (auto &name : this->request.names) {
+		if (hasExtension(name, ".cso")) {
+			reloadShaders = true;
+		} else if (name == "human.mesh") {
+			reloadMeshes = true;
+		} else if (hasExtension(name, ".dds") || hasExtension(name, ".anim")) {
+			reportReload(name.c_str(), "changed, and shows after a restart");
+		}
+	}
+	this->request.names.clear();
+	if (!reloadShaders && !reloadMeshes) {
+		return S_OK;
+	}
+
+	Archive archive;
+	if (!Archive::open(archivePath, &archive)) {
+		reportReload(archivePath, "couldn't be opened");
+		return S_OK;
+	}
+
+	// whatever replaces something in use goes in after the next frame, like that frame's own work
+	Retired retired = {};
+	retired.fenceValue = context->fenceValues[context->frameIndex];
+	auto replaced = false;
+
+	std::vector<char> vertexBinary;
+	std::vector<char> pixelBinary;
+	Material nextMaterial;
+	if (
+		reloadShaders &&
+		SUCCEEDED(readAsset(&archive, "vertex.cso", &vertexBinary)) &&
+		SUCCEEDED(readAsset(&archive, "pixel.cso", &pixelBinary)) &&
+		SUCCEEDED(Material::create(
+			context, material->inputs, &vertexBinary, &pixelBinary, &nextMaterial
+		))
+	) {
+		retired.material = std::move(*material);
+		*material = std::move(nextMaterial);
+		replaced = true;
+		reportReload("shaders", "reloaded");
+	} else if (reloadShaders) {
+		reportReload("shaders", "didn't load, so the old ones stay");
+	}
+
+	std::vector<char> meshData;
+	Mesh nextMesh;
+	HRESULT hr = S_OK;
+	if (
+		reloadMeshes &&
+		SUCCEEDED(hr = readAsset(&archive, "human.mesh", &meshData)) &&
+		SUCCEEDED(hr = reloadMesh(
+			this, context, &meshData, &retired.uploadHeap, &retired.uploadAllocation, &nextMesh
+		))
+	) {
+		std::vector<SceneGroup> groups;
+		Bounds bounds;
+		getSceneMesh(&nextMesh, &groups, &bounds);
+		scene->setMesh(groups.data(), groups.size(), &bounds);
+
+		retired.mesh = std::move(*mesh);
+		*mesh = std::move(nextMesh);
+		this->fenceValue = retired.fenceValue;
+		replaced = true;
+		reportReload("human.mesh", "reloaded");
+	} else if (reloadMeshes) {
+		printWindowsError(hr);
+		reportReload("human.mesh", "didn't load, so the old one stays");
+	}
+	archive.close();
+
+	if (replaced || retired.uploadHeap) {
+		this->retired.push_back(std::move(retired));
+	}
+	return S_OK;
+}
+
+void HotReload::release(Context *context) {
+	for (auto &retired : this->retired) {
+		retired.mesh.release(context);
+		if (retired.uploadHeap) {
+			retired.uploadHeap.Reset();
+			context->allocator.free(&retired.uploadAllocation);
+		}
+	}
+	this->retired.clear();
+	this->listener.close();
+}
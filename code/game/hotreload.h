@@ -0,0 +1,50 @@
+#pragma once
+#include "allocator.h"
+#include "material.h"
+#include "mesh.h"
+#include "reload.h"
+#include "scene.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+
+// The draws of a mesh and its bounds, as the scene wants them.
+void getSceneMesh(const Mesh *mesh, std::vector<SceneGroup> *groups, Bounds *bounds);
+
+// Reloads assets while the game runs, as the asset builder in watch mode reports rebuilding them.
+// Between frames, what changed is read out of the archive the builder has just replaced, which is
+// opened again for as long as that takes, and swapped in for what the frames use. What frames in
+// flight may still be using is released once they have completed. Shaders and the mesh reload;
+// textures stream out of the archive the game started with, so they keep what they had.
+struct HotReload {
+	struct Retired {
+		Material material;
+		Mesh mesh;
+		Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
+		GpuAllocation uploadAllocation;
+		UINT64 fenceValue;
+	};
+
+	ReloadListener listener;
+	ReloadRequest request;
+
+	// the copies of a reloaded mesh go on their own list, which is reused once this fence value
+	// has passed
+	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> commandAllocator;
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+	UINT64 fenceValue;
+
+	std::vector<Retired> retired;
+
+	static HRESULT create(Context *context, uint16_t port, HotReload *reload);
+
+	// Reloads what changed since the last call into the one material the renderer draws with and
+	// the mesh the scene draws. An asset that doesn't load is reported, and the old one is kept.
+	HRESULT update(
+		Context *context, const char *archivePath, Material *material, Mesh *mesh, Scene *scene
+	);
+
+	void release(Context *context);
+};
@@ -0,0 +1,63 @@
+#include "indirect.h"
+
+static_assert(sizeof(DrawIndexedArguments) == 20, "DrawIndexedArguments must match D3D12");
+static_assert(sizeof(IndirectCommand) == 24, "IndirectCommand must be tightly packed");
+
+bool IndirectLayout::addConstant(uint32_t rootParameterIndex, uint32_t num32BitValues) {
+	if (this->numArguments == MAX_ARGUMENTS || this->hasDraw() || num32BitValues == 0) {
+		return false;
+	}
+
+	auto &argument = this->arguments[this->numArguments++];
+	argument.type = INDIRECT_ARGUMENT_CONSTANT;
+	argument.rootParameterIndex = rootParameterIndex;
+	argument.num32BitValues = num32BitValues;
+	argument.offset = this->stride;
+
+	this->stride += num32BitValues * sizeof(uint32_t);
+	return true;
+}
+
+bool IndirectLayout::addDrawIndexed() {
+	if (this->numArguments == MAX_ARGUMENTS || this->hasDraw()) {
+		return false;
+	}
+
+	auto &argument = this->arguments[this->numArguments++];
+	argument.type = INDIRECT_ARGUMENT_DRAW_INDEXED;
+	argument.rootParameterIndex = 0;
+	argument.num32BitValues = sizeof(DrawIndexedArguments) / sizeof(uint32_t);
+	argument.offset = this->stride;
+
+	this->stride += sizeof(DrawIndexedArguments);
+	return true;
+}
+
+// A draw must be the last argument of a signature, so only the last can be one.
+bool IndirectLayout::hasDraw() const {
+	return this->numArguments > 0 &&
+		this->arguments[this->numArguments - 1].type == INDIRECT_ARGUMENT_DRAW_INDEXED;
+}
+
+void getIndirectCommandLayout(IndirectLayout *layout) {
+	*layout = IndirectLayout();
+	layout->addConstant(1, 1);
+	layout->addDrawIndexed();
+}
+
+void packIndirectCommands(const IndirectDraws *draws, IndirectCommand *commands) {
+	// kept branch-free over flat input arrays so the compiler can vectorize the stores
+	auto objectIds = draws->objectIds;
+	auto numIndices = draws->numIndices;
+	auto startIndices = draws->startIndices;
+	auto baseVertices = draws->baseVertices;
+	for (size_t i = 0; i < draws->count; i++) {
+		auto &command = commands[i];
+		command.objectId = objectIds[i];
+		command.draw.indexCountPerInstance = numIndices[i];
+		command.draw.instanceCount = 1;
+		command.draw.startIndexLocation = startIndices[i];
+		command.draw.baseVertexLocation = baseVertices[i];
+		command.draw.startInstanceLocation = 0;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+enum IndirectArgumentType {
+	INDIRECT_ARGUMENT_DRAW_INDEXED,
+	INDIRECT_ARGUMENT_CONSTANT,
+};
+
+struct IndirectArgument {
+	IndirectArgumentType type;
+	uint32_t rootParameterIndex;
+	uint32_t num32BitValues;
+	uint32_t offset;
+};
+
+// Byte offsets of each argument in a command signature, and the stride between commands. A draw
+// ends a signature, so nothing can be added after one.
+struct IndirectLayout {
+	static const size_t MAX_ARGUMENTS = 8;
+
+	IndirectArgument arguments[MAX_ARGUMENTS];
+	size_t numArguments = 0;
+	uint32_t stride = 0;
+
+	bool addConstant(uint32_t rootParameterIndex, uint32_t num32BitValues);
+	bool addDrawIndexed();
+
+	bool hasDraw() const;
+};
+
+// Matches D3D12_DRAW_INDEXED_ARGUMENTS.
+struct DrawIndexedArguments {
+	uint32_t indexCountPerInstance;
+	uint32_t instanceCount;
+	uint32_t startIndexLocation;
+	int32_t baseVertexLocation;
+	uint32_t startInstanceLocation;
+};
+
+// One command of the game's signature: the object index root constant, then the draw.
+struct IndirectCommand {
+	uint32_t objectId;
+	DrawIndexedArguments draw;
+};
+
+struct IndirectDraws {
+	const uint32_t *objectIds;
+	const uint32_t *numIndices;
+	const uint32_t *startIndices;
+	const int32_t *baseVertices;
+	size_t count;
+};
+
+void getIndirectCommandLayout(IndirectLayout *layout);
+void packIndirectCommands(const IndirectDraws *draws, IndirectCommand *commands);
@@ -0,0 +1,87 @@
+#include "jobs.h"
+
+void JobSystem::create(uint32_t numThreads, JobSystem *jobs) {
+	for (uint32_t i = 0; i < numThreads; i++) {
+		jobs->threads.emplace_back(&JobSystem::work, jobs);
+	}
+}
+
+JobSystem::~JobSystem() {
+	this->destroy();
+}
+
+void JobSystem::destroy() {
+	if (this->threads.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->quit = true;
+	}
+	this->wake.notify_all();
+
+	for (auto &thread : this->threads) {
+		thread.join();
+	}
+	this->threads.clear();
+}
+
+void JobSystem::parallelFor(JobFunction function, void *data, uint32_t count, uint32_t batchSize) {
+	if (this->threads.empty() || count <= batchSize) {
+		function(data, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->function = function;
+		this->data = data;
+		this->count = count;
+		this->batchSize = batchSize;
+		this->nextBatch = 0;
+		this->numBusy = (uint32_t)this->threads.size();
+		this->generation++;
+	}
+	this->wake.notify_all();
+
+	this->runBatches();
+
+	// workers still read the job after the last batch is claimed, so wait for all of them
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->done.wait(lock, [&] { return this->numBusy == 0; });
+}
+
+void JobSystem::runBatches() {
+	auto numBatches = (this->count + this->batchSize - 1) / this->batchSize;
+	for (auto batch = this->nextBatch++; batch < numBatches; batch = this->nextBatch++) {
+		auto first = batch * this->batchSize;
+		auto count = this->count - first < this->batchSize ? this->count - first : this->batchSize;
+		this->function(this->data, first, count);
+	}
+}
+
+void JobSystem::work() {
+	uint64_t generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [&] { return this->quit || this->generation != generation; });
+			if (this->quit) {
+				return;
+			}
+			generation = this->generation;
+		}
+
+		this->runBatches();
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			last = --this->numBusy == 0;
+		}
+		if (last) {
+			this->done.notify_one();
+		}
+	}
+}
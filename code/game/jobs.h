@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*JobFunction)(void *data, uint32_t first, uint32_t count);
+
+// A fixed pool of worker threads that split ranges into batches. The calling thread works on
+// batches too, and parallelFor returns once the whole range is done.
+struct JobSystem {
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	uint64_t generation = 0;
+	uint32_t numBusy = 0;
+	bool quit = false;
+
+	JobFunction function;
+	void *data;
+	uint32_t count;
+	uint32_t batchSize;
+	std::atomic<uint32_t> nextBatch;
+
+	~JobSystem();
+
+	static void create(uint32_t numThreads, JobSystem *jobs);
+	void destroy();
+
+	void parallelFor(JobFunction function, void *data, uint32_t count, uint32_t batchSize);
+
+	void runBatches();
+	void work();
+};
@@ -1,34 +1,93 @@
 #include "material.h"
 #include "context.h"
+#include "indirect.h"
+#include "mesh.h"
+#include <cstring>
 
 using Microsoft::WRL::ComPtr;
 
+UINT getInputLayout(VertexInputs inputs, D3D12_INPUT_ELEMENT_DESC *elements) {
+	// positions come first, so a position-only layout is the first element alone
+	const D3D12_INPUT_ELEMENT_DESC all[VERTEX_INPUT_ELEMENTS] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, VERTEX_STREAM_POSITION, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, VERTEX_STREAM_ATTRIBUTES, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, VERTEX_STREAM_ATTRIBUTES, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "BLENDINDICES", 0, DXGI_FORMAT_R8G8B8A8_UINT, VERTEX_STREAM_ATTRIBUTES, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "BLENDWEIGHT", 0, DXGI_FORMAT_R8G8B8A8_UNORM, VERTEX_STREAM_ATTRIBUTES, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+	auto numElements = inputs == VERTEX_INPUTS_POSITION ? 1 : VERTEX_INPUT_ELEMENTS;
+	memcpy(elements, all, numElements * sizeof(*elements));
+	return numElements;
+}
+
 HRESULT Material::create(
 	Context *context,
+	VertexInputs inputs,
 	std::vector<char> *vertexBytecode,
 	std::vector<char> *pixelBytecode,
   Material *material
 ) {
+	material->inputs = inputs;
+
 	D3D12_ROOT_DESCRIPTOR1 cbv = {};
 	cbv.RegisterSpace = 0;
 	cbv.ShaderRegister = 0;
 
-	D3D12_ROOT_PARAMETER1 parameters[1] = {};
+	D3D12_ROOT_CONSTANTS objectId = {};
+	objectId.RegisterSpace = 0;
+	objectId.ShaderRegister = 1;
+	objectId.Num32BitValues = 1;
+
+	D3D12_ROOT_DESCRIPTOR1 skinMatrices = {};
+	skinMatrices.RegisterSpace = 0;
+	skinMatrices.ShaderRegister = 0;
+
+	D3D12_DESCRIPTOR_RANGE1 textures = {};
+	textures.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+	textures.NumDescriptors = 1;
+	textures.BaseShaderRegister = 1;
+	textures.RegisterSpace = 0;
+	textures.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC;
+	textures.OffsetInDescriptorsFromTableStart = 0;
+
+	D3D12_ROOT_PARAMETER1 parameters[4] = {};
 	parameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
 	parameters[0].Descriptor = cbv;
 	parameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+	parameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+	parameters[1].Constants = objectId;
+	parameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+	parameters[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+	parameters[2].Descriptor = skinMatrices;
+	parameters[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+	parameters[3].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+	parameters[3].DescriptorTable.NumDescriptorRanges = 1;
+	parameters[3].DescriptorTable.pDescriptorRanges = &textures;
+	parameters[3].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+
+	D3D12_STATIC_SAMPLER_DESC sampler = {};
+	sampler.Filter = D3D12_FILTER_ANISOTROPIC;
+	sampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+	sampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+	sampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+	sampler.MaxAnisotropy = 8;
+	sampler.MaxLOD = D3D12_FLOAT32_MAX;
+	sampler.ShaderRegister = 0;
+	sampler.RegisterSpace = 0;
+	sampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
 
 	ComPtr<ID3DBlob> signatureData;
 	D3D12_VERSIONED_ROOT_SIGNATURE_DESC rsd = {};
 	rsd.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
 	rsd.Desc_1_1.NumParameters = sizeof(parameters) / sizeof(*parameters);
 	rsd.Desc_1_1.pParameters = parameters;
+	rsd.Desc_1_1.NumStaticSamplers = 1;
+	rsd.Desc_1_1.pStaticSamplers = &sampler;
 	rsd.Desc_1_1.Flags =
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
 		D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
 		D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
-		D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS |
-		D3D12_ROOT_SIGNATURE_FLAG_DENY_PIXEL_SHADER_ROOT_ACCESS;
+		D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
 	TRY(D3D12SerializeVersionedRootSignature(&rsd, &signatureData, NULL));
 
 	TRY(context->device->CreateRootSignature(
@@ -41,8 +100,10 @@ HRESULT Material::create(
 	psd.pRootSignature = material->rootSignature.Get();
 	psd.VS.pShaderBytecode = vertexBytecode->data();
 	psd.VS.BytecodeLength = vertexBytecode->size();
-	psd.PS.pShaderBytecode = pixelBytecode->data();
-	psd.PS.BytecodeLength = pixelBytecode->size();
+	if (pixelBytecode) {
+		psd.PS.pShaderBytecode = pixelBytecode->data();
+		psd.PS.BytecodeLength = pixelBytecode->size();
+	}
 
 	for (int i = 0; i < D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT; i++) {
 		psd.BlendState.RenderTarget[i].SrcBlend = D3D12_BLEND_ONE;
@@ -79,18 +140,16 @@ HRESULT Material::create(
 	dsd.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
 	psd.DepthStencilState.FrontFace = psd.DepthStencilState.BackFace = dsd;
 
-	D3D12_INPUT_ELEMENT_DESC inputLayout[] = {
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-	};
+	D3D12_INPUT_ELEMENT_DESC inputLayout[VERTEX_INPUT_ELEMENTS];
 	psd.InputLayout.pInputElementDescs = inputLayout;
-	psd.InputLayout.NumElements = sizeof(inputLayout) / sizeof(*inputLayout);
+	psd.InputLayout.NumElements = getInputLayout(inputs, inputLayout);
 
 	psd.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 
-	psd.NumRenderTargets = 1;
-	psd.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	if (pixelBytecode) {
+		psd.NumRenderTargets = 1;
+		psd.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+	}
 	psd.DSVFormat = DXGI_FORMAT_D32_FLOAT;
 
 	psd.SampleDesc.Count = 1;
@@ -99,6 +158,34 @@ HRESULT Material::create(
 		&psd, IID_PPV_ARGS(&material->pipelineState)
 	));
 
+	IndirectLayout layout;
+	getIndirectCommandLayout(&layout);
+
+	D3D12_INDIRECT_ARGUMENT_DESC arguments[IndirectLayout::MAX_ARGUMENTS] = {};
+	for (size_t i = 0; i < layout.numArguments; i++) {
+		auto &argument = layout.arguments[i];
+		switch (argument.type) {
+		case INDIRECT_ARGUMENT_DRAW_INDEXED:
+			arguments[i].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+			break;
+
+		case INDIRECT_ARGUMENT_CONSTANT:
+			arguments[i].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+			arguments[i].Constant.RootParameterIndex = argument.rootParameterIndex;
+			arguments[i].Constant.DestOffsetIn32BitValues = 0;
+			arguments[i].Constant.Num32BitValuesToSet = argument.num32BitValues;
+			break;
+		}
+	}
+
+	D3D12_COMMAND_SIGNATURE_DESC csd = {};
+	csd.ByteStride = layout.stride;
+	csd.NumArgumentDescs = (UINT)layout.numArguments;
+	csd.pArgumentDescs = arguments;
+	TRY(context->device->CreateCommandSignature(
+		&csd, material->rootSignature.Get(), IID_PPV_ARGS(&material->commandSignature)
+	));
+
 	return S_OK;
 
 }
\ No newline at end of file
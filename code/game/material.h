@@ -7,12 +7,31 @@
 
 struct Context;
 
+// Which vertex streams a material's vertex shader reads. Position-only materials, like depth or
+// shadow passes over geometry that isn't skinned, fetch 12 bytes a vertex from the position
+// stream, where the rest fetch all 40 from both.
+enum VertexInputs {
+	VERTEX_INPUTS_ALL,
+	VERTEX_INPUTS_POSITION,
+};
+
+static const UINT VERTEX_INPUT_ELEMENTS = 5;
+
+// Fills in the input layout for the inputs, each element in the slot of the stream it's in, and
+// returns how many elements there are, which is at most VERTEX_INPUT_ELEMENTS.
+UINT getInputLayout(VertexInputs inputs, D3D12_INPUT_ELEMENT_DESC *elements);
+
 struct Material {
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> pipelineState;
+	Microsoft::WRL::ComPtr<ID3D12CommandSignature> commandSignature;
+
+	VertexInputs inputs;
 
+	// Without pixel bytecode, the material only writes depth.
 	static HRESULT create(
 		Context *context,
+		VertexInputs inputs,
 		std::vector<char> *vertexBytecode,
 		std::vector<char> *pixelBytecode,
 	 	Material *material
@@ -1,94 +1,271 @@
 #include "mesh.h"
+#include "accounting.h"
+#include "arena.h"
 #include "context.h"
 #include "util.h"
 #include <d3d12.h>
-#include <fstream>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <memory>
 
-struct Vertex {
-	float position[3];
-	float normal[3];
-	float texcoord[2];
-};
+static const uint32_t MESH_MAGIC = 'M' | 'E' << 8 | 'S' << 16 | 'H' << 24;
+static const uint32_t MESH_VERSION = 1;
+static const uint32_t MESH_VERSION_SPLIT = 2;
+static const uint32_t MESH_VERSION_INSTANCED = 3;
+static const uint32_t MESH_VERSION_SPLIT_INSTANCED = 4;
 
 struct Group {
 	size_t numVertices;
 	size_t numIndices;
 };
 
+// One for every group of an instanced mesh, after the geometry. A group whose source is itself is
+// stored, and the rest are drawn from their source with its positions and normals transformed by
+// a row-major 3x4 matrix.
+struct Instance {
+	uint32_t source;
+	float transform[12];
+};
+
+static const float IDENTITY_TRANSFORM[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+static bool isIdentity(const float *transform) {
+	return memcmp(transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM)) == 0;
+}
+
+// The groups of a mesh file, and where the geometry of each stored one starts.
+struct MeshFile {
+	bool split;
+	FrameVector<Group> groups;
+	FrameVector<Instance> instances;
+	FrameVector<size_t> offsets;
+
+	// every stored group and every moved copy has geometry of its own
+	size_t uploadSize;
+};
+
+static HRESULT readMeshFile(const char *data, size_t size, MeshFile *file) {
+	uint32_t header[2] = {};
+	size_t numGroups = 0;
+	size_t offset = sizeof(header) + sizeof(numGroups);
+	if (size >= offset) {
+		memcpy(header, data, sizeof(header));
+		memcpy(&numGroups, data + sizeof(header), sizeof(numGroups));
+	}
+	auto instanced =
+		header[1] == MESH_VERSION_INSTANCED || header[1] == MESH_VERSION_SPLIT_INSTANCED;
+	auto entrySize = sizeof(Group) + (instanced ? sizeof(Instance) : 0);
+	if (
+		header[0] != MESH_MAGIC || header[1] < MESH_VERSION ||
+		header[1] > MESH_VERSION_SPLIT_INSTANCED || numGroups > (size - offset) / entrySize
+	) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+	file->split = header[1] == MESH_VERSION_SPLIT || header[1] == MESH_VERSION_SPLIT_INSTANCED;
+
+	file->groups.resize(numGroups);
+	memcpy(file->groups.data(), data + offset, numGroups * sizeof(Group));
+	offset += numGroups * sizeof(Group);
+
+	// groups are their own source unless the table after the geometry says otherwise
+	auto end = size;
+	file->instances.resize(numGroups);
+	if (instanced) {
+		end -= numGroups * sizeof(Instance);
+		memcpy(file->instances.data(), data + end, numGroups * sizeof(Instance));
+	} else {
+		for (size_t i = 0; i < numGroups; i++) {
+			file->instances[i].source = (uint32_t)i;
+			memcpy(file->instances[i].transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM));
+		}
+	}
+
+	file->offsets.resize(numGroups);
+	file->uploadSize = 0;
+	for (size_t i = 0; i < numGroups; i++) {
+		auto &group = file->groups[i];
+		auto &instance = file->instances[i];
+		auto groupSize = group.numVertices * sizeof(Vertex) + group.numIndices * sizeof(uint16_t);
+		if (instance.source == i) {
+			if (groupSize > end - offset) {
+				return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+			}
+			file->offsets[i] = offset;
+			offset += groupSize;
+			file->uploadSize += groupSize;
+			continue;
+		}
+
+		// a copy is of a group stored before it, with the same counts
+		auto source = instance.source;
+		if (
+			source > i || file->instances[source].source != source ||
+			file->groups[source].numVertices != group.numVertices ||
+			file->groups[source].numIndices != group.numIndices
+		) {
+			return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+		}
+		file->uploadSize += isIdentity(instance.transform) ? 0 : groupSize;
+	}
+	return S_OK;
+}
+
+HRESULT Mesh::getUploadSize(const char *data, size_t size, size_t *uploadSize) {
+	MemoryScope scope(MEMORY_ASSETS);
+	MeshFile file;
+	auto hr = readMeshFile(data, size, &file);
+	*uploadSize = file.uploadSize;
+	return hr;
+}
+
 HRESULT Mesh::create(
 	Context *context, ID3D12GraphicsCommandList *commandList, ID3D12Resource *uploadHeap,
-	Mesh *mesh
+	const char *data, size_t size, Mesh *mesh
 ) {
-	std::ifstream data("data/human.mesh", std::ios::binary);
-	size_t numGroups;
-	data.read((char*)&numGroups, sizeof(numGroups));
-
-	std::vector<Group> groups;
+	MemoryScope scope(MEMORY_ASSETS);
+	MeshFile file;
+	TRY(readMeshFile(data, size, &file));
+	if (file.uploadSize > uploadHeap->GetDesc().Width) {
+		return E_INVALIDARG;
+	}
 
-	size_t bufferSize = 0;
+	// exact copies draw their source's geometry, and the rest get geometry of their own
+	auto numGroups = file.groups.size();
+	mesh->groups.reserve(numGroups);
+	FrameVector<size_t> uploaded;
+	uploaded.reserve(numGroups);
 	for (size_t i = 0; i < numGroups; i++) {
-		Group group = {};
-		data.read((char*)&group.numVertices, sizeof(group.numVertices));
-		data.read((char*)&group.numIndices, sizeof(group.numIndices));
+		auto &instance = file.instances[i];
+		if (instance.source != i && isIdentity(instance.transform)) {
+			mesh->groups.push_back(mesh->groups[instance.source]);
+			continue;
+		}
+
+		auto &group = file.groups[i];
+		GeometryRange range;
+		if (!context->geometry.allocate((UINT)group.numVertices, (UINT)group.numIndices, &range)) {
+			mesh->release(context);
+			return E_OUTOFMEMORY;
+		}
 
-		bufferSize += group.numVertices * sizeof(Vertex) + group.numIndices * sizeof(uint16_t);
-		groups.push_back(group);
+		mesh->ranges.push_back(range);
+		mesh->groups.push_back(range);
+		uploaded.push_back(i);
 	}
 
-	{
-		D3D12_HEAP_PROPERTIES hp = {};
-		hp.Type = D3D12_HEAP_TYPE_DEFAULT;
-
-		D3D12_RESOURCE_DESC rd = {};
-		rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		rd.Width = bufferSize;
-		rd.Height = 1;
-		rd.DepthOrArraySize = 1;
-		rd.MipLevels = 1;
-		rd.Format = DXGI_FORMAT_UNKNOWN;
-		rd.SampleDesc.Count = 1;
-		rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-
-		TRY(context->device->CreateCommittedResource(
-			&hp, D3D12_HEAP_FLAG_NONE, &rd, D3D12_RESOURCE_STATE_COPY_DEST, NULL,
-			IID_PPV_ARGS(&mesh->data)
-		));
+	for (int i = 0; i < 3; i++) {
+		mesh->boundsMin[i] = FLT_MAX;
+		mesh->boundsMax[i] = -FLT_MAX;
 	}
+	auto addBounds = [&](const float *position) {
+		for (int i = 0; i < 3; i++) {
+			mesh->boundsMin[i] = std::min(mesh->boundsMin[i], position[i]);
+			mesh->boundsMax[i] = std::max(mesh->boundsMax[i], position[i]);
+		}
+	};
 
-	void *target;
-	uploadHeap->Map(0, NULL, &target);
-	data.read((char*)target, bufferSize);
+	// Each group goes up as its streams one after the other and then its indices, which takes as
+	// many bytes as either layout. Interleaved vertices are split on the way, moved copies are
+	// transformed, and the bounds are taken from the source, since upload memory is
+	// write-combined.
+	char *target;
+	uploadHeap->Map(0, NULL, (void**)&target);
+	for (auto i : uploaded) {
+		auto &group = file.groups[i];
+		auto &instance = file.instances[i];
+		auto source = data + file.offsets[instance.source];
+		auto moved = !isIdentity(instance.transform);
+
+		auto positionSize = VERTEX_STREAM_STRIDES[VERTEX_STREAM_POSITION];
+		auto attributes = target + group.numVertices * positionSize;
+		auto sourceAttributes = source + group.numVertices * positionSize;
+		for (size_t v = 0; v < group.numVertices; v++) {
+			float position[3];
+			VertexAttributes rest;
+			if (file.split) {
+				memcpy(position, source + v * positionSize, positionSize);
+				memcpy(&rest, sourceAttributes + v * sizeof(rest), sizeof(rest));
+			} else {
+				Vertex vertex;
+				memcpy(&vertex, source + v * sizeof(Vertex), sizeof(vertex));
+				memcpy(position, vertex.position, positionSize);
+				memcpy(rest.normal, vertex.normal, sizeof(rest.normal));
+				memcpy(rest.texcoord, vertex.texcoord, sizeof(rest.texcoord));
+				memcpy(rest.joints, vertex.joints, sizeof(rest.joints));
+				memcpy(rest.weights, vertex.weights, sizeof(rest.weights));
+			}
+
+			if (moved) {
+				auto m = instance.transform;
+				float p[3];
+				float n[3];
+				memcpy(p, position, sizeof(p));
+				memcpy(n, rest.normal, sizeof(n));
+				for (int r = 0; r < 3; r++) {
+					position[r] = m[4 * r] * p[0] + m[4 * r + 1] * p[1] + m[4 * r + 2] * p[2] +
+						m[4 * r + 3];
+					rest.normal[r] = m[4 * r] * n[0] + m[4 * r + 1] * n[1] + m[4 * r + 2] * n[2];
+				}
+			}
+			if (moved || !file.split) {
+				memcpy(target + v * positionSize, position, positionSize);
+				memcpy(attributes + v * sizeof(rest), &rest, sizeof(rest));
+			}
+			addBounds(position);
+		}
+		if (file.split && !moved) {
+			memcpy(target, source, group.numVertices * sizeof(Vertex));
+		}
+		source += group.numVertices * sizeof(Vertex);
+		target += group.numVertices * sizeof(Vertex);
+
+		memcpy(target, source, group.numIndices * sizeof(uint16_t));
+		target += group.numIndices * sizeof(uint16_t);
+	}
 	uploadHeap->Unmap(0, NULL);
-	commandList->CopyBufferRegion(mesh->data.Get(), 0, uploadHeap, 0, bufferSize);
-
-	D3D12_RESOURCE_BARRIER rb = {};
-	rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	rb.Transition.pResource = mesh->data.Get();
-	rb.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-	rb.Transition.StateAfter =
-		D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
-		D3D12_RESOURCE_STATE_INDEX_BUFFER;
-	commandList->ResourceBarrier(1, &rb);
-
-	auto address = mesh->data->GetGPUVirtualAddress();
-	for (auto &group : groups) {
-		D3D12_VERTEX_BUFFER_VIEW vbv = {};
-		vbv.BufferLocation = address;
-		vbv.SizeInBytes = (UINT)(group.numVertices * sizeof(Vertex));
-		vbv.StrideInBytes = sizeof(Vertex);
-
-		mesh->vertexBuffers.push_back(vbv);
-		address += vbv.SizeInBytes;
-
-		D3D12_INDEX_BUFFER_VIEW ibv = {};
-		ibv.BufferLocation = address;
-		ibv.SizeInBytes = (UINT)(group.numIndices * sizeof(uint16_t));
-		ibv.Format = DXGI_FORMAT_R16_UINT;
-
-		mesh->indexBuffers.push_back(ibv);
-		address += ibv.SizeInBytes;
+
+	auto &geometry = context->geometry;
+	auto indexBuffer = geometry.indexBuffer.Get();
+	for (UINT i = 0; i < VERTEX_STREAM_COUNT; i++) {
+		context->transition(geometry.vertexBuffers[i].Get(), D3D12_RESOURCE_STATE_COPY_DEST);
+	}
+	context->transition(indexBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
+	context->flushBarriers(commandList);
+
+	UINT64 offset = 0;
+	for (auto &range : mesh->ranges) {
+		for (UINT i = 0; i < VERTEX_STREAM_COUNT; i++) {
+			auto streamSize = range.numVertices * VERTEX_STREAM_STRIDES[i];
+			commandList->CopyBufferRegion(
+				geometry.vertexBuffers[i].Get(), range.baseVertex * VERTEX_STREAM_STRIDES[i],
+				uploadHeap, offset, streamSize
+			);
+			offset += streamSize;
+		}
+
+		auto indexSize = range.numIndices * sizeof(uint16_t);
+		commandList->CopyBufferRegion(
+			indexBuffer, range.startIndex * sizeof(uint16_t), uploadHeap, offset, indexSize
+		);
+		offset += indexSize;
 	}
 
+	auto state = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER;
+	for (UINT i = 0; i < VERTEX_STREAM_COUNT; i++) {
+		context->transition(geometry.vertexBuffers[i].Get(), state);
+	}
+	context->transition(indexBuffer, state);
+	context->flushBarriers(commandList);
+
 	return S_OK;
-}
\ No newline at end of file
+}
+
+// Frames in flight may still draw the mesh, so its geometry is only reused once they retire.
+void Mesh::release(Context *context) {
+	for (auto &range : this->ranges) {
+		context->geometry.freeDeferred(&range);
+	}
+	this->ranges.clear();
+	this->groups.clear();
+}
@@ -1,3 +1,6 @@
+#pragma once
+#include "geometry.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <d3d12.h>
 #include <wrl/client.h>
@@ -6,13 +9,50 @@
 
 struct Context;
 
+// A whole vertex, as interleaved meshes store it.
+struct Vertex {
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	uint8_t joints[4];
+	uint8_t weights[4];
+};
+
+// The geometry arena keeps positions in a stream of their own, so that passes that only need
+// positions fetch 12 bytes a vertex, and everything else in the second.
+enum VertexStream : UINT {
+	VERTEX_STREAM_POSITION,
+	VERTEX_STREAM_ATTRIBUTES,
+	VERTEX_STREAM_COUNT,
+};
+
+struct VertexAttributes {
+	float normal[3];
+	float texcoord[2];
+	uint8_t joints[4];
+	uint8_t weights[4];
+};
+
+static const UINT VERTEX_STREAM_STRIDES[VERTEX_STREAM_COUNT] = {
+	3 * sizeof(float), sizeof(VertexAttributes),
+};
+
+// Meshes are read interleaved, or already split the way the geometry arena keeps them. Groups the
+// asset builder found to be copies of another are drawn from its geometry when they're exact, and
+// get their own, transformed as it's uploaded, when they're moved.
 struct Mesh {
-	Microsoft::WRL::ComPtr<ID3D12Resource> data;
-	std::vector<D3D12_VERTEX_BUFFER_VIEW> vertexBuffers;
-	std::vector<D3D12_INDEX_BUFFER_VIEW> indexBuffers;
+	// every group's draw, which several may share, and the geometry the mesh allocated
+	std::vector<GeometryRange> groups;
+	std::vector<GeometryRange> ranges;
+	float boundsMin[3];
+	float boundsMax[3];
+
+	// How much upload memory creating the mesh takes, which copies can make more than its size.
+	static HRESULT getUploadSize(const char *data, size_t size, size_t *uploadSize);
 
 	static HRESULT create(
 		Context *context, ID3D12GraphicsCommandList *commandList, ID3D12Resource *uploadHeap,
-		Mesh *mesh
+		const char *data, size_t size, Mesh *mesh
 	);
-};
\ No newline at end of file
+	void release(Context *context);
+};
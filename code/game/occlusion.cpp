@@ -0,0 +1,403 @@
+#include "occlusion.h"
+#include "simd.h"
+#include <cfloat>
+#include <cmath>
+
+// clip space w below which a vertex counts as behind the near plane
+static const float NEAR_W = 1e-4f;
+
+struct TriangleSetup {
+	int minX;
+	int maxX;
+	int minY;
+	int maxY;
+
+	// edge functions A * x + B * y + C, non-negative inside
+	float a[3];
+	float b[3];
+	float c[3];
+
+	// depth plane
+	float za;
+	float zb;
+	float zc;
+};
+
+static bool setupTriangle(
+	const float *v0, const float *v1, const float *v2, TriangleSetup *setup
+) {
+	auto area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+	if (area == 0.0f) {
+		return false;
+	}
+
+	// occluders are closed, so both windings are rasterized rather than culling back faces
+	if (area < 0.0f) {
+		auto t = v1;
+		v1 = v2;
+		v2 = t;
+		area = -area;
+	}
+
+	auto minX = std::fmin(v0[0], std::fmin(v1[0], v2[0]));
+	auto maxX = std::fmax(v0[0], std::fmax(v1[0], v2[0]));
+	auto minY = std::fmin(v0[1], std::fmin(v1[1], v2[1]));
+	auto maxY = std::fmax(v0[1], std::fmax(v1[1], v2[1]));
+	setup->minX = minX < 0.0f ? 0 : (int)minX;
+	setup->maxX = maxX > OcclusionBuffer::WIDTH - 1 ? OcclusionBuffer::WIDTH - 1 : (int)maxX;
+	setup->minY = minY < 0.0f ? 0 : (int)minY;
+	setup->maxY = maxY > OcclusionBuffer::HEIGHT - 1 ? OcclusionBuffer::HEIGHT - 1 : (int)maxY;
+	if (setup->minX > setup->maxX || setup->minY > setup->maxY) {
+		return false;
+	}
+
+	const float *vertices[] = { v0, v1, v2 };
+	for (int i = 0; i < 3; i++) {
+		auto va = vertices[(i + 1) % 3];
+		auto vb = vertices[(i + 2) % 3];
+		setup->a[i] = va[1] - vb[1];
+		setup->b[i] = vb[0] - va[0];
+		setup->c[i] = va[0] * vb[1] - va[1] * vb[0];
+	}
+
+	// edge i is opposite vertex i, so the normalized edge functions are barycentrics
+	setup->za = 0.0f;
+	setup->zb = 0.0f;
+	setup->zc = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		auto z = vertices[i][2] / area;
+		setup->za += setup->a[i] * z;
+		setup->zb += setup->b[i] * z;
+		setup->zc += setup->c[i] * z;
+	}
+
+	return true;
+}
+
+void OcclusionBuffer::create(OcclusionBuffer *buffer) {
+	buffer->depth.resize(OcclusionBuffer::WIDTH * OcclusionBuffer::HEIGHT);
+
+	size_t pyramidSize = 0;
+	uint32_t width = OcclusionBuffer::WIDTH;
+	uint32_t height = OcclusionBuffer::HEIGHT;
+	buffer->numLevels = 1;
+	while (buffer->numLevels < OcclusionBuffer::MAX_LEVELS && width > 1 && height > 1) {
+		width /= 2;
+		height /= 2;
+		pyramidSize += 2 * width * height;
+		buffer->numLevels++;
+	}
+	buffer->pyramid.resize(pyramidSize);
+
+	buffer->levels[0].width = OcclusionBuffer::WIDTH;
+	buffer->levels[0].height = OcclusionBuffer::HEIGHT;
+	buffer->levels[0].minDepth = buffer->depth.data();
+	buffer->levels[0].maxDepth = buffer->depth.data();
+
+	auto next = buffer->pyramid.data();
+	for (uint32_t i = 1; i < buffer->numLevels; i++) {
+		auto &level = buffer->levels[i];
+		level.width = buffer->levels[i - 1].width / 2;
+		level.height = buffer->levels[i - 1].height / 2;
+		level.minDepth = next;
+		next += level.width * level.height;
+		level.maxDepth = next;
+		next += level.width * level.height;
+	}
+
+	buffer->clear();
+}
+
+void OcclusionBuffer::clear() {
+	for (auto &d : this->depth) {
+		d = 1.0f;
+	}
+	this->stats = Stats();
+}
+
+void OcclusionBuffer::rasterize(
+	const float *positions, size_t numVertices, const uint16_t *indices, size_t numIndices,
+	const float *matrix
+) {
+	this->screen.resize(4 * numVertices);
+	for (size_t i = 0; i < numVertices; i++) {
+		auto p = &positions[3 * i];
+		float clip[4];
+		for (int r = 0; r < 4; r++) {
+			auto m = &matrix[4 * r];
+			clip[r] = m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3];
+		}
+
+		auto s = &this->screen[4 * i];
+		if (clip[3] < NEAR_W) {
+			s[3] = 0.0f;
+			continue;
+		}
+
+		auto invW = 1.0f / clip[3];
+		s[0] = (clip[0] * invW * 0.5f + 0.5f) * OcclusionBuffer::WIDTH;
+		s[1] = (0.5f - clip[1] * invW * 0.5f) * OcclusionBuffer::HEIGHT;
+		s[2] = clip[2] * invW;
+		s[3] = 1.0f;
+	}
+
+	for (size_t i = 0; i + 2 < numIndices; i += 3) {
+		auto v0 = &this->screen[4 * indices[i + 0]];
+		auto v1 = &this->screen[4 * indices[i + 1]];
+		auto v2 = &this->screen[4 * indices[i + 2]];
+
+		// dropping triangles that cross the near plane only ever makes culling less aggressive
+		if (v0[3] == 0.0f || v1[3] == 0.0f || v2[3] == 0.0f) {
+			continue;
+		}
+
+#if defined(SIMD_SSE)
+		if (this->useSimd) {
+			this->rasterizeTriangle(v0, v1, v2);
+		} else {
+			this->rasterizeTriangleScalar(v0, v1, v2);
+		}
+#else
+		this->rasterizeTriangleScalar(v0, v1, v2);
+#endif
+		this->stats.numTriangles++;
+	}
+}
+
+void OcclusionBuffer::rasterizeTriangle(const float *v0, const float *v1, const float *v2) {
+#if defined(SIMD_SSE)
+	TriangleSetup setup;
+	if (!setupTriangle(v0, v1, v2, &setup)) {
+		return;
+	}
+
+	// spans start on a multiple of four pixels, and evaluate the edge functions in the same
+	// order as the scalar rasterizer so the two produce identical coverage and depth
+	auto startX = setup.minX & ~3;
+	auto offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	auto zero = _mm_setzero_ps();
+
+	__m128 a[3];
+	for (int i = 0; i < 3; i++) {
+		a[i] = _mm_set1_ps(setup.a[i]);
+	}
+	auto za = _mm_set1_ps(setup.za);
+
+	for (auto y = setup.minY; y <= setup.maxY; y++) {
+		auto py = y + 0.5f;
+
+		__m128 rowE[3];
+		for (int i = 0; i < 3; i++) {
+			rowE[i] = _mm_set1_ps(setup.b[i] * py + setup.c[i]);
+		}
+		auto rowZ = _mm_set1_ps(setup.zb * py + setup.zc);
+
+		auto row = &this->depth[y * OcclusionBuffer::WIDTH];
+		for (auto x = startX; x <= setup.maxX; x += 4) {
+			auto px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			auto inside = _mm_and_ps(
+				_mm_and_ps(
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], px), rowE[0]), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], px), rowE[1]), zero)
+				),
+				_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], px), rowE[2]), zero)
+			);
+			if (_mm_movemask_ps(inside) == 0) {
+				continue;
+			}
+
+			auto z = _mm_add_ps(_mm_mul_ps(za, px), rowZ);
+			auto d = _mm_loadu_ps(&row[x]);
+			auto nearer = _mm_and_ps(inside, _mm_cmplt_ps(z, d));
+			d = _mm_or_ps(_mm_and_ps(nearer, z), _mm_andnot_ps(nearer, d));
+			_mm_storeu_ps(&row[x], d);
+		}
+	}
+#else
+	this->rasterizeTriangleScalar(v0, v1, v2);
+#endif
+}
+
+void OcclusionBuffer::rasterizeTriangleScalar(const float *v0, const float *v1, const float *v2) {
+	TriangleSetup setup;
+	if (!setupTriangle(v0, v1, v2, &setup)) {
+		return;
+	}
+
+	for (auto y = setup.minY; y <= setup.maxY; y++) {
+		auto py = y + 0.5f;
+
+		float rowE[3];
+		for (int i = 0; i < 3; i++) {
+			rowE[i] = setup.b[i] * py + setup.c[i];
+		}
+		auto rowZ = setup.zb * py + setup.zc;
+
+		auto row = &this->depth[y * OcclusionBuffer::WIDTH];
+		for (auto x = setup.minX; x <= setup.maxX; x++) {
+			auto px = (float)x + 0.5f;
+
+			bool inside = true;
+			for (int i = 0; i < 3; i++) {
+				inside &= setup.a[i] * px + rowE[i] >= 0.0f;
+			}
+			if (!inside) {
+				continue;
+			}
+
+			auto z = setup.za * px + rowZ;
+			if (z < row[x]) {
+				row[x] = z;
+			}
+		}
+	}
+}
+
+void OcclusionBuffer::buildHierarchy() {
+	for (uint32_t i = 1; i < this->numLevels; i++) {
+		auto &src = this->levels[i - 1];
+		auto &dst = this->levels[i];
+		for (uint32_t y = 0; y < dst.height; y++) {
+			auto minRow0 = &src.minDepth[2 * y * src.width];
+			auto minRow1 = minRow0 + src.width;
+			auto maxRow0 = &src.maxDepth[2 * y * src.width];
+			auto maxRow1 = maxRow0 + src.width;
+			for (uint32_t x = 0; x < dst.width; x++) {
+				auto min = std::fmin(
+					std::fmin(minRow0[2 * x], minRow0[2 * x + 1]),
+					std::fmin(minRow1[2 * x], minRow1[2 * x + 1])
+				);
+				auto max = std::fmax(
+					std::fmax(maxRow0[2 * x], maxRow0[2 * x + 1]),
+					std::fmax(maxRow1[2 * x], maxRow1[2 * x + 1])
+				);
+				dst.minDepth[y * dst.width + x] = min;
+				dst.maxDepth[y * dst.width + x] = max;
+			}
+		}
+	}
+}
+
+bool OcclusionBuffer::isVisible(const float *boundsMin, const float *boundsMax, const float *matrix) {
+	this->stats.numTests++;
+
+	auto minX = FLT_MAX;
+	auto maxX = -FLT_MAX;
+	auto minY = FLT_MAX;
+	auto maxY = -FLT_MAX;
+	auto minZ = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++) {
+		float p[3] = {
+			corner & 1 ? boundsMax[0] : boundsMin[0],
+			corner & 2 ? boundsMax[1] : boundsMin[1],
+			corner & 4 ? boundsMax[2] : boundsMin[2],
+		};
+
+		float clip[4];
+		for (int r = 0; r < 4; r++) {
+			auto m = &matrix[4 * r];
+			clip[r] = m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3];
+		}
+
+		// bounds that reach the camera are always visible
+		if (clip[3] < NEAR_W) {
+			return true;
+		}
+
+		auto invW = 1.0f / clip[3];
+		auto x = (clip[0] * invW * 0.5f + 0.5f) * OcclusionBuffer::WIDTH;
+		auto y = (0.5f - clip[1] * invW * 0.5f) * OcclusionBuffer::HEIGHT;
+		auto z = clip[2] * invW;
+		minX = std::fmin(minX, x);
+		maxX = std::fmax(maxX, x);
+		minY = std::fmin(minY, y);
+		maxY = std::fmax(maxY, y);
+		minZ = std::fmin(minZ, z);
+	}
+
+	if (minZ <= 0.0f) {
+		return true;
+	}
+	if (maxX < 0.0f || minX >= OcclusionBuffer::WIDTH || maxY < 0.0f || minY >= OcclusionBuffer::HEIGHT) {
+		this->stats.numOccluded++;
+		return false;
+	}
+
+	uint32_t x0 = minX < 0.0f ? 0 : (uint32_t)minX;
+	uint32_t x1 = maxX >= OcclusionBuffer::WIDTH ? OcclusionBuffer::WIDTH - 1 : (uint32_t)maxX;
+	uint32_t y0 = minY < 0.0f ? 0 : (uint32_t)minY;
+	uint32_t y1 = maxY >= OcclusionBuffer::HEIGHT ? OcclusionBuffer::HEIGHT - 1 : (uint32_t)maxY;
+
+	// start from the finest level where the bounds cover at most 2x2 texels
+	uint32_t start = 0;
+	while (
+		start + 1 < this->numLevels &&
+		((x1 >> start) - (x0 >> start) > 1 || (y1 >> start) - (y0 >> start) > 1)
+	) {
+		start++;
+	}
+
+	struct Texel {
+		uint32_t level;
+		uint32_t x;
+		uint32_t y;
+	};
+	Texel stack[4 * OcclusionBuffer::MAX_LEVELS];
+	size_t numTexels = 0;
+	for (auto y = y0 >> start; y <= y1 >> start; y++) {
+		for (auto x = x0 >> start; x <= x1 >> start; x++) {
+			stack[numTexels++] = { start, x, y };
+		}
+	}
+
+	while (numTexels > 0) {
+		auto texel = stack[--numTexels];
+		auto &level = this->levels[texel.level];
+		auto index = texel.y * level.width + texel.x;
+		if (minZ > level.maxDepth[index]) {
+			continue;
+		}
+		if (texel.level == 0 || minZ <= level.minDepth[index]) {
+			return true;
+		}
+
+		// ambiguous, so refine into the children that overlap the bounds
+		auto child = texel.level - 1;
+		for (auto y = 2 * texel.y; y <= 2 * texel.y + 1; y++) {
+			if (y < y0 >> child || y > y1 >> child) {
+				continue;
+			}
+			for (auto x = 2 * texel.x; x <= 2 * texel.x + 1; x++) {
+				if (x < x0 >> child || x > x1 >> child) {
+					continue;
+				}
+				stack[numTexels++] = { child, x, y };
+			}
+		}
+	}
+
+	this->stats.numOccluded++;
+	return false;
+}
+
+void makeBoxOccluder(
+	const float *boundsMin, const float *boundsMax, float *positions, uint16_t *indices
+) {
+	for (int corner = 0; corner < 8; corner++) {
+		positions[3 * corner + 0] = corner & 1 ? boundsMax[0] : boundsMin[0];
+		positions[3 * corner + 1] = corner & 2 ? boundsMax[1] : boundsMin[1];
+		positions[3 * corner + 2] = corner & 4 ? boundsMax[2] : boundsMin[2];
+	}
+
+	static const uint16_t faces[36] = {
+		0, 2, 1, 1, 2, 3,
+		4, 5, 6, 5, 7, 6,
+		0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,
+		0, 4, 2, 2, 4, 6,
+		1, 3, 5, 3, 7, 5,
+	};
+	for (int i = 0; i < 36; i++) {
+		indices[i] = faces[i];
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A low resolution software depth buffer for occlusion culling. Occluders are rasterized into it
+// four pixels at a time, and a min/max depth pyramid built over it lets bounds tests start from
+// a handful of coarse texels and only descend where the result is ambiguous.
+//
+// Matrices are row major and transform column vectors, the same layout the vertex shader reads.
+struct OcclusionBuffer {
+	static const uint32_t WIDTH = 256;
+	static const uint32_t HEIGHT = 128;
+	static const uint32_t MAX_LEVELS = 8;
+
+	struct Level {
+		uint32_t width;
+		uint32_t height;
+		float *minDepth;
+		float *maxDepth;
+	};
+
+	struct Stats {
+		uint32_t numTriangles;
+		uint32_t numTests;
+		uint32_t numOccluded;
+	};
+
+	// level 0 is the depth buffer itself, and serves as both its min and max
+	std::vector<float> depth;
+	std::vector<float> pyramid;
+	Level levels[MAX_LEVELS];
+	uint32_t numLevels;
+
+	// false selects the scalar rasterizer, which is also the reference for the SIMD one
+	bool useSimd = true;
+
+	std::vector<float> screen;
+	Stats stats;
+
+	static void create(OcclusionBuffer *buffer);
+
+	void clear();
+	void rasterize(
+		const float *positions, size_t numVertices, const uint16_t *indices, size_t numIndices,
+		const float *matrix
+	);
+	void buildHierarchy();
+
+	bool isVisible(const float *boundsMin, const float *boundsMax, const float *matrix);
+
+	void rasterizeTriangle(const float *v0, const float *v1, const float *v2);
+	void rasterizeTriangleScalar(const float *v0, const float *v1, const float *v2);
+};
+
+// Writes a closed box over the given bounds as an occluder, 8 positions and 36 indices.
+void makeBoxOccluder(
+	const float *boundsMin, const float *boundsMax, float *positions, uint16_t *indices
+);
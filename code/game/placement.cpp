@@ -0,0 +1,116 @@
+#include "placement.h"
+
+uint32_t PlacementPool::addHeap(uint64_t size, uint64_t granularity, uint64_t alignment) {
+	uint32_t index = 0;
+	while (index < this->heaps.size() && this->heaps[index].live) {
+		index++;
+	}
+	if (index == this->heaps.size()) {
+		this->heaps.emplace_back();
+	}
+
+	auto &heap = this->heaps[index];
+	heap.live = true;
+	Tlsf::create(size, granularity, &heap.tlsf);
+	heap.alignment = alignment;
+	heap.owners.clear();
+	heap.alignments.clear();
+	return index;
+}
+
+bool PlacementPool::allocate(
+	uint32_t skipHeap, uint64_t size, uint64_t alignment, void *owner, Placement *placement
+) {
+	for (uint32_t i = 0; i < this->heaps.size(); i++) {
+		auto &heap = this->heaps[i];
+		if (i == skipHeap || !heap.live || heap.alignment < alignment) {
+			continue;
+		}
+
+		uint32_t block;
+		uint64_t offset;
+		if (!heap.tlsf.allocate(size, alignment, &block, &offset)) {
+			continue;
+		}
+
+		if (heap.owners.size() <= block) {
+			heap.owners.resize(block + 1);
+			heap.alignments.resize(block + 1);
+		}
+		heap.owners[block] = owner;
+		heap.alignments[block] = alignment;
+
+		placement->heap = i;
+		placement->block = block;
+		placement->offset = offset;
+		placement->size = heap.tlsf.blocks[block].size;
+		placement->alignment = alignment;
+		return true;
+	}
+
+	return false;
+}
+
+bool PlacementPool::free(const Placement *placement) {
+	auto &heap = this->heaps[placement->heap];
+	heap.tlsf.free(placement->block);
+	heap.owners[placement->block] = NULL;
+
+	if (!heap.tlsf.isEmpty() || placement->heap == 0) {
+		return false;
+	}
+
+	heap.live = false;
+	heap.owners.clear();
+	heap.alignments.clear();
+	return true;
+}
+
+bool PlacementPool::beginDefragment(
+	uint64_t maxBytes, uint64_t *movedBytes, std::vector<PlacementMove> *moves
+) {
+	uint32_t source = NO_HEAP;
+	uint32_t numHeaps = 0;
+	for (uint32_t i = 0; i < this->heaps.size(); i++) {
+		if (!this->heaps[i].live || this->heaps[i].tlsf.isEmpty()) {
+			continue;
+		}
+
+		numHeaps++;
+		if (source == NO_HEAP || this->heaps[i].tlsf.used < this->heaps[source].tlsf.used) {
+			source = i;
+		}
+	}
+	if (numHeaps < 2) {
+		return true;
+	}
+
+	auto &heap = this->heaps[source];
+	for (uint32_t block = 0; block < heap.tlsf.blocks.size(); block++) {
+		auto &b = heap.tlsf.blocks[block];
+		if (b.state != Tlsf::BLOCK_ALLOCATED) {
+			continue;
+		}
+		if (*movedBytes + b.size > maxBytes) {
+			return false;
+		}
+
+		PlacementMove move = {};
+		move.owner = heap.owners[block];
+		move.source.heap = source;
+		move.source.block = block;
+		move.source.offset = b.offset;
+		move.source.size = b.size;
+		move.source.alignment = heap.alignments[block];
+
+		// MSAA targets need more than the default placement alignment
+		if (!this->allocate(source, b.size, move.source.alignment, move.owner, &move.dest)) {
+			break;
+		}
+
+		moves->push_back(move);
+		*movedBytes += b.size;
+	}
+
+	return true;
+}
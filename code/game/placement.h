@@ -0,0 +1,60 @@
+#pragma once
+#include "tlsf.h"
+#include <cstdint>
+#include <vector>
+
+// Where an allocation sits in one of a pool's heaps.
+struct Placement {
+	uint32_t heap = 0;
+	uint32_t block = Tlsf::NULL_BLOCK;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint64_t alignment = 0;
+};
+
+// An allocation defragmentation wants moved. The destination is already allocated, and the
+// source stays allocated until the owner has copied it and the move is finished.
+struct PlacementMove {
+	void *owner;
+	Placement source;
+	Placement dest;
+};
+
+// The bookkeeping of a pool of GPU heaps: which allocation is placed where, and which to move to
+// empty a heap. It is kept apart from the heaps themselves so that it runs without a GPU; the
+// caller creates the memory behind a heap when it adds one, and releases it when free says so.
+struct PlacementPool {
+	static const uint32_t NO_HEAP = UINT32_MAX;
+
+	struct Heap {
+		bool live = false;
+		Tlsf tlsf;
+
+		// what the memory behind the heap is aligned to, which offsets in it can't improve on
+		uint64_t alignment = 0;
+
+		// by block, so that defragmentation can place a moved allocation the same way
+		std::vector<void*> owners;
+		std::vector<uint64_t> alignments;
+	};
+
+	std::vector<Heap> heaps;
+
+	// Takes the first released slot, so the heaps of live allocations keep their indices.
+	uint32_t addHeap(uint64_t size, uint64_t granularity, uint64_t alignment);
+
+	// Tries the live heaps aligned at least as strictly as asked, in order, other than skipHeap.
+	bool allocate(
+		uint32_t skipHeap, uint64_t size, uint64_t alignment, void *owner, Placement *placement
+	);
+
+	// Returns true when the heap emptied and was released. The first heap is kept even when empty,
+	// to avoid churn as it empties and refills.
+	bool free(const Placement *placement);
+
+	// Plans moves that drain the emptiest heap into the others, for as long as the bytes moved
+	// stay within maxBytes, counting from movedBytes. Returns false once that budget is spent.
+	bool beginDefragment(
+		uint64_t maxBytes, uint64_t *movedBytes, std::vector<PlacementMove> *moves
+	);
+};
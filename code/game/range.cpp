@@ -0,0 +1,139 @@
+#include "range.h"
+#include <algorithm>
+
+void RangeAllocator::create(uint32_t capacity, RangeAllocator *allocator) {
+	allocator->capacity = capacity;
+	allocator->used = 0;
+	allocator->freeRanges.clear();
+	allocator->freedThisFrame.clear();
+	allocator->retiring.clear();
+	if (capacity > 0) {
+		allocator->freeRanges.push_back(Range { 0, capacity });
+	}
+}
+
+bool RangeAllocator::allocate(uint32_t size, uint32_t alignment, uint32_t *offset) {
+	if (size == 0) {
+		return false;
+	}
+
+	// best fit keeps the large ranges intact for large allocations
+	size_t best = this->freeRanges.size();
+	uint32_t bestWaste = UINT32_MAX;
+	uint32_t bestOffset = 0;
+	for (size_t i = 0; i < this->freeRanges.size(); i++) {
+		auto &range = this->freeRanges[i];
+		auto aligned = (range.offset + alignment - 1) / alignment * alignment;
+		auto padding = aligned - range.offset;
+		if (range.size < size || range.size - size < padding) {
+			continue;
+		}
+
+		auto waste = range.size - size;
+		if (waste < bestWaste) {
+			best = i;
+			bestWaste = waste;
+			bestOffset = aligned;
+			if (waste == 0) {
+				break;
+			}
+		}
+	}
+
+	if (best == this->freeRanges.size()) {
+		return false;
+	}
+
+	auto range = this->freeRanges[best];
+	auto before = Range { range.offset, bestOffset - range.offset };
+	auto after = Range { bestOffset + size, range.offset + range.size - (bestOffset + size) };
+
+	if (before.size > 0 && after.size > 0) {
+		this->freeRanges[best] = before;
+		this->freeRanges.insert(this->freeRanges.begin() + best + 1, after);
+	} else if (before.size > 0) {
+		this->freeRanges[best] = before;
+	} else if (after.size > 0) {
+		this->freeRanges[best] = after;
+	} else {
+		this->freeRanges.erase(this->freeRanges.begin() + best);
+	}
+
+	this->used += size;
+	*offset = bestOffset;
+	return true;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t size) {
+	if (size == 0) {
+		return;
+	}
+
+	auto next = std::lower_bound(
+		this->freeRanges.begin(), this->freeRanges.end(), offset,
+		[](const Range &range, uint32_t offset) { return range.offset < offset; }
+	);
+
+	bool mergePrev = next != this->freeRanges.begin() &&
+		(next - 1)->offset + (next - 1)->size == offset;
+	bool mergeNext = next != this->freeRanges.end() && offset + size == next->offset;
+
+	if (mergePrev && mergeNext) {
+		(next - 1)->size += size + next->size;
+		this->freeRanges.erase(next);
+	} else if (mergePrev) {
+		(next - 1)->size += size;
+	} else if (mergeNext) {
+		next->offset = offset;
+		next->size += size;
+	} else {
+		this->freeRanges.insert(next, Range { offset, size });
+	}
+
+	this->used -= size;
+}
+
+void RangeAllocator::freeDeferred(uint32_t offset, uint32_t size) {
+	if (size > 0) {
+		this->freedThisFrame.push_back(Range { offset, size });
+	}
+}
+
+void RangeAllocator::finishFrame(uint64_t fenceValue) {
+	for (auto &range : this->freedThisFrame) {
+		this->retiring.push_back(RetiringRange { fenceValue, range });
+	}
+	this->freedThisFrame.clear();
+}
+
+void RangeAllocator::retire(uint64_t completedFenceValue) {
+	size_t numRetired = 0;
+	while (
+		numRetired < this->retiring.size() &&
+		this->retiring[numRetired].fenceValue <= completedFenceValue
+	) {
+		auto &range = this->retiring[numRetired].range;
+		this->free(range.offset, range.size);
+		numRetired++;
+	}
+	this->retiring.erase(this->retiring.begin(), this->retiring.begin() + numRetired);
+}
+
+RangeAllocator::Stats RangeAllocator::getStats() const {
+	Stats stats = {};
+	stats.capacity = this->capacity;
+	stats.used = this->used;
+	stats.numFreeRanges = (uint32_t)this->freeRanges.size();
+
+	uint32_t totalFree = 0;
+	for (auto &range : this->freeRanges) {
+		totalFree += range.size;
+		stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+	}
+
+	if (totalFree > 0) {
+		stats.fragmentation = 1.0f - (float)stats.largestFreeRange / totalFree;
+	}
+
+	return stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct RangeAllocator {
+	struct Range {
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct Stats {
+		uint32_t capacity;
+		uint32_t used;
+		uint32_t numFreeRanges;
+		uint32_t largestFreeRange;
+		float fragmentation;
+	};
+
+	uint32_t capacity = 0;
+	uint32_t used = 0;
+
+	// sorted by offset, never adjacent
+	std::vector<Range> freeRanges;
+
+	// Ranges freed while frames in flight may still read them, which stay in use until the
+	// frame they were freed in has retired, oldest frame first.
+	struct RetiringRange {
+		uint64_t fenceValue;
+		Range range;
+	};
+	std::vector<Range> freedThisFrame;
+	std::vector<RetiringRange> retiring;
+
+	static void create(uint32_t capacity, RangeAllocator *allocator);
+
+	bool allocate(uint32_t size, uint32_t alignment, uint32_t *offset);
+	void free(uint32_t offset, uint32_t size);
+
+	// Frees a range once the frame being recorded has retired.
+	void freeDeferred(uint32_t offset, uint32_t size);
+	void finishFrame(uint64_t fenceValue);
+	void retire(uint64_t completedFenceValue);
+
+	Stats getStats() const;
+};
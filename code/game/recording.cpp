@@ -0,0 +1,105 @@
+#include "recording.h"
+#include "accounting.h"
+#include "arena.h"
+#include "indirect.h"
+
+void RecordingBackend::create(uint64_t uploadSize, RecordingBackend *backend) {
+	backend->memory.resize(uploadSize);
+	FrameRing::create(uploadSize, &backend->ring);
+}
+
+bool RecordingBackend::allocateUpload(
+	uint64_t size, uint64_t alignment, void **data, uint64_t *address
+) {
+	uint64_t offset;
+	if (!this->ring.allocate(size, alignment, &offset)) {
+		return false;
+	}
+
+	*data = &this->memory[offset];
+	*address = RecordingBackend::BASE_ADDRESS + offset;
+	this->pendingStats.uploadBytes += size;
+	if (this->capture) {
+		this->capture->addUpload(*address, size, *data);
+	}
+	return true;
+}
+
+bool RecordingBackend::renderFrame(const FrameData *frame) {
+	MemoryScope scope(MEMORY_RENDER);
+	auto queue = frame->queue;
+	auto capture = this->capture;
+	if (capture) {
+		capture->beginFrame();
+	}
+
+	this->batches.clear();
+	for (auto &batch : queue->batches) {
+		if (capture && batch.setRootSignature) {
+			capture->setRootSignature(batch.pipeline);
+			capture->setRootConstantBuffer(0, frame->constants);
+			capture->setRootShaderResource(2, frame->skinMatrices);
+
+			// there are no descriptors here, but the stream should match the renderer's
+			capture->setRootDescriptorTable(3, 0);
+		}
+		if (capture && batch.setPipeline) {
+			capture->setPipeline(batch.pipeline);
+		}
+
+		void *commands;
+		uint64_t commandsAddress;
+		if (!this->allocateUpload(
+			batch.count * sizeof(IndirectCommand), sizeof(uint32_t), &commands, &commandsAddress
+		)) {
+			return false;
+		}
+
+		auto draws = queue->getIndirectDraws(&batch);
+		packIndirectCommands(&draws, (IndirectCommand*)commands);
+		if (capture) {
+			capture->executeIndirect(batch.pipeline, (uint32_t)batch.count, commandsAddress);
+		}
+
+		Batch recorded = {
+			batch.rootSignature, batch.pipeline, batch.setRootSignature, batch.setPipeline,
+			commandsAddress, (uint32_t)batch.count
+		};
+		this->batches.push_back(recorded);
+
+		this->pendingStats.batches++;
+		this->pendingStats.draws += batch.count;
+		this->pendingStats.rootSignatureChanges += batch.setRootSignature ? 1 : 0;
+		this->pendingStats.pipelineChanges += batch.setPipeline ? 1 : 0;
+	}
+	this->lastFrame = *frame;
+	if (capture) {
+		capture->endFrame();
+	}
+
+	auto &stats = this->pendingStats;
+	stats.frames = 1;
+	this->totalStats.frames++;
+	this->totalStats.batches += stats.batches;
+	this->totalStats.draws += stats.draws;
+	this->totalStats.rootSignatureChanges += stats.rootSignatureChanges;
+	this->totalStats.pipelineChanges += stats.pipelineChanges;
+	this->totalStats.uploadBytes += stats.uploadBytes;
+	this->frameStats = stats;
+	stats = Stats();
+
+	this->frameNumber++;
+	this->ring.finishFrame(this->frameNumber);
+	if (this->frameNumber > RecordingBackend::FRAME_LATENCY) {
+		this->ring.retire(this->frameNumber - RecordingBackend::FRAME_LATENCY);
+	}
+
+	// as at present, the frame's CPU data has been consumed
+	FrameArena::resetAll();
+
+	return true;
+}
+
+void *RecordingBackend::getData(uint64_t address) {
+	return &this->memory[address - RecordingBackend::BASE_ADDRESS];
+}
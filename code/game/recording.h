@@ -0,0 +1,61 @@
+#pragma once
+#include "backend.h"
+#include "capture.h"
+#include "ring.h"
+#include <cstdint>
+#include <vector>
+
+// A headless backend that does the CPU work of submitting a frame and records what would have been
+// sent. Upload memory comes from a CPU ring whose frames retire a fixed number of frames later, as
+// if a GPU were that far behind, and every batch is packed into indirect commands like the D3D12
+// renderer does.
+struct RecordingBackend : RenderBackend {
+	// fake GPU addresses start here, so that a zero address is never valid
+	static const uint64_t BASE_ADDRESS = 0x10000;
+	static const uint64_t FRAME_LATENCY = 2;
+
+	struct Batch {
+		uint32_t rootSignature;
+		uint32_t pipeline;
+		bool setRootSignature;
+		bool setPipeline;
+		uint64_t commands;
+		uint32_t count;
+	};
+
+	struct Stats {
+		uint64_t frames;
+		uint64_t batches;
+		uint64_t draws;
+		uint64_t rootSignatureChanges;
+		uint64_t pipelineChanges;
+		uint64_t uploadBytes;
+	};
+
+	std::vector<uint8_t> memory;
+	FrameRing ring;
+	uint64_t frameNumber = 0;
+
+	// the batches of the last frame
+	std::vector<Batch> batches;
+	FrameData lastFrame;
+
+	// the frame being recorded, the last complete frame, and every frame so far
+	Stats pendingStats = {};
+	Stats frameStats = {};
+	Stats totalStats = {};
+
+	// when set, records the commands the D3D12 renderer would have, minus geometry and barriers
+	CommandCapture *capture = NULL;
+
+	static void create(uint64_t uploadSize, RecordingBackend *backend);
+
+	bool allocateUpload(
+		uint64_t size, uint64_t alignment, void **data, uint64_t *address
+	) override;
+
+	bool renderFrame(const FrameData *frame) override;
+
+	// Resolves a fake GPU address back to the memory it was handed out with.
+	void *getData(uint64_t address);
+};
@@ -0,0 +1,136 @@
+#include "reload.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+bool parseReloadMessage(const char *data, size_t size, ReloadRequest *request) {
+	auto end = data + size;
+	auto line = std::find(data, end, '\n');
+	if (line == end) {
+		return false;
+	}
+
+	char header[64] = {};
+	memcpy(header, data, std::min((size_t)(line - data), sizeof(header) - 1));
+	uint32_t version;
+	uint64_t generation;
+	size_t count;
+	if (
+		sscanf(header, "reload %" SCNu32 " %" SCNu64 " %zu", &version, &generation, &count) != 3 ||
+		version != RELOAD_VERSION
+	) {
+		return false;
+	}
+
+	// every name is checked before any is added, so that a bad message adds nothing
+	std::vector<std::string> names;
+	for (auto next = line + 1; next != end;) {
+		line = std::find(next, end, '\n');
+		if (line == end || line == next) {
+			return false;
+		}
+		names.emplace_back(next, line);
+		next = line + 1;
+	}
+	if (names.size() != count) {
+		return false;
+	}
+
+	request->generation = std::max(request->generation, generation);
+	for (auto &name : names) {
+		auto &known = request->names;
+		if (std::find(known.begin(), known.end(), name) == known.end()) {
+			known.push_back(std::move(name));
+		}
+	}
+	return true;
+}
+
+bool ReloadListener::create(uint16_t port, ReloadListener *listener) {
+#ifdef _WIN32
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+		return false;
+	}
+#endif
+
+	auto handle = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	listener->socket = (intptr_t)handle;
+	if (listener->socket == -1) {
+		listener->close();
+		return false;
+	}
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressSize = sizeof(address);
+	if (
+		bind(handle, (const sockaddr*)&address, addressSize) != 0 ||
+		getsockname(handle, (sockaddr*)&address, &addressSize) != 0
+	) {
+		listener->close();
+		return false;
+	}
+	listener->port = ntohs(address.sin_port);
+
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	auto blocking = ioctlsocket(handle, FIONBIO, &nonBlocking) != 0;
+#else
+	auto blocking = fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_NONBLOCK) != 0;
+#endif
+	if (blocking) {
+		listener->close();
+		return false;
+	}
+	return true;
+}
+
+bool ReloadListener::poll(ReloadRequest *request) {
+	// the buffer has room for one more byte than a message can have, to tell when one was cut off
+	char message[RELOAD_MAX_MESSAGE + 1];
+	auto received = false;
+	while (true) {
+#ifdef _WIN32
+		auto size = recv((SOCKET)this->socket, message, (int)sizeof(message), 0);
+#else
+		auto size = recv((int)this->socket, message, sizeof(message), 0);
+#endif
+		if (size < 0) {
+			break;
+		}
+		if ((size_t)size <= RELOAD_MAX_MESSAGE && parseReloadMessage(message, size, request)) {
+			received = true;
+		}
+	}
+	return received;
+}
+
+void ReloadListener::close() {
+#ifdef _WIN32
+	if (this->socket != -1) {
+		closesocket((SOCKET)this->socket);
+	}
+	WSACleanup();
+#else
+	if (this->socket != -1) {
+		::close((int)this->socket);
+	}
+#endif
+	this->socket = -1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// The asset builder in watch mode sends these, and its side in tools/asset-builder/reload.h has to
+// agree on all of them. Each message is a "reload version generation count" line followed by the
+// names of count assets that changed, one to a line.
+static const uint16_t RELOAD_PORT = 47110;
+static const uint32_t RELOAD_VERSION = 1;
+static const size_t RELOAD_MAX_MESSAGE = 8192;
+
+// What changed over one or more builds: the last build heard of, and each asset that changed in
+// any of them once.
+struct ReloadRequest {
+	uint64_t generation = 0;
+	std::vector<std::string> names;
+};
+
+// Adds what a message lists to the request, and fails for anything that isn't a whole message of
+// this version.
+bool parseReloadMessage(const char *data, size_t size, ReloadRequest *request);
+
+// Receives the builder's messages on the loopback interface, without ever blocking the frame.
+struct ReloadListener {
+	// a SOCKET on Windows
+	intptr_t socket = -1;
+	uint16_t port = 0;
+
+	// A port of zero picks a free one, which is then in port.
+	static bool create(uint16_t port, ReloadListener *listener);
+
+	// Adds every message that arrived since the last poll to the request, and returns whether
+	// there were any. Messages that don't parse are dropped.
+	bool poll(ReloadRequest *request);
+
+	void close();
+};
@@ -0,0 +1,298 @@
+#include "renderer.h"
+#include "accounting.h"
+#include "context.h"
+#include "indirect.h"
+#include "material.h"
+#include "texture.h"
+#include "util.h"
+#include <cstring>
+
+void Renderer::create(
+	Context *context, Material *const *materials, size_t numMaterials,
+	TextureStreaming *streaming, Renderer *renderer
+) {
+	renderer->context = context;
+	renderer->materials = materials;
+	renderer->numMaterials = numMaterials;
+	renderer->streaming = streaming;
+}
+
+bool Renderer::allocateUpload(uint64_t size, uint64_t alignment, void **data, uint64_t *address) {
+	D3D12_GPU_VIRTUAL_ADDRESS gpuAddress;
+	UINT64 offset;
+	if (!this->context->uploads.allocate(size, alignment, data, &gpuAddress, &offset)) {
+		this->result = E_OUTOFMEMORY;
+		return false;
+	}
+
+	if (this->context->capture) {
+		this->context->capture->addUpload(gpuAddress, size, *data);
+	}
+
+	*address = gpuAddress;
+	return true;
+}
+
+bool Renderer::renderFrame(const FrameData *frame) {
+	MemoryScope scope(MEMORY_RENDER);
+	this->result = this->render(frame);
+	return SUCCEEDED(this->result);
+}
+
+HRESULT Renderer::render(const FrameData *frame) {
+	return this->submit([&](GraphPassContext *pass) {
+		this->drawQueue(pass, frame);
+	});
+}
+
+HRESULT Renderer::replay(const CaptureFrame *frame) {
+	MemoryScope scope(MEMORY_RENDER);
+	this->replayUploads.clear();
+	for (auto &upload : frame->uploads) {
+		void *data;
+		ReplayUpload replayed;
+		if (!this->context->uploads.allocate(
+			upload.size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT,
+			&data, &replayed.address, &replayed.offset
+		)) {
+			return E_OUTOFMEMORY;
+		}
+
+		memcpy(data, upload.data, upload.size);
+		this->replayUploads.push_back(replayed);
+	}
+
+	return this->submit([&](GraphPassContext *pass) {
+		this->replayCommands(pass, frame);
+	});
+}
+
+HRESULT Renderer::submit(const std::function<void(GraphPassContext*)> &draw) {
+	auto context = this->context;
+	auto renderTarget = context->renderTargets[context->frameIndex].Get();
+	auto rtv = context->rtvHeap->GetCPUDescriptorHandleForHeapStart();
+	rtv.ptr += context->frameIndex * context->rtvDescriptorSize;
+
+	D3D12_VIEWPORT viewport = {};
+	viewport.Width = (float)context->width;
+	viewport.Height = (float)context->height;
+	viewport.MaxDepth = 1.0f;
+
+	D3D12_RECT scissor = {};
+	scissor.right = context->width;
+	scissor.bottom = context->height;
+
+	auto &graph = this->graph;
+	graph.reset();
+	auto backBuffer = graph.importTexture(
+		renderTarget, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_RENDER_TARGET
+	);
+
+	GraphTextureDesc depthDesc;
+	context->transients.describe(
+		context->device.Get(), DXGI_FORMAT_D32_FLOAT, context->width, context->height,
+		D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE,
+		&depthDesc
+	);
+	auto depth = graph.createTexture(&depthDesc);
+
+	auto scene = graph.addPass("scene", [&](GraphPassContext *pass) {
+		auto commandList = pass->commandList;
+		auto dsv = pass->heap->getView(depth);
+		commandList->OMSetRenderTargets(1, &rtv, FALSE, &dsv);
+
+		FLOAT clearColor[] = { 0.0f, 0.3f, 0.6f, 1.0f };
+		commandList->ClearRenderTargetView(rtv, clearColor, 0, NULL);
+		commandList->ClearDepthStencilView(dsv, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, NULL);
+
+		commandList->RSSetViewports(1, &viewport);
+		commandList->RSSetScissorRects(1, &scissor);
+		commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		draw(pass);
+	});
+	graph.write(scene, backBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	graph.write(scene, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	graph.compile();
+
+	TRY(context->transients.realize(context, &graph));
+	TRY(context->prepare());
+	TRY(this->streaming->record(context, context->commandList.Get(), &this->textures));
+
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
+	TRY(context->transients.execute(context, &graph, context->commandList.Get()));
+	QueryPerformanceCounter(&end);
+	this->recordTicks = end.QuadPart - start.QuadPart;
+
+	TRY(context->present());
+
+	return S_OK;
+}
+
+void Renderer::drawQueue(GraphPassContext *pass, const FrameData *frame) {
+	auto commandList = pass->commandList;
+	auto &geometry = pass->context->geometry;
+	auto capture = pass->context->capture;
+
+	geometry.bind(commandList);
+	if (capture) {
+		for (UINT i = 0; i < geometry.numVertexStreams; i++) {
+			auto &vertices = geometry.vertexBufferViews[i];
+			capture->setVertexBuffer(
+				i, vertices.BufferLocation, vertices.SizeInBytes, vertices.StrideInBytes
+			);
+		}
+		auto &indices = geometry.indexBufferView;
+		capture->setIndexBuffer(indices.BufferLocation, indices.SizeInBytes, indices.Format);
+	}
+
+	auto queue = frame->queue;
+	for (auto &batch : queue->batches) {
+		auto batchMaterial = this->materials[batch.pipeline];
+		if (batch.setRootSignature) {
+			commandList->SetGraphicsRootSignature(batchMaterial->rootSignature.Get());
+			commandList->SetGraphicsRootConstantBufferView(0, frame->constants);
+			commandList->SetGraphicsRootShaderResourceView(2, frame->skinMatrices);
+			commandList->SetGraphicsRootDescriptorTable(3, this->textures);
+			if (capture) {
+				capture->setRootSignature(batch.pipeline);
+				capture->setRootConstantBuffer(0, frame->constants);
+				capture->setRootShaderResource(2, frame->skinMatrices);
+				capture->setRootDescriptorTable(3, this->textures.ptr);
+			}
+		}
+		if (batch.setPipeline) {
+			commandList->SetPipelineState(batchMaterial->pipelineState.Get());
+			if (capture) {
+				capture->setPipeline(batch.pipeline);
+			}
+		}
+
+		void *commands;
+		D3D12_GPU_VIRTUAL_ADDRESS commandsAddress;
+		UINT64 commandsOffset;
+		auto commandsSize = batch.count * sizeof(IndirectCommand);
+		if (!pass->context->uploads.allocate(
+			commandsSize, sizeof(UINT), &commands, &commandsAddress, &commandsOffset
+		)) {
+			pass->result = E_OUTOFMEMORY;
+			return;
+		}
+
+		auto draws = queue->getIndirectDraws(&batch);
+		packIndirectCommands(&draws, (IndirectCommand*)commands);
+		commandList->ExecuteIndirect(
+			batchMaterial->commandSignature.Get(), (UINT)draws.count,
+			pass->context->uploads.buffer.Get(), commandsOffset, NULL, 0
+		);
+		if (capture) {
+			capture->addUpload(commandsAddress, commandsSize, commands);
+			capture->executeIndirect(batch.pipeline, (uint32_t)draws.count, commandsAddress);
+		}
+	}
+}
+
+void Renderer::replayCommands(GraphPassContext *pass, const CaptureFrame *frame) {
+	auto commandList = pass->commandList;
+	auto &geometry = pass->context->geometry;
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < frame->numCommands; i++) {
+		CaptureCommand command;
+		if (!frame->next(&offset, &command)) {
+			pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+			return;
+		}
+
+		if (
+			(
+				command.op == CAPTURE_SET_ROOT_SIGNATURE || command.op == CAPTURE_SET_PIPELINE ||
+				command.op == CAPTURE_EXECUTE_INDIRECT
+			) &&
+			command.id >= this->numMaterials
+		) {
+			pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+			return;
+		}
+
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+		UINT64 uploadOffset;
+		switch (command.op) {
+		case CAPTURE_SET_ROOT_SIGNATURE:
+			commandList->SetGraphicsRootSignature(this->materials[command.id]->rootSignature.Get());
+			break;
+
+		case CAPTURE_SET_PIPELINE:
+			commandList->SetPipelineState(this->materials[command.id]->pipelineState.Get());
+			break;
+
+		case CAPTURE_SET_ROOT_CBV:
+		case CAPTURE_SET_ROOT_SRV:
+			if (!this->findReplayUpload(frame, command.address, &address, &uploadOffset)) {
+				pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+				return;
+			}
+			if (command.op == CAPTURE_SET_ROOT_CBV) {
+				commandList->SetGraphicsRootConstantBufferView(command.index, address);
+			} else {
+				commandList->SetGraphicsRootShaderResourceView(command.index, address);
+			}
+			break;
+
+		case CAPTURE_SET_ROOT_TABLE:
+			commandList->SetGraphicsRootDescriptorTable(command.index, this->textures);
+			break;
+
+		// geometry lives in the arena rather than the capture, so binds use the arena's views
+		case CAPTURE_SET_VERTEX_BUFFER:
+			if (command.index >= geometry.numVertexStreams) {
+				pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+				return;
+			}
+			commandList->IASetVertexBuffers(
+				command.index, 1, &geometry.vertexBufferViews[command.index]
+			);
+			break;
+
+		case CAPTURE_SET_INDEX_BUFFER:
+			commandList->IASetIndexBuffer(&geometry.indexBufferView);
+			break;
+
+		case CAPTURE_EXECUTE_INDIRECT:
+			if (!this->findReplayUpload(frame, command.address, &address, &uploadOffset)) {
+				pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+				return;
+			}
+			commandList->ExecuteIndirect(
+				this->materials[command.id]->commandSignature.Get(), command.count,
+				pass->context->uploads.buffer.Get(), uploadOffset, NULL, 0
+			);
+			break;
+
+		// the captured resources don't exist in this run, and the graph already issues the
+		// barriers this frame needs
+		case CAPTURE_BARRIERS:
+			break;
+
+		default:
+			pass->result = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+			return;
+		}
+	}
+}
+
+bool Renderer::findReplayUpload(
+	const CaptureFrame *frame, uint64_t address, D3D12_GPU_VIRTUAL_ADDRESS *gpuAddress,
+	UINT64 *offset
+) {
+	auto upload = frame->findUpload(address);
+	if (!upload) {
+		return false;
+	}
+
+	auto &replayed = this->replayUploads[upload - frame->uploads.data()];
+	*gpuAddress = replayed.address + (address - upload->address);
+	*offset = replayed.offset + (address - upload->address);
+	return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "backend.h"
+#include "capture.h"
+#include "graph.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <Windows.h>
+#include <functional>
+#include <vector>
+
+struct Context;
+struct Material;
+struct TextureStreaming;
+
+// Renders frames with D3D12: a render graph with one scene pass that draws each batch of the
+// queue with ExecuteIndirect, followed by present. The same pass can instead re-submit a captured
+// frame, to time its submission cost.
+struct Renderer : RenderBackend {
+	Context *context;
+	Material *const *materials;
+	size_t numMaterials;
+
+	// the textures every material samples from, and this frame's table of them
+	TextureStreaming *streaming;
+	D3D12_GPU_DESCRIPTOR_HANDLE textures = {};
+
+	RenderGraph graph;
+
+	// where each upload of the frame being replayed went
+	struct ReplayUpload {
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+		UINT64 offset;
+	};
+	std::vector<ReplayUpload> replayUploads;
+
+	// the first failure, since the backend interface only reports success
+	HRESULT result = S_OK;
+
+	// how long the last frame took to record its command list, in performance counter ticks
+	LONGLONG recordTicks = 0;
+
+	static void create(
+		Context *context, Material *const *materials, size_t numMaterials,
+		TextureStreaming *streaming, Renderer *renderer
+	);
+
+	bool allocateUpload(
+		uint64_t size, uint64_t alignment, void **data, uint64_t *address
+	) override;
+
+	bool renderFrame(const FrameData *frame) override;
+	HRESULT render(const FrameData *frame);
+	HRESULT replay(const CaptureFrame *frame);
+
+	HRESULT submit(const std::function<void(GraphPassContext*)> &draw);
+	void drawQueue(GraphPassContext *pass, const FrameData *frame);
+	void replayCommands(GraphPassContext *pass, const CaptureFrame *frame);
+	bool findReplayUpload(
+		const CaptureFrame *frame, uint64_t address, D3D12_GPU_VIRTUAL_ADDRESS *gpuAddress,
+		UINT64 *offset
+	);
+};
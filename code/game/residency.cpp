@@ -0,0 +1,156 @@
+#include "residency.h"
+
+void ResidencySet::create(uint64_t budget, ResidencySet *set) {
+	*set = ResidencySet();
+	set->budget = budget;
+}
+
+void ResidencySet::setBudget(uint64_t budget, uint64_t currentUsage) {
+	// memory outside the set, like swap chain buffers and descriptor heaps, comes off the top
+	auto unmanaged = currentUsage > this->residentBytes ? currentUsage - this->residentBytes : 0;
+	this->budget = budget > unmanaged ? budget - unmanaged : 0;
+}
+
+uint32_t ResidencySet::add(uint64_t size) {
+	uint32_t object;
+	if (!this->freeObjects.empty()) {
+		object = this->freeObjects.back();
+		this->freeObjects.pop_back();
+	} else {
+		object = (uint32_t)this->objects.size();
+		this->objects.emplace_back();
+	}
+
+	// new objects are created resident
+	auto &o = this->objects[object];
+	o.size = size;
+	o.lastUsed = this->currentFence;
+	o.resident = true;
+	o.live = true;
+	this->residentBytes += size;
+
+	this->link(object);
+	return object;
+}
+
+void ResidencySet::remove(uint32_t object) {
+	auto &o = this->objects[object];
+	if (o.resident) {
+		this->residentBytes -= o.size;
+	}
+	o.live = false;
+
+	for (size_t i = 0; i < this->pending.size(); i++) {
+		if (this->pending[i] == object) {
+			this->pending[i] = this->pending.back();
+			this->pending.pop_back();
+			break;
+		}
+	}
+
+	this->unlink(object);
+	this->freeObjects.push_back(object);
+}
+
+void ResidencySet::beginFrame(uint64_t fenceValue) {
+	this->currentFence = fenceValue;
+}
+
+void ResidencySet::use(uint32_t object) {
+	auto &o = this->objects[object];
+	if (o.lastUsed == this->currentFence && this->last == object) {
+		return;
+	}
+
+	if (!o.resident && o.lastUsed != this->currentFence) {
+		this->pending.push_back(object);
+	}
+	o.lastUsed = this->currentFence;
+
+	this->unlink(object);
+	this->link(object);
+}
+
+void ResidencySet::update(
+	uint64_t completedFenceValue,
+	std::vector<uint32_t> *evict, std::vector<uint32_t> *makeResident
+) {
+	auto needed = this->residentBytes;
+	for (auto object : this->pending) {
+		needed += this->objects[object].size;
+	}
+
+	// the list is ordered by last use, so the first object still in flight ends the search
+	for (auto object = this->first; object != NULL_OBJECT && needed > this->budget; ) {
+		auto &o = this->objects[object];
+		if (o.lastUsed > completedFenceValue) {
+			break;
+		}
+
+		if (o.resident) {
+			o.resident = false;
+			this->residentBytes -= o.size;
+			needed -= o.size;
+			evict->push_back(object);
+		}
+		object = o.next;
+	}
+
+	// objects the frame needs are made resident even over budget, leaving the rest to the OS
+	for (auto object : this->pending) {
+		auto &o = this->objects[object];
+		o.resident = true;
+		this->residentBytes += o.size;
+		makeResident->push_back(object);
+	}
+	this->pending.clear();
+}
+
+ResidencySet::Stats ResidencySet::getStats() const {
+	Stats stats = {};
+	stats.budget = this->budget;
+	stats.residentBytes = this->residentBytes;
+
+	for (auto &o : this->objects) {
+		if (!o.live) {
+			continue;
+		}
+
+		if (o.resident) {
+			stats.numResident++;
+		} else {
+			stats.numEvicted++;
+			stats.evictedBytes += o.size;
+		}
+	}
+
+	return stats;
+}
+
+void ResidencySet::unlink(uint32_t object) {
+	auto &o = this->objects[object];
+	if (o.prev != NULL_OBJECT) {
+		this->objects[o.prev].next = o.next;
+	} else {
+		this->first = o.next;
+	}
+	if (o.next != NULL_OBJECT) {
+		this->objects[o.next].prev = o.prev;
+	} else {
+		this->last = o.prev;
+	}
+	o.prev = NULL_OBJECT;
+	o.next = NULL_OBJECT;
+}
+
+void ResidencySet::link(uint32_t object) {
+	auto &o = this->objects[object];
+	o.prev = this->last;
+	o.next = NULL_OBJECT;
+	if (this->last != NULL_OBJECT) {
+		this->objects[this->last].next = object;
+	} else {
+		this->first = object;
+	}
+	this->last = object;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Residency policy over a set of pageable objects kept in least recently used order. Objects are
+// stamped with the fence value of the frame that uses them, and only objects whose last use has
+// completed on the GPU are candidates for eviction.
+struct ResidencySet {
+	static const uint32_t NULL_OBJECT = UINT32_MAX;
+
+	struct Object {
+		uint64_t size;
+		uint64_t lastUsed;
+		uint32_t prev;
+		uint32_t next;
+		bool resident;
+		bool live;
+	};
+
+	struct Stats {
+		uint64_t budget;
+		uint64_t residentBytes;
+		uint64_t evictedBytes;
+		uint32_t numResident;
+		uint32_t numEvicted;
+	};
+
+	std::vector<Object> objects;
+	std::vector<uint32_t> freeObjects;
+
+	// least recently used first
+	uint32_t first = NULL_OBJECT;
+	uint32_t last = NULL_OBJECT;
+
+	uint64_t budget = UINT64_MAX;
+	uint64_t residentBytes = 0;
+
+	// the fence value the frame being recorded will signal
+	uint64_t currentFence = 0;
+
+	// objects used by the current frame that are not resident
+	std::vector<uint32_t> pending;
+
+	static void create(uint64_t budget, ResidencySet *set);
+
+	// Takes the OS's budget for the process and what it currently uses, which includes memory
+	// outside the set, and leaves the set what is left of the budget.
+	void setBudget(uint64_t budget, uint64_t currentUsage);
+
+	uint32_t add(uint64_t size);
+	void remove(uint32_t object);
+
+	void beginFrame(uint64_t fenceValue);
+	void use(uint32_t object);
+
+	// Collects the objects to make resident for the current frame and, least recently used
+	// first, the objects to evict to bring the set back within budget.
+	void update(
+		uint64_t completedFenceValue,
+		std::vector<uint32_t> *evict, std::vector<uint32_t> *makeResident
+	);
+
+	Stats getStats() const;
+
+	void unlink(uint32_t object);
+	void link(uint32_t object);
+};
@@ -0,0 +1,50 @@
+#include "ring.h"
+
+void FrameRing::create(uint64_t capacity, FrameRing *ring) {
+	*ring = FrameRing();
+	ring->capacity = capacity;
+}
+
+bool FrameRing::allocate(uint64_t size, uint64_t alignment, uint64_t *offset) {
+	if (size > this->capacity) {
+		return false;
+	}
+
+	auto start = (this->head + alignment - 1) / alignment * alignment;
+	if (start % this->capacity + size > this->capacity) {
+		start = (start / this->capacity + 1) * this->capacity;
+	}
+
+	if (start + size - this->tail > this->capacity) {
+		return false;
+	}
+
+	this->head = start + size;
+	*offset = start % this->capacity;
+	return true;
+}
+
+void FrameRing::finishFrame(uint64_t fenceValue) {
+	if (this->numFrames == MAX_FRAMES) {
+		// fold the oldest frame into the next one, which only delays reclaiming it
+		this->firstFrame = (this->firstFrame + 1) % MAX_FRAMES;
+		this->numFrames--;
+	}
+
+	auto index = (this->firstFrame + this->numFrames) % MAX_FRAMES;
+	this->frames[index] = Frame { fenceValue, this->head };
+	this->numFrames++;
+}
+
+void FrameRing::retire(uint64_t completedFenceValue) {
+	while (this->numFrames > 0) {
+		auto &frame = this->frames[this->firstFrame];
+		if (frame.fenceValue > completedFenceValue) {
+			break;
+		}
+
+		this->tail = frame.head;
+		this->firstFrame = (this->firstFrame + 1) % MAX_FRAMES;
+		this->numFrames--;
+	}
+}
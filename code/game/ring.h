@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+struct FrameRing {
+	static const size_t MAX_FRAMES = 8;
+
+	struct Frame {
+		uint64_t fenceValue;
+		uint64_t head;
+	};
+
+	uint64_t capacity = 0;
+
+	// head and tail only ever increase, so that head - tail is always the amount in use
+	uint64_t head = 0;
+	uint64_t tail = 0;
+
+	Frame frames[MAX_FRAMES] = {};
+	size_t firstFrame = 0;
+	size_t numFrames = 0;
+
+	static void create(uint64_t capacity, FrameRing *ring);
+
+	bool allocate(uint64_t size, uint64_t alignment, uint64_t *offset);
+
+	void finishFrame(uint64_t fenceValue);
+	void retire(uint64_t completedFenceValue);
+};
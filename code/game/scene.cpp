@@ -0,0 +1,312 @@
+#include "scene.h"
+#include "accounting.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float PI = 3.14159265f;
+static const float NEAR_Z = 0.1f;
+static const float FAR_Z = 64.0f;
+
+// The crowd is one mesh drawn through one root signature, in the main pass.
+static const uint32_t SCENE_PASS = 0;
+static const uint32_t SCENE_ROOT_SIGNATURE = 0;
+static const uint32_t SCENE_MESH = 0;
+
+// The same matrices as DirectXMath's right handed perspective and look-at, transposed to
+// transform column vectors.
+static void perspective(float fovY, float aspect, float nearZ, float farZ, float *m) {
+	auto yScale = 1.0f / tanf(0.5f * fovY);
+	memset(m, 0, 16 * sizeof(float));
+	m[0] = yScale / aspect;
+	m[5] = yScale;
+	m[10] = farZ / (nearZ - farZ);
+	m[11] = nearZ * farZ / (nearZ - farZ);
+	m[14] = -1.0f;
+}
+
+static void normalize(float *v) {
+	auto scale = 1.0f / sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	for (int i = 0; i < 3; i++) {
+		v[i] *= scale;
+	}
+}
+
+static void cross(const float *a, const float *b, float *out) {
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void lookAt(const float *eye, const float *target, const float *up, float *m) {
+	float z[3] = { eye[0] - target[0], eye[1] - target[1], eye[2] - target[2] };
+	normalize(z);
+	float x[3];
+	cross(up, z, x);
+	normalize(x);
+	float y[3];
+	cross(z, x, y);
+
+	const float *axes[3] = { x, y, z };
+	for (int r = 0; r < 3; r++) {
+		auto axis = axes[r];
+		m[4 * r + 0] = axis[0];
+		m[4 * r + 1] = axis[1];
+		m[4 * r + 2] = axis[2];
+		m[4 * r + 3] = -(axis[0] * eye[0] + axis[1] * eye[1] + axis[2] * eye[2]);
+	}
+	m[12] = m[13] = m[14] = 0.0f;
+	m[15] = 1.0f;
+}
+
+static void multiply(const float *a, const float *b, float *out) {
+	for (int r = 0; r < 4; r++) {
+		for (int c = 0; c < 4; c++) {
+			out[4 * r + c] = a[4 * r + 0] * b[c] + a[4 * r + 1] * b[4 + c] +
+				a[4 * r + 2] * b[8 + c] + a[4 * r + 3] * b[12 + c];
+		}
+	}
+}
+
+// A box inside the torso, which is the part of the mesh that reliably covers what is behind it.
+static void setOccluder(Scene *scene) {
+	const float occluderLow[3] = { 0.4f, 0.05f, 0.25f };
+	const float occluderHigh[3] = { 0.6f, 0.9f, 0.75f };
+	float occluderMin[3];
+	float occluderMax[3];
+	for (int i = 0; i < 3; i++) {
+		auto extent = scene->meshBounds.max[i] - scene->meshBounds.min[i];
+		occluderMin[i] = scene->meshBounds.min[i] + occluderLow[i] * extent;
+		occluderMax[i] = scene->meshBounds.min[i] + occluderHigh[i] * extent;
+	}
+	makeBoxOccluder(occluderMin, occluderMax, scene->occluderPositions, scene->occluderIndices);
+}
+
+void Scene::create(
+	const SceneDesc *desc, const SceneGroup *groups, size_t numGroups, const Bounds *meshBounds,
+	const Skeleton *skeleton, const AnimationClip *walk, const AnimationClip *idle,
+	Scene *scene
+) {
+	scene->desc = *desc;
+	scene->groups.assign(groups, groups + numGroups);
+	scene->meshBounds = *meshBounds;
+	scene->skeleton = skeleton;
+	scene->walk = walk;
+	scene->idle = idle;
+
+	perspective(0.25f * PI, desc->aspect, NEAR_Z, FAR_Z, scene->proj);
+
+	const float eye[3] = { 0.0f, 1.2f, -4.0f };
+	const float target[3] = { 0.0f, 1.0f, 8.0f };
+	scene->setCamera(eye, target);
+
+	// a crowd of humans under one root node, where the nearest rows hide most of the rest
+	scene->numInstances = desc->crowdWidth * desc->crowdDepth;
+	std::vector<uint32_t> parents(1 + scene->numInstances, 0);
+	parents[0] = TransformHierarchy::NO_PARENT;
+	TransformHierarchy::create(parents.data(), (uint32_t)parents.size(), &scene->transforms);
+
+	for (uint32_t z = 0; z < desc->crowdDepth; z++) {
+		for (uint32_t x = 0; x < desc->crowdWidth; x++) {
+			auto offset = ((float)x - 0.5f * (desc->crowdWidth - 1)) * 1.8f;
+			scene->translations.push_back(offset);
+			scene->translations.push_back(0.0f);
+			scene->translations.push_back(z * 1.5f);
+		}
+	}
+
+	// instances are siblings, so their slots are contiguous and in node order
+	scene->firstInstanceSlot = scene->transforms.slots[1];
+
+	// instances are laid out front to back, so the first rows are the occluders
+	scene->numOccluders = std::min(2 * desc->crowdWidth, scene->numInstances);
+	OcclusionBuffer::create(&scene->occlusion);
+
+	setOccluder(scene);
+	scene->occluderWorldViewProjs.resize(16 * scene->numOccluders);
+
+	const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const float unit[3] = { 1.0f, 1.0f, 1.0f };
+	for (uint32_t i = 0; i < scene->numInstances; i++) {
+		scene->transforms.setLocal(1 + i, &scene->translations[3 * i], identity, unit);
+	}
+	scene->transforms.update(NULL);
+
+	scene->instanceBounds.resize(scene->numInstances);
+	for (uint32_t i = 0; i < scene->numInstances; i++) {
+		float world[16];
+		scene->transforms.getWorld(1 + i, world);
+		transformBounds(world, meshBounds, &scene->instanceBounds[i]);
+	}
+
+	Bvh::create(scene->instanceBounds.data(), scene->numInstances, &scene->bvh);
+
+	// sized for every instance up front, so that frames never grow them
+	scene->visible.reserve(scene->numInstances);
+	scene->animated.reserve(scene->numInstances);
+	scene->screenSizes.reserve(scene->numInstances);
+}
+
+void Scene::setMesh(const SceneGroup *groups, size_t numGroups, const Bounds *meshBounds) {
+	this->groups.assign(groups, groups + numGroups);
+	this->meshBounds = *meshBounds;
+	setOccluder(this);
+}
+
+void Scene::setCamera(const float *eye, const float *target) {
+	const float up[3] = { 0.0f, 1.0f, 0.0f };
+	float view[16];
+	lookAt(eye, target, up, view);
+	multiply(this->proj, view, this->viewProj);
+}
+
+// The radius of the bounding sphere over its distance from the camera, scaled by the projection,
+// is half its height in clip space, which spans two units.
+// The distance in front of the camera of the centre of the bounds, which is w after projection.
+static float getViewDepth(const Bounds *bounds, const float *viewProj) {
+	float center[3];
+	for (int i = 0; i < 3; i++) {
+		center[i] = 0.5f * (bounds->min[i] + bounds->max[i]);
+	}
+	return viewProj[12] * center[0] + viewProj[13] * center[1] + viewProj[14] * center[2] +
+		viewProj[15];
+}
+
+static float getScreenSize(const Bounds *bounds, float yScale, float viewDepth) {
+	float radius = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		auto extent = 0.5f * (bounds->max[i] - bounds->min[i]);
+		radius += extent * extent;
+	}
+	radius = sqrtf(radius);
+	return radius * yScale / std::max(viewDepth, NEAR_Z);
+}
+
+struct AnimationJob {
+	const Scene *scene;
+	float *skinMatrices;
+};
+
+static void animateBatch(void *data, uint32_t first, uint32_t count) {
+	MemoryScope scope(MEMORY_ANIMATION);
+	auto job = (AnimationJob*)data;
+	auto scene = job->scene;
+
+	Pose walk;
+	Pose idle;
+	Pose pose;
+	for (auto i = first; i < first + count; i++) {
+		// every character is at its own point in the cycle and drifts between idling and walking
+		auto objectId = scene->animated[i];
+		auto time = scene->time + 0.37f * objectId;
+		auto weight = 0.5f + 0.5f * sinf(0.3f * scene->time + 0.9f * objectId);
+
+		scene->walk->sample(time, &walk);
+		scene->idle->sample(time, &idle);
+		Pose::blend(&idle, &walk, weight, scene->skeleton->numJoints, &pose);
+		scene->skeleton->computeSkinMatrices(
+			&pose, job->skinMatrices + objectId * Pose::MAX_JOINTS * 12
+		);
+	}
+}
+
+bool Scene::update(float dt, JobSystem *jobs, RenderBackend *backend, FrameData *frame) {
+	MemoryScope scope(MEMORY_SCENE);
+	this->angle += 3.0f * dt;
+	this->time += dt;
+
+	const float unit[3] = { 1.0f, 1.0f, 1.0f };
+	float rotation[4] = { 0.0f, sinf(0.5f * this->angle), 0.0f, cosf(0.5f * this->angle) };
+	for (uint32_t i = 0; i < this->numInstances; i++) {
+		this->transforms.setLocal(1 + i, &this->translations[3 * i], rotation, unit);
+	}
+	this->transforms.update(jobs);
+
+	void *constants;
+	if (!backend->allocateUpload(
+		this->numInstances * 16 * sizeof(float), 256, &constants, &frame->constants
+	)) {
+		return false;
+	}
+	this->transforms.writeWorldViewProj(
+		jobs, this->viewProj, this->firstInstanceSlot, this->numInstances, (float*)constants
+	);
+
+	for (uint32_t i = 0; i < this->numInstances; i++) {
+		float world[16];
+		this->transforms.getWorld(1 + i, world);
+		transformBounds(world, &this->meshBounds, &this->instanceBounds[i]);
+	}
+	this->bvh.refit(this->instanceBounds.data());
+
+	Frustum frustum;
+	extractFrustum(this->viewProj, &frustum);
+
+	this->visible.clear();
+	this->bvh.cullFrustum(&frustum, &this->visible);
+
+	// upload memory is write-combined, so the occluders get their own copy to read back
+	this->transforms.writeWorldViewProj(
+		NULL, this->viewProj, this->firstInstanceSlot, this->numOccluders,
+		this->occluderWorldViewProjs.data()
+	);
+
+	this->occlusion.clear();
+	for (uint32_t i = 0; i < this->numOccluders; i++) {
+		this->occlusion.rasterize(
+			this->occluderPositions, 8, this->occluderIndices, 36,
+			&this->occluderWorldViewProjs[16 * i]
+		);
+	}
+	this->occlusion.buildHierarchy();
+
+	this->queue.clear();
+	this->queue.reserve(this->visible.size() * this->groups.size());
+	this->animated.clear();
+	this->screenSizes.clear();
+	for (auto i : this->visible) {
+		auto &bounds = this->instanceBounds[i];
+		if (!this->occlusion.isVisible(bounds.min, bounds.max, this->viewProj)) {
+			continue;
+		}
+
+		auto objectId = this->transforms.slots[1 + i] - this->firstInstanceSlot;
+		this->animated.push_back(objectId);
+		auto viewDepth = getViewDepth(&bounds, this->viewProj);
+		this->screenSizes.push_back(getScreenSize(&bounds, this->proj[5], viewDepth));
+		for (auto &group : this->groups) {
+			DrawPacket packet = {};
+			packet.pass = SCENE_PASS;
+			packet.rootSignature = SCENE_ROOT_SIGNATURE;
+			packet.pipeline = objectId % this->desc.numMaterials;
+			packet.mesh = SCENE_MESH;
+			packet.depth = (viewDepth - NEAR_Z) / (FAR_Z - NEAR_Z);
+			packet.objectId = objectId;
+			packet.numIndices = group.numIndices;
+			packet.startIndex = group.startIndex;
+			packet.baseVertex = group.baseVertex;
+			this->queue.push(&packet);
+		}
+	}
+	this->queue.sort();
+	this->queue.build();
+
+	// only characters that survived culling are animated, straight into upload memory
+	void *skinMatrices;
+	if (!backend->allocateUpload(
+		this->numInstances * Pose::MAX_JOINTS * 12 * sizeof(float), 16,
+		&skinMatrices, &frame->skinMatrices
+	)) {
+		return false;
+	}
+
+	AnimationJob job = { this, (float*)skinMatrices };
+	if (jobs) {
+		jobs->parallelFor(animateBatch, &job, (uint32_t)this->animated.size(), 16);
+	} else {
+		animateBatch(&job, 0, (uint32_t)this->animated.size());
+	}
+
+	frame->queue = &this->queue;
+	return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "animation.h"
+#include "backend.h"
+#include "bvh.h"
+#include "draw.h"
+#include "jobs.h"
+#include "occlusion.h"
+#include "transform.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct SceneDesc {
+	uint32_t crowdWidth;
+	uint32_t crowdDepth;
+	uint32_t numMaterials;
+	float aspect;
+};
+
+// One draw of the mesh, as placed in the shared geometry buffers.
+struct SceneGroup {
+	uint32_t numIndices;
+	uint32_t startIndex;
+	int32_t baseVertex;
+};
+
+// The CPU side of a frame of the crowd: animation, transforms, culling and the sorted draw queue.
+// It only talks to the GPU through a RenderBackend, so the same frames run headless.
+struct Scene {
+	SceneDesc desc;
+	std::vector<SceneGroup> groups;
+	Bounds meshBounds;
+	const Skeleton *skeleton;
+	const AnimationClip *walk;
+	const AnimationClip *idle;
+
+	float proj[16];
+	float viewProj[16];
+	float angle = 0.0f;
+	float time = 0.0f;
+
+	uint32_t numInstances;
+	uint32_t firstInstanceSlot;
+	TransformHierarchy transforms;
+	std::vector<float> translations;
+	std::vector<Bounds> instanceBounds;
+	Bvh bvh;
+	std::vector<uint32_t> visible;
+	std::vector<uint32_t> animated;
+
+	// for each animated instance, the fraction of the screen height its bounding sphere covers
+	std::vector<float> screenSizes;
+
+	uint32_t numOccluders;
+	OcclusionBuffer occlusion;
+	float occluderPositions[8 * 3];
+	uint16_t occluderIndices[36];
+	std::vector<float> occluderWorldViewProjs;
+
+	DrawQueue queue;
+
+	static void create(
+		const SceneDesc *desc, const SceneGroup *groups, size_t numGroups, const Bounds *meshBounds,
+		const Skeleton *skeleton, const AnimationClip *walk, const AnimationClip *idle,
+		Scene *scene
+	);
+
+	// Swaps in another mesh for every instance, like one that was reloaded. The instances' bounds
+	// follow it from the next update.
+	void setMesh(const SceneGroup *groups, size_t numGroups, const Bounds *meshBounds);
+
+	void setCamera(const float *eye, const float *target);
+
+	// Advances the crowd by dt seconds and fills in the frame for the backend to render. Fails
+	// when the backend is out of upload memory.
+	bool update(float dt, JobSystem *jobs, RenderBackend *backend, FrameData *frame);
+};
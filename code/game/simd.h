@@ -0,0 +1,7 @@
+#pragma once
+
+// SSE2 is part of x64, and of x86 when the compiler is allowed to target it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,58 @@
+#include "space.h"
+
+void GeometrySpace::create(uint32_t maxVertices, uint32_t maxIndices, GeometrySpace *space) {
+	RangeAllocator::create(maxVertices, &space->vertices);
+	RangeAllocator::create(maxIndices, &space->indices);
+}
+
+bool GeometrySpace::allocate(uint32_t numVertices, uint32_t numIndices, GeometryRange *range) {
+	uint32_t baseVertex;
+	if (!this->vertices.allocate(numVertices, 1, &baseVertex)) {
+		return false;
+	}
+
+	uint32_t startIndex;
+	if (!this->indices.allocate(numIndices, 1, &startIndex)) {
+		this->vertices.free(baseVertex, numVertices);
+		return false;
+	}
+
+	range->baseVertex = baseVertex;
+	range->numVertices = numVertices;
+	range->startIndex = startIndex;
+	range->numIndices = numIndices;
+	return true;
+}
+
+void GeometrySpace::free(const GeometryRange *range) {
+	this->vertices.free(range->baseVertex, range->numVertices);
+	this->indices.free(range->startIndex, range->numIndices);
+}
+
+void GeometrySpace::freeDeferred(const GeometryRange *range) {
+	this->vertices.freeDeferred(range->baseVertex, range->numVertices);
+	this->indices.freeDeferred(range->startIndex, range->numIndices);
+}
+
+void GeometrySpace::finishFrame(uint64_t fenceValue) {
+	this->vertices.finishFrame(fenceValue);
+	this->indices.finishFrame(fenceValue);
+}
+
+void GeometrySpace::retire(uint64_t completedFenceValue) {
+	this->vertices.retire(completedFenceValue);
+	this->indices.retire(completedFenceValue);
+}
+
+GeometrySpace::Stats GeometrySpace::getStats() const {
+	Stats stats = {};
+	stats.vertices = this->vertices.getStats();
+	stats.indices = this->indices.getStats();
+	if (stats.vertices.capacity > 0) {
+		stats.vertexOccupancy = (float)stats.vertices.used / stats.vertices.capacity;
+	}
+	if (stats.indices.capacity > 0) {
+		stats.indexOccupancy = (float)stats.indices.used / stats.indices.capacity;
+	}
+	return stats;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "range.h"
+#include <cstdint>
+
+struct GeometryRange {
+	uint32_t baseVertex;
+	uint32_t numVertices;
+	uint32_t startIndex;
+	uint32_t numIndices;
+};
+
+// Where meshes go in the shared vertex and index buffers, kept apart from the buffers themselves
+// so that it runs without a GPU. Vertex streams share offsets, so one allocator covers them all.
+struct GeometrySpace {
+	struct Stats {
+		RangeAllocator::Stats vertices;
+		RangeAllocator::Stats indices;
+		float vertexOccupancy;
+		float indexOccupancy;
+	};
+
+	RangeAllocator vertices;
+	RangeAllocator indices;
+
+	static void create(uint32_t maxVertices, uint32_t maxIndices, GeometrySpace *space);
+
+	bool allocate(uint32_t numVertices, uint32_t numIndices, GeometryRange *range);
+	void free(const GeometryRange *range);
+
+	// Frees a range that frames in flight may still draw from once the current frame retires.
+	void freeDeferred(const GeometryRange *range);
+	void finishFrame(uint64_t fenceValue);
+	void retire(uint64_t completedFenceValue);
+
+	Stats getStats() const;
+};
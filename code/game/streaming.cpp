@@ -0,0 +1,158 @@
+#include "streaming.h"
+#include <algorithm>
+#include <cmath>
+
+void TextureStreamer::create(const StreamerDesc *desc, TextureStreamer *streamer) {
+	streamer->desc = *desc;
+}
+
+uint32_t TextureStreamer::addTexture(
+	uint32_t width, uint32_t height, uint32_t numMips, const uint64_t *mipSizes
+) {
+	Texture texture = {};
+	texture.width = width;
+	texture.height = height;
+	texture.numMips = std::min(numMips, (uint32_t)TextureStreamer::MAX_MIPS);
+	for (uint32_t i = 0; i < texture.numMips; i++) {
+		texture.mipSizes[i] = mipSizes[i];
+	}
+
+	texture.tailMip = 0;
+	while (
+		texture.tailMip + 1 < texture.numMips &&
+		std::max(width >> texture.tailMip, height >> texture.tailMip) > this->desc.tailSize
+	) {
+		texture.tailMip++;
+	}
+
+	texture.residentMip = texture.tailMip;
+	texture.loadingMip = texture.tailMip;
+	texture.wantedMip = texture.tailMip;
+	this->textures.push_back(texture);
+	return (uint32_t)this->textures.size() - 1;
+}
+
+uint64_t TextureStreamer::getTailSize(uint32_t texture) const {
+	auto &t = this->textures[texture];
+	uint64_t size = 0;
+	for (auto i = t.tailMip; i < t.numMips; i++) {
+		size += t.mipSizes[i];
+	}
+	return size;
+}
+
+uint32_t TextureStreamer::getWantedMip(uint32_t texture, float screenSize) const {
+	auto &t = this->textures[texture];
+	auto pixels = screenSize * this->desc.screenHeight;
+	if (pixels <= 0.0f) {
+		return t.tailMip;
+	}
+
+	// one texel per pixel, for a texture that wraps the object once
+	auto texels = (float)std::max(t.width, t.height);
+	auto mip = floorf(log2f(texels / pixels) + this->desc.mipBias);
+	return (uint32_t)std::min(std::max(mip, 0.0f), (float)t.tailMip);
+}
+
+void TextureStreamer::beginFrame() {
+	this->frame++;
+	for (auto &texture : this->textures) {
+		texture.wantedMip = texture.tailMip;
+		texture.screenSize = 0.0f;
+	}
+	this->loads = FrameVector<StreamRequest>();
+	this->evictions = FrameVector<StreamRequest>();
+}
+
+void TextureStreamer::request(uint32_t texture, float screenSize) {
+	auto &t = this->textures[texture];
+	auto mip = this->getWantedMip(texture, screenSize);
+	t.wantedMip = std::min(t.wantedMip, mip);
+	t.screenSize = std::max(t.screenSize, screenSize * this->desc.screenHeight);
+	t.lastUsed = this->frame;
+
+	this->stats.requests++;
+	if (t.residentMip <= mip) {
+		this->stats.satisfied++;
+	}
+}
+
+void TextureStreamer::update() {
+	auto &textures = this->textures;
+
+	// how many pixels each texel of the finest resident mip is stretched over
+	auto getMagnification = [&](uint32_t i) {
+		auto &t = textures[i];
+		return t.screenSize / std::max(std::max(t.width, t.height) >> t.residentMip, 1u);
+	};
+
+	// textures that want more detail and aren't already loading it, most magnified first
+	FrameVector<uint32_t> candidates;
+	FrameVector<uint32_t> victims;
+	candidates.reserve(textures.size());
+	victims.reserve(textures.size());
+	for (uint32_t i = 0; i < textures.size(); i++) {
+		auto &t = textures[i];
+		if (t.loadingMip != t.residentMip) {
+			continue;
+		}
+		if (t.wantedMip < t.residentMip) {
+			candidates.push_back(i);
+		} else if (t.residentMip < t.wantedMip) {
+			victims.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+		return getMagnification(a) > getMagnification(b);
+	});
+
+	// textures with more detail than they need, least recently used first
+	std::sort(victims.begin(), victims.end(), [&](uint32_t a, uint32_t b) {
+		return textures[a].lastUsed < textures[b].lastUsed;
+	});
+
+	size_t nextVictim = 0;
+	uint64_t uploaded = 0;
+	for (auto i : candidates) {
+		auto &t = textures[i];
+		auto mip = t.loadingMip - 1;
+		auto size = t.mipSizes[mip];
+		if (uploaded > 0 && uploaded + size > this->desc.uploadBudget) {
+			this->stats.deferred++;
+			continue;
+		}
+
+		while (this->used + size > this->desc.budget && nextVictim < victims.size()) {
+			auto victim = victims[nextVictim];
+			auto &v = textures[victim];
+			if (v.residentMip >= v.wantedMip) {
+				nextVictim++;
+				continue;
+			}
+
+			auto evictedSize = v.mipSizes[v.residentMip];
+			this->evictions.push_back(StreamRequest { victim, v.residentMip });
+			this->used -= evictedSize;
+			this->stats.evictions++;
+			this->stats.evictedBytes += evictedSize;
+			v.residentMip++;
+			v.loadingMip = v.residentMip;
+		}
+		if (this->used + size > this->desc.budget) {
+			this->stats.deferred++;
+			continue;
+		}
+
+		this->loads.push_back(StreamRequest { i, mip });
+		this->used += size;
+		uploaded += size;
+		this->stats.loads++;
+		this->stats.loadedBytes += size;
+		t.loadingMip = mip;
+	}
+}
+
+void TextureStreamer::completeLoad(uint32_t texture, uint32_t mip) {
+	auto &t = this->textures[texture];
+	t.residentMip = std::max(mip, t.loadingMip);
+}
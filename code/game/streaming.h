@@ -0,0 +1,97 @@
+#pragma once
+#include "arena.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct StreamerDesc {
+	// bytes of memory for the mips above the tails, which are always resident
+	uint64_t budget;
+
+	// bytes of mips that may start loading in one frame
+	uint64_t uploadBudget;
+
+	// mips no larger than this in either dimension make up the tail
+	uint32_t tailSize;
+
+	// the height of the screen in pixels, and a bias added to every wanted mip
+	float screenHeight;
+	float mipBias;
+};
+
+struct StreamRequest {
+	uint32_t texture;
+	uint32_t mip;
+};
+
+struct StreamStats {
+	// draws that asked for a texture, and how many of them had the mip they wanted resident
+	uint64_t requests;
+	uint64_t satisfied;
+
+	uint64_t loads;
+	uint64_t loadedBytes;
+	uint64_t evictions;
+	uint64_t evictedBytes;
+
+	// loads that had to wait for a later frame, for lack of memory or upload bandwidth
+	uint64_t deferred;
+};
+
+// Decides which mips of which textures should be resident. Draws request the mip their screen size
+// needs, and each update starts loading the next finer mip of the textures that are most magnified
+// on screen, one level at a time. When that would go over budget, the finest mips of the least
+// recently used textures that have more detail than they need are evicted to make room. The
+// streamer only keeps the books, so the caller does the loading, and reports back when a mip has
+// arrived.
+struct TextureStreamer {
+	static const uint32_t MAX_MIPS = 16;
+
+	struct Texture {
+		uint32_t width;
+		uint32_t height;
+		uint32_t numMips;
+		uint32_t tailMip;
+		uint64_t mipSizes[MAX_MIPS];
+
+		// the finest resident mip, and the finest that is resident or loading
+		uint32_t residentMip;
+		uint32_t loadingMip;
+
+		// the finest mip any draw asked for this frame and its largest size on screen in pixels,
+		// which stay at the tail and zero when nothing drew it
+		uint32_t wantedMip;
+		float screenSize;
+		uint64_t lastUsed;
+	};
+
+	StreamerDesc desc;
+	std::vector<Texture> textures;
+
+	// bytes above the tails, including loads in flight
+	uint64_t used = 0;
+	uint64_t frame = 0;
+
+	// what the last update started loading and evicted, which only last until the end of the frame
+	FrameVector<StreamRequest> loads;
+	FrameVector<StreamRequest> evictions;
+
+	StreamStats stats = {};
+
+	static void create(const StreamerDesc *desc, TextureStreamer *streamer);
+
+	// Adds a texture with only its tail resident, given the size in bytes of each mip.
+	uint32_t addTexture(
+		uint32_t width, uint32_t height, uint32_t numMips, const uint64_t *mipSizes
+	);
+	uint64_t getTailSize(uint32_t texture) const;
+	uint32_t getWantedMip(uint32_t texture, float screenSize) const;
+
+	void beginFrame();
+
+	// screenSize is the fraction of the screen height that the textured object covers
+	void request(uint32_t texture, float screenSize);
+
+	void update();
+	void completeLoad(uint32_t texture, uint32_t mip);
+};
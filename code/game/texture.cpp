@@ -0,0 +1,358 @@
+#include "texture.h"
+#include "accounting.h"
+#include "context.h"
+#include "util.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint32_t DDS_MAGIC = 'D' | 'D' << 8 | 'S' << 16 | ' ' << 24;
+static const uint32_t DDS_DX10 = 'D' | 'X' << 8 | '1' << 16 | '0' << 24;
+static const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+struct DdsPixelFormat {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t masks[4];
+};
+
+struct DdsHeader {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+
+struct DdsHeaderDx10 {
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static bool isSupportedFormat(DXGI_FORMAT format) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+HRESULT TextureFile::open(
+	ID3D12Device *device, const uint8_t *data, UINT64 size, TextureFile *file
+) {
+	file->data = data;
+	file->size = size;
+
+	DdsHeader header;
+	DdsHeaderDx10 dx10;
+	if (size < sizeof(header) + sizeof(dx10)) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+	memcpy(&header, data, sizeof(header));
+	memcpy(&dx10, data + sizeof(header), sizeof(dx10));
+
+	file->format = (DXGI_FORMAT)dx10.dxgiFormat;
+	file->width = header.width;
+	file->height = header.height;
+	file->numMips = header.mipMapCount;
+	if (
+		header.magic != DDS_MAGIC || header.pixelFormat.fourCC != DDS_DX10 ||
+		dx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10.arraySize != 1 ||
+		!isSupportedFormat(file->format) || file->numMips == 0 ||
+		file->numMips > TextureFile::MAX_MIPS
+	) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	rd.Width = file->width;
+	rd.Height = file->height;
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = (UINT16)file->numMips;
+	rd.Format = file->format;
+	rd.SampleDesc.Count = 1;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	device->GetCopyableFootprints(
+		&rd, 0, file->numMips, 0, NULL, file->numRows, file->rowSizes, NULL
+	);
+
+	auto offset = (UINT64)(sizeof(header) + sizeof(dx10));
+	for (UINT i = 0; i < file->numMips; i++) {
+		file->offsets[i] = offset;
+		offset += file->getMipSize(i);
+	}
+	if (offset > size) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	return S_OK;
+}
+
+UINT64 TextureFile::getMipSize(UINT mip) const {
+	return this->rowSizes[mip] * this->numRows[mip];
+}
+
+HRESULT TextureFile::readMip(UINT mip, const D3D12_SUBRESOURCE_FOOTPRINT *footprint, void *data) {
+	auto source = this->data + this->offsets[mip];
+	for (UINT row = 0; row < this->numRows[mip]; row++) {
+		memcpy(
+			(uint8_t*)data + row * footprint->RowPitch, source + row * this->rowSizes[mip],
+			(size_t)this->rowSizes[mip]
+		);
+	}
+	return S_OK;
+}
+
+HRESULT Texture::create(
+	Context *context, ID3D12GraphicsCommandList *commandList, TextureFile *file,
+	UINT firstMip, const Texture *previous, Texture *texture
+) {
+	auto numMips = file->numMips - firstMip;
+
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	rd.Width = std::max(file->width >> firstMip, 1u);
+	rd.Height = std::max(file->height >> firstMip, 1u);
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = (UINT16)numMips;
+	rd.Format = file->format;
+	rd.SampleDesc.Count = 1;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+
+	// the finest levels that previous doesn't have come from the file
+	auto numUploads = numMips;
+	if (previous) {
+		numUploads = std::min(std::max(previous->firstMip, firstMip) - firstMip, numMips);
+	}
+
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[TextureFile::MAX_MIPS];
+	UINT64 totalSize = 0;
+	void *mapped = NULL;
+	UINT64 uploadOffset = 0;
+	if (numUploads > 0) {
+		context->device->GetCopyableFootprints(
+			&rd, 0, numUploads, 0, footprints, NULL, NULL, &totalSize
+		);
+
+		D3D12_GPU_VIRTUAL_ADDRESS address;
+		if (!context->uploads.allocate(
+			totalSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, &mapped, &address, &uploadOffset
+		)) {
+			return E_OUTOFMEMORY;
+		}
+	}
+
+	TRY(context->allocator.createResource(
+		D3D12_HEAP_TYPE_DEFAULT, &rd, D3D12_RESOURCE_STATE_COPY_DEST, NULL, texture,
+		&texture->resource, &texture->allocation
+	));
+	context->states.track(texture->resource.Get(), 1, D3D12_RESOURCE_STATE_COPY_DEST);
+	texture->firstMip = firstMip;
+
+	for (UINT i = 0; i < numUploads; i++) {
+		auto &footprint = footprints[i];
+		TRY(file->readMip(firstMip + i, &footprint.Footprint, (uint8_t*)mapped + footprint.Offset));
+
+		D3D12_TEXTURE_COPY_LOCATION dest = {};
+		dest.pResource = texture->resource.Get();
+		dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		dest.SubresourceIndex = i;
+
+		D3D12_TEXTURE_COPY_LOCATION src = {};
+		src.pResource = context->uploads.buffer.Get();
+		src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		src.PlacedFootprint = footprint;
+		src.PlacedFootprint.Offset += uploadOffset;
+
+		commandList->CopyTextureRegion(&dest, 0, 0, 0, &src, NULL);
+	}
+
+	if (numUploads < numMips) {
+		context->transition(previous->resource.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE);
+		context->flushBarriers(commandList);
+		for (auto i = numUploads; i < numMips; i++) {
+			D3D12_TEXTURE_COPY_LOCATION dest = {};
+			dest.pResource = texture->resource.Get();
+			dest.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			dest.SubresourceIndex = i;
+
+			D3D12_TEXTURE_COPY_LOCATION src = {};
+			src.pResource = previous->resource.Get();
+			src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			src.SubresourceIndex = firstMip + i - previous->firstMip;
+
+			commandList->CopyTextureRegion(&dest, 0, 0, 0, &src, NULL);
+		}
+	}
+
+	context->transition(texture->resource.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	context->flushBarriers(commandList);
+
+	return S_OK;
+}
+
+void Texture::createView(Context *context, const TextureFile *file) {
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvd = {};
+	srvd.Format = file->format;
+	srvd.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvd.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvd.Texture2D.MipLevels = file->numMips - this->firstMip;
+	context->device->CreateShaderResourceView(
+		this->resource.Get(), &srvd, context->cbvSrvUavHeap.getStagingHandle(this->descriptor)
+	);
+}
+
+void Texture::release(Context *context) {
+	if (this->descriptor != Texture::NO_DESCRIPTOR) {
+		context->cbvSrvUavHeap.free(this->descriptor, 1);
+		this->descriptor = Texture::NO_DESCRIPTOR;
+	}
+	if (this->resource) {
+		context->states.untrack(this->resource.Get());
+		this->resource.Reset();
+		context->allocator.free(&this->allocation);
+	}
+}
+
+void TextureStreaming::create(const StreamerDesc *desc, TextureStreaming *streaming) {
+	TextureStreamer::create(desc, &streaming->streamer);
+}
+
+HRESULT TextureStreaming::addTexture(
+	Context *context, ID3D12GraphicsCommandList *commandList, const Archive *archive,
+	const char *name, UINT *index
+) {
+	MemoryScope scope(MEMORY_ASSETS);
+	auto entry = archive->find(name);
+	if (entry == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	// the builder stores textures uncompressed, to be read a mip at a time
+	auto data = archive->getData(entry);
+	if (data == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	this->files.emplace_back();
+	auto &file = this->files.back();
+	TRY(TextureFile::open(context->device.Get(), data, entry->size, &file));
+
+	uint64_t mipSizes[TextureFile::MAX_MIPS];
+	for (UINT i = 0; i < file.numMips; i++) {
+		mipSizes[i] = file.getMipSize(i);
+	}
+	*index = this->streamer.addTexture(file.width, file.height, file.numMips, mipSizes);
+
+	this->textures.emplace_back();
+	auto &texture = this->textures.back();
+	TRY(Texture::create(
+		context, commandList, &file, this->streamer.textures[*index].tailMip, NULL, &texture
+	));
+	if (!context->cbvSrvUavHeap.allocate(1, &texture.descriptor)) {
+		return E_OUTOFMEMORY;
+	}
+	texture.createView(context, &file);
+	this->views.push_back(context->cbvSrvUavHeap.getStagingHandle(texture.descriptor));
+
+	return S_OK;
+}
+
+HRESULT TextureStreaming::record(
+	Context *context, ID3D12GraphicsCommandList *commandList,
+	D3D12_GPU_DESCRIPTOR_HANDLE *table
+) {
+	auto completedFenceValue = context->fence->GetCompletedValue();
+	for (size_t i = 0; i < this->retired.size();) {
+		auto &retired = this->retired[i];
+		if (retired.fenceValue > completedFenceValue) {
+			i++;
+			continue;
+		}
+
+		context->states.untrack(retired.resource.Get());
+		retired.resource.Reset();
+		context->allocator.free(&retired.allocation);
+		retired = std::move(this->retired.back());
+		this->retired.pop_back();
+	}
+
+	// the streamer has already counted evictions as done, and loads complete within the frame,
+	// so each texture is simply brought to the finest mip that is resident or loading
+	for (UINT i = 0; i < (UINT)this->textures.size(); i++) {
+		auto &state = this->streamer.textures[i];
+		auto &texture = this->textures[i];
+		if (state.loadingMip == texture.firstMip) {
+			continue;
+		}
+
+		Texture previous = std::move(texture);
+		texture = Texture();
+		context->allocator.use(&previous.allocation);
+		auto hr = Texture::create(
+			context, commandList, &this->files[i], state.loadingMip, &previous, &texture
+		);
+		if (FAILED(hr)) {
+			texture.release(context);
+			texture = std::move(previous);
+			return hr;
+		}
+
+		// the view is only ever copied into transient tables, so frames in flight keep the old one
+		texture.descriptor = previous.descriptor;
+		texture.createView(context, &this->files[i]);
+
+		Retired retired;
+		retired.resource = std::move(previous.resource);
+		retired.allocation = previous.allocation;
+		retired.fenceValue = context->fenceValues[context->frameIndex];
+		this->retired.push_back(std::move(retired));
+
+		if (texture.firstMip < state.residentMip) {
+			this->streamer.completeLoad(i, texture.firstMip);
+		}
+	}
+
+	for (auto &texture : this->textures) {
+		context->allocator.use(&texture.allocation);
+	}
+
+	if (!context->cbvSrvUavHeap.copyTransient(
+		context->device.Get(), (UINT)this->views.size(), this->views.data(), table
+	)) {
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+void TextureStreaming::release(Context *context) {
+	for (auto &retired : this->retired) {
+		context->states.untrack(retired.resource.Get());
+		retired.resource.Reset();
+		context->allocator.free(&retired.allocation);
+	}
+	this->retired.clear();
+
+	for (auto &texture : this->textures) {
+		texture.release(context);
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "allocator.h"
+#include "archive.h"
+#include "streaming.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <Windows.h>
+#include <vector>
+
+struct Context;
+
+// A DDS written by the asset builder, read in place from the archive's mapping as mips are needed.
+// Each level is stored with its rows tightly packed, one after the other from the finest.
+struct TextureFile {
+	static const UINT MAX_MIPS = 16;
+
+	const uint8_t *data;
+	UINT64 size;
+	DXGI_FORMAT format;
+	UINT width;
+	UINT height;
+	UINT numMips;
+	UINT64 offsets[MAX_MIPS];
+	UINT64 rowSizes[MAX_MIPS];
+	UINT numRows[MAX_MIPS];
+
+	static HRESULT open(ID3D12Device *device, const uint8_t *data, UINT64 size, TextureFile *file);
+
+	UINT64 getMipSize(UINT mip) const;
+
+	// Reads a level into upload memory laid out as footprint describes.
+	HRESULT readMip(UINT mip, const D3D12_SUBRESOURCE_FOOTPRINT *footprint, void *data);
+};
+
+// A mipmapped 2D texture that holds the levels of a file from firstMip down.
+struct Texture {
+	Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+	GpuAllocation allocation;
+	UINT firstMip = 0;
+
+	static const UINT NO_DESCRIPTOR = 0xffffffff;
+	UINT descriptor = NO_DESCRIPTOR;
+
+	// Records the copies into commandList. Levels that previous also holds are copied from it on
+	// the GPU, and the rest are read from the file and staged in the context's upload ring. The
+	// texture is left without a descriptor.
+	static HRESULT create(
+		Context *context, ID3D12GraphicsCommandList *commandList, TextureFile *file,
+		UINT firstMip, const Texture *previous, Texture *texture
+	);
+	void createView(Context *context, const TextureFile *file);
+	void release(Context *context);
+};
+
+// Keeps the textures' resources in step with what a TextureStreamer decides. A texture whose mips
+// change is re-created with the new range, and the old resource is released once the frames that
+// used it have completed. Each texture has a view in the staging part of the descriptor heap, which
+// is copied into a transient table every frame, so in-flight frames keep their own views.
+struct TextureStreaming {
+	struct Retired {
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+		GpuAllocation allocation;
+		UINT64 fenceValue;
+	};
+
+	TextureStreamer streamer;
+	std::vector<TextureFile> files;
+	std::vector<Texture> textures;
+	std::vector<Retired> retired;
+	std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> views;
+
+	static void create(const StreamerDesc *desc, TextureStreaming *streaming);
+
+	// Loads the mip tail of a texture and returns its index in the table, which is also its index
+	// in the streamer. The texture is read from the archive for as long as it streams, so the
+	// archive has to stay open.
+	HRESULT addTexture(
+		Context *context, ID3D12GraphicsCommandList *commandList, const Archive *archive,
+		const char *name, UINT *index
+	);
+
+	// Brings every texture to the mips the streamer has chosen, after Context::prepare, and builds
+	// the frame's table of them.
+	HRESULT record(
+		Context *context, ID3D12GraphicsCommandList *commandList,
+		D3D12_GPU_DESCRIPTOR_HANDLE *table
+	);
+
+	void release(Context *context);
+};
@@ -0,0 +1,277 @@
+#include "tlsf.h"
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+static uint32_t findLastSet(uint64_t x) {
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return index;
+}
+
+static uint32_t findFirstSet(uint64_t x) {
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return index;
+}
+#else
+static uint32_t findLastSet(uint64_t x) { return 63 - __builtin_clzll(x); }
+static uint32_t findFirstSet(uint64_t x) { return __builtin_ctzll(x); }
+#endif
+
+static void mapping(uint64_t size, uint32_t *fl, uint32_t *sl) {
+	if (size < Tlsf::SL_COUNT) {
+		*fl = 0;
+		*sl = (uint32_t)size;
+	} else {
+		auto log2 = findLastSet(size);
+		*fl = log2 - Tlsf::SL_BITS + 1;
+		*sl = (uint32_t)(size >> (log2 - Tlsf::SL_BITS)) ^ Tlsf::SL_COUNT;
+	}
+}
+
+void Tlsf::create(uint64_t capacity, uint64_t granularity, Tlsf *tlsf) {
+	tlsf->capacity = capacity / granularity * granularity;
+	tlsf->granularity = granularity;
+	tlsf->used = 0;
+	tlsf->numAllocations = 0;
+	tlsf->blocks.clear();
+	tlsf->unusedBlocks.clear();
+
+	tlsf->flBitmap = 0;
+	for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+		tlsf->slBitmaps[fl] = 0;
+		for (uint32_t sl = 0; sl < SL_COUNT; sl++) {
+			tlsf->freeLists[fl][sl] = NULL_BLOCK;
+		}
+	}
+
+	if (tlsf->capacity == 0) {
+		return;
+	}
+
+	auto block = tlsf->newBlock();
+	tlsf->blocks[block].offset = 0;
+	tlsf->blocks[block].size = tlsf->capacity;
+	tlsf->insertFree(block);
+}
+
+uint32_t Tlsf::newBlock() {
+	uint32_t index;
+	if (!this->unusedBlocks.empty()) {
+		index = this->unusedBlocks.back();
+		this->unusedBlocks.pop_back();
+	} else {
+		index = (uint32_t)this->blocks.size();
+		this->blocks.emplace_back();
+	}
+
+	auto &block = this->blocks[index];
+	block = Block {};
+	block.prevPhysical = block.nextPhysical = NULL_BLOCK;
+	block.prevFree = block.nextFree = NULL_BLOCK;
+	block.state = BLOCK_UNUSED;
+	return index;
+}
+
+void Tlsf::insertFree(uint32_t index) {
+	auto &block = this->blocks[index];
+
+	uint32_t fl, sl;
+	mapping(block.size, &fl, &sl);
+
+	auto head = this->freeLists[fl][sl];
+	block.state = BLOCK_FREE;
+	block.prevFree = NULL_BLOCK;
+	block.nextFree = head;
+	if (head != NULL_BLOCK) {
+		this->blocks[head].prevFree = index;
+	}
+
+	this->freeLists[fl][sl] = index;
+	this->flBitmap |= 1ULL << fl;
+	this->slBitmaps[fl] |= 1U << sl;
+}
+
+void Tlsf::removeFree(uint32_t index) {
+	auto &block = this->blocks[index];
+
+	uint32_t fl, sl;
+	mapping(block.size, &fl, &sl);
+
+	if (block.prevFree != NULL_BLOCK) {
+		this->blocks[block.prevFree].nextFree = block.nextFree;
+	} else {
+		this->freeLists[fl][sl] = block.nextFree;
+	}
+	if (block.nextFree != NULL_BLOCK) {
+		this->blocks[block.nextFree].prevFree = block.prevFree;
+	}
+
+	if (this->freeLists[fl][sl] == NULL_BLOCK) {
+		this->slBitmaps[fl] &= ~(1U << sl);
+		if (this->slBitmaps[fl] == 0) {
+			this->flBitmap &= ~(1ULL << fl);
+		}
+	}
+
+	block.prevFree = block.nextFree = NULL_BLOCK;
+	block.state = BLOCK_UNUSED;
+}
+
+uint32_t Tlsf::findFree(uint64_t size) {
+	// round up to the next list so that any block found is large enough
+	if (size >= SL_COUNT) {
+		auto round = (1ULL << (findLastSet(size) - SL_BITS)) - 1;
+		if (size + round < size) {
+			return NULL_BLOCK;
+		}
+		size += round;
+	}
+
+	uint32_t fl, sl;
+	mapping(size, &fl, &sl);
+	if (fl >= FL_COUNT) {
+		return NULL_BLOCK;
+	}
+
+	auto slMap = this->slBitmaps[fl] & (~0U << sl);
+	if (slMap == 0) {
+		auto flMap = fl + 1 < 64 ? this->flBitmap & (~0ULL << (fl + 1)) : 0;
+		if (flMap == 0) {
+			return NULL_BLOCK;
+		}
+
+		fl = findFirstSet(flMap);
+		slMap = this->slBitmaps[fl];
+	}
+
+	sl = findFirstSet(slMap);
+	return this->freeLists[fl][sl];
+}
+
+void Tlsf::split(uint32_t index, uint64_t size) {
+	auto remaining = this->blocks[index].size - size;
+	if (remaining == 0) {
+		return;
+	}
+
+	auto rest = this->newBlock();
+	auto &block = this->blocks[index];
+	auto &restBlock = this->blocks[rest];
+
+	restBlock.offset = block.offset + size;
+	restBlock.size = remaining;
+	restBlock.prevPhysical = index;
+	restBlock.nextPhysical = block.nextPhysical;
+	if (block.nextPhysical != NULL_BLOCK) {
+		this->blocks[block.nextPhysical].prevPhysical = rest;
+	}
+
+	block.size = size;
+	block.nextPhysical = rest;
+
+	this->insertFree(rest);
+}
+
+bool Tlsf::allocate(uint64_t size, uint64_t alignment, uint32_t *result, uint64_t *offset) {
+	if (size == 0) {
+		return false;
+	}
+
+	size = (size + this->granularity - 1) / this->granularity * this->granularity;
+	alignment = std::max(alignment, this->granularity);
+
+	auto padding = alignment - this->granularity;
+	auto index = this->findFree(size + padding);
+	if (index == NULL_BLOCK) {
+		return false;
+	}
+
+	this->removeFree(index);
+
+	// give any leading padding its own free block, so the allocation starts aligned
+	auto aligned = (this->blocks[index].offset + alignment - 1) / alignment * alignment;
+	auto lead = aligned - this->blocks[index].offset;
+	if (lead > 0) {
+		this->split(index, lead);
+		auto next = this->blocks[index].nextPhysical;
+		this->removeFree(next);
+		this->insertFree(index);
+		index = next;
+	}
+
+	this->split(index, size);
+	this->blocks[index].state = BLOCK_ALLOCATED;
+
+	this->used += size;
+	this->numAllocations++;
+
+	*result = index;
+	*offset = this->blocks[index].offset;
+	return true;
+}
+
+void Tlsf::free(uint32_t index) {
+	auto &block = this->blocks[index];
+	this->used -= block.size;
+	this->numAllocations--;
+	block.state = BLOCK_UNUSED;
+
+	auto prev = block.prevPhysical;
+	if (prev != NULL_BLOCK && this->blocks[prev].state == BLOCK_FREE) {
+		this->removeFree(prev);
+
+		auto &prevBlock = this->blocks[prev];
+		prevBlock.size += block.size;
+		prevBlock.nextPhysical = block.nextPhysical;
+		if (block.nextPhysical != NULL_BLOCK) {
+			this->blocks[block.nextPhysical].prevPhysical = prev;
+		}
+
+		this->unusedBlocks.push_back(index);
+		index = prev;
+	}
+
+	auto &merged = this->blocks[index];
+	auto next = merged.nextPhysical;
+	if (next != NULL_BLOCK && this->blocks[next].state == BLOCK_FREE) {
+		this->removeFree(next);
+
+		auto &nextBlock = this->blocks[next];
+		merged.size += nextBlock.size;
+		merged.nextPhysical = nextBlock.nextPhysical;
+		if (nextBlock.nextPhysical != NULL_BLOCK) {
+			this->blocks[nextBlock.nextPhysical].prevPhysical = index;
+		}
+
+		this->unusedBlocks.push_back(next);
+	}
+
+	this->insertFree(index);
+}
+
+Tlsf::Stats Tlsf::getStats() const {
+	Stats stats = {};
+	stats.capacity = this->capacity;
+	stats.used = this->used;
+	stats.numAllocations = this->numAllocations;
+
+	uint64_t totalFree = 0;
+	for (auto &block : this->blocks) {
+		if (block.state != BLOCK_FREE) {
+			continue;
+		}
+
+		stats.numFreeBlocks++;
+		totalFree += block.size;
+		stats.largestFreeBlock = std::max(stats.largestFreeBlock, block.size);
+	}
+
+	if (totalFree > 0) {
+		stats.fragmentation = 1.0f - (float)((double)stats.largestFreeBlock / totalFree);
+	}
+
+	return stats;
+}
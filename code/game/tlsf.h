@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Two-level segregated fit allocator over an external address range. Block metadata lives
+// outside the managed memory, so it can hand out offsets into GPU heaps.
+struct Tlsf {
+	static const uint32_t NULL_BLOCK = UINT32_MAX;
+	static const uint32_t SL_BITS = 4;
+	static const uint32_t SL_COUNT = 1 << SL_BITS;
+	static const uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+	enum BlockState : uint8_t {
+		BLOCK_UNUSED,
+		BLOCK_FREE,
+		BLOCK_ALLOCATED,
+	};
+
+	struct Block {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t prevPhysical;
+		uint32_t nextPhysical;
+		uint32_t prevFree;
+		uint32_t nextFree;
+		BlockState state;
+	};
+
+	struct Stats {
+		uint64_t capacity;
+		uint64_t used;
+		uint32_t numAllocations;
+		uint32_t numFreeBlocks;
+		uint64_t largestFreeBlock;
+		float fragmentation;
+	};
+
+	uint64_t capacity = 0;
+	uint64_t granularity = 1;
+	uint64_t used = 0;
+	uint32_t numAllocations = 0;
+
+	std::vector<Block> blocks;
+	std::vector<uint32_t> unusedBlocks;
+
+	uint64_t flBitmap = 0;
+	uint32_t slBitmaps[FL_COUNT] = {};
+	uint32_t freeLists[FL_COUNT][SL_COUNT];
+
+	static void create(uint64_t capacity, uint64_t granularity, Tlsf *tlsf);
+
+	bool allocate(uint64_t size, uint64_t alignment, uint32_t *block, uint64_t *offset);
+	void free(uint32_t block);
+
+	bool isEmpty() const { return this->numAllocations == 0; }
+	Stats getStats() const;
+
+	uint32_t newBlock();
+	void insertFree(uint32_t block);
+	void removeFree(uint32_t block);
+	uint32_t findFree(uint64_t size);
+	void split(uint32_t block, uint64_t size);
+};
@@ -0,0 +1,301 @@
+#include "transform.h"
+#include "simd.h"
+
+void TransformHierarchy::create(
+	const uint32_t *parents, uint32_t count, TransformHierarchy *hierarchy
+) {
+	hierarchy->count = count;
+
+	// depths are resolved by walking up to the nearest node whose depth is already known
+	std::vector<uint32_t> depths(count, UINT32_MAX);
+	std::vector<uint32_t> path;
+	uint32_t numLevels = 0;
+	for (uint32_t node = 0; node < count; node++) {
+		auto n = node;
+		while (depths[n] == UINT32_MAX && parents[n] != NO_PARENT) {
+			path.push_back(n);
+			n = parents[n];
+		}
+		if (depths[n] == UINT32_MAX) {
+			depths[n] = 0;
+		}
+		while (!path.empty()) {
+			auto child = path.back();
+			path.pop_back();
+			depths[child] = depths[parents[child]] + 1;
+		}
+		if (depths[node] + 1 > numLevels) {
+			numLevels = depths[node] + 1;
+		}
+	}
+
+	hierarchy->levels.assign(numLevels + 1, 0);
+	for (uint32_t node = 0; node < count; node++) {
+		hierarchy->levels[depths[node] + 1]++;
+	}
+	for (uint32_t level = 0; level < numLevels; level++) {
+		hierarchy->levels[level + 1] += hierarchy->levels[level];
+	}
+
+	auto next = hierarchy->levels;
+	hierarchy->slots.resize(count);
+	for (uint32_t node = 0; node < count; node++) {
+		hierarchy->slots[node] = next[depths[node]]++;
+	}
+
+	hierarchy->parents.resize(count);
+	for (uint32_t node = 0; node < count; node++) {
+		auto parent = parents[node];
+		hierarchy->parents[hierarchy->slots[node]] =
+			parent == NO_PARENT ? NO_PARENT : hierarchy->slots[parent];
+	}
+
+	for (int i = 0; i < 3; i++) {
+		hierarchy->translation[i].assign(count, 0.0f);
+		hierarchy->scale[i].assign(count, 1.0f);
+	}
+	for (int i = 0; i < 4; i++) {
+		hierarchy->rotation[i].assign(count, i == 3 ? 1.0f : 0.0f);
+	}
+	for (int i = 0; i < 12; i++) {
+		hierarchy->world[i].assign(count, i % 5 == 0 ? 1.0f : 0.0f);
+	}
+}
+
+void TransformHierarchy::setLocal(
+	uint32_t node, const float *translation, const float *rotation, const float *scale
+) {
+	auto slot = this->slots[node];
+	for (int i = 0; i < 3; i++) {
+		this->translation[i][slot] = translation[i];
+		this->scale[i][slot] = scale[i];
+	}
+	for (int i = 0; i < 4; i++) {
+		this->rotation[i][slot] = rotation[i];
+	}
+}
+
+void TransformHierarchy::getWorld(uint32_t node, float *matrix) const {
+	auto slot = this->slots[node];
+	for (int i = 0; i < 12; i++) {
+		matrix[i] = this->world[i][slot];
+	}
+	matrix[12] = 0.0f;
+	matrix[13] = 0.0f;
+	matrix[14] = 0.0f;
+	matrix[15] = 1.0f;
+}
+
+static void localMatrix(
+	float tx, float ty, float tz, float qx, float qy, float qz, float qw,
+	float sx, float sy, float sz, float *m
+) {
+	m[0] = (1.0f - 2.0f * (qy * qy + qz * qz)) * sx;
+	m[1] = 2.0f * (qx * qy - qw * qz) * sy;
+	m[2] = 2.0f * (qx * qz + qw * qy) * sz;
+	m[3] = tx;
+	m[4] = 2.0f * (qx * qy + qw * qz) * sx;
+	m[5] = (1.0f - 2.0f * (qx * qx + qz * qz)) * sy;
+	m[6] = 2.0f * (qy * qz - qw * qx) * sz;
+	m[7] = ty;
+	m[8] = 2.0f * (qx * qz - qw * qy) * sx;
+	m[9] = 2.0f * (qy * qz + qw * qx) * sy;
+	m[10] = (1.0f - 2.0f * (qx * qx + qy * qy)) * sz;
+	m[11] = tz;
+}
+
+void TransformHierarchy::updateSlots(uint32_t first, uint32_t count) {
+	auto end = first + count;
+	auto slot = first;
+
+#if defined(SIMD_SSE)
+	auto one = _mm_set1_ps(1.0f);
+	auto two = _mm_set1_ps(2.0f);
+	for (; slot + 4 <= end; slot += 4) {
+		auto tx = _mm_loadu_ps(&this->translation[0][slot]);
+		auto ty = _mm_loadu_ps(&this->translation[1][slot]);
+		auto tz = _mm_loadu_ps(&this->translation[2][slot]);
+		auto qx = _mm_loadu_ps(&this->rotation[0][slot]);
+		auto qy = _mm_loadu_ps(&this->rotation[1][slot]);
+		auto qz = _mm_loadu_ps(&this->rotation[2][slot]);
+		auto qw = _mm_loadu_ps(&this->rotation[3][slot]);
+		auto sx = _mm_loadu_ps(&this->scale[0][slot]);
+		auto sy = _mm_loadu_ps(&this->scale[1][slot]);
+		auto sz = _mm_loadu_ps(&this->scale[2][slot]);
+
+		auto xx = _mm_mul_ps(qx, qx);
+		auto yy = _mm_mul_ps(qy, qy);
+		auto zz = _mm_mul_ps(qz, qz);
+		auto xy = _mm_mul_ps(qx, qy);
+		auto xz = _mm_mul_ps(qx, qz);
+		auto yz = _mm_mul_ps(qy, qz);
+		auto wx = _mm_mul_ps(qw, qx);
+		auto wy = _mm_mul_ps(qw, qy);
+		auto wz = _mm_mul_ps(qw, qz);
+
+		__m128 local[12];
+		local[0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		local[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		local[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		local[3] = tx;
+		local[4] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		local[5] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		local[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		local[7] = ty;
+		local[8] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		local[9] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		local[10] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		local[11] = tz;
+
+		// parents are scattered, so their matrices are gathered into the same SoA layout
+		float gathered[12][4];
+		for (int lane = 0; lane < 4; lane++) {
+			auto parent = this->parents[slot + lane];
+			for (int i = 0; i < 12; i++) {
+				gathered[i][lane] = parent == NO_PARENT ?
+					(i % 5 == 0 ? 1.0f : 0.0f) : this->world[i][parent];
+			}
+		}
+
+		for (int r = 0; r < 3; r++) {
+			auto p0 = _mm_loadu_ps(gathered[4 * r + 0]);
+			auto p1 = _mm_loadu_ps(gathered[4 * r + 1]);
+			auto p2 = _mm_loadu_ps(gathered[4 * r + 2]);
+			auto p3 = _mm_loadu_ps(gathered[4 * r + 3]);
+			for (int c = 0; c < 4; c++) {
+				auto w = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(p0, local[c]), _mm_mul_ps(p1, local[4 + c])),
+					_mm_mul_ps(p2, local[8 + c])
+				);
+				if (c == 3) {
+					w = _mm_add_ps(w, p3);
+				}
+				_mm_storeu_ps(&this->world[4 * r + c][slot], w);
+			}
+		}
+	}
+#endif
+
+	for (; slot < end; slot++) {
+		float local[12];
+		localMatrix(
+			this->translation[0][slot], this->translation[1][slot], this->translation[2][slot],
+			this->rotation[0][slot], this->rotation[1][slot], this->rotation[2][slot],
+			this->rotation[3][slot],
+			this->scale[0][slot], this->scale[1][slot], this->scale[2][slot],
+			local
+		);
+
+		auto parent = this->parents[slot];
+		float p[12];
+		for (int i = 0; i < 12; i++) {
+			p[i] = parent == NO_PARENT ? (i % 5 == 0 ? 1.0f : 0.0f) : this->world[i][parent];
+		}
+
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 4; c++) {
+				auto w = p[4 * r + 0] * local[c] + p[4 * r + 1] * local[4 + c] +
+					p[4 * r + 2] * local[8 + c];
+				if (c == 3) {
+					w += p[4 * r + 3];
+				}
+				this->world[4 * r + c][slot] = w;
+			}
+		}
+	}
+}
+
+struct UpdateJob {
+	TransformHierarchy *hierarchy;
+	uint32_t first;
+};
+
+static void updateBatch(void *data, uint32_t first, uint32_t count) {
+	auto job = (UpdateJob*)data;
+	job->hierarchy->updateSlots(job->first + first, count);
+}
+
+void TransformHierarchy::update(JobSystem *jobs) {
+	for (size_t level = 0; level + 1 < this->levels.size(); level++) {
+		UpdateJob job = { this, this->levels[level] };
+		auto count = this->levels[level + 1] - this->levels[level];
+		if (jobs) {
+			jobs->parallelFor(updateBatch, &job, count, TransformHierarchy::BATCH_SIZE);
+		} else {
+			updateBatch(&job, 0, count);
+		}
+	}
+}
+
+void TransformHierarchy::writeWorldViewProjSlots(
+	const float *viewProj, uint32_t first, uint32_t count, float *out
+) const {
+	auto end = first + count;
+	auto slot = first;
+
+#if defined(SIMD_SSE)
+	for (; slot + 4 <= end; slot += 4, out += 4 * 16) {
+		__m128 w[12];
+		for (int i = 0; i < 12; i++) {
+			w[i] = _mm_loadu_ps(&this->world[i][slot]);
+		}
+
+		for (int r = 0; r < 4; r++) {
+			auto v0 = _mm_set1_ps(viewProj[4 * r + 0]);
+			auto v1 = _mm_set1_ps(viewProj[4 * r + 1]);
+			auto v2 = _mm_set1_ps(viewProj[4 * r + 2]);
+			auto v3 = _mm_set1_ps(viewProj[4 * r + 3]);
+
+			__m128 row[4];
+			for (int c = 0; c < 4; c++) {
+				row[c] = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(v0, w[c]), _mm_mul_ps(v1, w[4 + c])),
+					_mm_mul_ps(v2, w[8 + c])
+				);
+			}
+			row[3] = _mm_add_ps(row[3], v3);
+
+			// lanes are slots, so transposing turns four columns into one row of each matrix
+			_MM_TRANSPOSE4_PS(row[0], row[1], row[2], row[3]);
+			for (int lane = 0; lane < 4; lane++) {
+				_mm_storeu_ps(&out[16 * lane + 4 * r], row[lane]);
+			}
+		}
+	}
+#endif
+
+	for (; slot < end; slot++, out += 16) {
+		for (int r = 0; r < 4; r++) {
+			auto v = &viewProj[4 * r];
+			for (int c = 0; c < 4; c++) {
+				out[4 * r + c] = v[0] * this->world[c][slot] + v[1] * this->world[4 + c][slot] +
+					v[2] * this->world[8 + c][slot] + (c == 3 ? v[3] : 0.0f);
+			}
+		}
+	}
+}
+
+struct WriteJob {
+	const TransformHierarchy *hierarchy;
+	const float *viewProj;
+	uint32_t first;
+	float *out;
+};
+
+static void writeBatch(void *data, uint32_t first, uint32_t count) {
+	auto job = (WriteJob*)data;
+	job->hierarchy->writeWorldViewProjSlots(
+		job->viewProj, job->first + first, count, job->out + 16 * first
+	);
+}
+
+void TransformHierarchy::writeWorldViewProj(
+	JobSystem *jobs, const float *viewProj, uint32_t first, uint32_t count, float *out
+) const {
+	WriteJob job = { this, viewProj, first, out };
+	if (jobs) {
+		jobs->parallelFor(writeBatch, &job, count, TransformHierarchy::BATCH_SIZE);
+	} else {
+		writeBatch(&job, 0, count);
+	}
+}
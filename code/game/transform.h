@@ -0,0 +1,46 @@
+#pragma once
+#include "jobs.h"
+#include <cstdint>
+#include <vector>
+
+// Local translation, rotation and scale for a hierarchy of nodes, stored in SoA arrays with the
+// nodes sorted by depth. Every parent is updated before its children, and the nodes within one
+// depth level are independent, so each level is updated in parallel batches four nodes at a time.
+//
+// World matrices are affine 3x4, and all matrices are row major and transform column vectors,
+// the same layout the vertex shader reads.
+struct TransformHierarchy {
+	static const uint32_t NO_PARENT = UINT32_MAX;
+	static const uint32_t BATCH_SIZE = 1024;
+
+	uint32_t count = 0;
+
+	// node to slot, where slots are in depth order
+	std::vector<uint32_t> slots;
+	std::vector<uint32_t> parents;
+
+	// the first slot of each depth level, followed by the count
+	std::vector<uint32_t> levels;
+
+	std::vector<float> translation[3];
+	std::vector<float> rotation[4];
+	std::vector<float> scale[3];
+	std::vector<float> world[12];
+
+	static void create(const uint32_t *parents, uint32_t count, TransformHierarchy *hierarchy);
+
+	void setLocal(uint32_t node, const float *translation, const float *rotation, const float *scale);
+	void getWorld(uint32_t node, float *matrix) const;
+
+	void update(JobSystem *jobs);
+	void updateSlots(uint32_t first, uint32_t count);
+
+	// Writes viewProj * world as full 4x4 matrices for a range of slots, so that out can point
+	// straight into mapped constant or instance memory.
+	void writeWorldViewProj(
+		JobSystem *jobs, const float *viewProj, uint32_t first, uint32_t count, float *out
+	) const;
+	void writeWorldViewProjSlots(
+		const float *viewProj, uint32_t first, uint32_t count, float *out
+	) const;
+};
@@ -0,0 +1,203 @@
+#include "transient.h"
+#include "context.h"
+#include "util.h"
+
+static D3D12_RESOURCE_DESC getResourceDesc(const GraphTextureDesc *desc) {
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	rd.Width = desc->width;
+	rd.Height = desc->height;
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = 1;
+	rd.Format = (DXGI_FORMAT)desc->format;
+	rd.SampleDesc.Count = 1;
+	rd.Flags = (D3D12_RESOURCE_FLAGS)desc->flags;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	return rd;
+}
+
+HRESULT TransientHeap::create(ID3D12Device *device, TransientHeap *heap) {
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC dhd = {};
+		dhd.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		dhd.NumDescriptors = TransientHeap::MAX_TEXTURES;
+		TRY(device->CreateDescriptorHeap(&dhd, IID_PPV_ARGS(&heap->rtvHeap)));
+		heap->rtvDescriptorSize = device->GetDescriptorHandleIncrementSize(dhd.Type);
+	}
+
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC dhd = {};
+		dhd.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+		dhd.NumDescriptors = TransientHeap::MAX_TEXTURES;
+		TRY(device->CreateDescriptorHeap(&dhd, IID_PPV_ARGS(&heap->dsvHeap)));
+		heap->dsvDescriptorSize = device->GetDescriptorHandleIncrementSize(dhd.Type);
+	}
+
+	return S_OK;
+}
+
+void TransientHeap::describe(
+	ID3D12Device *device, DXGI_FORMAT format, UINT width, UINT height,
+	D3D12_RESOURCE_FLAGS flags, GraphTextureDesc *desc
+) {
+	desc->width = width;
+	desc->height = height;
+	desc->format = format;
+	desc->flags = flags;
+	if (this->sizes.find(desc)) {
+		return;
+	}
+
+	auto rd = getResourceDesc(desc);
+	auto info = device->GetResourceAllocationInfo(0, 1, &rd);
+	desc->size = info.SizeInBytes;
+	desc->alignment = info.Alignment;
+	this->sizes.add(desc);
+}
+
+HRESULT TransientHeap::realize(Context *context, RenderGraph *graph) {
+	if (graph->textures.size() > TransientHeap::MAX_TEXTURES) {
+		return E_OUTOFMEMORY;
+	}
+	this->textures.resize(graph->textures.size());
+
+	bool changed = this->heapSize < graph->transientSize;
+	for (GraphResource i = 0; i < graph->textures.size(); i++) {
+		auto &texture = graph->textures[i];
+		if (texture.imported || texture.firstPass == RenderGraph::NO_PASS) {
+			continue;
+		}
+
+		auto &cached = this->textures[i];
+		auto rd = getResourceDesc(&texture.desc);
+		changed |= !cached.resource.Get() || cached.offset != texture.offset ||
+			memcmp(&cached.desc, &rd, sizeof(rd)) != 0;
+	}
+	if (!changed) {
+		return S_OK;
+	}
+
+	// the layout only changes on resize or when passes change, so a full stall is acceptable
+	TRY(context->waitForGpu());
+	for (auto &cached : this->textures) {
+		if (cached.resource.Get()) {
+			context->states.untrack(cached.resource.Get());
+			cached.resource.Reset();
+		}
+	}
+
+	if (this->heapSize < graph->transientSize) {
+		if (this->residency != ResidencySet::NULL_OBJECT) {
+			context->residency.remove(this->residency);
+		}
+		this->heap.Reset();
+
+		D3D12_HEAP_DESC hd = {};
+		hd.SizeInBytes = graph->transientSize;
+		hd.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+		hd.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		hd.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+		TRY(context->device->CreateHeap(&hd, IID_PPV_ARGS(&this->heap)));
+		this->heapSize = graph->transientSize;
+		this->residency = context->residency.add(this->heap.Get(), this->heapSize);
+	}
+
+	for (GraphResource i = 0; i < graph->textures.size(); i++) {
+		auto &texture = graph->textures[i];
+		if (texture.imported || texture.firstPass == RenderGraph::NO_PASS) {
+			continue;
+		}
+
+		UINT32 initialState = 0;
+		for (auto &access : graph->passes[texture.firstPass].accesses) {
+			if (access.resource == i) {
+				initialState = access.state;
+				break;
+			}
+		}
+
+		auto &cached = this->textures[i];
+		cached.desc = getResourceDesc(&texture.desc);
+		cached.offset = texture.offset;
+
+		bool isDepth = (cached.desc.Flags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL) != 0;
+		D3D12_CLEAR_VALUE clear = {};
+		clear.Format = cached.desc.Format;
+		if (isDepth) {
+			clear.DepthStencil.Depth = 1.0f;
+		}
+
+		TRY(context->device->CreatePlacedResource(
+			this->heap.Get(), cached.offset, &cached.desc,
+			(D3D12_RESOURCE_STATES)initialState, &clear, IID_PPV_ARGS(&cached.resource)
+		));
+		context->states.track(cached.resource.Get(), 1, initialState);
+
+		if (isDepth) {
+			cached.view = this->dsvHeap->GetCPUDescriptorHandleForHeapStart();
+			cached.view.ptr += i * this->dsvDescriptorSize;
+			context->device->CreateDepthStencilView(cached.resource.Get(), NULL, cached.view);
+		} else {
+			cached.view = this->rtvHeap->GetCPUDescriptorHandleForHeapStart();
+			cached.view.ptr += i * this->rtvDescriptorSize;
+			context->device->CreateRenderTargetView(cached.resource.Get(), NULL, cached.view);
+		}
+	}
+
+	return S_OK;
+}
+
+HRESULT TransientHeap::execute(
+	Context *context, RenderGraph *graph, ID3D12GraphicsCommandList *commandList
+) {
+	GraphPassContext passContext = {};
+	passContext.context = context;
+	passContext.commandList = commandList;
+	passContext.heap = this;
+	passContext.graph = graph;
+	passContext.result = S_OK;
+
+	if (this->residency != ResidencySet::NULL_OBJECT) {
+		context->residency.use(this->residency);
+	}
+
+	for (auto &pass : graph->passes) {
+		if (pass.culled) {
+			continue;
+		}
+
+		for (auto &barrier : pass.barriers) {
+			auto resource = this->getResource(graph, barrier.resource);
+			if (barrier.aliasing) {
+				context->states.activate(resource);
+			}
+			context->transition(resource, (D3D12_RESOURCE_STATES)barrier.after);
+		}
+		context->flushBarriers(commandList);
+
+		if (pass.execute) {
+			pass.execute(&passContext);
+			TRY(passContext.result);
+		}
+	}
+
+	for (auto &barrier : graph->finalBarriers) {
+		auto resource = this->getResource(graph, barrier.resource);
+		context->transition(resource, (D3D12_RESOURCE_STATES)barrier.after);
+	}
+	context->flushBarriers(commandList);
+
+	return S_OK;
+}
+
+ID3D12Resource *TransientHeap::getResource(RenderGraph *graph, GraphResource resource) {
+	auto &texture = graph->textures[resource];
+	if (texture.imported) {
+		return (ID3D12Resource*)texture.external;
+	}
+	return this->textures[resource].resource.Get();
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE TransientHeap::getView(GraphResource resource) {
+	return this->textures[resource].view;
+}
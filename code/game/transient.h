@@ -0,0 +1,57 @@
+#pragma once
+#include "graph.h"
+#include "residency.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <vector>
+
+struct Context;
+struct TransientHeap;
+
+struct GraphPassContext {
+	Context *context;
+	ID3D12GraphicsCommandList *commandList;
+	TransientHeap *heap;
+	RenderGraph *graph;
+	HRESULT result;
+};
+
+// Backs the transient textures of a compiled render graph with placed resources in one heap,
+// at the offsets the graph chose, so resources with disjoint lifetimes share memory.
+struct TransientHeap {
+	static const UINT MAX_TEXTURES = 32;
+
+	struct Texture {
+		Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+		D3D12_RESOURCE_DESC desc;
+		UINT64 offset;
+		D3D12_CPU_DESCRIPTOR_HANDLE view;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+	UINT64 heapSize = 0;
+	UINT32 residency = ResidencySet::NULL_OBJECT;
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> rtvHeap;
+	UINT rtvDescriptorSize;
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> dsvHeap;
+	UINT dsvDescriptorSize;
+
+	std::vector<Texture> textures;
+	GraphTextureSizes sizes;
+
+	static HRESULT create(ID3D12Device *device, TransientHeap *heap);
+
+	void describe(
+		ID3D12Device *device, DXGI_FORMAT format, UINT width, UINT height,
+		D3D12_RESOURCE_FLAGS flags, GraphTextureDesc *desc
+	);
+
+	HRESULT realize(Context *context, RenderGraph *graph);
+	HRESULT execute(Context *context, RenderGraph *graph, ID3D12GraphicsCommandList *commandList);
+
+	ID3D12Resource *getResource(RenderGraph *graph, GraphResource resource);
+	D3D12_CPU_DESCRIPTOR_HANDLE getView(GraphResource resource);
+};
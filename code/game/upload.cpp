@@ -0,0 +1,49 @@
+#include "upload.h"
+#include "util.h"
+
+HRESULT UploadRing::create(GpuAllocator *allocator, UINT64 size, UploadRing *upload) {
+	D3D12_RESOURCE_DESC rd = {};
+	rd.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	rd.Width = size;
+	rd.Height = 1;
+	rd.DepthOrArraySize = 1;
+	rd.MipLevels = 1;
+	rd.Format = DXGI_FORMAT_UNKNOWN;
+	rd.SampleDesc.Count = 1;
+	rd.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+	TRY(allocator->createResource(
+		D3D12_HEAP_TYPE_UPLOAD, &rd, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, upload,
+		&upload->buffer, &upload->allocation
+	));
+
+	D3D12_RANGE readRange = {};
+	TRY(upload->buffer->Map(0, &readRange, (void**)&upload->mapped));
+
+	FrameRing::create(size, &upload->ring);
+
+	return S_OK;
+}
+
+bool UploadRing::allocate(
+	UINT64 size, UINT64 alignment,
+	void **data, D3D12_GPU_VIRTUAL_ADDRESS *address, UINT64 *offset
+) {
+	UINT64 start;
+	if (!this->ring.allocate(size, alignment, &start)) {
+		return false;
+	}
+
+	*data = this->mapped + start;
+	*address = this->buffer->GetGPUVirtualAddress() + start;
+	*offset = start;
+	return true;
+}
+
+void UploadRing::finishFrame(UINT64 fenceValue) {
+	this->ring.finishFrame(fenceValue);
+}
+
+void UploadRing::retire(UINT64 completedFenceValue) {
+	this->ring.retire(completedFenceValue);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "allocator.h"
+#include "ring.h"
+
+#define WIN32_LEAN_AND_MEAN
+#include <d3d12.h>
+#include <wrl/client.h>
+
+// A persistently mapped upload buffer handed out per frame and reclaimed on fence completion.
+struct UploadRing {
+	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+	GpuAllocation allocation;
+	UINT8 *mapped;
+	FrameRing ring;
+
+	static HRESULT create(GpuAllocator *allocator, UINT64 size, UploadRing *upload);
+
+	bool allocate(
+		UINT64 size, UINT64 alignment,
+		void **data, D3D12_GPU_VIRTUAL_ADDRESS *address, UINT64 *offset
+	);
+
+	void finishFrame(UINT64 fenceValue);
+	void retire(UINT64 completedFenceValue);
+};
@@ -1,5 +1,4 @@
 #include "util.h"
-#include <fstream>
 
 void printWindowsError(HRESULT error) {
 	WCHAR *message = 0;
@@ -10,13 +9,13 @@ void printWindowsError(HRESULT error) {
 	HeapFree(GetProcessHeap(), 0, message);
 }
 
-std::vector<char> readFile(const char *path) {
-	std::ifstream file(path, std::ios::binary | std::ios::ate);
-	auto size = file.tellg();
-	file.seekg(0, std::ios::beg);
-
-	std::vector<char> data(size);
-	file.read(data.data(), size);
-
-	return data;
+HRESULT readAsset(const Archive *archive, const char *name, std::vector<char> *data) {
+	auto entry = archive->find(name);
+	if (entry == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+	if (!archive->read(entry, data)) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+	return S_OK;
 }
@@ -1,3 +1,5 @@
+#include "archive.h"
+
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <vector>
@@ -11,4 +13,5 @@
 
 void printWindowsError(HRESULT error);
 
-std::vector<char> readFile(const char *path);
+// Reads a whole asset out of the archive, decompressing it if it has to.
+HRESULT readAsset(const Archive *archive, const char *name, std::vector<char> *data);
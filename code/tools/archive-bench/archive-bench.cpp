@@ -0,0 +1,303 @@
+#include "game/archive.h"
+#include "tools/asset-builder/archive.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Options {
+	uint32_t assets = 2000;
+	uint32_t size = 32;
+	uint32_t lookups = 1000000;
+	const char *dir = NULL;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--assets") == 0) {
+			options->assets = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--size") == 0) {
+			options->size = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--lookups") == 0) {
+			options->lookups = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--dir") == 0) {
+			options->dir = value;
+		} else {
+			return false;
+		}
+	}
+	return options->assets > 0 && options->size > 0;
+}
+
+static bool writeFile(const std::string &path, const std::vector<char> &data) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	auto complete = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && complete;
+}
+
+static bool readFile(const std::string &path, std::vector<char> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+// Drops a file's pages from the page cache, so the next read of it has to go to the disk.
+static void evictFile(const std::string &path) {
+	auto file = open(path.c_str(), O_RDONLY);
+	if (file >= 0) {
+		fdatasync(file);
+		posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+		close(file);
+	}
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+// Stands in for the kinds of asset there are: vertex data on a grid that repeats itself a little,
+// text like shader reflection or scripts that compresses well, and texture blocks that don't
+// compress at all and are stored, like the builder stores DDS files.
+static void generateAsset(
+	uint32_t kind, size_t size, std::mt19937 *random, std::vector<char> *out
+) {
+	out->resize(size);
+	if (kind == 0) {
+		for (size_t i = 0; i + 4 <= size; i += 4) {
+			auto value = (float)((*random)() % 64) * 0.125f;
+			memcpy(out->data() + i, &value, sizeof(value));
+		}
+	} else if (kind == 1) {
+		static const char *words[] = {
+			"float4", "position", "normal", "texcoord", "cbuffer", "register", "return", "mul",
+			"Texture2D", "SamplerState", "struct", "joints", "weights", "saturate", "dot",
+		};
+		size_t i = 0;
+		while (i < size) {
+			auto word = words[(*random)() % (sizeof(words) / sizeof(*words))];
+			for (; *word && i < size; word++) {
+				(*out)[i++] = *word;
+			}
+			if (i < size) {
+				(*out)[i++] = (*random)() % 8 == 0 ? '\n' : ' ';
+			}
+		}
+	} else {
+		for (auto &byte : *out) {
+			byte = (char)(*random)();
+		}
+	}
+}
+
+static bool run(const Options *options, const std::string &root) {
+	std::mt19937 random(1);
+	std::vector<ArchiveInput> inputs(options->assets);
+	std::vector<std::vector<char>> contents(options->assets);
+	const char *extensions[] = { "mesh", "txt", "dds" };
+	for (uint32_t i = 0; i < options->assets; i++) {
+		auto kind = i % 3;
+		auto size = (size_t)options->size * 1024 / 4 + random() % (options->size * 1024 * 7 / 4);
+		generateAsset(kind, size, &random, &contents[i]);
+
+		char name[64];
+		snprintf(name, sizeof(name), "asset-%05u.%s", i, extensions[kind]);
+		inputs[i].name = name;
+		inputs[i].path = root + name;
+		inputs[i].compress = kind != 2;
+		if (!writeFile(inputs[i].path, contents[i])) {
+			fprintf(stderr, "couldn't write %s\n", inputs[i].path.c_str());
+			return false;
+		}
+	}
+
+	auto listPath = root + "assets.list";
+	auto archivePath = root + "assets.pak";
+	std::vector<ArchiveInput> listed;
+	if (
+		!writeArchiveList(listPath.c_str(), inputs.data(), inputs.size()) ||
+		!readArchiveList(listPath.c_str(), &listed) || listed.size() != inputs.size()
+	) {
+		fprintf(stderr, "the archive list didn't read back\n");
+		return false;
+	}
+
+	ArchiveStats stats;
+	auto start = Clock::now();
+	if (!writeArchive(archivePath.c_str(), listed.data(), listed.size(), &stats)) {
+		fprintf(stderr, "couldn't write the archive\n");
+		return false;
+	}
+	auto packMilliseconds = getMilliseconds(start, Clock::now());
+	printf(
+		"packed %llu entries, %.1f MB into %.1f MB (%llu compressed, %.1f MB of padding) "
+		"in %.1f ms, %.0f MB/s\n",
+		(unsigned long long)stats.numEntries, stats.size / 1048576.0, stats.fileSize / 1048576.0,
+		(unsigned long long)stats.numCompressed,
+		(stats.fileSize - stats.storedSize) / 1048576.0, packMilliseconds,
+		stats.size / 1048576.0 / (packMilliseconds / 1000.0)
+	);
+
+	// reads go in a shuffled order, as a level asks for its assets
+	std::vector<uint32_t> order(options->assets);
+	for (uint32_t i = 0; i < options->assets; i++) {
+		order[i] = i;
+	}
+	std::shuffle(order.begin(), order.end(), random);
+
+	printf("%-28s %10s %10s\n", "load every asset", "cold ms", "warm ms");
+	std::vector<char> data;
+	double looseMilliseconds[2];
+	double archiveMilliseconds[2];
+	for (int warm = 0; warm < 2; warm++) {
+		if (!warm) {
+			for (auto &input : inputs) {
+				evictFile(input.path);
+			}
+		}
+		start = Clock::now();
+		for (auto i : order) {
+			if (!readFile(inputs[i].path, &data)) {
+				fprintf(stderr, "couldn't read %s\n", inputs[i].path.c_str());
+				return false;
+			}
+		}
+		looseMilliseconds[warm] = getMilliseconds(start, Clock::now());
+
+		if (!warm) {
+			evictFile(archivePath);
+		}
+		start = Clock::now();
+		Archive archive;
+		if (!Archive::open(archivePath.c_str(), &archive)) {
+			fprintf(stderr, "couldn't open the archive\n");
+			return false;
+		}
+		for (auto i : order) {
+			auto entry = archive.find(inputs[i].name.c_str());
+			if (entry == NULL || !archive.read(entry, &data)) {
+				fprintf(stderr, "couldn't read %s from the archive\n", inputs[i].name.c_str());
+				archive.close();
+				return false;
+			}
+		}
+		archive.close();
+		archiveMilliseconds[warm] = getMilliseconds(start, Clock::now());
+	}
+	printf(
+		"%-28s %10.1f %10.1f\n%-28s %10.1f %10.1f\n",
+		"loose files", looseMilliseconds[0], looseMilliseconds[1],
+		"archive", archiveMilliseconds[0], archiveMilliseconds[1]
+	);
+
+	Archive archive;
+	if (!Archive::open(archivePath.c_str(), &archive)) {
+		fprintf(stderr, "couldn't open the archive\n");
+		return false;
+	}
+
+	auto succeeded = true;
+	for (uint32_t i = 0; succeeded && i < options->assets; i++) {
+		auto entry = archive.find(inputs[i].name.c_str());
+		succeeded =
+			entry != NULL && entry->offset % ARCHIVE_ALIGNMENT == 0 &&
+			archive.read(entry, &data) && data == contents[i] &&
+			(archive.getData(entry) == NULL) == ((entry->flags & ARCHIVE_ENTRY_COMPRESSED) != 0);
+		if (!succeeded) {
+			fprintf(stderr, "%s didn't read back as it was written\n", inputs[i].name.c_str());
+		}
+	}
+
+	// half the lookups are for names that aren't there, which have to reach a free slot
+	std::vector<std::pair<std::string, bool>> names;
+	for (auto &input : inputs) {
+		names.push_back(std::make_pair(input.name, true));
+		names.push_back(std::make_pair(input.name + ".missing", false));
+	}
+	std::shuffle(names.begin(), names.end(), random);
+	uint32_t numFound = 0;
+	start = Clock::now();
+	for (uint32_t i = 0; i < options->lookups; i++) {
+		numFound += archive.find(names[i % names.size()].first.c_str()) != NULL;
+	}
+	auto lookupMilliseconds = getMilliseconds(start, Clock::now());
+	uint32_t expectedFound = 0;
+	for (uint32_t i = 0; i < options->lookups; i++) {
+		expectedFound += names[i % names.size()].second;
+	}
+	printf(
+		"%u lookups, half of them misses, in %.1f ms, %.1f ns each\n",
+		options->lookups, lookupMilliseconds, 1e6 * lookupMilliseconds / options->lookups
+	);
+	if (numFound != expectedFound) {
+		fprintf(stderr, "found %u names, not %u\n", numFound, expectedFound);
+		succeeded = false;
+	}
+	archive.close();
+
+	// a truncated archive has entries past its end, and must not open
+	if (truncate(archivePath.c_str(), (off_t)(stats.fileSize - ARCHIVE_ALIGNMENT)) != 0) {
+		return false;
+	}
+	if (Archive::open(archivePath.c_str(), &archive)) {
+		fprintf(stderr, "a truncated archive opened\n");
+		archive.close();
+		succeeded = false;
+	}
+
+	return succeeded;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr, "usage: %s [--assets n] [--size kb] [--lookups n] [--dir path]\n", argv[0]
+		);
+		return 1;
+	}
+
+	// everything goes in a new directory, which is removed afterwards
+	std::string base = options.dir ? options.dir : "/tmp";
+	std::vector<char> root(base.begin(), base.end());
+	const char suffix[] = "/archive-bench-XXXXXX";
+	root.insert(root.end(), suffix, suffix + sizeof(suffix));
+	if (mkdtemp(root.data()) == NULL) {
+		fprintf(stderr, "couldn't create a directory in %s\n", base.c_str());
+		return 1;
+	}
+
+	printf("%u assets of about %u KB in %s\n", options.assets, options.size, root.data());
+	auto succeeded = run(&options, std::string(root.data()) + "/");
+	nftw(root.data(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,348 @@
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+#include "anim.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+struct AnimationHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numJoints;
+	uint32_t numFrames;
+	float frameRate;
+	uint32_t numKeys;
+};
+
+struct AnimationJoint {
+	int32_t parent;
+	float translation[3];
+	float rotation[4];
+};
+
+struct AnimationTrack {
+	uint32_t firstKey;
+	uint32_t numKeys;
+	float min[4];
+	float extent[4];
+};
+
+struct AnimationKey {
+	uint16_t frame;
+	uint16_t values[4];
+};
+
+static const uint32_t ANIMATION_MAGIC = 'A' | 'N' << 8 | 'I' << 16 | 'M' << 24;
+static const uint32_t ANIMATION_VERSION = 1;
+
+// keys are dropped while interpolating the neighbours stays within these errors
+static const float ROTATION_TOLERANCE = 0.25f;
+static const float TRANSLATION_TOLERANCE = 0.0005f;
+
+static const float PI = 3.14159265f;
+
+static bool readToken(FILE *file, char *token) {
+	return fscanf(file, "%255s", token) == 1;
+}
+
+HRESULT loadBvh(const char *path, BvhSkeleton *skeleton) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	skeleton->joints.clear();
+	skeleton->numChannels = 0;
+
+	char token[256];
+	std::vector<int32_t> stack;
+	bool endSite = false;
+	bool corrupt = !readToken(file, token) || strcmp(token, "HIERARCHY") != 0;
+	while (!corrupt && readToken(file, token)) {
+		if (strcmp(token, "ROOT") == 0 || strcmp(token, "JOINT") == 0) {
+			BvhJoint joint = {};
+			joint.parent = stack.empty() ? -1 : stack.back();
+			corrupt = !readToken(file, token);
+			joint.name = token;
+			stack.push_back((int32_t)skeleton->joints.size());
+			skeleton->joints.push_back(joint);
+			corrupt = corrupt || !readToken(file, token) || strcmp(token, "{") != 0;
+		} else if (strcmp(token, "End") == 0) {
+			corrupt = stack.empty() || !readToken(file, token) || !readToken(file, token) ||
+				strcmp(token, "{") != 0;
+			endSite = true;
+		} else if (strcmp(token, "OFFSET") == 0) {
+			float offset[3];
+			corrupt = stack.empty() ||
+				fscanf(file, "%f %f %f", &offset[0], &offset[1], &offset[2]) != 3;
+			if (!corrupt) {
+				auto &joint = skeleton->joints[stack.back()];
+				memcpy(endSite ? joint.end : joint.offset, offset, sizeof(offset));
+				joint.hasEnd = joint.hasEnd || endSite;
+			}
+		} else if (strcmp(token, "CHANNELS") == 0) {
+			auto &joint = skeleton->joints[stack.back()];
+			corrupt = fscanf(file, "%u", &joint.numChannels) != 1 || joint.numChannels > 6;
+			joint.firstChannel = skeleton->numChannels;
+			skeleton->numChannels += joint.numChannels;
+			for (uint32_t i = 0; !corrupt && i < joint.numChannels; i++) {
+				corrupt = !readToken(file, token) || strlen(token) < 2 ||
+					token[0] < 'X' || token[0] > 'Z';
+				if (!corrupt) {
+					auto axis = (uint32_t)(token[0] - 'X');
+					joint.channels[i] = strcmp(&token[1], "position") == 0 ? axis : 3 + axis;
+				}
+			}
+		} else if (strcmp(token, "}") == 0) {
+			if (endSite) {
+				endSite = false;
+			} else if (!stack.empty()) {
+				stack.pop_back();
+			} else {
+				corrupt = true;
+			}
+		} else if (strcmp(token, "MOTION") == 0) {
+			break;
+		} else {
+			corrupt = true;
+		}
+	}
+
+	corrupt = corrupt || skeleton->joints.empty() ||
+		fscanf(file, " Frames: %u", &skeleton->numFrames) != 1 ||
+		fscanf(file, " Frame Time: %f", &skeleton->frameTime) != 1 ||
+		skeleton->numFrames == 0 || skeleton->numFrames > UINT16_MAX || skeleton->frameTime <= 0.0f;
+	if (!corrupt) {
+		skeleton->motion.resize(skeleton->numFrames * skeleton->numChannels);
+		for (auto &value : skeleton->motion) {
+			if (fscanf(file, "%f", &value) != 1) {
+				corrupt = true;
+				break;
+			}
+		}
+	}
+
+	fclose(file);
+	return corrupt ? HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT) : S_OK;
+}
+
+void getRestPositions(const BvhSkeleton *skeleton, std::vector<float> *positions) {
+	positions->resize(3 * skeleton->joints.size());
+	for (size_t j = 0; j < skeleton->joints.size(); j++) {
+		auto &joint = skeleton->joints[j];
+		for (int i = 0; i < 3; i++) {
+			auto parent = joint.parent < 0 ? 0.0f : (*positions)[3 * joint.parent + i];
+			(*positions)[3 * j + i] = parent + joint.offset[i];
+		}
+	}
+}
+
+static void multiplyQuaternion(const float *a, const float *b, float *out) {
+	float q[4] = {
+		a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1],
+		a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0],
+		a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3],
+		a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2],
+	};
+	memcpy(out, q, sizeof(q));
+}
+
+// Converts one frame of a joint's channels to a local translation and rotation. Rotations apply
+// in channel order, and position channels replace the matching component of the offset.
+static void getLocalTransform(
+	const BvhSkeleton *skeleton, uint32_t joint, uint32_t frame,
+	float *translation, float *rotation
+) {
+	auto &j = skeleton->joints[joint];
+	auto values = &skeleton->motion[frame * skeleton->numChannels + j.firstChannel];
+
+	memcpy(translation, j.offset, sizeof(j.offset));
+	rotation[0] = rotation[1] = rotation[2] = 0.0f;
+	rotation[3] = 1.0f;
+	for (uint32_t i = 0; i < j.numChannels; i++) {
+		auto channel = j.channels[i];
+		if (channel < 3) {
+			translation[channel] = values[i];
+			continue;
+		}
+
+		auto angle = 0.5f * values[i] * PI / 180.0f;
+		float axis[4] = { 0.0f, 0.0f, 0.0f, cosf(angle) };
+		axis[channel - 3] = sinf(angle);
+		multiplyQuaternion(rotation, axis, rotation);
+	}
+}
+
+static void interpolate(
+	const float *a, const float *b, float t, uint32_t numComponents, bool rotation, float *out
+) {
+	// the runtime takes the short way between rotations, so flip b into a's hemisphere
+	auto sign = 1.0f;
+	if (rotation && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f) {
+		sign = -1.0f;
+	}
+
+	auto length = 0.0f;
+	for (uint32_t i = 0; i < numComponents; i++) {
+		out[i] = a[i] + t * (sign * b[i] - a[i]);
+		length += out[i] * out[i];
+	}
+	if (rotation) {
+		auto scale = 1.0f / sqrtf(length);
+		for (uint32_t i = 0; i < numComponents; i++) {
+			out[i] *= scale;
+		}
+	}
+}
+
+static float getError(const float *a, const float *b, uint32_t numComponents, bool rotation) {
+	auto sum = 0.0f;
+	for (uint32_t i = 0; i < numComponents; i++) {
+		sum += rotation ? a[i] * b[i] : (a[i] - b[i]) * (a[i] - b[i]);
+	}
+	if (rotation) {
+		return 2.0f * acosf(std::min(fabsf(sum), 1.0f)) * 180.0f / PI;
+	}
+	return sqrtf(sum);
+}
+
+// Greedily extends each key as far as interpolating to the next one stays within tolerance. The
+// clip loops, so frame numFrames is frame 0 again and the last key interpolates back to it.
+static void reduceTrack(
+	const float *samples, uint32_t numFrames, uint32_t numComponents, bool rotation,
+	std::vector<uint32_t> *keyFrames
+) {
+	auto tolerance = rotation ? ROTATION_TOLERANCE : TRANSLATION_TOLERANCE;
+	auto sample = [&](uint32_t frame) { return &samples[4 * (frame % numFrames)]; };
+
+	keyFrames->clear();
+	uint32_t key = 0;
+	while (key < numFrames) {
+		keyFrames->push_back(key);
+
+		auto next = key + 1;
+		for (auto end = next + 1; end <= numFrames; end++) {
+			auto fits = true;
+			for (auto frame = key + 1; fits && frame < end; frame++) {
+				float value[4];
+				auto t = (float)(frame - key) / (end - key);
+				interpolate(sample(key), sample(end), t, numComponents, rotation, value);
+				fits = getError(value, sample(frame), numComponents, rotation) <= tolerance;
+			}
+			if (!fits) {
+				break;
+			}
+			next = end;
+		}
+		key = next;
+	}
+}
+
+HRESULT buildAnimation(const char *sourcePath, const char *targetPath) {
+	HRESULT hr;
+
+	BvhSkeleton skeleton;
+	if (FAILED(hr = loadBvh(sourcePath, &skeleton))) {
+		return hr;
+	}
+
+	auto numJoints = (uint32_t)skeleton.joints.size();
+	auto numFrames = skeleton.numFrames;
+
+	AnimationHeader header = {};
+	header.magic = ANIMATION_MAGIC;
+	header.version = ANIMATION_VERSION;
+	header.numJoints = numJoints;
+	header.numFrames = numFrames;
+	header.frameRate = 1.0f / skeleton.frameTime;
+
+	std::vector<AnimationJoint> joints(numJoints);
+	std::vector<AnimationTrack> tracks(2 * numJoints);
+	std::vector<AnimationKey> keys;
+
+	std::vector<float> samples(4 * numFrames);
+	std::vector<uint32_t> keyFrames;
+	for (uint32_t j = 0; j < numJoints; j++) {
+		joints[j].parent = skeleton.joints[j].parent;
+		memcpy(joints[j].translation, skeleton.joints[j].offset, sizeof(joints[j].translation));
+		joints[j].rotation[3] = 1.0f;
+
+		for (uint32_t t = 0; t < 2; t++) {
+			auto rotation = t == 0;
+			auto numComponents = rotation ? 4u : 3u;
+
+			for (uint32_t frame = 0; frame < numFrames; frame++) {
+				float translation[3];
+				float quaternion[4];
+				getLocalTransform(&skeleton, j, frame, translation, quaternion);
+
+				auto sample = &samples[4 * frame];
+				memcpy(sample, rotation ? quaternion : translation, numComponents * sizeof(float));
+				sample[3] = rotation ? sample[3] : 0.0f;
+
+				// neighbouring rotations in the same hemisphere keep the quantization range small
+				auto previous = sample - 4;
+				if (rotation && frame > 0 && sample[0] * previous[0] + sample[1] * previous[1] +
+					sample[2] * previous[2] + sample[3] * previous[3] < 0.0f) {
+					for (int i = 0; i < 4; i++) {
+						sample[i] = -sample[i];
+					}
+				}
+			}
+
+			reduceTrack(samples.data(), numFrames, numComponents, rotation, &keyFrames);
+
+			auto &track = tracks[2 * j + t];
+			track.firstKey = (uint32_t)keys.size();
+			track.numKeys = (uint32_t)keyFrames.size();
+			for (uint32_t i = 0; i < 4; i++) {
+				auto low = samples[4 * keyFrames[0] + i];
+				auto high = low;
+				for (auto frame : keyFrames) {
+					low = std::min(low, samples[4 * frame + i]);
+					high = std::max(high, samples[4 * frame + i]);
+				}
+				track.min[i] = low;
+				track.extent[i] = high - low;
+			}
+
+			for (auto frame : keyFrames) {
+				AnimationKey key = {};
+				key.frame = (uint16_t)frame;
+				for (uint32_t i = 0; i < 4; i++) {
+					auto value = track.extent[i] > 0.0f ?
+						(samples[4 * frame + i] - track.min[i]) / track.extent[i] : 0.0f;
+					key.values[i] = (uint16_t)(value * UINT16_MAX + 0.5f);
+				}
+				keys.push_back(key);
+			}
+		}
+	}
+	header.numKeys = (uint32_t)keys.size();
+
+	std::vector<char> output;
+	auto append = [&](const void *data, size_t size) {
+		output.insert(output.end(), (const char*)data, (const char*)data + size);
+	};
+	append(&header, sizeof(header));
+	append(joints.data(), joints.size() * sizeof(joints[0]));
+	append(tracks.data(), tracks.size() * sizeof(tracks[0]));
+	append(keys.data(), keys.size() * sizeof(keys[0]));
+
+	auto rawSize = (size_t)numFrames * numJoints * 7 * sizeof(float);
+	fprintf(
+		stderr, "  %u joints, %u frames, %u keys: %zu bytes raw, %zu compressed (%.1fx)\n",
+		numJoints, numFrames, header.numKeys, rawSize, output.size(),
+		(double)rawSize / output.size()
+	);
+
+	FILE *file = fopen(targetPath, "wb");
+	if (file == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+	auto written = fwrite(output.data(), 1, output.size(), file);
+	fclose(file);
+
+	return written == output.size() ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "platform.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BvhJoint {
+	std::string name;
+	int32_t parent;
+	float offset[3];
+	bool hasEnd;
+	float end[3];
+
+	// channel kinds are 0-2 for X/Y/Z position and 3-5 for X/Y/Z rotation
+	uint32_t numChannels;
+	uint32_t channels[6];
+	uint32_t firstChannel;
+};
+
+// A BVH skeleton in file order, so every joint comes after its parent.
+struct BvhSkeleton {
+	std::vector<BvhJoint> joints;
+	uint32_t numChannels;
+	uint32_t numFrames;
+	float frameTime;
+	std::vector<float> motion;
+};
+
+HRESULT loadBvh(const char *path, BvhSkeleton *skeleton);
+void getRestPositions(const BvhSkeleton *skeleton, std::vector<float> *positions);
+
+HRESULT buildAnimation(const char *sourcePath, const char *targetPath);
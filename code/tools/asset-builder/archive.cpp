@@ -0,0 +1,317 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "archive.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+
+// the format ends every block with literals, and no match may start this close to the end
+static const size_t LAST_LITERALS = 5;
+static const size_t MATCH_LIMIT = 12;
+
+static const uint32_t HASH_BITS = 16;
+
+uint64_t hashArchiveName(const char *name, size_t length) {
+	auto hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)name[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static uint32_t read32(const uint8_t *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t hashSequence(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static bool writeLength(size_t length, uint8_t **out, const uint8_t *end) {
+	for (; length >= 255; length -= 255) {
+		if (*out == end) {
+			return false;
+		}
+		*(*out)++ = 255;
+	}
+	if (*out == end) {
+		return false;
+	}
+	*(*out)++ = (uint8_t)length;
+	return true;
+}
+
+// Writes a token, the literals and, unless this is the last sequence, the match.
+static bool writeSequence(
+	const uint8_t *literals, size_t numLiterals, size_t offset, size_t matchLength,
+	uint8_t **out, const uint8_t *end
+) {
+	if (*out == end) {
+		return false;
+	}
+	auto token = *out;
+	*(*out)++ = 0;
+
+	*token = (uint8_t)(std::min<size_t>(numLiterals, 15) << 4);
+	if (numLiterals >= 15 && !writeLength(numLiterals - 15, out, end)) {
+		return false;
+	}
+	if ((size_t)(end - *out) < numLiterals) {
+		return false;
+	}
+	memcpy(*out, literals, numLiterals);
+	*out += numLiterals;
+
+	if (matchLength == 0) {
+		return true;
+	}
+	if (end - *out < 2) {
+		return false;
+	}
+	*(*out)++ = (uint8_t)offset;
+	*(*out)++ = (uint8_t)(offset >> 8);
+
+	auto extra = matchLength - MIN_MATCH;
+	*token |= (uint8_t)std::min<size_t>(extra, 15);
+	return extra < 15 || writeLength(extra - 15, out, end);
+}
+
+size_t compressBlock(const uint8_t *source, size_t size, uint8_t *target, size_t capacity) {
+	std::vector<uint32_t> table(1 << HASH_BITS, 0);
+	auto out = target;
+	auto end = target + capacity;
+	size_t anchor = 0;
+
+	if (size > MATCH_LIMIT) {
+		auto limit = size - MATCH_LIMIT;
+		size_t i = 1;
+		uint32_t misses = 0;
+		while (i < limit) {
+			auto sequence = read32(source + i);
+			auto &slot = table[hashSequence(sequence)];
+			size_t candidate = slot;
+			slot = (uint32_t)i;
+
+			if (i - candidate > MAX_OFFSET || read32(source + candidate) != sequence) {
+				// data that doesn't match is skipped over faster and faster
+				i += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			auto matchEnd = i + MIN_MATCH;
+			auto matchSource = candidate + MIN_MATCH;
+			while (matchEnd < size - LAST_LITERALS && source[matchEnd] == source[matchSource]) {
+				matchEnd++;
+				matchSource++;
+			}
+			while (i > anchor && candidate > 0 && source[i - 1] == source[candidate - 1]) {
+				i--;
+				candidate--;
+			}
+
+			if (!writeSequence(
+				source + anchor, i - anchor, i - candidate, matchEnd - i, &out, end
+			)) {
+				return 0;
+			}
+			i = matchEnd;
+			anchor = i;
+		}
+	}
+
+	if (!writeSequence(source + anchor, size - anchor, 0, 0, &out, end)) {
+		return 0;
+	}
+	return out - target;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> *data) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+
+	data->clear();
+	uint8_t buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data->insert(data->end(), buffer, buffer + read);
+	}
+	auto complete = ferror(file) == 0;
+	fclose(file);
+	return complete;
+}
+
+bool writeArchiveList(const char *path, const ArchiveInput *inputs, size_t numInputs) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	auto complete = true;
+	for (size_t i = 0; i < numInputs; i++) {
+		auto mode = inputs[i].compress ? "compress" : "store";
+		complete = complete && fprintf(file, "%s %s\n", mode, inputs[i].name.c_str()) > 0;
+	}
+	return fclose(file) == 0 && complete;
+}
+
+bool readArchiveList(const char *path, std::vector<ArchiveInput> *inputs) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	std::string dir = path;
+	auto separator = dir.find_last_of("\\/");
+	dir.resize(separator == std::string::npos ? 0 : separator + 1);
+
+	inputs->clear();
+	char line[4096];
+	auto complete = true;
+	while (complete && fgets(line, sizeof(line), file)) {
+		auto length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			line[--length] = '\0';
+		}
+		if (length == 0) {
+			continue;
+		}
+
+		ArchiveInput input;
+		auto name = strchr(line, ' ');
+		complete = name != NULL && name[1] != '\0';
+		if (complete) {
+			*name++ = '\0';
+			input.compress = strcmp(line, "compress") == 0;
+			complete = input.compress || strcmp(line, "store") == 0;
+			input.name = name;
+			input.path = dir + name;
+			inputs->push_back(input);
+		}
+	}
+	fclose(file);
+	return complete;
+}
+
+static uint64_t alignArchive(uint64_t offset) {
+	return (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+}
+
+bool writeArchive(
+	const char *path, const ArchiveInput *inputs, size_t numInputs, ArchiveStats *stats
+) {
+	*stats = {};
+
+	uint32_t numSlots = 1;
+	while (numSlots < 2 * numInputs) {
+		numSlots *= 2;
+	}
+
+	ArchiveHeader header = {};
+	header.magic = ARCHIVE_MAGIC;
+	header.version = ARCHIVE_VERSION;
+	header.numSlots = numSlots;
+	header.numEntries = (uint32_t)numInputs;
+	header.namesOffset = sizeof(header) + numSlots * sizeof(ArchiveEntry);
+
+	std::vector<ArchiveEntry> entries(numSlots);
+	std::vector<uint32_t> slots(numInputs);
+	std::vector<char> names;
+	for (size_t i = 0; i < numInputs; i++) {
+		auto &name = inputs[i].name;
+		auto nameHash = hashArchiveName(name.c_str(), name.size());
+		auto slot = (uint32_t)nameHash & (numSlots - 1);
+		for (; entries[slot].flags & ARCHIVE_ENTRY_USED; slot = (slot + 1) & (numSlots - 1)) {
+			auto &other = entries[slot];
+			if (
+				other.nameHash == nameHash && other.nameSize == name.size() &&
+				memcmp(names.data() + other.nameOffset, name.c_str(), name.size()) == 0
+			) {
+				fprintf(stderr, "%s is in the archive twice\n", name.c_str());
+				return false;
+			}
+		}
+
+		auto &entry = entries[slot];
+		entry.nameHash = nameHash;
+		entry.nameOffset = (uint32_t)names.size();
+		entry.nameSize = (uint32_t)name.size();
+		entry.flags = ARCHIVE_ENTRY_USED;
+		names.insert(names.end(), name.begin(), name.end());
+		names.push_back('\0');
+		slots[i] = slot;
+	}
+	header.namesSize = names.size();
+
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		return false;
+	}
+
+	// the table is written again once every entry knows where it ended up
+	std::vector<uint8_t> padding(ARCHIVE_ALIGNMENT);
+	auto offset = alignArchive(header.namesOffset + header.namesSize);
+	auto paddingSize = (size_t)(offset - header.namesOffset - header.namesSize);
+	auto complete =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(entries.data(), sizeof(ArchiveEntry), numSlots, file) == numSlots &&
+		fwrite(names.data(), 1, names.size(), file) == names.size() &&
+		fwrite(padding.data(), 1, paddingSize, file) == paddingSize;
+
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> compressed;
+	for (size_t i = 0; complete && i < numInputs; i++) {
+		if (!readFile(inputs[i].path.c_str(), &data)) {
+			fprintf(stderr, "couldn't read %s\n", inputs[i].path.c_str());
+			complete = false;
+			break;
+		}
+
+		auto &entry = entries[slots[i]];
+		entry.offset = offset;
+		entry.size = data.size();
+		entry.storedSize = data.size();
+		auto stored = data.data();
+		if (inputs[i].compress && !data.empty()) {
+			compressed.resize(data.size() - data.size() / 8);
+			auto compressedSize = compressBlock(
+				data.data(), data.size(), compressed.data(), compressed.size()
+			);
+			if (compressedSize > 0) {
+				entry.flags |= ARCHIVE_ENTRY_COMPRESSED;
+				entry.storedSize = compressedSize;
+				stored = compressed.data();
+				stats->numCompressed++;
+			}
+		}
+		stats->size += entry.size;
+		stats->storedSize += entry.storedSize;
+
+		// the last entry is padded too, so the file ends on a page boundary
+		offset = alignArchive(offset + entry.storedSize);
+		paddingSize = (size_t)(offset - entry.offset - entry.storedSize);
+		complete =
+			fwrite(stored, 1, (size_t)entry.storedSize, file) == entry.storedSize &&
+			fwrite(padding.data(), 1, paddingSize, file) == paddingSize;
+	}
+
+	complete =
+		complete && fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(entries.data(), sizeof(ArchiveEntry), numSlots, file) == numSlots;
+	complete = fclose(file) == 0 && complete;
+	if (!complete) {
+		remove(path);
+		return false;
+	}
+
+	stats->numEntries = numInputs;
+	stats->fileSize = offset;
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+static const uint32_t ARCHIVE_MAGIC = 'P' | 'A' << 8 | 'C' << 16 | 'K' << 24;
+static const uint32_t ARCHIVE_VERSION = 1;
+
+// entries start on page boundaries, so each can be mapped and read in place
+static const uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+static const uint32_t ARCHIVE_ENTRY_USED = 1;
+static const uint32_t ARCHIVE_ENTRY_COMPRESSED = 2;
+
+// An archive starts with this header, followed by its table of entries and their names. The table
+// is open addressed, with a power of two slots at most half full, and each entry goes in the
+// first free slot from its name's hash onwards.
+struct ArchiveHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numSlots;
+	uint32_t numEntries;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+};
+
+struct ArchiveEntry {
+	uint64_t nameHash;
+	uint64_t offset;
+
+	// the size of the asset, and of what is stored for it when it's compressed
+	uint64_t size;
+	uint64_t storedSize;
+
+	uint32_t nameOffset;
+	uint32_t nameSize;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct ArchiveInput {
+	std::string name;
+	std::string path;
+
+	// whether to try compressing the entry, which then has to be read whole
+	bool compress;
+};
+
+struct ArchiveStats {
+	uint64_t numEntries;
+	uint64_t numCompressed;
+	uint64_t size;
+	uint64_t storedSize;
+	uint64_t fileSize;
+};
+
+// FNV-1a, which is enough for the names of a few thousand assets, and the game hashes them the
+// same way.
+uint64_t hashArchiveName(const char *name, size_t length);
+
+// LZ4's block format. Returns the compressed size, or zero when it doesn't fit in capacity.
+size_t compressBlock(const uint8_t *source, size_t size, uint8_t *target, size_t capacity);
+
+// A list has one "compress name" or "store name" line for each entry, with names relative to the
+// list's directory.
+bool writeArchiveList(const char *path, const ArchiveInput *inputs, size_t numInputs);
+bool readArchiveList(const char *path, std::vector<ArchiveInput> *inputs);
+
+// Entries are only kept compressed when that saves at least an eighth of their size.
+bool writeArchive(
+	const char *path, const ArchiveInput *inputs, size_t numInputs, ArchiveStats *stats
+);
@@ -1,79 +1,270 @@
+#include "anim.h"
+#include "archive.h"
+#include "graph.h"
 #include "mesh.h"
+#include "reload.h"
 #include "shader.h"
+#include "texture.h"
 #include "util.h"
+#include "watch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
-template <typename F>
-HRESULT build(
+typedef std::chrono::high_resolution_clock Clock;
+
+// Bumped whenever a change to the builder changes what it writes, which invalidates every cached
+// output built before.
+static const uint64_t BUILDER_VERSION = 2;
+
+// Adds a node for each asset, from sourceDir/asset.sourceExt to targetDir/asset.targetExt.
+static void addAssets(
+	BuildGraph *graph,
 	const char *sourceDir, const char *targetDir,
 	const char *sourceExt, const char *targetExt,
-	uint64_t builderTime,
-	F f, const char *assets[], size_t numAssets
+	BuildFunction build, const char *parameters, const char *assets[], size_t numAssets,
+	std::vector<uint32_t> *nodes
 ) {
-	HRESULT hr;
-
-	HRESULT error = S_OK;
 	for (size_t i = 0; i < numAssets; i++) {
 		auto sourceLen = strlen(assets[i]) + 1 + strlen(sourceExt);
 		auto targetLen = strlen(assets[i]) + 1 + strlen(targetExt);
 
+		std::vector<char> name(sourceLen + 1);
+		snprintf(name.data(), name.size(), "%s.%s", assets[i], sourceExt);
+
 		std::vector<char> sourcePath(strlen(sourceDir) + sourceLen + 1);
 		snprintf(sourcePath.data(), sourcePath.size(), "%s%s.%s", sourceDir, assets[i], sourceExt);
 
 		std::vector<char> targetPath(strlen(targetDir) + targetLen + 1);
 		snprintf(targetPath.data(), targetPath.size(), "%s%s.%s", targetDir, assets[i], targetExt);
 
-		bool sourceExists;
-		if (FAILED(hr = getFileExists(sourcePath.data(), &sourceExists))) {
-			error = hr;
-			printWindowsError(error);
+		auto node = graph->addNode(
+			name.data(), build, parameters, sourcePath.data(), targetPath.data()
+		);
+		if (nodes) {
+			nodes->push_back(node);
+		}
+	}
+}
+
+// Packs the outputs listed in sourcePath into the one archive the game loads.
+static HRESULT buildArchive(const char *sourcePath, const char *targetPath) {
+	std::vector<ArchiveInput> inputs;
+	if (!readArchiveList(sourcePath, &inputs)) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	// written beside the old archive and moved over it, since a running game has that one mapped
+	HRESULT hr;
+	ArchiveStats stats;
+	auto tempPath = std::string(targetPath) + ".tmp";
+	if (!writeArchive(tempPath.c_str(), inputs.data(), inputs.size(), &stats)) {
+		return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+	}
+	if (FAILED(hr = replaceFile(tempPath.c_str(), targetPath))) {
+		remove(tempPath.c_str());
+		return hr;
+	}
+	fprintf(
+		stderr, "%s: %llu entries, %llu compressed, %.1f KB in %.1f KB\n", targetPath,
+		(unsigned long long)stats.numEntries, (unsigned long long)stats.numCompressed,
+		stats.size / 1024.0, stats.fileSize / 1024.0
+	);
+	return S_OK;
+}
+
+static void addShaderIncludes(BuildGraph *graph, const std::vector<uint32_t> *nodes) {
+	for (auto node : *nodes) {
+		std::vector<std::string> includes;
+		findShaderIncludes(graph->nodes[node].inputs[0].c_str(), &includes);
+		for (auto &include : includes) {
+			graph->addInput(node, include.c_str());
+		}
+	}
+}
+
+// Meshes are skinned to the skeleton next to them, which they read as well as their OBJ.
+static void addMeshSkeletons(BuildGraph *graph, const std::vector<uint32_t> *nodes) {
+	for (auto node : *nodes) {
+		auto skeletonPath = graph->nodes[node].inputs[0];
+		skeletonPath.replace(skeletonPath.size() - 3, 3, "bvh");
+		graph->addInput(node, skeletonPath.c_str());
+	}
+}
+
+// Watches the directories of every file the build reads that no step writes.
+static HRESULT watchSources(const BuildGraph *graph, FileWatcher *watcher) {
+	HRESULT hr;
+	std::unordered_set<std::string> outputs;
+	for (auto &node : graph->nodes) {
+		outputs.insert(node.outputs.begin(), node.outputs.end());
+	}
+
+	for (auto &node : graph->nodes) {
+		for (auto &input : node.inputs) {
+			auto separator = input.find_last_of("\\/");
+			if (outputs.count(input) || separator == std::string::npos) {
+				continue;
+			}
+			if (FAILED(hr = watcher->addDirectory(input.substr(0, separator + 1).c_str()))) {
+				fprintf(stderr, "%s: ", input.c_str());
+				return hr;
+			}
+		}
+	}
+	return S_OK;
+}
+
+// Tells the game about every output the marked nodes wrote or fetched, by its name in dataDir.
+static HRESULT sendChanges(
+	const BuildGraph *graph, const std::vector<bool> *dirty, const char *dataDir,
+	ReloadNotifier *notifier
+) {
+	std::vector<std::string> names;
+	auto dataDirLen = strlen(dataDir);
+	for (size_t i = 0; i < graph->nodes.size(); i++) {
+		auto &node = graph->nodes[i];
+		if (!(*dirty)[i] || FAILED(node.result) || !(node.built || node.fetched)) {
 			continue;
 		}
-		if (!sourceExists) {
-			error = ERROR_FILE_NOT_FOUND;
-			printWindowsError(error);
+		for (auto &output : node.outputs) {
+			if (output.compare(0, dataDirLen, dataDir) == 0) {
+				names.push_back(output.substr(dataDirLen));
+			}
+		}
+	}
+	return notifier->send(names);
+}
+
+// Rebuilds what reads the sources as they change, until a stop is requested, and tells a running
+// game what it should reload after each build. The graph and the hashes of files that didn't
+// change carry over from one build to the next, so a change costs only the steps downstream of it.
+static int watchAssets(
+	BuildGraph *graph, BuildCache *cache, uint32_t numThreads, const char *dataDir,
+	const std::vector<uint32_t> *shaders
+) {
+	HRESULT hr;
+
+	uint16_t port = RELOAD_PORT;
+	std::vector<char> value;
+	if (getEnv("ReloadPort", &value) == S_OK) {
+		port = (uint16_t)atoi(value.data());
+	}
+
+	ReloadNotifier notifier;
+	if (FAILED(hr = ReloadNotifier::create(port, &notifier))) {
+		printWindowsError(hr);
+		return 1;
+	}
+
+	FileWatcher watcher;
+	if (FAILED(hr = FileWatcher::create(&watcher)) || FAILED(hr = watchSources(graph, &watcher))) {
+		printWindowsError(hr);
+		notifier.close();
+		return 1;
+	}
+	catchStopRequests();
+
+	// the first build changed everything it built or fetched
+	std::vector<bool> dirty(graph->nodes.size(), true);
+	sendChanges(graph, &dirty, dataDir, &notifier);
+	fprintf(stderr, "watching for changes, reloads go to port %u\n", port);
+
+	std::vector<std::string> changed;
+	while (!getStopRequested()) {
+		changed.clear();
+		if (FAILED(hr = watcher.wait(250, &changed))) {
+			printWindowsError(hr);
+			break;
+		}
+		if (changed.empty() && !watcher.overflowed) {
 			continue;
 		}
 
-		bool targetExists;
-		if (FAILED(hr = getFileExists(targetPath.data(), &targetExists))) {
-			error = hr;
-			printWindowsError(error);
+		// an editor saving a file can change it a few times in a row, so the build waits for quiet
+		auto start = Clock::now();
+		size_t numChanged;
+		do {
+			numChanged = changed.size();
+			watcher.wait(20, &changed);
+		} while (changed.size() > numChanged && !getStopRequested());
+
+		// when changes were dropped, every source might have changed
+		auto anyDirty = watcher.overflowed;
+		std::fill(dirty.begin(), dirty.end(), watcher.overflowed);
+		if (watcher.overflowed) {
+			cache->fileHashes.clear();
+			watcher.overflowed = false;
+		}
+		for (auto &path : changed) {
+			cache->forget(path);
+			anyDirty = graph->markDirty(path, &dirty) || anyDirty;
+		}
+		if (!anyDirty) {
 			continue;
 		}
-		if (targetExists) {
-			uint64_t sourceTime;
-			if (FAILED(hr = getLastWriteTime(sourcePath.data(), &sourceTime))) {
-				error = hr;
-				printWindowsError(error);
-				continue;
-			}
 
-			uint64_t targetTime;
-			if (FAILED(hr = getLastWriteTime(targetPath.data(), &targetTime))) {
-				error = hr;
-				printWindowsError(error);
-				continue;
+		// what the marked steps write is hashed again by the steps that read it
+		for (size_t i = 0; i < graph->nodes.size(); i++) {
+			if (dirty[i]) {
+				for (auto &output : graph->nodes[i].outputs) {
+					cache->forget(output);
+				}
 			}
+		}
 
-			if (targetTime > sourceTime && targetTime > builderTime) {
-				continue;
+		// a changed shader may include files it didn't before, which have to be linked and watched
+		std::vector<uint32_t> dirtyShaders;
+		size_t numInputs = 0;
+		for (auto node : *shaders) {
+			if (dirty[node]) {
+				dirtyShaders.push_back(node);
+				numInputs += graph->nodes[node].inputs.size();
+			}
+		}
+		addShaderIncludes(graph, &dirtyShaders);
+		for (auto node : dirtyShaders) {
+			numInputs -= graph->nodes[node].inputs.size();
+		}
+		if (numInputs != 0) {
+			if (FAILED(hr = graph->link()) || FAILED(hr = watchSources(graph, &watcher))) {
+				printWindowsError(hr);
+				break;
 			}
 		}
 
-		fprintf(stderr, "%s.%s\n", assets[i], sourceExt);
-		if (FAILED(hr = f(sourcePath.data(), targetPath.data()))) {
-			error = hr;
-			printWindowsError(error);
-			continue;
+		graph->run(numThreads, cache, &dirty);
+		graph->report(stderr, 5);
+		if (!cache->saveManifest()) {
+			fprintf(stderr, "couldn't write the build manifest\n");
 		}
+		sendChanges(graph, &dirty, dataDir, &notifier);
+		fprintf(
+			stderr, "rebuilt after %zu changes in %.1f ms\n", changed.size(),
+			std::chrono::duration<double, std::milli>(Clock::now() - start).count()
+		);
 	}
 
-	return error;
+	watcher.close();
+	notifier.close();
+	return FAILED(hr);
 }
 
 int main(int argc, const char *argv[]) {
 	HRESULT hr;
 
+	// --watch keeps building as the sources change, until it's stopped
+	auto watch = argc == 2 && strcmp(argv[1], "--watch") == 0;
+	if (argc > 1 && !watch) {
+		fprintf(stderr, "usage: %s [--watch]\n", argv[0]);
+		return 1;
+	}
+
 	std::vector<char> assetDir;
 	if ((hr = getEnv("AssetDir", &assetDir)) != S_OK) {
 		printWindowsError(hr);
@@ -91,40 +282,159 @@ int main(int argc, const char *argv[]) {
 		return 1;
 	}
 
-	uint64_t builderTime;
-	if (FAILED(hr = getLastWriteTime(argv[0], &builderTime))) {
+	// AssetCache can point at a directory shared between checkouts or machines
+	std::string cacheDir;
+	std::vector<char> value;
+	if (getEnv("AssetCache", &value) == S_OK) {
+		cacheDir = value.data();
+		if (!cacheDir.empty() && cacheDir.back() != '\\' && cacheDir.back() != '/') {
+			cacheDir += PATH_SEPARATOR;
+		}
+	} else {
+		cacheDir = std::string(dataDir.data()) + "cache" + PATH_SEPARATOR;
+	}
+	if (FAILED(hr = makeDir(cacheDir.c_str()))) {
 		printWindowsError(hr);
 		return 1;
 	}
 
-	HRESULT error = S_OK;
+	auto manifestPath = std::string(dataDir.data()) + "build.manifest";
+	BuildCache cache;
+	BuildCache::create(cacheDir.c_str(), manifestPath.c_str(), BUILDER_VERSION, &cache);
 
-	const char *vertexShaders[] = { "vertex" };
-	auto numVertexShaders = sizeof(vertexShaders) / sizeof(*vertexShaders);
-	if (FAILED(hr = build(
-		assetDir.data(), dataDir.data(), "hlsl", "cso", builderTime,
-		buildVertexShader, vertexShaders, numVertexShaders
-	))) {
-		error = hr;
+	// settings that change what a stage writes are part of its parameters, so they key the cache
+	std::vector<char> quality;
+	if (getEnv("TextureQuality", &quality) != S_OK) {
+		const char normal[] = "normal";
+		quality.assign(normal, normal + sizeof(normal));
 	}
+	auto colorParameters = std::string("color texture ") + quality.data();
+	auto normalParameters = std::string("normal texture ") + quality.data();
 
-	const char *pixelShaders[] = { "pixel" };
-	auto numPixelShaders = sizeof(pixelShaders) / sizeof(*pixelShaders);
-	if (FAILED(hr = build(
-		assetDir.data(), dataDir.data(), "hlsl", "cso", builderTime,
-		buildPixelShader, pixelShaders, numPixelShaders
-	))) {
-		error = hr;
+	// MeshLayout=split writes positions apart from the other attributes, as the game keeps them,
+	// and MeshDedup picks which copies of groups are only stored once
+	std::vector<char> meshLayout;
+	auto splitMeshes =
+		getEnv("MeshLayout", &meshLayout) == S_OK && strcmp(meshLayout.data(), "split") == 0;
+	std::vector<char> meshDedup;
+	if (getEnv("MeshDedup", &meshDedup) != S_OK) {
+		const char exact[] = "exact";
+		meshDedup.assign(exact, exact + sizeof(exact));
 	}
+	auto meshParameters = std::string(splitMeshes ? "mesh split " : "mesh ") + meshDedup.data();
+#if defined(_DEBUG)
+	const char *shaderConfiguration = " debug";
+#else
+	const char *shaderConfiguration = "";
+#endif
+
+	// shaders are only built with a compiler for this platform, and which one is a parameter too
+	auto shaderCompiler = getShaderCompiler();
+	std::string vertexParameters;
+	std::string pixelParameters;
+	if (shaderCompiler) {
+		auto compilerName = std::string(" ") + shaderCompiler->getName();
+		vertexParameters = std::string("vertex shader") + shaderConfiguration + compilerName;
+		pixelParameters = std::string("pixel shader") + shaderConfiguration + compilerName;
+	} else {
+		fprintf(stderr, "no shader compiler, so shaders won't be built\n");
+	}
+
+	// BuildThreads limits how many assets build at once, and defaults to one per hardware thread
+	uint32_t numThreads = 0;
+	std::vector<char> threads;
+	if (getEnv("BuildThreads", &threads) == S_OK) {
+		numThreads = (uint32_t)atoi(threads.data());
+	}
+
+	BuildGraph graph;
+	std::vector<uint32_t> shaders;
+
+	const char *vertexShaders[] = { "vertex" };
+	auto numVertexShaders = shaderCompiler ? sizeof(vertexShaders) / sizeof(*vertexShaders) : 0;
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "hlsl", "cso",
+		buildVertexShader, vertexParameters.c_str(), vertexShaders, numVertexShaders, &shaders
+	);
+
+	const char *pixelShaders[] = { "pixel" };
+	auto numPixelShaders = shaderCompiler ? sizeof(pixelShaders) / sizeof(*pixelShaders) : 0;
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "hlsl", "cso",
+		buildPixelShader, pixelParameters.c_str(), pixelShaders, numPixelShaders, &shaders
+	);
+	addShaderIncludes(&graph, &shaders);
 
 	const char *meshes[] = { "human" };
 	auto numMeshes = sizeof(meshes) / sizeof(*meshes);
-	if (FAILED(hr = build(
-		assetDir.data(), dataDir.data(), "obj", "mesh", builderTime,
-		buildMesh, meshes, numMeshes
-	))) {
-		error = hr;
+	std::vector<uint32_t> meshNodes;
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "obj", "mesh",
+		splitMeshes ? buildSplitMesh : buildMesh, meshParameters.c_str(), meshes, numMeshes,
+		&meshNodes
+	);
+	addMeshSkeletons(&graph, &meshNodes);
+
+	const char *colorTextures[] = { "human" };
+	auto numColorTextures = sizeof(colorTextures) / sizeof(*colorTextures);
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "tga", "dds",
+		buildColorTexture, colorParameters.c_str(), colorTextures, numColorTextures, NULL
+	);
+
+	const char *normalTextures[] = { "human-normal" };
+	auto numNormalTextures = sizeof(normalTextures) / sizeof(*normalTextures);
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "tga", "dds",
+		buildNormalTexture, normalParameters.c_str(), normalTextures, numNormalTextures, NULL
+	);
+
+	const char *animations[] = { "human", "human-idle" };
+	auto numAnimations = sizeof(animations) / sizeof(*animations);
+	addAssets(
+		&graph, assetDir.data(), dataDir.data(), "bvh", "anim",
+		buildAnimation, "animation", animations, numAnimations, NULL
+	);
+
+	// Everything built also goes in an archive, which the game maps instead of opening each file.
+	// Textures are stored as they are, so their mips can be read in place as they stream.
+	std::vector<ArchiveInput> archiveInputs;
+	for (auto &node : graph.nodes) {
+		auto &target = node.outputs[0];
+		ArchiveInput input;
+		input.name = target.substr(strlen(dataDir.data()));
+		input.path = target;
+		input.compress = target.size() < 4 || target.compare(target.size() - 4, 4, ".dds") != 0;
+		archiveInputs.push_back(input);
+	}
+
+	auto listPath = std::string(dataDir.data()) + "assets.list";
+	auto archivePath = std::string(dataDir.data()) + "assets.pak";
+	if (!writeArchiveList(listPath.c_str(), archiveInputs.data(), archiveInputs.size())) {
+		fprintf(stderr, "couldn't write %s\n", listPath.c_str());
+		return 1;
+	}
+	auto archive = graph.addNode(
+		"assets.pak", buildArchive, "archive", listPath.c_str(), archivePath.c_str()
+	);
+	for (auto &input : archiveInputs) {
+		graph.addInput(archive, input.path.c_str());
+	}
+
+	if (FAILED(hr = graph.link())) {
+		printWindowsError(hr);
+		return 1;
 	}
 
+	hr = graph.run(numThreads, &cache);
+	graph.report(stderr, 5);
+	cache.report(stderr);
+	reportMeshDedup(stderr);
+	if (!cache.saveManifest()) {
+		fprintf(stderr, "couldn't write %s\n", manifestPath.c_str());
+	}
+	if (watch) {
+		return watchAssets(&graph, &cache, numThreads, dataDir.data(), &shaders);
+	}
 	return FAILED(hr);
-}
\ No newline at end of file
+}
@@ -0,0 +1,848 @@
+#include "bc.h"
+#include "simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+// BC7 interpolation weights for 4-bit indices, out of 64
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// The 16 pixels of a block stored channel by channel, so four pixels of one channel fill an SSE
+// register.
+struct BlockPixels {
+	alignas(16) float values[4][16];
+};
+
+static void loadPixels(const uint8_t *pixels, BlockPixels *block) {
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 4; c++) {
+			block->values[c][i] = pixels[4 * i + c];
+		}
+	}
+}
+
+// Picks the closest palette entry for every pixel over the first numChannels channels, and
+// returns the total squared error.
+static float selectIndices(
+	const BlockPixels *block, int numChannels, const float (*palette)[4], int numEntries,
+	uint8_t *indices
+) {
+	float total = 0.0f;
+#if defined(SIMD_SSE)
+	for (int group = 0; group < 4; group++) {
+		auto best = _mm_set1_ps(FLT_MAX);
+		auto bestIndex = _mm_setzero_ps();
+		for (int e = 0; e < numEntries; e++) {
+			auto distance = _mm_setzero_ps();
+			for (int c = 0; c < numChannels; c++) {
+				auto pixels = _mm_load_ps(&block->values[c][4 * group]);
+				auto d = _mm_sub_ps(pixels, _mm_set1_ps(palette[e][c]));
+				distance = _mm_add_ps(distance, _mm_mul_ps(d, d));
+			}
+			auto closer = _mm_cmplt_ps(distance, best);
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_ps(
+				_mm_and_ps(closer, _mm_set1_ps((float)e)), _mm_andnot_ps(closer, bestIndex)
+			);
+		}
+
+		alignas(16) float errors[4];
+		alignas(16) float chosen[4];
+		_mm_store_ps(errors, best);
+		_mm_store_ps(chosen, bestIndex);
+		for (int i = 0; i < 4; i++) {
+			indices[4 * group + i] = (uint8_t)chosen[i];
+			total += errors[i];
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++) {
+		auto best = FLT_MAX;
+		for (int e = 0; e < numEntries; e++) {
+			float distance = 0.0f;
+			for (int c = 0; c < numChannels; c++) {
+				auto d = block->values[c][i] - palette[e][c];
+				distance += d * d;
+			}
+			if (distance < best) {
+				best = distance;
+				indices[i] = (uint8_t)e;
+			}
+		}
+		total += best;
+	}
+#endif
+	return total;
+}
+
+// Starts endpoints at the extremes of the block along its principal axis, found by power
+// iteration on the covariance.
+static void getAxisEndpoints(
+	const BlockPixels *block, int numChannels, int numIterations, float *start, float *end
+) {
+	float mean[4] = {};
+	for (int c = 0; c < numChannels; c++) {
+		for (int i = 0; i < 16; i++) {
+			mean[c] += block->values[c][i];
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++) {
+				covariance[a][b] +=
+					(block->values[a][i] - mean[a]) * (block->values[b][i] - mean[b]);
+			}
+		}
+	}
+
+	// the row of the channel that varies most is a good first guess
+	int widest = 0;
+	for (int c = 1; c < numChannels; c++) {
+		if (covariance[c][c] > covariance[widest][widest]) {
+			widest = c;
+		}
+	}
+	float axis[4] = {};
+	for (int c = 0; c < numChannels; c++) {
+		axis[c] = covariance[widest][c];
+	}
+
+	for (int iteration = 0; iteration < numIterations; iteration++) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < numChannels; a++) {
+			for (int b = 0; b < numChannels; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = std::max(length, fabsf(next[a]));
+		}
+		if (length == 0.0f) {
+			break;
+		}
+		for (int c = 0; c < numChannels; c++) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < numChannels; c++) {
+		length += axis[c] * axis[c];
+	}
+	length = sqrtf(length);
+
+	auto low = 0.0f;
+	auto high = 0.0f;
+	if (length > 0.0f) {
+		for (int c = 0; c < numChannels; c++) {
+			axis[c] /= length;
+		}
+		low = FLT_MAX;
+		high = -FLT_MAX;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int c = 0; c < numChannels; c++) {
+				t += (block->values[c][i] - mean[c]) * axis[c];
+			}
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+	}
+
+	for (int c = 0; c < numChannels; c++) {
+		start[c] = std::min(std::max(mean[c] + axis[c] * low, 0.0f), 255.0f);
+		end[c] = std::min(std::max(mean[c] + axis[c] * high, 0.0f), 255.0f);
+	}
+}
+
+// Solves for the endpoints that best reproduce the block with the chosen indices, where weights
+// give how far each index lies from start to end. Fails when every pixel uses the same weight.
+static bool fitEndpoints(
+	const BlockPixels *block, int numChannels, const uint8_t *indices, const float *weights,
+	float *start, float *end
+) {
+	float aa = 0.0f;
+	float ab = 0.0f;
+	float bb = 0.0f;
+	float ax[4] = {};
+	float bx[4] = {};
+	for (int i = 0; i < 16; i++) {
+		auto b = weights[indices[i]];
+		auto a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < numChannels; c++) {
+			ax[c] += a * block->values[c][i];
+			bx[c] += b * block->values[c][i];
+		}
+	}
+
+	auto determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f) {
+		return false;
+	}
+	for (int c = 0; c < numChannels; c++) {
+		start[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+		end[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+		start[c] = std::min(std::max(start[c], 0.0f), 255.0f);
+		end[c] = std::min(std::max(end[c], 0.0f), 255.0f);
+	}
+	return true;
+}
+
+static int quantize(float value, int bits) {
+	auto max = (1 << bits) - 1;
+	return std::min(std::max((int)(value * max / 255.0f + 0.5f), 0), max);
+}
+
+static int expand(int value, int bits) {
+	return value << (8 - bits) | value >> (2 * bits - 8);
+}
+
+static void writeLe16(uint8_t *out, uint32_t value) {
+	out[0] = (uint8_t)value;
+	out[1] = (uint8_t)(value >> 8);
+}
+
+// BC1
+
+struct Bc1Endpoints {
+	// 5:6:5 bits
+	int colors[2][3];
+};
+
+static const int BC1_BITS[3] = {5, 6, 5};
+static const float BC1_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+
+static float evaluateBc1(
+	const BlockPixels *block, const Bc1Endpoints *endpoints, uint8_t *indices
+) {
+	float palette[4][4] = {};
+	for (int c = 0; c < 3; c++) {
+		auto a = (float)expand(endpoints->colors[0][c], BC1_BITS[c]);
+		auto b = (float)expand(endpoints->colors[1][c], BC1_BITS[c]);
+		for (int e = 0; e < 4; e++) {
+			palette[e][c] = a + (b - a) * BC1_WEIGHTS[e];
+		}
+	}
+	return selectIndices(block, 3, palette, 4, indices);
+}
+
+static void quantizeBc1(const float *start, const float *end, Bc1Endpoints *endpoints) {
+	for (int c = 0; c < 3; c++) {
+		endpoints->colors[0][c] = quantize(start[c], BC1_BITS[c]);
+		endpoints->colors[1][c] = quantize(end[c], BC1_BITS[c]);
+	}
+}
+
+void encodeBc1Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block) {
+	BlockPixels source;
+	loadPixels(pixels, &source);
+
+	float start[4];
+	float end[4];
+	auto numIterations = quality == TEXTURE_QUALITY_FAST ? 1 : 3;
+	getAxisEndpoints(&source, 3, quality == TEXTURE_QUALITY_FAST ? 2 : 8, start, end);
+
+	Bc1Endpoints best;
+	uint8_t bestIndices[16];
+	auto bestError = FLT_MAX;
+	for (int iteration = 0; iteration < numIterations; iteration++) {
+		Bc1Endpoints endpoints;
+		uint8_t indices[16];
+		quantizeBc1(start, end, &endpoints);
+		auto error = evaluateBc1(&source, &endpoints, indices);
+		if (error >= bestError) {
+			break;
+		}
+
+		best = endpoints;
+		bestError = error;
+		memcpy(bestIndices, indices, sizeof(indices));
+		if (!fitEndpoints(&source, 3, indices, BC1_WEIGHTS, start, end)) {
+			break;
+		}
+	}
+
+	// nudge each quantized endpoint channel a step at a time while that still helps
+	if (quality == TEXTURE_QUALITY_BEST) {
+		auto improved = true;
+		for (int pass = 0; pass < 4 && improved; pass++) {
+			improved = false;
+			for (int e = 0; e < 2; e++) {
+				for (int c = 0; c < 3; c++) {
+					for (int step = -1; step <= 1; step += 2) {
+						auto endpoints = best;
+						auto value = endpoints.colors[e][c] + step;
+						if (value < 0 || value >= 1 << BC1_BITS[c]) {
+							continue;
+						}
+						endpoints.colors[e][c] = value;
+
+						uint8_t indices[16];
+						auto error = evaluateBc1(&source, &endpoints, indices);
+						if (error < bestError) {
+							best = endpoints;
+							bestError = error;
+							memcpy(bestIndices, indices, sizeof(indices));
+							improved = true;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	uint32_t colors[2];
+	for (int e = 0; e < 2; e++) {
+		colors[e] = best.colors[e][0] << 11 | best.colors[e][1] << 5 | best.colors[e][2];
+	}
+
+	// the first color has to be the larger one to select the four color mode
+	if (colors[0] < colors[1]) {
+		std::swap(colors[0], colors[1]);
+		for (int i = 0; i < 16; i++) {
+			bestIndices[i] ^= 1;
+		}
+	} else if (colors[0] == colors[1]) {
+		memset(bestIndices, 0, sizeof(bestIndices));
+	}
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		bits |= (uint32_t)bestIndices[i] << 2 * i;
+	}
+	writeLe16(block, colors[0]);
+	writeLe16(block + 2, colors[1]);
+	writeLe16(block + 4, bits);
+	writeLe16(block + 6, bits >> 16);
+}
+
+void decodeBc1Block(const uint8_t *block, uint8_t *pixels) {
+	uint32_t colors[2] = {
+		(uint32_t)(block[0] | block[1] << 8), (uint32_t)(block[2] | block[3] << 8),
+	};
+	auto bits = (uint32_t)(block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24);
+
+	uint8_t palette[4][4];
+	for (int e = 0; e < 2; e++) {
+		palette[e][0] = (uint8_t)expand(colors[e] >> 11, 5);
+		palette[e][1] = (uint8_t)expand(colors[e] >> 5 & 0x3f, 6);
+		palette[e][2] = (uint8_t)expand(colors[e] & 0x1f, 5);
+		palette[e][3] = 255;
+	}
+	for (int c = 0; c < 3; c++) {
+		int a = palette[0][c];
+		int b = palette[1][c];
+		if (colors[0] > colors[1]) {
+			palette[2][c] = (uint8_t)((2 * a + b + 1) / 3);
+			palette[3][c] = (uint8_t)((a + 2 * b + 1) / 3);
+		} else {
+			palette[2][c] = (uint8_t)((a + b + 1) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = colors[0] > colors[1] ? 255 : 0;
+
+	for (int i = 0; i < 16; i++) {
+		memcpy(pixels + 4 * i, palette[bits >> 2 * i & 3], 4);
+	}
+}
+
+// BC4, two of which make up BC5
+
+static const float BC4_WEIGHTS[8] = {
+	0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f,
+};
+
+static float evaluateBc4(const BlockPixels *block, int start, int end, uint8_t *indices) {
+	float palette[8][4] = {};
+	for (int e = 0; e < 8; e++) {
+		palette[e][0] = start + (end - start) * BC4_WEIGHTS[e];
+	}
+	return selectIndices(block, 1, palette, 8, indices);
+}
+
+static void encodeBc4Block(
+	const uint8_t *pixels, int channel, TextureQuality quality, uint8_t *block
+) {
+	BlockPixels source;
+	float low = 255.0f;
+	float high = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		auto value = (float)pixels[4 * i + channel];
+		source.values[0][i] = value;
+		low = std::min(low, value);
+		high = std::max(high, value);
+	}
+
+	auto bestStart = (int)high;
+	auto bestEnd = (int)low;
+	uint8_t bestIndices[16] = {};
+	auto bestError = FLT_MAX;
+	if (bestStart != bestEnd) {
+		float start = high;
+		float end = low;
+		auto numIterations = quality == TEXTURE_QUALITY_FAST ? 1 : 3;
+		for (int iteration = 0; iteration < numIterations; iteration++) {
+			auto quantizedStart = (int)(start + 0.5f);
+			auto quantizedEnd = (int)(end + 0.5f);
+			uint8_t indices[16];
+			auto error = evaluateBc4(&source, quantizedStart, quantizedEnd, indices);
+			if (error >= bestError) {
+				break;
+			}
+
+			bestStart = quantizedStart;
+			bestEnd = quantizedEnd;
+			bestError = error;
+			memcpy(bestIndices, indices, sizeof(indices));
+			if (!fitEndpoints(&source, 1, indices, BC4_WEIGHTS, &start, &end)) {
+				break;
+			}
+		}
+
+		if (quality == TEXTURE_QUALITY_BEST) {
+			const int RADIUS = 3;
+			auto centerStart = bestStart;
+			auto centerEnd = bestEnd;
+			for (int s = centerStart - RADIUS; s <= centerStart + RADIUS; s++) {
+				for (int e = centerEnd - RADIUS; e <= centerEnd + RADIUS; e++) {
+					if (s < 0 || s > 255 || e < 0 || e > 255) {
+						continue;
+					}
+					uint8_t indices[16];
+					auto error = evaluateBc4(&source, s, e, indices);
+					if (error < bestError) {
+						bestStart = s;
+						bestEnd = e;
+						bestError = error;
+						memcpy(bestIndices, indices, sizeof(indices));
+					}
+				}
+			}
+		}
+	}
+
+	// the first value has to be the larger one to select the eight value mode
+	if (bestStart < bestEnd) {
+		std::swap(bestStart, bestEnd);
+		for (int i = 0; i < 16; i++) {
+			auto index = bestIndices[i];
+			bestIndices[i] = (uint8_t)(index < 2 ? index ^ 1 : 9 - index);
+		}
+	} else if (bestStart == bestEnd) {
+		memset(bestIndices, 0, sizeof(bestIndices));
+	}
+
+	block[0] = (uint8_t)bestStart;
+	block[1] = (uint8_t)bestEnd;
+	uint64_t bits = 0;
+	for (int i = 0; i < 16; i++) {
+		bits |= (uint64_t)bestIndices[i] << 3 * i;
+	}
+	for (int i = 0; i < 6; i++) {
+		block[2 + i] = (uint8_t)(bits >> 8 * i);
+	}
+}
+
+static void decodeBc4Block(const uint8_t *block, int channel, uint8_t *pixels) {
+	int a = block[0];
+	int b = block[1];
+	uint8_t palette[8] = {(uint8_t)a, (uint8_t)b};
+	if (a > b) {
+		for (int e = 2; e < 8; e++) {
+			palette[e] = (uint8_t)(((8 - e) * a + (e - 1) * b + 3) / 7);
+		}
+	} else {
+		for (int e = 2; e < 6; e++) {
+			palette[e] = (uint8_t)(((6 - e) * a + (e - 1) * b + 2) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; i++) {
+		bits |= (uint64_t)block[2 + i] << 8 * i;
+	}
+	for (int i = 0; i < 16; i++) {
+		pixels[4 * i + channel] = palette[bits >> 3 * i & 7];
+	}
+}
+
+void encodeBc5Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block) {
+	encodeBc4Block(pixels, 0, quality, block);
+	encodeBc4Block(pixels, 1, quality, block + 8);
+}
+
+void decodeBc5Block(const uint8_t *block, uint8_t *pixels) {
+	for (int i = 0; i < 16; i++) {
+		pixels[4 * i + 2] = 0;
+		pixels[4 * i + 3] = 255;
+	}
+	decodeBc4Block(block, 0, pixels);
+	decodeBc4Block(block + 8, 1, pixels);
+}
+
+// BC7 mode 6, a single subset with 7-bit RGBA endpoints, a p-bit each and 4-bit indices
+
+struct Bc7Endpoints {
+	int colors[2][4];
+	int pbits[2];
+};
+
+static float evaluateBc7(
+	const BlockPixels *block, const Bc7Endpoints *endpoints, uint8_t *indices
+) {
+	float palette[16][4];
+	for (int c = 0; c < 4; c++) {
+		auto a = endpoints->colors[0][c] << 1 | endpoints->pbits[0];
+		auto b = endpoints->colors[1][c] << 1 | endpoints->pbits[1];
+		for (int e = 0; e < 16; e++) {
+			auto w = BC7_WEIGHTS[e];
+			palette[e][c] = (float)(((64 - w) * a + w * b + 32) >> 6);
+		}
+	}
+	return selectIndices(block, 4, palette, 16, indices);
+}
+
+static void quantizeBc7(const float *value, int pbit, int *color) {
+	for (int c = 0; c < 4; c++) {
+		color[c] = std::min(std::max((int)((value[c] - pbit) * 0.5f + 0.5f), 0), 127);
+	}
+}
+
+static float getQuantizationError(const float *value, int pbit) {
+	int color[4];
+	quantizeBc7(value, pbit, color);
+	float error = 0.0f;
+	for (int c = 0; c < 4; c++) {
+		auto d = value[c] - (color[c] << 1 | pbit);
+		error += d * d;
+	}
+	return error;
+}
+
+// Tries p-bits for the unquantized endpoints, keeping the best result. The fast preset only picks
+// the p-bit closest to each endpoint on its own, while the others try all four pairs.
+static float searchPbits(
+	const BlockPixels *block, const float *start, const float *end, bool exhaustive,
+	Bc7Endpoints *endpoints, uint8_t *indices
+) {
+	auto bestError = FLT_MAX;
+	for (int pair = 0; pair < 4; pair++) {
+		Bc7Endpoints candidate;
+		candidate.pbits[0] = pair & 1;
+		candidate.pbits[1] = pair >> 1;
+		if (!exhaustive) {
+			candidate.pbits[0] = getQuantizationError(start, 1) < getQuantizationError(start, 0);
+			candidate.pbits[1] = getQuantizationError(end, 1) < getQuantizationError(end, 0);
+		}
+		quantizeBc7(start, candidate.pbits[0], candidate.colors[0]);
+		quantizeBc7(end, candidate.pbits[1], candidate.colors[1]);
+
+		uint8_t candidateIndices[16];
+		auto error = evaluateBc7(block, &candidate, candidateIndices);
+		if (error < bestError) {
+			*endpoints = candidate;
+			bestError = error;
+			memcpy(indices, candidateIndices, sizeof(candidateIndices));
+		}
+		if (!exhaustive) {
+			break;
+		}
+	}
+	return bestError;
+}
+
+// Writes fields least significant bit first, as BC7 lays them out.
+struct BitWriter {
+	uint8_t *data;
+	uint32_t position;
+
+	void write(uint32_t value, uint32_t bits) {
+		for (uint32_t i = 0; i < bits; i++, this->position++) {
+			if (value >> i & 1) {
+				this->data[this->position / 8] |= (uint8_t)(1 << this->position % 8);
+			}
+		}
+	}
+};
+
+struct BitReader {
+	const uint8_t *data;
+	uint32_t position;
+
+	uint32_t read(uint32_t bits) {
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bits; i++, this->position++) {
+			value |= (uint32_t)(this->data[this->position / 8] >> this->position % 8 & 1) << i;
+		}
+		return value;
+	}
+};
+
+void encodeBc7Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block) {
+	BlockPixels source;
+	loadPixels(pixels, &source);
+
+	float start[4];
+	float end[4];
+	auto exhaustive = quality != TEXTURE_QUALITY_FAST;
+	auto numIterations = quality == TEXTURE_QUALITY_FAST ? 1 :
+		quality == TEXTURE_QUALITY_NORMAL ? 2 : 4;
+	getAxisEndpoints(&source, 4, quality == TEXTURE_QUALITY_FAST ? 2 : 8, start, end);
+
+	Bc7Endpoints best;
+	uint8_t bestIndices[16];
+	auto bestError = FLT_MAX;
+	for (int iteration = 0; iteration < numIterations; iteration++) {
+		Bc7Endpoints endpoints;
+		uint8_t indices[16];
+		auto error = searchPbits(&source, start, end, exhaustive, &endpoints, indices);
+		if (error >= bestError) {
+			break;
+		}
+
+		best = endpoints;
+		bestError = error;
+		memcpy(bestIndices, indices, sizeof(indices));
+
+		float weights[16];
+		for (int e = 0; e < 16; e++) {
+			weights[e] = BC7_WEIGHTS[e] / 64.0f;
+		}
+		if (!fitEndpoints(&source, 4, indices, weights, start, end)) {
+			break;
+		}
+	}
+
+	if (quality == TEXTURE_QUALITY_BEST) {
+		auto improved = true;
+		for (int pass = 0; pass < 2 && improved; pass++) {
+			improved = false;
+			for (int e = 0; e < 2; e++) {
+				for (int c = 0; c < 4; c++) {
+					for (int step = -1; step <= 1; step += 2) {
+						auto endpoints = best;
+						auto value = endpoints.colors[e][c] + step;
+						if (value < 0 || value > 127) {
+							continue;
+						}
+						endpoints.colors[e][c] = value;
+
+						uint8_t indices[16];
+						auto error = evaluateBc7(&source, &endpoints, indices);
+						if (error < bestError) {
+							best = endpoints;
+							bestError = error;
+							memcpy(bestIndices, indices, sizeof(indices));
+							improved = true;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// the first index implicitly has its top bit clear, so flip the endpoints if it's set
+	if (bestIndices[0] >= 8) {
+		std::swap(best.colors[0], best.colors[1]);
+		std::swap(best.pbits[0], best.pbits[1]);
+		for (int i = 0; i < 16; i++) {
+			bestIndices[i] = (uint8_t)(15 - bestIndices[i]);
+		}
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer = {block, 0};
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writer.write(best.colors[0][c], 7);
+		writer.write(best.colors[1][c], 7);
+	}
+	writer.write(best.pbits[0], 1);
+	writer.write(best.pbits[1], 1);
+	writer.write(bestIndices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		writer.write(bestIndices[i], 4);
+	}
+}
+
+bool decodeBc7Block(const uint8_t *block, uint8_t *pixels) {
+	BitReader reader = {block, 0};
+	if (reader.read(7) != 1 << 6) {
+		return false;
+	}
+
+	int colors[2][4];
+	for (int c = 0; c < 4; c++) {
+		colors[0][c] = (int)reader.read(7);
+		colors[1][c] = (int)reader.read(7);
+	}
+	int pbits[2];
+	pbits[0] = (int)reader.read(1);
+	pbits[1] = (int)reader.read(1);
+
+	for (int i = 0; i < 16; i++) {
+		auto w = BC7_WEIGHTS[reader.read(i == 0 ? 3 : 4)];
+		for (int c = 0; c < 4; c++) {
+			auto a = colors[0][c] << 1 | pbits[0];
+			auto b = colors[1][c] << 1 | pbits[1];
+			pixels[4 * i + c] = (uint8_t)(((64 - w) * a + w * b + 32) >> 6);
+		}
+	}
+	return true;
+}
+
+// Images
+
+const char *getTextureFormatName(TextureFormat format) {
+	switch (format) {
+	case TEXTURE_FORMAT_RGBA8:
+		return "RGBA8";
+	case TEXTURE_FORMAT_BC1:
+		return "BC1";
+	case TEXTURE_FORMAT_BC5:
+		return "BC5";
+	case TEXTURE_FORMAT_BC7:
+		return "BC7";
+	}
+	return "unknown";
+}
+
+const char *getTextureQualityName(TextureQuality quality) {
+	switch (quality) {
+	case TEXTURE_QUALITY_FAST:
+		return "fast";
+	case TEXTURE_QUALITY_NORMAL:
+		return "normal";
+	case TEXTURE_QUALITY_BEST:
+		return "best";
+	}
+	return "unknown";
+}
+
+static size_t getBlockSize(TextureFormat format) {
+	return format == TEXTURE_FORMAT_BC1 ? 8 : 16;
+}
+
+size_t getEncodedSize(TextureFormat format, uint32_t width, uint32_t height) {
+	if (format == TEXTURE_FORMAT_RGBA8) {
+		return 4 * (size_t)width * height;
+	}
+	return getBlockSize(format) * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+void encodeImage(
+	const Image *image, TextureFormat format, TextureQuality quality, uint32_t numThreads,
+	std::vector<uint8_t> *data
+) {
+	data->resize(getEncodedSize(format, image->width, image->height));
+	if (format == TEXTURE_FORMAT_RGBA8) {
+		memcpy(data->data(), image->pixels.data(), data->size());
+		return;
+	}
+
+	auto encodeBlock = format == TEXTURE_FORMAT_BC1 ? encodeBc1Block :
+		format == TEXTURE_FORMAT_BC5 ? encodeBc5Block : encodeBc7Block;
+	auto blockSize = getBlockSize(format);
+	auto blocksX = (image->width + 3) / 4;
+	auto blocksY = (image->height + 3) / 4;
+
+	// threads take whole rows of blocks until there are none left
+	std::atomic<uint32_t> nextRow(0);
+	auto work = [&]() {
+		uint8_t pixels[64];
+		for (;;) {
+			auto row = nextRow++;
+			if (row >= blocksY) {
+				break;
+			}
+			for (uint32_t column = 0; column < blocksX; column++) {
+				for (uint32_t i = 0; i < 16; i++) {
+					auto x = std::min(4 * column + i % 4, image->width - 1);
+					auto y = std::min(4 * row + i / 4, image->height - 1);
+					memcpy(pixels + 4 * i, &image->pixels[4 * ((size_t)y * image->width + x)], 4);
+				}
+				encodeBlock(pixels, quality, &(*data)[blockSize * ((size_t)row * blocksX + column)]);
+			}
+		}
+	};
+
+	if (numThreads == 0) {
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	numThreads = std::min(numThreads, blocksY);
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; i++) {
+		threads.emplace_back(work);
+	}
+	work();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+bool decodeImage(
+	const uint8_t *data, TextureFormat format, uint32_t width, uint32_t height, Image *image
+) {
+	image->width = width;
+	image->height = height;
+	image->pixels.resize(4 * (size_t)width * height);
+	if (format == TEXTURE_FORMAT_RGBA8) {
+		memcpy(image->pixels.data(), data, image->pixels.size());
+		return true;
+	}
+
+	auto blockSize = getBlockSize(format);
+	auto blocksX = (width + 3) / 4;
+	auto blocksY = (height + 3) / 4;
+	uint8_t pixels[64];
+	for (uint32_t row = 0; row < blocksY; row++) {
+		for (uint32_t column = 0; column < blocksX; column++) {
+			auto block = data + blockSize * ((size_t)row * blocksX + column);
+			if (format == TEXTURE_FORMAT_BC1) {
+				decodeBc1Block(block, pixels);
+			} else if (format == TEXTURE_FORMAT_BC5) {
+				decodeBc5Block(block, pixels);
+			} else if (!decodeBc7Block(block, pixels)) {
+				return false;
+			}
+
+			for (uint32_t i = 0; i < 16; i++) {
+				auto x = 4 * column + i % 4;
+				auto y = 4 * row + i / 4;
+				if (x < width && y < height) {
+					memcpy(&image->pixels[4 * ((size_t)y * width + x)], pixels + 4 * i, 4);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+double computePsnr(const Image *a, const Image *b, uint32_t numChannels) {
+	double error = 0.0;
+	auto numPixels = (size_t)a->width * a->height;
+	for (size_t i = 0; i < numPixels; i++) {
+		for (uint32_t c = 0; c < numChannels; c++) {
+			double d = (int)a->pixels[4 * i + c] - (int)b->pixels[4 * i + c];
+			error += d * d;
+		}
+	}
+	error /= (double)numPixels * numChannels;
+	if (error == 0.0) {
+		return INFINITY;
+	}
+	return 10.0 * log10(255.0 * 255.0 / error);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "image.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+enum TextureFormat {
+	TEXTURE_FORMAT_RGBA8,
+
+	// opaque color at 4 bits per pixel
+	TEXTURE_FORMAT_BC1,
+
+	// two independent channels at 8 bits per pixel, for tangent-space normals
+	TEXTURE_FORMAT_BC5,
+
+	// color and alpha at 8 bits per pixel, only using mode 6
+	TEXTURE_FORMAT_BC7,
+};
+
+// Presets that trade encoding time against quality, by how far endpoints are refined.
+enum TextureQuality {
+	TEXTURE_QUALITY_FAST,
+	TEXTURE_QUALITY_NORMAL,
+	TEXTURE_QUALITY_BEST,
+};
+
+const char *getTextureFormatName(TextureFormat format);
+const char *getTextureQualityName(TextureQuality quality);
+
+size_t getEncodedSize(TextureFormat format, uint32_t width, uint32_t height);
+
+// Blocks are 4x4 RGBA8 pixels in, BC blocks out. BC1 ignores alpha and BC5 only encodes red and
+// green.
+void encodeBc1Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block);
+void encodeBc5Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block);
+void encodeBc7Block(const uint8_t *pixels, TextureQuality quality, uint8_t *block);
+
+void decodeBc1Block(const uint8_t *block, uint8_t *pixels);
+void decodeBc5Block(const uint8_t *block, uint8_t *pixels);
+
+// Only decodes mode 6, and fails on any other mode.
+bool decodeBc7Block(const uint8_t *block, uint8_t *pixels);
+
+// Encodes rows of blocks on numThreads threads, or one per core when it is 0. Edge blocks of
+// images that aren't a multiple of 4 repeat the last row and column.
+void encodeImage(
+	const Image *image, TextureFormat format, TextureQuality quality, uint32_t numThreads,
+	std::vector<uint8_t> *data
+);
+bool decodeImage(
+	const uint8_t *data, TextureFormat format, uint32_t width, uint32_t height, Image *image
+);
+
+// Over the first numChannels channels.
+double computePsnr(const Image *a, const Image *b, uint32_t numChannels);
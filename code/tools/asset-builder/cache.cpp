@@ -0,0 +1,301 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "cache.h"
+#include "hash.h"
+#include "platform.h"
+#include <cinttypes>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static void makeSubdir(const std::string &path) {
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0777);
+#endif
+}
+
+static bool getExists(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fclose(file);
+	return true;
+}
+
+// Moves a file over target. Readers that have the old file open or mapped keep it on POSIX, and on
+// Windows can only have opened it with delete sharing.
+static bool replaceFile(const std::string &sourcePath, const std::string &targetPath) {
+#ifdef _WIN32
+	return MoveFileExA(sourcePath.c_str(), targetPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(sourcePath.c_str(), targetPath.c_str()) == 0;
+#endif
+}
+
+static bool copyFile(const std::string &sourcePath, const std::string &targetPath, uint64_t *size) {
+	FILE *source = fopen(sourcePath.c_str(), "rb");
+	if (source == NULL) {
+		return false;
+	}
+	FILE *target = fopen(targetPath.c_str(), "wb");
+	if (target == NULL) {
+		fclose(source);
+		return false;
+	}
+
+	std::vector<char> buffer(1024 * 1024);
+	*size = 0;
+	size_t read;
+	auto complete = true;
+	while (complete && (read = fread(buffer.data(), 1, buffer.size(), source)) > 0) {
+		complete = fwrite(buffer.data(), 1, read, target) == read;
+		*size += read;
+	}
+	complete = complete && ferror(source) == 0;
+	fclose(source);
+	complete = fclose(target) == 0 && complete;
+
+	if (!complete) {
+		remove(targetPath.c_str());
+	}
+	return complete;
+}
+
+// Entries are spread over 256 directories by the first byte of their key.
+static std::string getEntryPath(const BuildCache *cache, uint64_t key, size_t output) {
+	char name[64];
+	snprintf(
+		name, sizeof(name), "%02x/%016" PRIx64 "-%zu", (unsigned)(key >> 56), key, output
+	);
+	return cache->dir + name;
+}
+
+bool BuildCache::create(
+	const char *dir, const char *manifestPath, uint64_t version, BuildCache *cache
+) {
+	cache->dir = dir;
+	cache->manifestPath = manifestPath;
+	cache->version = version;
+	cache->manifest.clear();
+	cache->fileHashes.clear();
+	std::random_device random;
+	cache->nextTemp = (uint64_t)random() << 32 | random();
+	cache->upToDate = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->fetchedBytes = 0;
+	cache->storedBytes = 0;
+	cache->hashedBytes = 0;
+
+	FILE *file = fopen(manifestPath, "r");
+	if (file == NULL) {
+		return true;
+	}
+
+	// one "key path" line per output
+	char line[4096];
+	auto complete = true;
+	while (fgets(line, sizeof(line), file)) {
+		auto length = strlen(line);
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+			line[--length] = '\0';
+		}
+
+		uint64_t key;
+		int keyLength;
+		if (sscanf(line, "%" SCNx64 " %n", &key, &keyLength) != 1 || keyLength >= (int)length) {
+			complete = false;
+			break;
+		}
+		cache->manifest[line + keyLength] = key;
+	}
+	fclose(file);
+
+	// a damaged manifest only costs a rebuild, or a fetch from the cache
+	if (!complete) {
+		cache->manifest.clear();
+	}
+	return true;
+}
+
+bool BuildCache::getKey(
+	const char *parameters, const std::string *inputs, size_t numInputs, uint64_t *key
+) {
+	auto h = hash64(&this->version, sizeof(this->version), 0);
+	h = hash64(parameters, strlen(parameters), h);
+	for (size_t i = 0; i < numInputs; i++) {
+		uint64_t fileHash;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			auto found = this->fileHashes.find(inputs[i]);
+			if (found != this->fileHashes.end()) {
+				h = hash64(&found->second, sizeof(found->second), h);
+				continue;
+			}
+		}
+
+		uint64_t size;
+		if (!hashFile(inputs[i].c_str(), &fileHash, &size)) {
+			return false;
+		}
+		this->hashedBytes += size;
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->fileHashes[inputs[i]] = fileHash;
+		}
+		h = hash64(&fileHash, sizeof(fileHash), h);
+	}
+
+	*key = h;
+	return true;
+}
+
+void BuildCache::forget(const std::string &path) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->fileHashes.erase(path);
+}
+
+bool BuildCache::isUpToDate(uint64_t key, const std::string *outputs, size_t numOutputs) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (size_t i = 0; i < numOutputs; i++) {
+			auto found = this->manifest.find(outputs[i]);
+			if (found == this->manifest.end() || found->second != key) {
+				return false;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < numOutputs; i++) {
+		if (!getExists(outputs[i])) {
+			return false;
+		}
+	}
+
+	this->upToDate++;
+	return true;
+}
+
+bool BuildCache::fetch(uint64_t key, const std::string *outputs, size_t numOutputs) {
+	for (size_t i = 0; i < numOutputs; i++) {
+		if (!getExists(getEntryPath(this, key, i))) {
+			this->misses++;
+			return false;
+		}
+	}
+
+	// outputs are replaced whole, since a running game may have the old ones mapped
+	uint64_t fetched = 0;
+	for (size_t i = 0; i < numOutputs; i++) {
+		uint64_t size;
+		auto tempPath = outputs[i] + ".tmp";
+		if (!copyFile(getEntryPath(this, key, i), tempPath, &size)) {
+			this->misses++;
+			return false;
+		}
+		if (!replaceFile(tempPath, outputs[i])) {
+			remove(tempPath.c_str());
+			this->misses++;
+			return false;
+		}
+		fetched += size;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (size_t i = 0; i < numOutputs; i++) {
+			this->manifest[outputs[i]] = key;
+		}
+	}
+
+	this->hits++;
+	this->fetchedBytes += fetched;
+	return true;
+}
+
+bool BuildCache::store(uint64_t key, const std::string *outputs, size_t numOutputs) {
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (size_t i = 0; i < numOutputs; i++) {
+			this->manifest[outputs[i]] = key;
+		}
+	}
+
+	char prefix[8];
+	snprintf(prefix, sizeof(prefix), "%02x", (unsigned)(key >> 56));
+	makeSubdir(this->dir + prefix);
+
+	// another builder may be storing the same entry, so each writes its own temporary file
+	for (size_t i = 0; i < numOutputs; i++) {
+		auto entryPath = getEntryPath(this, key, i);
+		auto tempPath = entryPath + ".tmp" + std::to_string(this->nextTemp++);
+
+		uint64_t size;
+		if (!copyFile(outputs[i], tempPath, &size)) {
+			return false;
+		}
+
+		// fails when the entry already exists on Windows, where it has the same contents anyway
+		if (rename(tempPath.c_str(), entryPath.c_str()) != 0) {
+			remove(tempPath.c_str());
+			if (!getExists(entryPath)) {
+				return false;
+			}
+		}
+		this->storedBytes += size;
+	}
+
+	return true;
+}
+
+bool BuildCache::saveManifest() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto tempPath = this->manifestPath + ".tmp";
+	FILE *file = fopen(tempPath.c_str(), "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	auto complete = true;
+	for (auto &entry : this->manifest) {
+		auto path = entry.first.c_str();
+		complete = complete && fprintf(file, "%016" PRIx64 " %s\n", entry.second, path) > 0;
+	}
+	complete = fclose(file) == 0 && complete;
+
+	remove(this->manifestPath.c_str());
+	return complete && rename(tempPath.c_str(), this->manifestPath.c_str()) == 0;
+}
+
+CacheStats BuildCache::getStats() const {
+	CacheStats stats;
+	stats.upToDate = this->upToDate;
+	stats.hits = this->hits;
+	stats.misses = this->misses;
+	stats.fetchedBytes = this->fetchedBytes;
+	stats.storedBytes = this->storedBytes;
+	stats.hashedBytes = this->hashedBytes;
+	return stats;
+}
+
+void BuildCache::report(FILE *file) const {
+	auto stats = this->getStats();
+	auto lookups = stats.hits + stats.misses;
+	fprintf(
+		file,
+		"cache: %" PRIu64 " up to date, %" PRIu64 " hits, %" PRIu64 " misses (%.0f%% hit rate), "
+		"%.1f MB fetched, %.1f MB stored, %.1f MB hashed\n",
+		stats.upToDate, stats.hits, stats.misses, lookups ? 100.0 * stats.hits / lookups : 100.0,
+		stats.fetchedBytes / 1048576.0, stats.storedBytes / 1048576.0,
+		stats.hashedBytes / 1048576.0
+	);
+}
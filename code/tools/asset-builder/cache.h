@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct CacheStats {
+	// outputs that already matched their key, were copied out of the cache, or had to be built
+	uint64_t upToDate;
+	uint64_t hits;
+	uint64_t misses;
+
+	uint64_t fetchedBytes;
+	uint64_t storedBytes;
+	uint64_t hashedBytes;
+};
+
+// A content-addressed store of build outputs. A step's key is the hash of the builder version,
+// its parameters and the contents of its inputs, so the same inputs built anywhere map to the
+// same entry, and the directory can be shared between checkouts and machines. A manifest next to
+// the outputs remembers which key each output was last made from, which is what makes a step up
+// to date, rather than file times. Every function may be called from several threads at once.
+struct BuildCache {
+	std::string dir;
+	std::string manifestPath;
+	uint64_t version;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, uint64_t> manifest;
+	std::unordered_map<std::string, uint64_t> fileHashes;
+
+	// starts at a random number, to keep temporary files apart from other builders'
+	std::atomic<uint64_t> nextTemp;
+
+	std::atomic<uint64_t> upToDate;
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> fetchedBytes;
+	std::atomic<uint64_t> storedBytes;
+	std::atomic<uint64_t> hashedBytes;
+
+	// dir must end in a path separator and already exist, and the manifest may not exist yet.
+	static bool create(
+		const char *dir, const char *manifestPath, uint64_t version, BuildCache *cache
+	);
+
+	// Fails when an input can't be read. Inputs are hashed once per run, so they must not change
+	// while the build is running.
+	bool getKey(
+		const char *parameters, const std::string *inputs, size_t numInputs, uint64_t *key
+	);
+
+	// Makes the next key that reads path hash it again, for a file that changed since.
+	void forget(const std::string &path);
+
+	bool isUpToDate(uint64_t key, const std::string *outputs, size_t numOutputs);
+
+	// Copies the outputs of a key out of the cache, or fails when it doesn't have all of them.
+	bool fetch(uint64_t key, const std::string *outputs, size_t numOutputs);
+
+	// Copies freshly built outputs into the cache. Entries are written under a temporary name
+	// and renamed into place, so readers never see half an entry.
+	bool store(uint64_t key, const std::string *outputs, size_t numOutputs);
+
+	bool saveManifest();
+
+	CacheStats getStats() const;
+	void report(FILE *file) const;
+};
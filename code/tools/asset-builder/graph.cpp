@@ -0,0 +1,345 @@
+#include "graph.h"
+#include "util.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+uint32_t BuildGraph::addNode(
+	const char *name, BuildFunction build, const char *parameters,
+	const char *source, const char *target
+) {
+	BuildNode node = {};
+	node.name = name;
+	node.build = build;
+	node.parameters = parameters;
+	node.inputs.push_back(source);
+	node.outputs.push_back(target);
+	node.pathPrevious = BuildGraph::NO_NODE;
+	this->nodes.push_back(node);
+	return (uint32_t)this->nodes.size() - 1;
+}
+
+void BuildGraph::addInput(uint32_t node, const char *path) {
+	auto &inputs = this->nodes[node].inputs;
+	if (std::find(inputs.begin(), inputs.end(), path) == inputs.end()) {
+		inputs.push_back(path);
+	}
+}
+
+void BuildGraph::addOutput(uint32_t node, const char *path) {
+	this->nodes[node].outputs.push_back(path);
+}
+
+HRESULT BuildGraph::link() {
+	std::unordered_map<std::string, uint32_t> writers;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		for (auto &output : this->nodes[i].outputs) {
+			auto inserted = writers.insert(std::make_pair(output, i));
+			if (!inserted.second) {
+				auto &other = this->nodes[inserted.first->second];
+				fprintf(
+					stderr, "%s and %s both write %s\n", other.name.c_str(),
+					this->nodes[i].name.c_str(), output.c_str()
+				);
+				return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		auto &node = this->nodes[i];
+		node.dependencies.clear();
+		node.dependents.clear();
+	}
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		auto &node = this->nodes[i];
+		for (auto &input : node.inputs) {
+			auto writer = writers.find(input);
+			if (writer == writers.end()) {
+				continue;
+			}
+
+			auto &dependencies = node.dependencies;
+			auto dependency = writer->second;
+			auto found = std::find(dependencies.begin(), dependencies.end(), dependency);
+			if (found != dependencies.end()) {
+				continue;
+			}
+			dependencies.push_back(dependency);
+			this->nodes[dependency].dependents.push_back(i);
+		}
+	}
+
+	// whatever never runs out of dependencies is on a cycle or depends on one
+	std::vector<uint32_t> pending(this->nodes.size());
+	std::vector<uint32_t> ready;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		pending[i] = (uint32_t)this->nodes[i].dependencies.size();
+		if (pending[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+	size_t numSorted = 0;
+	while (!ready.empty()) {
+		auto i = ready.back();
+		ready.pop_back();
+		numSorted++;
+		for (auto dependent : this->nodes[i].dependents) {
+			if (--pending[dependent] == 0) {
+				ready.push_back(dependent);
+			}
+		}
+	}
+	if (numSorted < this->nodes.size()) {
+		for (uint32_t i = 0; i < this->nodes.size(); i++) {
+			if (pending[i] > 0) {
+				auto name = this->nodes[i].name.c_str();
+				fprintf(stderr, "%s is on or behind a dependency cycle\n", name);
+			}
+		}
+		return HRESULT_FROM_WIN32(ERROR_CIRCULAR_DEPENDENCY);
+	}
+
+	return S_OK;
+}
+
+static void runNode(BuildGraph *graph, uint32_t index, BuildCache *cache) {
+	auto &node = graph->nodes[index];
+	node.result = S_OK;
+	node.built = false;
+	node.fetched = false;
+
+	for (auto dependency : node.dependencies) {
+		if (FAILED(graph->nodes[dependency].result)) {
+			node.result = graph->nodes[dependency].result;
+			return;
+		}
+	}
+
+	uint64_t key;
+	auto &inputs = node.inputs;
+	auto &outputs = node.outputs;
+	if (!cache->getKey(node.parameters.c_str(), inputs.data(), inputs.size(), &key)) {
+		fprintf(stderr, "%s: couldn't read its inputs\n", node.name.c_str());
+		node.result = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+		return;
+	}
+	if (cache->isUpToDate(key, outputs.data(), outputs.size())) {
+		return;
+	}
+	if (cache->fetch(key, outputs.data(), outputs.size())) {
+		node.fetched = true;
+		return;
+	}
+
+	fprintf(stderr, "%s\n", node.name.c_str());
+	node.built = true;
+	if (FAILED(node.result = node.build(inputs[0].c_str(), outputs[0].c_str()))) {
+		printWindowsError(node.result);
+		return;
+	}
+
+	// the outputs are fine, so a failure to share them is only worth a warning
+	if (!cache->store(key, outputs.data(), outputs.size())) {
+		fprintf(stderr, "%s: couldn't store its outputs in the cache\n", node.name.c_str());
+	}
+}
+
+HRESULT BuildGraph::run(uint32_t numThreads, BuildCache *cache) {
+	std::vector<bool> dirty(this->nodes.size(), true);
+	return this->run(numThreads, cache, &dirty);
+}
+
+bool BuildGraph::markDirty(const std::string &path, std::vector<bool> *dirty) const {
+	std::vector<uint32_t> stack;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		auto &inputs = this->nodes[i].inputs;
+		if (std::find(inputs.begin(), inputs.end(), path) != inputs.end()) {
+			stack.push_back(i);
+		}
+	}
+
+	auto found = !stack.empty();
+	while (!stack.empty()) {
+		auto i = stack.back();
+		stack.pop_back();
+		if ((*dirty)[i]) {
+			continue;
+		}
+		(*dirty)[i] = true;
+		for (auto dependent : this->nodes[i].dependents) {
+			stack.push_back(dependent);
+		}
+	}
+	return found;
+}
+
+HRESULT BuildGraph::run(uint32_t numThreads, BuildCache *cache, const std::vector<bool> *dirty) {
+	size_t numDirty = 0;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		numDirty += (*dirty)[i] ? 1 : 0;
+	}
+
+	if (numThreads == 0) {
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+	numThreads = std::max(std::min(numThreads, (uint32_t)numDirty), 1u);
+	this->numThreads = numThreads;
+
+	// nodes left out didn't do anything this time
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		auto &node = this->nodes[i];
+		if (!(*dirty)[i]) {
+			node.built = false;
+			node.fetched = false;
+			node.seconds = 0.0;
+			node.pathSeconds = 0.0;
+			node.pathPrevious = BuildGraph::NO_NODE;
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<uint32_t> pending(this->nodes.size());
+	std::vector<uint32_t> ready;
+	size_t numFinished = 0;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		if (!(*dirty)[i]) {
+			continue;
+		}
+		for (auto dependency : this->nodes[i].dependencies) {
+			pending[i] += (*dirty)[dependency] ? 1 : 0;
+		}
+		if (pending[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+
+	// the last node added runs first, so reverse them to start in the order they were declared
+	std::reverse(ready.begin(), ready.end());
+
+	auto work = [&]() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			wake.wait(lock, [&]() {
+				return !ready.empty() || numFinished == numDirty;
+			});
+			if (ready.empty()) {
+				return;
+			}
+			auto i = ready.back();
+			ready.pop_back();
+			lock.unlock();
+
+			auto &node = this->nodes[i];
+			auto start = Clock::now();
+			runNode(this, i, cache);
+			node.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			// dependencies have all finished, so their paths are final
+			node.pathSeconds = 0.0;
+			node.pathPrevious = BuildGraph::NO_NODE;
+			for (auto dependency : node.dependencies) {
+				auto pathSeconds = this->nodes[dependency].pathSeconds;
+				if (node.pathPrevious == BuildGraph::NO_NODE || pathSeconds > node.pathSeconds) {
+					node.pathSeconds = pathSeconds;
+					node.pathPrevious = dependency;
+				}
+			}
+			node.pathSeconds += node.seconds;
+
+			lock.lock();
+			numFinished++;
+			for (auto dependent : node.dependents) {
+				if ((*dirty)[dependent] && --pending[dependent] == 0) {
+					ready.push_back(dependent);
+				}
+			}
+			wake.notify_all();
+		}
+	};
+
+	auto start = Clock::now();
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < numThreads; i++) {
+		threads.emplace_back(work);
+	}
+	work();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	this->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		if ((*dirty)[i] && FAILED(this->nodes[i].result)) {
+			return this->nodes[i].result;
+		}
+	}
+	return S_OK;
+}
+
+void BuildGraph::report(FILE *file, size_t numSlowest) const {
+	size_t numBuilt = 0;
+	size_t numFetched = 0;
+	size_t numFailed = 0;
+	double busySeconds = 0.0;
+	uint32_t last = BuildGraph::NO_NODE;
+	std::vector<uint32_t> built;
+	for (uint32_t i = 0; i < this->nodes.size(); i++) {
+		auto &node = this->nodes[i];
+		numBuilt += node.built ? 1 : 0;
+		numFetched += node.fetched ? 1 : 0;
+		numFailed += FAILED(node.result) ? 1 : 0;
+		busySeconds += node.seconds;
+		if (node.built) {
+			built.push_back(i);
+		}
+		if (last == BuildGraph::NO_NODE || node.pathSeconds > this->nodes[last].pathSeconds) {
+			last = i;
+		}
+	}
+
+	fprintf(
+		file,
+		"%zu nodes: %zu built, %zu fetched, %zu up to date, %zu failed in %.2f s on %u threads "
+		"(%.1fx parallel, %.0f%% busy)\n",
+		this->nodes.size(), numBuilt, numFetched,
+		this->nodes.size() - numBuilt - numFetched - numFailed, numFailed,
+		this->seconds, this->numThreads, busySeconds / std::max(this->seconds, 1e-9),
+		100.0 * busySeconds / std::max(this->seconds * this->numThreads, 1e-9)
+	);
+
+	if (numBuilt == 0) {
+		return;
+	}
+
+	std::sort(built.begin(), built.end(), [&](uint32_t a, uint32_t b) {
+		return this->nodes[a].seconds > this->nodes[b].seconds;
+	});
+	built.resize(std::min(built.size(), numSlowest));
+	for (auto i : built) {
+		auto &node = this->nodes[i];
+		fprintf(file, "  %9.1f ms  %s\n", 1000.0 * node.seconds, node.name.c_str());
+	}
+
+	if (last == BuildGraph::NO_NODE) {
+		return;
+	}
+	std::vector<uint32_t> path;
+	for (auto i = last; i != BuildGraph::NO_NODE; i = this->nodes[i].pathPrevious) {
+		path.push_back(i);
+	}
+	fprintf(
+		file, "critical path: %.1f ms through %zu nodes\n",
+		1000.0 * this->nodes[last].pathSeconds, path.size()
+	);
+	for (auto i = path.rbegin(); i != path.rend(); i++) {
+		auto &node = this->nodes[*i];
+		fprintf(file, "  %9.1f ms  %s\n", 1000.0 * node.seconds, node.name.c_str());
+	}
+}
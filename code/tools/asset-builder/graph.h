@@ -0,0 +1,73 @@
+#pragma once
+#include "cache.h"
+#include "platform.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef HRESULT (*BuildFunction)(const char *sourcePath, const char *targetPath);
+
+// One step of the build, which turns its inputs into its outputs. The first input is the source
+// and the first output the target that the build function is given, and the rest are only
+// looked at to decide whether the step is up to date, like a shader's includes. The parameters
+// describe everything else that changes the outputs, like the kind of step and its settings.
+struct BuildNode {
+	std::string name;
+	BuildFunction build;
+	std::string parameters;
+	std::vector<std::string> inputs;
+	std::vector<std::string> outputs;
+
+	// the nodes that write this one's inputs, and the ones that read its outputs
+	std::vector<uint32_t> dependencies;
+	std::vector<uint32_t> dependents;
+
+	HRESULT result;
+	bool built;
+	bool fetched;
+	double seconds;
+
+	// the longest chain of work that ends with this node, and the node before it on that chain
+	double pathSeconds;
+	uint32_t pathPrevious;
+};
+
+// Runs build steps on a pool of threads, each as soon as the steps that write its inputs have
+// finished. A step is skipped when its outputs were last made from the same inputs, and its
+// outputs are copied out of the cache when they were built before anywhere else. A failed step
+// fails everything downstream of it without running it.
+struct BuildGraph {
+	static const uint32_t NO_NODE = 0xffffffff;
+
+	std::vector<BuildNode> nodes;
+	uint32_t numThreads;
+	double seconds;
+
+	uint32_t addNode(
+		const char *name, BuildFunction build, const char *parameters,
+		const char *source, const char *target
+	);
+	void addInput(uint32_t node, const char *path);
+	void addOutput(uint32_t node, const char *path);
+
+	// Connects each node to the ones that write its inputs. Fails when two nodes write the same
+	// file or the nodes depend on each other in a cycle.
+	HRESULT link();
+
+	// Runs every node, with all of the hardware threads when numThreads is zero, and returns the
+	// first failure.
+	HRESULT run(uint32_t numThreads, BuildCache *cache);
+
+	// Marks the nodes that read path, and every node downstream of them. Returns whether any node
+	// reads it.
+	bool markDirty(const std::string &path, std::vector<bool> *dirty) const;
+
+	// Runs only the marked nodes, like run does. The rest keep what the last run left them with,
+	// and count as finished for the marked nodes that depend on them.
+	HRESULT run(uint32_t numThreads, BuildCache *cache, const std::vector<bool> *dirty);
+
+	// Prints the slowest nodes, the critical path and how well the build used its threads.
+	void report(FILE *file, size_t numSlowest) const;
+};
@@ -0,0 +1,96 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "hash.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+static const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+static const uint64_t PRIME3 = 0x165667b19e3779f9ull;
+static const uint64_t PRIME4 = 0x85ebca77c2b2ae63ull;
+static const uint64_t PRIME5 = 0x27d4eb2f165667c5ull;
+
+static uint64_t rotl(uint64_t x, int r) {
+	return x << r | x >> (64 - r);
+}
+
+static uint64_t read64(const uint8_t *p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t read32(const uint8_t *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t round(uint64_t acc, uint64_t input) {
+	return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+static uint64_t mergeRound(uint64_t acc, uint64_t value) {
+	return (acc ^ round(0, value)) * PRIME1 + PRIME4;
+}
+
+uint64_t hash64(const void *data, size_t size, uint64_t seed) {
+	auto p = (const uint8_t*)data;
+	auto end = p + size;
+
+	uint64_t h;
+	if (size >= 32) {
+		uint64_t v[4] = { seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1 };
+		for (; p + 32 <= end; p += 32) {
+			for (int i = 0; i < 4; i++) {
+				v[i] = round(v[i], read64(p + 8 * i));
+			}
+		}
+		h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+		for (int i = 0; i < 4; i++) {
+			h = mergeRound(h, v[i]);
+		}
+	} else {
+		h = seed + PRIME5;
+	}
+	h += size;
+
+	for (; p + 8 <= end; p += 8) {
+		h = rotl(h ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h = rotl(h ^ read32(p) * PRIME1, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h = rotl(h ^ *p * PRIME5, 11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+bool hashFile(const char *path, uint64_t *hash, uint64_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+
+	std::vector<uint8_t> buffer(1024 * 1024);
+	uint64_t h = 0;
+	*size = 0;
+	size_t read;
+	while ((read = fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+		h = hash64(buffer.data(), read, h);
+		*size += read;
+	}
+	auto complete = ferror(file) == 0;
+	fclose(file);
+
+	*hash = h;
+	return complete;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// XXH64, which hashes at memory speed and is good enough to key build outputs by their inputs.
+uint64_t hash64(const void *data, size_t size, uint64_t seed);
+
+// Hashes a file in chunks, each seeded with the hash of the ones before it.
+bool hashFile(const char *path, uint64_t *hash, uint64_t *size);
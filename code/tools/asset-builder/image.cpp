@@ -0,0 +1,295 @@
+#include "image.h"
+#include "simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float PI = 3.14159265f;
+
+// taps on each side of a destination pixel, in source pixels when halving
+static const int FILTER_RADIUS = 4;
+
+bool decodeTga(const uint8_t *data, size_t size, Image *image) {
+	if (size < 18) {
+		return false;
+	}
+
+	auto idLength = data[0];
+	auto colorMapType = data[1];
+	auto imageType = data[2];
+	auto width = (uint32_t)(data[12] | data[13] << 8);
+	auto height = (uint32_t)(data[14] | data[15] << 8);
+	auto bitsPerPixel = data[16];
+	auto topFirst = (data[17] & 0x20) != 0;
+
+	auto rle = imageType == 10 || imageType == 11;
+	auto gray = imageType == 3 || imageType == 11;
+	if (
+		colorMapType != 0 || width == 0 || height == 0 ||
+		(imageType != 2 && imageType != 3 && imageType != 10 && imageType != 11) ||
+		(gray && bitsPerPixel != 8) || (!gray && bitsPerPixel != 24 && bitsPerPixel != 32)
+	) {
+		return false;
+	}
+
+	auto bytesPerPixel = bitsPerPixel / 8u;
+	size_t offset = 18 + idLength;
+	size_t numPixels = (size_t)width * height;
+
+	image->width = width;
+	image->height = height;
+	image->pixels.resize(4 * numPixels);
+
+	auto readPixel = [&](size_t i) {
+		auto source = data + offset;
+		auto row = i / width;
+		auto y = topFirst ? row : height - 1 - row;
+		auto target = &image->pixels[4 * (y * width + i % width)];
+		if (gray) {
+			target[0] = target[1] = target[2] = source[0];
+			target[3] = 255;
+		} else {
+			target[0] = source[2];
+			target[1] = source[1];
+			target[2] = source[0];
+			target[3] = bytesPerPixel == 4 ? source[3] : 255;
+		}
+	};
+
+	size_t i = 0;
+	while (i < numPixels) {
+		size_t count = 1;
+		auto repeat = false;
+		if (rle) {
+			if (offset >= size) {
+				return false;
+			}
+			auto packet = data[offset++];
+			count = (packet & 0x7f) + 1u;
+			repeat = (packet & 0x80) != 0;
+		}
+		if (count > numPixels - i) {
+			return false;
+		}
+
+		if (repeat) {
+			if (bytesPerPixel > size - offset) {
+				return false;
+			}
+			for (size_t j = 0; j < count; j++) {
+				readPixel(i++);
+			}
+			offset += bytesPerPixel;
+		} else {
+			if (count * bytesPerPixel > size - offset) {
+				return false;
+			}
+			for (size_t j = 0; j < count; j++) {
+				readPixel(i++);
+				offset += bytesPerPixel;
+			}
+		}
+	}
+
+	return true;
+}
+
+struct SrgbTables {
+	float decode[256];
+
+	// the linear values halfway between neighbouring codes, so encoding rounds to the nearest
+	float thresholds[255];
+
+	SrgbTables() {
+		for (int i = 0; i < 256; i++) {
+			auto c = i / 255.0f;
+			this->decode[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 255; i++) {
+			this->thresholds[i] = 0.5f * (this->decode[i] + this->decode[i + 1]);
+		}
+	}
+};
+
+static const SrgbTables *getSrgbTables() {
+	static SrgbTables tables;
+	return &tables;
+}
+
+float srgbToLinear(uint8_t value) {
+	return getSrgbTables()->decode[value];
+}
+
+uint8_t linearToSrgb(float value) {
+	auto thresholds = getSrgbTables()->thresholds;
+	return (uint8_t)(std::upper_bound(thresholds, thresholds + 255, value) - thresholds);
+}
+
+static float sinc(float x) {
+	if (fabsf(x) < 1e-6f) {
+		return 1.0f;
+	}
+	return sinf(PI * x) / (PI * x);
+}
+
+static float lanczos(float x) {
+	return fabsf(x) < 2.0f ? sinc(x) * sinc(0.5f * x) : 0.0f;
+}
+
+// The source pixels and normalized weights that make up each destination pixel along one axis.
+struct FilterTaps {
+	std::vector<uint32_t> indices;
+	std::vector<float> weights;
+};
+
+static void makeTaps(uint32_t sourceSize, uint32_t targetSize, bool wrap, FilterTaps *taps) {
+	const int numTaps = 2 * FILTER_RADIUS;
+	taps->indices.resize(targetSize * numTaps);
+	taps->weights.resize(targetSize * numTaps);
+
+	auto scale = (float)sourceSize / targetSize;
+	for (uint32_t i = 0; i < targetSize; i++) {
+		auto center = (i + 0.5f) * scale - 0.5f;
+		auto first = (int)floorf(center) - FILTER_RADIUS + 1;
+
+		float total = 0.0f;
+		for (int t = 0; t < numTaps; t++) {
+			auto x = first + t;
+			auto weight = lanczos((x - center) / scale);
+
+			int index;
+			if (wrap) {
+				index = ((x % (int)sourceSize) + (int)sourceSize) % (int)sourceSize;
+			} else {
+				index = std::min(std::max(x, 0), (int)sourceSize - 1);
+			}
+
+			taps->indices[i * numTaps + t] = (uint32_t)index;
+			taps->weights[i * numTaps + t] = weight;
+			total += weight;
+		}
+		for (int t = 0; t < numTaps; t++) {
+			taps->weights[i * numTaps + t] /= total;
+		}
+	}
+}
+
+// Filters lines of 4-channel pixels, where strides step from one line to the next and steps from
+// one pixel to the next along a line, so the same loop filters rows and columns.
+static void filterLines(
+	const float *source, size_t sourceStride, size_t sourceStep, uint32_t numLines,
+	const FilterTaps *taps, uint32_t targetSize, float *target, size_t targetStride,
+	size_t targetStep
+) {
+	const int numTaps = 2 * FILTER_RADIUS;
+	for (uint32_t line = 0; line < numLines; line++) {
+		auto sourceLine = source + line * sourceStride;
+		auto targetLine = target + line * targetStride;
+		for (uint32_t i = 0; i < targetSize; i++) {
+			auto indices = &taps->indices[i * numTaps];
+			auto weights = &taps->weights[i * numTaps];
+#if defined(SIMD_SSE)
+			auto sum = _mm_setzero_ps();
+			for (int t = 0; t < numTaps; t++) {
+				auto pixel = _mm_loadu_ps(sourceLine + indices[t] * sourceStep);
+				sum = _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_set1_ps(weights[t])));
+			}
+			_mm_storeu_ps(targetLine + i * targetStep, sum);
+#else
+			float sum[4] = {};
+			for (int t = 0; t < numTaps; t++) {
+				auto pixel = sourceLine + indices[t] * sourceStep;
+				for (int c = 0; c < 4; c++) {
+					sum[c] += pixel[c] * weights[t];
+				}
+			}
+			memcpy(targetLine + i * targetStep, sum, sizeof(sum));
+#endif
+		}
+	}
+}
+
+static void toLinear(const Image *image, const MipSettings *settings, std::vector<float> *out) {
+	auto numPixels = (size_t)image->width * image->height;
+	out->resize(4 * numPixels);
+	for (size_t i = 0; i < 4 * numPixels; i++) {
+		auto value = image->pixels[i];
+		(*out)[i] = settings->srgb && i % 4 != 3 ? srgbToLinear(value) : value / 255.0f;
+	}
+}
+
+static uint8_t toUnorm(float value) {
+	return (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void fromLinear(
+	const float *pixels, uint32_t width, uint32_t height, const MipSettings *settings, Image *out
+) {
+	auto numPixels = (size_t)width * height;
+	out->width = width;
+	out->height = height;
+	out->pixels.resize(4 * numPixels);
+	for (size_t i = 0; i < numPixels; i++) {
+		float pixel[4];
+		memcpy(pixel, pixels + 4 * i, sizeof(pixel));
+
+		if (settings->normalMap) {
+			float v[3];
+			for (int c = 0; c < 3; c++) {
+				v[c] = 2.0f * pixel[c] - 1.0f;
+			}
+			auto length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			for (int c = 0; c < 3; c++) {
+				pixel[c] = length > 0.0f ? 0.5f * v[c] / length + 0.5f : 0.5f;
+			}
+		}
+
+		auto target = &out->pixels[4 * i];
+		for (int c = 0; c < 3; c++) {
+			target[c] = settings->srgb ? linearToSrgb(pixel[c]) : toUnorm(pixel[c]);
+		}
+		target[3] = toUnorm(pixel[3]);
+	}
+}
+
+void generateMips(const Image *image, const MipSettings *settings, std::vector<Image> *mips) {
+	mips->clear();
+	mips->push_back(*image);
+
+	std::vector<float> source;
+	std::vector<float> rows;
+	std::vector<float> target;
+	toLinear(image, settings, &source);
+
+	auto width = image->width;
+	auto height = image->height;
+	FilterTaps horizontal;
+	FilterTaps vertical;
+	while (width > 1 || height > 1) {
+		auto nextWidth = std::max(width / 2, 1u);
+		auto nextHeight = std::max(height / 2, 1u);
+		makeTaps(width, nextWidth, settings->wrap, &horizontal);
+		makeTaps(height, nextHeight, settings->wrap, &vertical);
+
+		// rows first into a nextWidth x height image, then columns of that
+		rows.resize(4 * (size_t)nextWidth * height);
+		filterLines(
+			source.data(), 4 * (size_t)width, 4, height, &horizontal, nextWidth,
+			rows.data(), 4 * (size_t)nextWidth, 4
+		);
+		target.resize(4 * (size_t)nextWidth * nextHeight);
+		filterLines(
+			rows.data(), 4, 4 * (size_t)nextWidth, nextWidth, &vertical, nextHeight,
+			target.data(), 4, 4 * (size_t)nextWidth
+		);
+
+		Image mip;
+		fromLinear(target.data(), nextWidth, nextHeight, settings, &mip);
+		mips->push_back(mip);
+
+		// each level is filtered from the unquantized one before it
+		source.swap(target);
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Tightly packed 8-bit RGBA, top row first.
+struct Image {
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> pixels;
+};
+
+struct MipSettings {
+	// color channels are sRGB encoded and filtered in linear space, alpha is always linear
+	bool srgb;
+
+	// RGB holds a unit vector in [-1, 1], which is renormalized after filtering
+	bool normalMap;
+
+	// the image tiles, so filters wrap around its edges instead of clamping
+	bool wrap;
+};
+
+// Reads an uncompressed or run-length encoded true-color TGA, with or without alpha.
+bool decodeTga(const uint8_t *data, size_t size, Image *image);
+
+// Fills in every level down to 1x1, starting with a copy of the image itself. Each level is
+// filtered from the one before with a separable Lanczos kernel.
+void generateMips(const Image *image, const MipSettings *settings, std::vector<Image> *mips);
+
+float srgbToLinear(uint8_t value);
+uint8_t linearToSrgb(float value);
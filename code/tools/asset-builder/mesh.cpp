@@ -1,7 +1,18 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define NOMINMAX
 #include "mesh.h"
+#include "anim.h"
+#include "hash.h"
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -46,34 +57,655 @@ struct Vertex {
 	Vector3 position;
 	Vector3 normal;
 	Vector2 texcoord;
+	uint8_t joints[4];
+	uint8_t weights[4];
 };
 
+// everything but the position, which is the second stream of a split mesh
+struct VertexAttributes {
+	Vector3 normal;
+	Vector2 texcoord;
+	uint8_t joints[4];
+	uint8_t weights[4];
+};
+
+static const uint32_t MESH_MAGIC = 'M' | 'E' << 8 | 'S' << 16 | 'H' << 24;
+
+// the version says how vertices are laid out and whether groups are instanced, so meshes without
+// copies are as they always were
+static const uint32_t MESH_VERSION = 1;
+static const uint32_t MESH_VERSION_SPLIT = 2;
+static const uint32_t MESH_VERSION_INSTANCED = 3;
+static const uint32_t MESH_VERSION_SPLIT_INSTANCED = 4;
+
+// One for every group of an instanced mesh, after the geometry. A group whose source is itself is
+// stored, and the rest are drawn from their source with its positions and normals transformed by
+// a row-major 3x4 matrix.
+struct MeshInstance {
+	uint32_t source;
+	float transform[12];
+};
+
+static const float IDENTITY_TRANSFORM[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+// how far a rigid copy's normals may turn out from the ones it had
+static const float RIGID_NORMAL_TOLERANCE = 1e-3f;
+
+static Vector3 subtract(const Vector3 &a, const Vector3 &b) {
+	return Vector3 { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static Vector3 cross(const Vector3 &a, const Vector3 &b) {
+	return Vector3 { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static float dot(const Vector3 &a, const Vector3 &b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static Vector3 normalize(const Vector3 &v) {
+	auto scale = 1.0f / sqrtf(dot(v, v));
+	return Vector3 { v.x * scale, v.y * scale, v.z * scale };
+}
+
+// A point or direction through a row-major 3x4 matrix, with or without its translation.
+static Vector3 applyTransform(const float *m, const Vector3 &v, float w) {
+	return Vector3 {
+		m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * w,
+		m[4] * v.x + m[5] * v.y + m[6] * v.z + m[7] * w,
+		m[8] * v.x + m[9] * v.y + m[10] * v.z + m[11] * w,
+	};
+}
+
+struct Segment {
+	uint8_t joint;
+	Vector3 start;
+	Vector3 end;
+};
+
+static float getDistanceSquared(const Vector3 &p, const Segment &segment) {
+	Vector3 d = {
+		segment.end.x - segment.start.x,
+		segment.end.y - segment.start.y,
+		segment.end.z - segment.start.z,
+	};
+	Vector3 v = { p.x - segment.start.x, p.y - segment.start.y, p.z - segment.start.z };
+	auto length = d.x * d.x + d.y * d.y + d.z * d.z;
+	auto t = length > 0.0f ? (v.x * d.x + v.y * d.y + v.z * d.z) / length : 0.0f;
+	t = std::min(std::max(t, 0.0f), 1.0f);
+	v.x -= t * d.x;
+	v.y -= t * d.y;
+	v.z -= t * d.z;
+	return v.x * v.x + v.y * v.y + v.z * v.z;
+}
+
+struct Skeleton {
+	size_t numJoints;
+	std::vector<Segment> segments;
+};
+
+// Finds the bones of the skeleton in its rest pose. Each joint owns the segments to its children,
+// except children with position channels, which move freely.
+static HRESULT loadSkeleton(const char *skeletonPath, Skeleton *out) {
+	HRESULT hr;
+
+	BvhSkeleton skeleton;
+	if (FAILED(hr = loadBvh(skeletonPath, &skeleton))) {
+		return hr;
+	}
+	if (skeleton.joints.size() > UINT8_MAX) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	std::vector<float> positions;
+	getRestPositions(&skeleton, &positions);
+	auto position = [&](size_t joint) {
+		return Vector3 { positions[3 * joint], positions[3 * joint + 1], positions[3 * joint + 2] };
+	};
+
+	auto &segments = out->segments;
+	segments.clear();
+	for (size_t j = 0; j < skeleton.joints.size(); j++) {
+		auto &joint = skeleton.joints[j];
+		if (joint.hasEnd) {
+			auto start = position(j);
+			Vector3 end = { start.x + joint.end[0], start.y + joint.end[1], start.z + joint.end[2] };
+			segments.push_back(Segment { (uint8_t)j, start, end });
+		}
+
+		auto moves = false;
+		for (uint32_t i = 0; i < joint.numChannels; i++) {
+			moves = moves || joint.channels[i] < 3;
+		}
+		if (joint.parent >= 0 && !moves) {
+			segments.push_back(Segment { (uint8_t)joint.parent, position(joint.parent), position(j) });
+		}
+	}
+	if (segments.empty()) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	out->numJoints = skeleton.joints.size();
+	return S_OK;
+}
+
+// Skins every vertex to the (up to) four nearest bones of the skeleton.
+static void computeSkinWeights(const Skeleton *skeleton, std::vector<Vertex> *vertices) {
+	std::vector<float> distances(skeleton->numJoints);
+	std::vector<uint8_t> nearest(skeleton->numJoints);
+	for (auto &vertex : *vertices) {
+		std::fill(distances.begin(), distances.end(), FLT_MAX);
+		for (auto &segment : skeleton->segments) {
+			auto distance = getDistanceSquared(vertex.position, segment);
+			distances[segment.joint] = std::min(distances[segment.joint], distance);
+		}
+
+		for (size_t j = 0; j < nearest.size(); j++) {
+			nearest[j] = (uint8_t)j;
+		}
+		auto count = std::min(nearest.size(), (size_t)4);
+		std::partial_sort(
+			nearest.begin(), nearest.begin() + count, nearest.end(),
+			[&](uint8_t a, uint8_t b) {
+				// ties go to the lower joint, so every standard library picks the same bones
+				return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+			}
+		);
+
+		// weights fall off with the fourth power of distance, so a bone only shares the vertices
+		// near where it meets its neighbours
+		float weights[4] = {};
+		auto sum = 0.0f;
+		for (size_t i = 0; i < count && distances[nearest[i]] < FLT_MAX; i++) {
+			auto d = std::max(distances[nearest[i]], 1e-4f);
+			weights[i] = 1.0f / (d * d);
+			sum += weights[i];
+		}
+
+		uint32_t total = 0;
+		for (size_t i = 0; i < 4; i++) {
+			vertex.joints[i] = i < count ? nearest[i] : 0;
+			vertex.weights[i] = (uint8_t)(weights[i] / sum * UINT8_MAX);
+			total += vertex.weights[i];
+		}
+		vertex.weights[0] += (uint8_t)(UINT8_MAX - total);
+	}
+}
+
+// the skeleton lives next to the mesh under the same name
+static HRESULT loadMeshSkeleton(const char *sourcePath, Skeleton *skeleton) {
+	std::string skeletonPath = sourcePath;
+	skeletonPath.replace(skeletonPath.size() - 3, 3, "bvh");
+	return loadSkeleton(skeletonPath.c_str(), skeleton);
+}
+
 struct Group {
 	std::string name;
 	std::vector<Vertex> vertices;
 	std::vector<uint16_t> indices;
+	std::unordered_map<VertexIndices, uint16_t> vertexIndices;
+	size_t numCorners;
+};
+
+// A group takes faces until their corners could give it more vertices than 16-bit indices reach,
+// and then the rest of the OBJ group goes on in a new one.
+static const size_t MAX_GROUP_CORNERS = std::numeric_limits<uint16_t>::max();
+
+// The attributes faces index, from 1 like in the OBJ.
+struct ObjAttributes {
+	const Vector3 *positions;
+	size_t numPositions;
+	const Vector2 *texcoords;
+	size_t numTexcoords;
+	const Vector3 *normals;
+	size_t numNormals;
 };
 
+// Reads the corners of a face, which is a triangle or a quad, and returns how many it has.
+static int parseFace(const char *line, VertexIndices *vi) {
+	auto count = sscanf(
+		line, "f %zd/%zd/%zd %zd/%zd/%zd %zd/%zd/%zd %zd/%zd/%zd",
+		&vi[0].position, &vi[0].texcoord, &vi[0].normal,
+		&vi[1].position, &vi[1].texcoord, &vi[1].normal,
+		&vi[2].position, &vi[2].texcoord, &vi[2].normal,
+		&vi[3].position, &vi[3].texcoord, &vi[3].normal
+	);
+	return std::max(count, 0) / 3;
+}
+
+// Adds a face to the group, which has to have room for its corners. Fails for corners that index
+// past the attributes.
+static bool addFace(
+	const ObjAttributes *attributes, const VertexIndices *vi, int numCorners, Group *group
+) {
+	assert(group->numCorners + numCorners <= MAX_GROUP_CORNERS);
+	group->numCorners += numCorners;
+
+	uint16_t faceIndices[4] = {};
+	for (int i = 0; i < numCorners; i++) {
+		uint16_t index = 0;
+
+		auto vertex = group->vertexIndices.find(vi[i]);
+		if (vertex != group->vertexIndices.end()) {
+			index = vertex->second;
+		} else {
+			if (
+				vi[i].position - 1 >= attributes->numPositions ||
+				vi[i].normal - 1 >= attributes->numNormals ||
+				vi[i].texcoord - 1 >= attributes->numTexcoords
+			) {
+				return false;
+			}
+
+			Vertex v = {};
+			v.position = attributes->positions[vi[i].position - 1];
+			v.normal = attributes->normals[vi[i].normal - 1];
+			v.texcoord = attributes->texcoords[vi[i].texcoord - 1];
+
+			index = (uint16_t)group->vertices.size();
+			group->vertices.push_back(v);
+
+			group->vertexIndices[vi[i]] = index;
+		}
+
+		faceIndices[i] = index;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		group->indices.push_back(faceIndices[i]);
+	}
+	if (numCorners == 4) {
+		for (int i = 2; i < 5; i++) {
+			group->indices.push_back(faceIndices[i % 4]);
+		}
+	}
+	return true;
+}
+
+// Starts the next group, which keeps the name of the one before unless it's given a new one.
+static void resetGroup(Group *group, const char *name) {
+	if (name) {
+		group->name = name;
+	}
+	group->vertices.clear();
+	group->indices.clear();
+	group->vertexIndices.clear();
+	group->numCorners = 0;
+}
+
+// Reads a "g name" line.
+static std::string parseGroupName(const char *line) {
+	char name[256] = {};
+	sscanf(line, "g %255s", name);
+	return name;
+}
+
+static bool writeGroup(FILE *file, const Group *group, MeshLayout layout) {
+	auto numVertices = group->vertices.size();
+	auto numIndices = group->indices.size();
+	auto complete = true;
+	if (layout == MESH_SPLIT) {
+		std::vector<Vector3> positions(numVertices);
+		std::vector<VertexAttributes> attributes(numVertices);
+		for (size_t i = 0; i < numVertices; i++) {
+			auto &vertex = group->vertices[i];
+			positions[i] = vertex.position;
+			attributes[i].normal = vertex.normal;
+			attributes[i].texcoord = vertex.texcoord;
+			memcpy(attributes[i].joints, vertex.joints, sizeof(vertex.joints));
+			memcpy(attributes[i].weights, vertex.weights, sizeof(vertex.weights));
+		}
+		complete =
+			fwrite(positions.data(), sizeof(Vector3), numVertices, file) == numVertices &&
+			fwrite(attributes.data(), sizeof(VertexAttributes), numVertices, file) == numVertices;
+	} else {
+		complete = fwrite(group->vertices.data(), sizeof(Vertex), numVertices, file) == numVertices;
+	}
+	return
+		complete &&
+		fwrite(group->indices.data(), sizeof(uint16_t), numIndices, file) == numIndices;
+}
+
+static uint64_t getGroupSize(size_t numVertices, size_t numIndices) {
+	return (uint64_t)numVertices * sizeof(Vertex) + (uint64_t)numIndices * sizeof(uint16_t);
+}
+
+// Reads back a group that's already written, into one sized for its counts.
+static bool readGroup(FILE *file, uint64_t offset, MeshLayout layout, Group *group) {
+	auto numVertices = group->vertices.size();
+	auto numIndices = group->indices.size();
+	if (FAILED(seekFile(file, offset))) {
+		return false;
+	}
+
+	auto complete = true;
+	if (layout == MESH_SPLIT) {
+		std::vector<Vector3> positions(numVertices);
+		std::vector<VertexAttributes> attributes(numVertices);
+		complete =
+			fread(positions.data(), sizeof(Vector3), numVertices, file) == numVertices &&
+			fread(attributes.data(), sizeof(VertexAttributes), numVertices, file) == numVertices;
+		for (size_t i = 0; i < numVertices && complete; i++) {
+			auto &vertex = group->vertices[i];
+			vertex.position = positions[i];
+			vertex.normal = attributes[i].normal;
+			vertex.texcoord = attributes[i].texcoord;
+			memcpy(vertex.joints, attributes[i].joints, sizeof(vertex.joints));
+			memcpy(vertex.weights, attributes[i].weights, sizeof(vertex.weights));
+		}
+	} else {
+		complete = fread(group->vertices.data(), sizeof(Vertex), numVertices, file) == numVertices;
+	}
+	return
+		complete &&
+		fread(group->indices.data(), sizeof(uint16_t), numIndices, file) == numIndices;
+}
+
+// Hashes what a copy has to share with the group it's drawn from: its indices and everything but
+// positions and normals, which for exact copies are hashed as well.
+static uint64_t hashGroup(const Group *group, MeshDedup dedup) {
+	std::vector<uint8_t> shared;
+	shared.reserve(group->vertices.size() * sizeof(Vertex));
+	for (auto &vertex : group->vertices) {
+		auto first = (const uint8_t*)&vertex.texcoord;
+		shared.insert(shared.end(), first, (const uint8_t*)(&vertex + 1));
+		if (dedup == MESH_DEDUP_EXACT) {
+			auto position = (const uint8_t*)&vertex.position;
+			shared.insert(shared.end(), position, first);
+		}
+	}
+	auto hash = hash64(group->indices.data(), group->indices.size() * sizeof(uint16_t), 0);
+	return hash64(shared.data(), shared.size(), hash);
+}
+
+// Finds the rotation and translation that take the source's positions onto the copy's, from
+// frames on three of its vertices that are far apart, and checks every vertex against it. A
+// source with all its positions on a line is only matched moved.
+static bool findRigidTransform(const Group *source, const Group *copy, float *transform) {
+	auto &from = source->vertices;
+	auto &to = copy->vertices;
+	size_t farVertex = 0;
+	auto farthest = 0.0f;
+	for (size_t i = 0; i < from.size(); i++) {
+		auto d = subtract(from[i].position, from[0].position);
+		if (dot(d, d) > farthest) {
+			farthest = dot(d, d);
+			farVertex = i;
+		}
+	}
+	size_t sideVertex = 0;
+	auto largest = 0.0f;
+	auto edge = subtract(from[farVertex].position, from[0].position);
+	for (size_t i = 0; i < from.size(); i++) {
+		auto normal = cross(edge, subtract(from[i].position, from[0].position));
+		if (dot(normal, normal) > largest) {
+			largest = dot(normal, normal);
+			sideVertex = i;
+		}
+	}
+
+	memcpy(transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM));
+	if (largest > 1e-12f * farthest * farthest) {
+		auto getFrame = [&](const std::vector<Vertex> &vertices, Vector3 *axes) {
+			auto x = subtract(vertices[farVertex].position, vertices[0].position);
+			auto y = subtract(vertices[sideVertex].position, vertices[0].position);
+			axes[0] = normalize(x);
+			axes[2] = normalize(cross(x, y));
+			axes[1] = cross(axes[2], axes[0]);
+		};
+		Vector3 fromAxes[3];
+		Vector3 toAxes[3];
+		getFrame(from, fromAxes);
+		getFrame(to, toAxes);
+
+		// the rotation takes each axis of the source's frame to the same axis of the copy's
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				auto &sum = transform[4 * r + c];
+				sum = 0.0f;
+				for (int i = 0; i < 3; i++) {
+					sum += (&toAxes[i].x)[r] * (&fromAxes[i].x)[c];
+				}
+			}
+		}
+	}
+	auto moved = applyTransform(transform, from[0].position, 1.0f);
+	transform[3] = to[0].position.x - moved.x;
+	transform[7] = to[0].position.y - moved.y;
+	transform[11] = to[0].position.z - moved.z;
+
+	// written so that a copy too flat for its frame, which gives NaNs, fails
+	auto tolerance = MESH_RIGID_TOLERANCE * std::max(sqrtf(farthest), 1.0f);
+	for (size_t i = 0; i < from.size(); i++) {
+		auto position = applyTransform(transform, from[i].position, 1.0f);
+		auto normal = applyTransform(transform, from[i].normal, 0.0f);
+		auto positionError = subtract(position, to[i].position);
+		auto normalError = subtract(normal, to[i].normal);
+		if (
+			!(dot(positionError, positionError) <= tolerance * tolerance) ||
+			!(dot(normalError, normalError) <= RIGID_NORMAL_TOLERANCE * RIGID_NORMAL_TOLERANCE)
+		) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Whether a group can be drawn from one with the same counts, and with what transform.
+static bool isCopy(const Group *source, const Group *copy, MeshDedup dedup, float *transform) {
+	if (source->indices != copy->indices) {
+		return false;
+	}
+	auto exact = true;
+	for (size_t i = 0; i < source->vertices.size(); i++) {
+		auto &a = source->vertices[i];
+		auto &b = copy->vertices[i];
+		auto shared = sizeof(Vertex) - offsetof(Vertex, texcoord);
+		if (memcmp(&a.texcoord, &b.texcoord, shared) != 0) {
+			return false;
+		}
+		exact = exact && memcmp(&a, &b, offsetof(Vertex, texcoord)) == 0;
+	}
+
+	if (exact) {
+		memcpy(transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM));
+		return true;
+	}
+	return dedup == MESH_DEDUP_RIGID && findRigidTransform(source, copy, transform);
+}
+
+// what every mesh built so far left out, added to by the builds on each thread as they finish
+static std::atomic<uint64_t> dedupGroups(0);
+static std::atomic<uint64_t> dedupExact(0);
+static std::atomic<uint64_t> dedupRigid(0);
+static std::atomic<uint64_t> dedupSavedBytes(0);
+
+MeshDedupStats getMeshDedupStats() {
+	MeshDedupStats stats;
+	stats.numGroups = dedupGroups;
+	stats.numExact = dedupExact;
+	stats.numRigid = dedupRigid;
+	stats.savedBytes = dedupSavedBytes;
+	return stats;
+}
+
+void reportMeshDedup(FILE *file) {
+	auto stats = getMeshDedupStats();
+	fprintf(
+		file,
+		"meshes: %" PRIu64 " groups, %" PRIu64 " exact and %" PRIu64 " rigid copies, "
+		"%.1f MB saved\n",
+		stats.numGroups, stats.numExact, stats.numRigid, stats.savedBytes / 1048576.0
+	);
+}
+
+// Writes groups one after the other, leaving out the copies of groups already written. Groups
+// are looked up by hash, and only compared once read back from the target.
+struct GroupWriter {
+	struct Stored {
+		uint32_t index;
+		uint64_t offset;
+		size_t numVertices;
+		size_t numIndices;
+	};
+
+	FILE *file;
+	MeshLayout layout;
+	MeshDedup dedup;
+	uint64_t offset;
+	std::unordered_multimap<uint64_t, Stored> stored;
+	std::vector<MeshInstance> instances;
+
+	size_t numExact;
+	size_t numRigid;
+	uint64_t savedBytes;
+
+	static void create(
+		FILE *file, MeshLayout layout, MeshDedup dedup, uint64_t offset, GroupWriter *writer
+	) {
+		writer->file = file;
+		writer->layout = layout;
+		writer->dedup = dedup;
+		writer->offset = offset;
+		writer->numExact = 0;
+		writer->numRigid = 0;
+		writer->savedBytes = 0;
+	}
+
+	bool write(const Group *group) {
+		MeshInstance instance = {};
+		instance.source = (uint32_t)this->instances.size();
+		memcpy(instance.transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM));
+		auto numVertices = group->vertices.size();
+		auto numIndices = group->indices.size();
+		auto size = getGroupSize(numVertices, numIndices);
+
+		uint64_t hash = 0;
+		if (this->dedup != MESH_DEDUP_NONE) {
+			hash = hashGroup(group, this->dedup);
+			auto range = this->stored.equal_range(hash);
+			Group candidate;
+			for (auto i = range.first; i != range.second; i++) {
+				auto &stored = i->second;
+				if (stored.numVertices != numVertices || stored.numIndices != numIndices) {
+					continue;
+				}
+				candidate.vertices.resize(numVertices);
+				candidate.indices.resize(numIndices);
+				if (!readGroup(this->file, stored.offset, this->layout, &candidate)) {
+					return false;
+				}
+				if (isCopy(&candidate, group, this->dedup, instance.transform)) {
+					instance.source = stored.index;
+					break;
+				}
+			}
+
+			// reads and writes have to be separated by a seek
+			if (FAILED(seekFile(this->file, this->offset))) {
+				return false;
+			}
+		}
+
+		if (instance.source != this->instances.size()) {
+			auto exact = memcmp(
+				instance.transform, IDENTITY_TRANSFORM, sizeof(IDENTITY_TRANSFORM)
+			) == 0;
+			this->numExact += exact ? 1 : 0;
+			this->numRigid += exact ? 0 : 1;
+			this->savedBytes += size;
+			this->instances.push_back(instance);
+			return true;
+		}
+
+		if (!writeGroup(this->file, group, this->layout)) {
+			return false;
+		}
+		Stored stored = { instance.source, this->offset, numVertices, numIndices };
+		this->stored.emplace(hash, stored);
+		this->offset += size;
+		this->instances.push_back(instance);
+		return true;
+	}
+
+	// Writes the table of instances after the geometry when there were copies, and returns the
+	// version the header has to have.
+	bool finish(uint32_t *version) {
+		dedupGroups += this->instances.size();
+		dedupExact += this->numExact;
+		dedupRigid += this->numRigid;
+		dedupSavedBytes += this->savedBytes;
+
+		auto split = this->layout == MESH_SPLIT;
+		if (this->numExact + this->numRigid == 0) {
+			*version = split ? MESH_VERSION_SPLIT : MESH_VERSION;
+			return true;
+		}
+		*version = split ? MESH_VERSION_SPLIT_INSTANCED : MESH_VERSION_INSTANCED;
+
+		auto count = this->instances.size();
+		return fwrite(this->instances.data(), sizeof(MeshInstance), count, this->file) == count;
+	}
+};
+
+static MeshDedup getDedup() {
+	std::vector<char> value;
+	if (getEnv("MeshDedup", &value) == S_OK) {
+		if (strcmp(value.data(), "none") == 0) {
+			return MESH_DEDUP_NONE;
+		}
+		if (strcmp(value.data(), "rigid") == 0) {
+			return MESH_DEDUP_RIGID;
+		}
+	}
+	return MESH_DEDUP_EXACT;
+}
+
+static HRESULT buildMeshWithLayout(
+	const char *sourcePath, const char *targetPath, MeshLayout layout
+) {
+	HRESULT hr;
+
+	uint64_t size;
+	if (FAILED(hr = getFileSize(sourcePath, &size))) {
+		return hr;
+	}
+	if (size >= MESH_STREAMING_SIZE) {
+		return buildMeshStreaming(sourcePath, targetPath, layout, getDedup());
+	}
+	return buildMeshInMemory(sourcePath, targetPath, layout, getDedup());
+}
+
 HRESULT buildMesh(const char *sourcePath, const char *targetPath) {
+	return buildMeshWithLayout(sourcePath, targetPath, MESH_INTERLEAVED);
+}
+
+HRESULT buildSplitMesh(const char *sourcePath, const char *targetPath) {
+	return buildMeshWithLayout(sourcePath, targetPath, MESH_SPLIT);
+}
+
+HRESULT buildMeshInMemory(
+	const char *sourcePath, const char *targetPath, MeshLayout layout, MeshDedup dedup
+) {
 	HRESULT hr = S_OK;
 
 	std::vector<Vector3> positions;
 	std::vector<Vector2> texcoords;
 	std::vector<Vector3> normals;
 
-	std::string groupName;
 	std::vector<Group> groups;
-
-	std::unordered_map<VertexIndices, uint16_t> vertexIndices;
-	std::vector<Vertex> vertices;
-	std::vector<uint16_t> indices;
+	Group group;
+	resetGroup(&group, "");
 
 	FILE *file = fopen(sourcePath, "rb");
+	if (file == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
 	while (!feof(file)) {
 		char line[256] = {};
 		fgets(line, sizeof(line), file);
 		if (ferror(file)) {
-			hr = ERROR_FILE_CORRUPT;
+			hr = HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
 			break;
 		}
 
@@ -81,13 +713,7 @@ HRESULT buildMesh(const char *sourcePath, const char *targetPath) {
 			continue;
 		}
 
-#define STR2(x) #x
-#define STR(x) STR2(x)
-
-		if (strncmp(line, "mtllib ", 7) == 0) {
-			char path[MAX_PATH];
-			sscanf(line, "mtllib %" STR(MAX_PATH) "s", path);
-		} else if (strncmp(line, "v ", 2) == 0) {
+		if (strncmp(line, "v ", 2) == 0) {
 			Vector3 v;
 			sscanf(line, "v %f %f %f", &v.x, &v.y, &v.z);
 			positions.push_back(v);
@@ -100,104 +726,297 @@ HRESULT buildMesh(const char *sourcePath, const char *targetPath) {
 			sscanf(line, "vn %f %f %f", &v.x, &v.y, &v.z);
 			normals.push_back(v);
 		} else if (strncmp(line, "g ", 2) == 0) {
-			std::string oldName = std::move(groupName);
-
-			char name[256];
-			sscanf(line, "g %256s", name);
-			groupName = name;
-
-			auto group = Group { std::move(oldName), std::move(vertices), std::move(indices) };
-			if (group.vertices.empty()) {
-				continue;
+			// groups without faces are left out
+			if (!group.vertices.empty()) {
+				groups.push_back(std::move(group));
 			}
-
-			groups.emplace_back(std::move(group));
-			vertexIndices.clear();
-		} else if (strncmp(line, "usemtl ", 7) == 0) {
-			char name[256];
-			sscanf(line, "usemtl %256s", name);
-		} else if (strncmp(line, "s ", 2) == 0) {
-			int group;
-			sscanf(line, "s %d", &group);
+			resetGroup(&group, parseGroupName(line).c_str());
 		} else if (strncmp(line, "f ", 2) == 0) {
 			VertexIndices vi[4];
-			auto count = sscanf(
-				line, "f %zd/%zd/%zd %zd/%zd/%zd %zd/%zd/%zd %zd/%zd/%zd",
-				&vi[0].position, &vi[0].texcoord, &vi[0].normal,
-				&vi[1].position, &vi[1].texcoord, &vi[1].normal,
-				&vi[2].position, &vi[2].texcoord, &vi[2].normal,
-				&vi[3].position, &vi[3].texcoord, &vi[3].normal
-			);
-
-			auto numVertices = count / 3;
-			uint16_t faceIndices[4] = {};
-			for (int i = 0; i < numVertices; i++) {
-				uint16_t index = 0;
-
-				auto vertex = vertexIndices.find(vi[i]);
-				if (vertex != vertexIndices.end()) {
-					index = vertex->second;
-				} else {
-					Vertex v = {};
-					v.position = positions[vi[i].position - 1];
-					v.normal = normals[vi[i].normal - 1];
-					v.texcoord = texcoords[vi[i].texcoord - 1];
-
-					assert(vertices.size() < std::numeric_limits<uint16_t>::max());
-					index = (uint16_t)vertices.size();
-					vertices.push_back(v);
-
-					vertexIndices[vi[i]] = index;
-				}
-
-				faceIndices[i] = index;
+			auto numCorners = parseFace(line, vi);
+			if (group.numCorners + numCorners > MAX_GROUP_CORNERS) {
+				auto name = group.name;
+				groups.push_back(std::move(group));
+				resetGroup(&group, name.c_str());
 			}
 
-			for (int i = 0; i < 3; i++) {
-				indices.push_back(faceIndices[i]);
-			}
-			if (numVertices == 4) {
-				for (int i = 2; i < 5; i++) {
-					indices.push_back(faceIndices[i % 4]);
-				}
+			ObjAttributes attributes = {
+				positions.data(), positions.size(), texcoords.data(), texcoords.size(),
+				normals.data(), normals.size(),
+			};
+			if (!addFace(&attributes, vi, numCorners, &group)) {
+				hr = HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+				break;
 			}
 		}
 	}
 	fclose(file);
+	if (FAILED(hr)) {
+		return hr;
+	}
 
 	positions.clear();
 	texcoords.clear();
 	normals.clear();
+	groups.push_back(std::move(group));
 
-	auto group = Group { std::move(groupName), std::move(vertices), std::move(indices) };
-	groups.emplace_back(std::move(group));
-	vertexIndices.clear();
+	Skeleton skeleton;
+	if (FAILED(hr = loadMeshSkeleton(sourcePath, &skeleton))) {
+		return hr;
+	}
+	for (auto &group : groups) {
+		computeSkinWeights(&skeleton, &group.vertices);
+	}
 
-	file = fopen(targetPath, "wb");
+	// opened for reading too, to compare groups with the ones written before them
+	file = fopen(targetPath, "w+b");
 	if (file == NULL) {
-		return ERROR_FILE_NOT_FOUND;
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
 	}
 
+	uint32_t header[2] = { MESH_MAGIC, 0 };
 	size_t numGroups = groups.size();
-	assert(fwrite(&numGroups, sizeof(numGroups), 1, file) == 1);
+	auto complete =
+		fwrite(header, sizeof(header), 1, file) == 1 &&
+		fwrite(&numGroups, sizeof(numGroups), 1, file) == 1;
 
 	for (auto &group : groups) {
 		size_t numVertices = group.vertices.size();
-		assert(fwrite(&numVertices, sizeof(numVertices), 1, file) == 1);
-
 		size_t numIndices = group.indices.size();
-		assert(fwrite(&numIndices, sizeof(numIndices), 1, file) == 1);
+		complete =
+			complete &&
+			fwrite(&numVertices, sizeof(numVertices), 1, file) == 1 &&
+			fwrite(&numIndices, sizeof(numIndices), 1, file) == 1;
 	}
 
+	GroupWriter writer;
+	auto tableSize = sizeof(header) + sizeof(numGroups) + 2 * numGroups * sizeof(size_t);
+	GroupWriter::create(file, layout, dedup, tableSize, &writer);
 	for (auto &group : groups) {
-		size_t numVertices = group.vertices.size();
-		assert(fwrite(group.vertices.data(), sizeof(vertices[0]), numVertices, file) == numVertices);
+		complete = complete && writer.write(&group);
+	}
 
-		size_t numIndices = group.indices.size();
-		assert(fwrite(group.indices.data(), sizeof(indices[0]), numIndices, file) == numIndices);
+	// the version is only known once every group is written
+	complete =
+		complete &&
+		writer.finish(&header[1]) &&
+		fseek(file, 0, SEEK_SET) == 0 &&
+		fwrite(header, sizeof(header), 1, file) == 1;
+	complete = fclose(file) == 0 && complete;
+	if (!complete) {
+		remove(targetPath);
+		return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
 	}
 
-	fclose(file);
+	return S_OK;
+}
+
+// The attributes of an OBJ, written out as they're read so faces can index them from a mapping.
+struct AttributeSpill {
+	std::string paths[3];
+	FILE *files[3];
+	MappedFile mapped[3];
+};
+
+static void closeSpill(AttributeSpill *spill) {
+	for (int i = 0; i < 3; i++) {
+		if (spill->files[i]) {
+			fclose(spill->files[i]);
+			spill->files[i] = NULL;
+		}
+		unmapFile(&spill->mapped[i]);
+		remove(spill->paths[i].c_str());
+	}
+}
+
+// The first pass spills the attributes, and counts the groups the second pass will make, so the
+// table of groups can go before them.
+static HRESULT spillAttributes(FILE *source, AttributeSpill *spill, size_t *numGroups) {
+	*numGroups = 0;
+	size_t numCorners = 0;
+	auto complete = true;
+	while (!feof(source)) {
+		char line[256] = {};
+		fgets(line, sizeof(line), source);
+		if (ferror(source)) {
+			return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+		}
+
+		if (strncmp(line, "v ", 2) == 0) {
+			Vector3 v;
+			sscanf(line, "v %f %f %f", &v.x, &v.y, &v.z);
+			complete = complete && fwrite(&v, sizeof(v), 1, spill->files[0]) == 1;
+		} else if (strncmp(line, "vt ", 3) == 0) {
+			Vector2 v;
+			sscanf(line, "vt %f %f", &v.x, &v.y);
+			complete = complete && fwrite(&v, sizeof(v), 1, spill->files[1]) == 1;
+		} else if (strncmp(line, "vn ", 3) == 0) {
+			Vector3 v;
+			sscanf(line, "vn %f %f %f", &v.x, &v.y, &v.z);
+			complete = complete && fwrite(&v, sizeof(v), 1, spill->files[2]) == 1;
+		} else if (strncmp(line, "g ", 2) == 0) {
+			if (numCorners > 0) {
+				(*numGroups)++;
+			}
+			numCorners = 0;
+		} else if (strncmp(line, "f ", 2) == 0) {
+			VertexIndices vi[4];
+			auto corners = (size_t)parseFace(line, vi);
+			if (numCorners + corners > MAX_GROUP_CORNERS) {
+				(*numGroups)++;
+				numCorners = 0;
+			}
+			numCorners += corners;
+		}
+	}
+	(*numGroups)++;
+
+	for (int i = 0; i < 3; i++) {
+		complete = fclose(spill->files[i]) == 0 && complete;
+		spill->files[i] = NULL;
+	}
+	return complete ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+}
+
+// The second pass builds a group at a time, and writes each as soon as it's complete. Only its
+// counts are kept, for the table.
+static HRESULT writeGroups(
+	FILE *source, AttributeSpill *spill, const Skeleton *skeleton, GroupWriter *writer,
+	std::vector<size_t> *counts
+) {
+	ObjAttributes attributes = {
+		(const Vector3*)spill->mapped[0].data, spill->mapped[0].size / sizeof(Vector3),
+		(const Vector2*)spill->mapped[1].data, spill->mapped[1].size / sizeof(Vector2),
+		(const Vector3*)spill->mapped[2].data, spill->mapped[2].size / sizeof(Vector3),
+	};
+
+	Group group;
+	resetGroup(&group, "");
+	auto finishGroup = [&]() {
+		computeSkinWeights(skeleton, &group.vertices);
+		counts->push_back(group.vertices.size());
+		counts->push_back(group.indices.size());
+		auto written = writer->write(&group);
+
+		// the attributes this group touched are in the file, and don't have to stay in memory
+		for (int i = 0; i < 3; i++) {
+			releaseMappedPages(&spill->mapped[i]);
+		}
+		return written;
+	};
+
+	while (!feof(source)) {
+		char line[256] = {};
+		fgets(line, sizeof(line), source);
+		if (ferror(source)) {
+			return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+		}
+
+		auto written = true;
+		if (strncmp(line, "g ", 2) == 0) {
+			if (!group.vertices.empty()) {
+				written = finishGroup();
+			}
+			resetGroup(&group, parseGroupName(line).c_str());
+		} else if (strncmp(line, "f ", 2) == 0) {
+			VertexIndices vi[4];
+			auto numCorners = parseFace(line, vi);
+			if (group.numCorners + numCorners > MAX_GROUP_CORNERS) {
+				written = finishGroup();
+				resetGroup(&group, NULL);
+			}
+			if (!addFace(&attributes, vi, numCorners, &group)) {
+				return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+			}
+		}
+		if (!written) {
+			return HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+		}
+	}
+
+	return finishGroup() ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+}
+
+HRESULT buildMeshStreaming(
+	const char *sourcePath, const char *targetPath, MeshLayout layout, MeshDedup dedup
+) {
+	HRESULT hr;
+
+	Skeleton skeleton;
+	if (FAILED(hr = loadMeshSkeleton(sourcePath, &skeleton))) {
+		return hr;
+	}
+
+	FILE *source = fopen(sourcePath, "rb");
+	if (source == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	// the spills go next to the target, where there's room for what's built
+	AttributeSpill spill = {};
+	const char *suffixes[] = { ".positions", ".texcoords", ".normals" };
+	for (int i = 0; i < 3; i++) {
+		spill.paths[i] = std::string(targetPath) + suffixes[i];
+		spill.files[i] = fopen(spill.paths[i].c_str(), "wb");
+		if (spill.files[i] == NULL) {
+			fclose(source);
+			closeSpill(&spill);
+			return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+		}
+	}
+
+	size_t numGroups;
+	hr = spillAttributes(source, &spill, &numGroups);
+	for (int i = 0; i < 3 && SUCCEEDED(hr); i++) {
+		hr = mapFile(spill.paths[i].c_str(), &spill.mapped[i]);
+	}
+	if (FAILED(hr)) {
+		fclose(source);
+		closeSpill(&spill);
+		return hr;
+	}
+	rewind(source);
+
+	FILE *target = fopen(targetPath, "w+b");
+	if (target == NULL) {
+		fclose(source);
+		closeSpill(&spill);
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	// the version and the table are written with zeros, and filled in once every group is written
+	uint32_t header[2] = { MESH_MAGIC, 0 };
+	std::vector<size_t> counts(2 * numGroups);
+	auto complete =
+		fwrite(header, sizeof(header), 1, target) == 1 &&
+		fwrite(&numGroups, sizeof(numGroups), 1, target) == 1 &&
+		fwrite(counts.data(), sizeof(size_t), counts.size(), target) == counts.size();
+	counts.clear();
+
+	GroupWriter writer;
+	auto tableSize = sizeof(header) + sizeof(numGroups) + 2 * numGroups * sizeof(size_t);
+	GroupWriter::create(target, layout, dedup, tableSize, &writer);
+	hr = complete ? writeGroups(source, &spill, &skeleton, &writer, &counts) :
+		HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+	fclose(source);
+	closeSpill(&spill);
+	if (SUCCEEDED(hr) && counts.size() != 2 * numGroups) {
+		// the source changed between the passes
+		hr = HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+
+	complete =
+		SUCCEEDED(hr) &&
+		writer.finish(&header[1]) &&
+		fseek(target, 0, SEEK_SET) == 0 &&
+		fwrite(header, sizeof(header), 1, target) == 1 &&
+		fseek(target, (long)(sizeof(header) + sizeof(numGroups)), SEEK_SET) == 0 &&
+		fwrite(counts.data(), sizeof(size_t), counts.size(), target) == counts.size();
+	complete = fclose(target) == 0 && complete;
+	if (!complete) {
+		remove(targetPath);
+		return FAILED(hr) ? hr : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+	}
 
-	return hr;
+	return S_OK;
 }
@@ -1,4 +1,59 @@
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "platform.h"
+#include <cstdint>
+#include <cstdio>
 
+// Sources at least this large are streamed, rather than read into memory whole.
+static const uint64_t MESH_STREAMING_SIZE = 256ull << 20;
+
+// How a mesh's vertices are written. Interleaved meshes store each vertex whole. Split meshes
+// store each group's positions tightly packed, followed by the rest of its vertices' attributes,
+// which is how the game keeps them, so that passes that only need positions fetch 12 bytes a
+// vertex rather than 40.
+enum MeshLayout {
+	MESH_INTERLEAVED,
+	MESH_SPLIT,
+};
+
+// Which groups are only stored once. An exact copy has the same vertices and indices as a group
+// written before it. A rigid copy matches one once that's moved and turned, but not mirrored, and
+// its positions come out within MESH_RIGID_TOLERANCE of its size of where they were. Copies are
+// left out of the geometry, and a table after it gives each group the one it's drawn from and
+// the transform. Meshes without copies come out the same whichever is used.
+enum MeshDedup {
+	MESH_DEDUP_NONE,
+	MESH_DEDUP_EXACT,
+	MESH_DEDUP_RIGID,
+};
+
+static const float MESH_RIGID_TOLERANCE = 1e-4f;
+
+// Converts an OBJ to the game's mesh format, skinned to the skeleton in the .bvh next to it, in
+// memory or streamed depending on its size. Both give the same mesh. MeshDedup=none or rigid
+// changes which copies are found, from exact ones.
 HRESULT buildMesh(const char *sourcePath, const char *targetPath);
+HRESULT buildSplitMesh(const char *sourcePath, const char *targetPath);
+HRESULT buildMeshInMemory(
+	const char *sourcePath, const char *targetPath, MeshLayout layout, MeshDedup dedup
+);
+
+// Converts a group at a time, in memory that doesn't grow with the source. A first pass writes
+// the attributes to files next to the target and counts the groups, and a second maps those
+// files and writes every group as soon as it's complete. The table of groups before them is
+// filled in last.
+// A copy is found by reading its group back from the target, so only the hash and offset of
+// each group are kept.
+HRESULT buildMeshStreaming(
+	const char *sourcePath, const char *targetPath, MeshLayout layout, MeshDedup dedup
+);
+
+// What deduplication left out of every mesh built so far, on any thread. Groups counts all of
+// them, copies or not, and the saved bytes are the geometry the copies didn't need.
+struct MeshDedupStats {
+	uint64_t numGroups;
+	uint64_t numExact;
+	uint64_t numRigid;
+	uint64_t savedBytes;
+};
+
+MeshDedupStats getMeshDedupStats();
+void reportMeshDedup(FILE *file);
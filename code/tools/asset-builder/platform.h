@@ -0,0 +1,42 @@
+#pragma once
+
+// The builder reports errors as HRESULTs throughout. Off Windows these are the few definitions it
+// uses, with the same values, so an error means the same whichever platform built the assets.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cstdint>
+
+typedef int32_t HRESULT;
+
+#define S_OK ((HRESULT)0)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000e)
+
+#define SUCCEEDED(hr) ((HRESULT)(hr) >= 0)
+#define FAILED(hr) ((HRESULT)(hr) < 0)
+#define HRESULT_FROM_WIN32(x) \
+	((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000ffff) | 0x80070000))
+
+#define ERROR_SUCCESS 0L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_WRITE_FAULT 29L
+#define ERROR_READ_FAULT 30L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_ENVVAR_NOT_FOUND 203L
+#define ERROR_CIRCULAR_DEPENDENCY 1059L
+#define ERROR_FILE_CORRUPT 1392L
+
+#define MAX_PATH 260
+#endif
+
+// what the builder puts between the directories and files of the paths it makes
+#ifdef _WIN32
+static const char PATH_SEPARATOR = '\\';
+#else
+static const char PATH_SEPARATOR = '/';
+#endif
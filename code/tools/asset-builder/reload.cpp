@@ -0,0 +1,101 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "reload.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define INVALID_SOCKET (-1)
+#endif
+
+static HRESULT getSocketError() {
+#ifdef _WIN32
+	return HRESULT_FROM_WIN32(WSAGetLastError());
+#else
+	return errno == ENOMEM || errno == ENOBUFS ? E_OUTOFMEMORY : E_FAIL;
+#endif
+}
+
+HRESULT ReloadNotifier::create(uint16_t port, ReloadNotifier *notifier) {
+#ifdef _WIN32
+	WSADATA data;
+	auto error = WSAStartup(MAKEWORD(2, 2), &data);
+	if (error != 0) {
+		return HRESULT_FROM_WIN32(error);
+	}
+#endif
+
+	notifier->port = port;
+	notifier->generation = 0;
+	notifier->socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (notifier->socket == INVALID_SOCKET) {
+		return getSocketError();
+	}
+	return S_OK;
+}
+
+HRESULT ReloadNotifier::send(const std::vector<std::string> &names) {
+	this->generation++;
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(this->port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	// every message goes out even when there's nothing in it, which tells the game a build is done
+	size_t next = 0;
+	do {
+		char header[64];
+		std::string body;
+		size_t count = 0;
+		for (; next < names.size(); next++, count++) {
+			auto &name = names[next];
+			if (sizeof(header) + body.size() + name.size() + 1 > RELOAD_MAX_MESSAGE) {
+				break;
+			}
+			body += name;
+			body += '\n';
+		}
+		if (count == 0 && next < names.size()) {
+			// a name too long for any message
+			next++;
+			continue;
+		}
+
+		snprintf(
+			header, sizeof(header), "reload %u %" PRIu64 " %zu\n", RELOAD_VERSION,
+			this->generation, count
+		);
+		auto message = header + body;
+		auto sent = sendto(
+			this->socket, message.data(), (int)message.size(), 0,
+			(const sockaddr*)&address, (socklen_t)sizeof(address)
+		);
+		if (sent < 0 || (size_t)sent != message.size()) {
+			return getSocketError();
+		}
+	} while (next < names.size());
+
+	return S_OK;
+}
+
+void ReloadNotifier::close() {
+#ifdef _WIN32
+	if (this->socket != INVALID_SOCKET) {
+		closesocket(this->socket);
+	}
+	WSACleanup();
+#else
+	if (this->socket != INVALID_SOCKET) {
+		::close(this->socket);
+	}
+#endif
+	this->socket = INVALID_SOCKET;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "platform.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+// The port on the loopback interface that a running game listens on for reloads, unless
+// ReloadPort says otherwise.
+static const uint16_t RELOAD_PORT = 47110;
+static const uint32_t RELOAD_VERSION = 1;
+
+// Messages are single datagrams of at most this many bytes. Each starts with a
+// "reload version generation count" line, and is followed by count lines, one for each output
+// that changed, by its name relative to the data directory. Names that don't fit go in further
+// messages of the same generation.
+static const size_t RELOAD_MAX_MESSAGE = 8192;
+
+// Tells a running game which outputs a build changed, so that it can reload them. Nothing has to
+// be listening: a message nobody receives is dropped, and the game loads the latest outputs when
+// it starts anyway.
+struct ReloadNotifier {
+#ifdef _WIN32
+	SOCKET socket;
+#else
+	int socket;
+#endif
+	uint16_t port;
+
+	// counts builds, so that the game can tell which messages belong together
+	uint64_t generation;
+
+	static HRESULT create(uint16_t port, ReloadNotifier *notifier);
+
+	// Sends the next generation, even when nothing changed.
+	HRESULT send(const std::vector<std::string> &names);
+
+	void close();
+};
@@ -1,45 +1,126 @@
 #include "shader.h"
 #include "util.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
 #include <d3dcompiler.h>
 #include <wrl/client.h>
-#include <cstdio>
 
 using Microsoft::WRL::ComPtr;
 
-static const char *shaderKinds[] = { "vs_5_0", "ps_5_0" };
+struct FxcCompiler : ShaderCompiler {
+	const char *getName() const override {
+		return "fxc";
+	}
 
-HRESULT buildShader(const char *sourcePath, const char *targetPath, ShaderKind kind) {
-	HRESULT hr;
+	HRESULT compile(const char *sourcePath, const char *targetPath, ShaderKind kind) override {
+		static const char *profiles[] = { "vs_5_0", "ps_5_0" };
+		HRESULT hr;
 
-	ComPtr<ID3DBlob> shader;
-	{
-		auto path = toWide(sourcePath);
+		ComPtr<ID3DBlob> shader;
+		{
+			auto path = toWide(sourcePath);
 
-		ComPtr<ID3DBlob> errors;
-		hr = D3DCompileFromFile(
-			path.data(), NULL, NULL, "main", shaderKinds[kind],
+			ComPtr<ID3DBlob> errors;
+			hr = D3DCompileFromFile(
+				path.data(), NULL, D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", profiles[kind],
 #if defined(_DEBUG)
-			D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION |
+				D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION |
 #endif
-			D3DCOMPILE_PACK_MATRIX_ROW_MAJOR, 0,
-			&shader, &errors
-		);
-		if (FAILED(hr)) {
-			fprintf(stderr, "%s\n", (char*)errors->GetBufferPointer());
-			return hr;
+				D3DCOMPILE_PACK_MATRIX_ROW_MAJOR, 0,
+				&shader, &errors
+			);
+			if (FAILED(hr)) {
+				fprintf(stderr, "%s\n", (char*)errors->GetBufferPointer());
+				return hr;
+			}
+		}
+
+		{
+			auto path = toWide(targetPath);
+			hr = D3DWriteBlobToFile(shader.Get(), path.data(), TRUE);
+			if (FAILED(hr)) {
+				fprintf(stderr, "shader : Error: Could not write to file %s\n", targetPath);
+				return hr;
+			}
 		}
+
+		return S_OK;
 	}
+};
+#endif
 
-	{
-		auto path = toWide(targetPath);
-		hr = D3DWriteBlobToFile(shader.Get(), path.data(), TRUE);
+// DXC compiles to DXIL for shader model 6, which D3D12 loads like FXC's bytecode, and prints its
+// own errors.
+struct DxcCompiler : ShaderCompiler {
+	std::string program;
+
+	const char *getName() const override {
+		return "dxc";
+	}
+
+	HRESULT compile(const char *sourcePath, const char *targetPath, ShaderKind kind) override {
+		static const char *profiles[] = { "vs_6_0", "ps_6_0" };
+		std::vector<const char*> args = {
+			this->program.c_str(), "-nologo", "-T", profiles[kind], "-E", "main", "-Zpr",
+#if defined(_DEBUG)
+			"-Zi", "-Qembed_debug", "-Od",
+#endif
+			"-Fo", targetPath, sourcePath, NULL,
+		};
+
+		int exitCode;
+		auto hr = runProcess(args.data(), &exitCode);
 		if (FAILED(hr)) {
-			fprintf(stderr, "shader : Error: Could not write to file %s\n", targetPath);
+			fprintf(stderr, "shader : Error: Could not run %s\n", this->program.c_str());
 			return hr;
 		}
+		return exitCode == 0 ? S_OK : E_FAIL;
 	}
+};
 
-	return S_OK;
+static ShaderCompiler *createShaderCompiler() {
+	std::vector<char> name;
+	if (getEnv("ShaderCompiler", &name) != S_OK) {
+#ifdef _WIN32
+		const char fallback[] = "fxc";
+#else
+		const char fallback[] = "dxc";
+#endif
+		name.assign(fallback, fallback + sizeof(fallback));
+	}
+
+#ifdef _WIN32
+	static FxcCompiler fxc;
+	if (strcmp(name.data(), "fxc") == 0) {
+		return &fxc;
+	}
+#endif
+
+	static DxcCompiler dxc;
+	if (strcmp(name.data(), "dxc") == 0) {
+		std::vector<char> program;
+		dxc.program = getEnv("Dxc", &program) == S_OK ? program.data() : "dxc";
+		return &dxc;
+	}
+
+	return NULL;
+}
+
+ShaderCompiler *getShaderCompiler() {
+	static ShaderCompiler *compiler = createShaderCompiler();
+	return compiler;
+}
+
+HRESULT buildShader(const char *sourcePath, const char *targetPath, ShaderKind kind) {
+	auto compiler = getShaderCompiler();
+	if (compiler == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+	return compiler->compile(sourcePath, targetPath, kind);
 }
 
 HRESULT buildVertexShader(const char *sourcePath, const char *targetPath) {
@@ -49,3 +130,34 @@ HRESULT buildVertexShader(const char *sourcePath, const char *targetPath) {
 HRESULT buildPixelShader(const char *sourcePath, const char *targetPath) {
 	return buildShader(sourcePath, targetPath, SHADER_PIXEL);
 }
+
+void findShaderIncludes(const char *sourcePath, std::vector<std::string> *includes) {
+	std::ifstream file(sourcePath);
+	if (!file) {
+		return;
+	}
+
+	std::string dir = sourcePath;
+	auto slash = dir.find_last_of("/\\");
+	dir.resize(slash == std::string::npos ? 0 : slash + 1);
+
+	std::string line;
+	while (std::getline(file, line)) {
+		auto start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			continue;
+		}
+		auto open = line.find('"', start + 8);
+		auto close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			continue;
+		}
+
+		auto path = dir + line.substr(open + 1, close - open - 1);
+		if (std::find(includes->begin(), includes->end(), path) != includes->end()) {
+			continue;
+		}
+		includes->push_back(path);
+		findShaderIncludes(path.c_str(), includes);
+	}
+}
@@ -1,11 +1,32 @@
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "platform.h"
+#include <string>
+#include <vector>
 
 enum ShaderKind {
 	SHADER_VERTEX,
 	SHADER_PIXEL,
 };
 
+// Compiles the main function of an HLSL file with row major matrices, with includes relative to
+// the file, and writes the bytecode to targetPath. Debug builds of the builder compile shaders
+// for debugging, without optimizations.
+struct ShaderCompiler {
+	virtual ~ShaderCompiler() {}
+
+	virtual const char *getName() const = 0;
+	virtual HRESULT compile(const char *sourcePath, const char *targetPath, ShaderKind kind) = 0;
+};
+
+// FXC through d3dcompiler, which only exists on Windows, or DXC's command line compiler, which
+// runs wherever it's installed. The ShaderCompiler environment variable picks fxc, dxc or none,
+// and defaults to fxc on Windows and dxc elsewhere, where Dxc can name the program to run. Returns
+// NULL for none, or for a compiler this platform doesn't have, and then no shaders are built.
+ShaderCompiler *getShaderCompiler();
+
 HRESULT buildShader(const char *sourcePath, const char *targetPath, ShaderKind kind);
 HRESULT buildVertexShader(const char *sourcePath, const char *targetPath);
-HRESULT buildPixelShader(const char *sourcePath, const char *targetPath);
\ No newline at end of file
+HRESULT buildPixelShader(const char *sourcePath, const char *targetPath);
+
+// Appends every file that sourcePath includes with quotes, directly or not, relative to the file
+// that includes it. Files that can't be read are still listed, but not looked into.
+void findShaderIncludes(const char *sourcePath, std::vector<std::string> *includes);
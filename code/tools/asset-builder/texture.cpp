@@ -0,0 +1,180 @@
+#define _CRT_SECURE_NO_WARNINGS
+#define NOMINMAX
+#include "texture.h"
+#include "bc.h"
+#include "image.h"
+#include "util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static const uint32_t DDS_MAGIC = 'D' | 'D' << 8 | 'S' << 16 | ' ' << 24;
+static const uint32_t DDS_DX10 = 'D' | 'X' << 8 | '1' << 16 | '0' << 24;
+
+static const uint32_t DDSD_CAPS = 0x1;
+static const uint32_t DDSD_HEIGHT = 0x2;
+static const uint32_t DDSD_WIDTH = 0x4;
+static const uint32_t DDSD_PIXELFORMAT = 0x1000;
+static const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+static const uint32_t DDSD_LINEARSIZE = 0x80000;
+static const uint32_t DDPF_FOURCC = 0x4;
+static const uint32_t DDSCAPS_COMPLEX = 0x8;
+static const uint32_t DDSCAPS_TEXTURE = 0x1000;
+static const uint32_t DDSCAPS_MIPMAP = 0x400000;
+static const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+// the DXGI_FORMAT values, which the builder doesn't otherwise need D3D headers for
+static const uint32_t DXGI_BC5_UNORM = 83;
+static const uint32_t DXGI_BC7_UNORM_SRGB = 99;
+
+struct DdsPixelFormat {
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t masks[4];
+};
+
+struct DdsHeader {
+	uint32_t magic;
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+
+struct DdsHeaderDx10 {
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static TextureQuality getQuality() {
+	std::vector<char> value;
+	if (getEnv("TextureQuality", &value) == S_OK) {
+		if (strcmp(value.data(), "fast") == 0) {
+			return TEXTURE_QUALITY_FAST;
+		}
+		if (strcmp(value.data(), "best") == 0) {
+			return TEXTURE_QUALITY_BEST;
+		}
+	}
+	return TEXTURE_QUALITY_NORMAL;
+}
+
+static HRESULT readImage(const char *path, Image *image) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + read);
+	}
+	fclose(file);
+
+	if (!decodeTga(data.data(), data.size(), image)) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+	}
+	return S_OK;
+}
+
+static HRESULT buildTexture(
+	const char *sourcePath, const char *targetPath, const MipSettings *settings,
+	TextureFormat format, uint32_t dxgiFormat, uint32_t numChannels
+) {
+	HRESULT hr;
+
+	Image image;
+	if (FAILED(hr = readImage(sourcePath, &image))) {
+		return hr;
+	}
+
+	std::vector<Image> mips;
+	generateMips(&image, settings, &mips);
+
+	auto quality = getQuality();
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::vector<uint8_t>> levels(mips.size());
+	size_t numPixels = 0;
+	size_t rawSize = 0;
+	size_t encodedSize = 0;
+	for (size_t i = 0; i < mips.size(); i++) {
+		encodeImage(&mips[i], format, quality, 0, &levels[i]);
+		numPixels += (size_t)mips[i].width * mips[i].height;
+		rawSize += getEncodedSize(TEXTURE_FORMAT_RGBA8, mips[i].width, mips[i].height);
+		encodedSize += levels[i].size();
+	}
+	auto seconds = std::chrono::duration<double>(
+		std::chrono::high_resolution_clock::now() - start
+	).count();
+
+	Image decoded;
+	decodeImage(levels[0].data(), format, image.width, image.height, &decoded);
+	fprintf(
+		stderr, "  %ux%u, %zu mips, %s %s: %.1f Mpix/s, %.2f dB, %zu bytes (%.1fx smaller)\n",
+		image.width, image.height, mips.size(), getTextureFormatName(format),
+		getTextureQualityName(quality), numPixels / seconds / 1e6,
+		computePsnr(&image, &decoded, numChannels), encodedSize, (double)rawSize / encodedSize
+	);
+
+	DdsHeader header = {};
+	header.magic = DDS_MAGIC;
+	header.size = sizeof(header) - sizeof(header.magic);
+	header.flags =
+		DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT |
+		DDSD_LINEARSIZE;
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = (uint32_t)levels[0].size();
+	header.depth = 1;
+	header.mipMapCount = (uint32_t)mips.size();
+	header.pixelFormat.size = sizeof(header.pixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDS_DX10;
+	header.caps[0] = DDSCAPS_COMPLEX | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP;
+
+	DdsHeaderDx10 dx10 = {};
+	dx10.dxgiFormat = dxgiFormat;
+	dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.arraySize = 1;
+
+	FILE *file = fopen(targetPath, "wb");
+	if (file == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+	auto complete =
+		fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(&dx10, sizeof(dx10), 1, file) == 1;
+	for (auto &level : levels) {
+		complete = complete && fwrite(level.data(), 1, level.size(), file) == level.size();
+	}
+	fclose(file);
+
+	return complete ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+}
+
+HRESULT buildColorTexture(const char *sourcePath, const char *targetPath) {
+	MipSettings settings = { true, false, true };
+	return buildTexture(
+		sourcePath, targetPath, &settings, TEXTURE_FORMAT_BC7, DXGI_BC7_UNORM_SRGB, 4
+	);
+}
+
+HRESULT buildNormalTexture(const char *sourcePath, const char *targetPath) {
+	MipSettings settings = { false, true, true };
+	return buildTexture(sourcePath, targetPath, &settings, TEXTURE_FORMAT_BC5, DXGI_BC5_UNORM, 2);
+}
@@ -0,0 +1,7 @@
+#include "platform.h"
+
+// Both read a TGA and write a DDS with a full mip chain. Color textures are sRGB and encoded to
+// BC7, normal maps to BC5. The TextureQuality environment variable picks the encoder preset,
+// fast, normal or best, and defaults to normal.
+HRESULT buildColorTexture(const char *sourcePath, const char *targetPath);
+HRESULT buildNormalTexture(const char *sourcePath, const char *targetPath);
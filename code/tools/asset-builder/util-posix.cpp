@@ -0,0 +1,220 @@
+#include "util.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// The Win32 error that means the same as errno, or a generic failure for the rest.
+static HRESULT getErrnoError(int error) {
+	switch (error) {
+	case ENOENT:
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	case ENOTDIR:
+		return HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+	case EACCES:
+	case EPERM:
+		return HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED);
+	case EEXIST:
+		return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+	case ENOMEM:
+		return E_OUTOFMEMORY;
+	default:
+		return E_FAIL;
+	}
+}
+
+void printWindowsError(HRESULT error) {
+	const char *message;
+	switch (error) {
+	case HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND):
+		message = "The system cannot find the file specified.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND):
+		message = "The system cannot find the path specified.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED):
+		message = "Access is denied.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_WRITE_FAULT):
+		message = "The system cannot write to the specified device.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_READ_FAULT):
+		message = "The system cannot read from the specified device.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED):
+		message = "The request is not supported.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS):
+		message = "Cannot create a file when that file already exists.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_ENVVAR_NOT_FOUND):
+		message = "The system could not find the environment option that was entered.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_CIRCULAR_DEPENDENCY):
+		message = "Circular service dependency was specified.";
+		break;
+	case HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT):
+		message = "The file or directory is corrupted and unreadable.";
+		break;
+	case E_OUTOFMEMORY:
+		message = "Not enough memory resources are available to complete this operation.";
+		break;
+	default:
+		fprintf(stderr, "Error 0x%08x\n", (uint32_t)error);
+		return;
+	}
+	fprintf(stderr, "%s\n", message);
+}
+
+HRESULT getEnv(const char *name, std::vector<char> *value) {
+	auto found = getenv(name);
+	if (found == NULL) {
+		return HRESULT_FROM_WIN32(ERROR_ENVVAR_NOT_FOUND);
+	}
+
+	value->assign(found, found + strlen(found) + 1);
+	return S_OK;
+}
+
+HRESULT makeDir(const char *path) {
+	// every directory on the way is made as well, like SHCreateDirectory does
+	std::string partial;
+	for (auto c = path; *c; c++) {
+		partial += *c;
+		if ((*c == '/' || c[1] == '\0') && partial != "/") {
+			if (mkdir(partial.c_str(), 0777) != 0 && errno != EEXIST) {
+				return getErrnoError(errno);
+			}
+		}
+	}
+
+	struct stat status;
+	if (stat(path, &status) != 0) {
+		return getErrnoError(errno);
+	}
+	return S_ISDIR(status.st_mode) ? S_OK : HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+}
+
+HRESULT getFileExists(const char *path, bool *fileExists) {
+	struct stat status;
+	if (stat(path, &status) != 0) {
+		if (errno == ENOENT || errno == ENOTDIR) {
+			*fileExists = false;
+			return S_OK;
+		}
+		return getErrnoError(errno);
+	}
+
+	*fileExists = true;
+	return S_OK;
+}
+
+HRESULT getLastWriteTime(const char *path, uint64_t *lastWriteTime) {
+	struct stat status;
+	if (stat(path, &status) != 0) {
+		return getErrnoError(errno);
+	}
+
+	// in 100 ns steps since 1601, like a FILETIME
+	*lastWriteTime =
+		((uint64_t)status.st_mtim.tv_sec + 11644473600ull) * 10000000ull +
+		(uint64_t)status.st_mtim.tv_nsec / 100;
+	return S_OK;
+}
+
+HRESULT getFileSize(const char *path, uint64_t *size) {
+	struct stat status;
+	if (stat(path, &status) != 0) {
+		return getErrnoError(errno);
+	}
+
+	*size = (uint64_t)status.st_size;
+	return S_OK;
+}
+
+HRESULT seekFile(FILE *file, uint64_t offset) {
+	if (fseeko(file, (off_t)offset, SEEK_SET) != 0) {
+		return getErrnoError(errno);
+	}
+	return S_OK;
+}
+
+HRESULT replaceFile(const char *sourcePath, const char *targetPath) {
+	if (rename(sourcePath, targetPath) != 0) {
+		return getErrnoError(errno);
+	}
+	return S_OK;
+}
+
+HRESULT mapFile(const char *path, MappedFile *file) {
+	auto descriptor = open(path, O_RDONLY);
+	if (descriptor < 0) {
+		return getErrnoError(errno);
+	}
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0) {
+		auto hr = getErrnoError(errno);
+		close(descriptor);
+		return hr;
+	}
+
+	file->data = NULL;
+	file->size = (uint64_t)status.st_size;
+	if (file->size > 0) {
+		auto data = mmap(NULL, (size_t)file->size, PROT_READ, MAP_SHARED, descriptor, 0);
+		if (data == MAP_FAILED) {
+			auto hr = getErrnoError(errno);
+			close(descriptor);
+			return hr;
+		}
+		file->data = (const char*)data;
+	}
+
+	// the mapping keeps the file open
+	close(descriptor);
+	return S_OK;
+}
+
+void unmapFile(MappedFile *file) {
+	if (file->data) {
+		munmap((void*)file->data, (size_t)file->size);
+	}
+	file->data = NULL;
+	file->size = 0;
+}
+
+void releaseMappedPages(MappedFile *file) {
+	// for a shared mapping of a file this only drops the process's references to the pages
+	if (file->data) {
+		madvise((void*)file->data, (size_t)file->size, MADV_DONTNEED);
+	}
+}
+
+HRESULT runProcess(const char *const *args, int *exitCode) {
+	pid_t pid;
+	auto error = posix_spawnp(&pid, args[0], NULL, NULL, (char *const *)args, environ);
+	if (error != 0) {
+		return getErrnoError(error);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return getErrnoError(errno);
+		}
+	}
+
+	// a program that was killed is reported like the shell does
+	*exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+	return S_OK;
+}
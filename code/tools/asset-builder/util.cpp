@@ -1,6 +1,7 @@
 #include "util.h"
 #include <ShlObj.h>
 #include <cstdio>
+#include <string>
 
 void printWindowsError(HRESULT error) {
 	WCHAR *message = 0;
@@ -94,3 +95,118 @@ HRESULT getLastWriteTime(const char *path, uint64_t *lastWriteTime) {
 	*lastWriteTime = lwt.QuadPart;
 	return S_OK;
 }
+
+HRESULT getFileSize(const char *path, uint64_t *size) {
+	auto pathWide = toWide(path);
+
+	WIN32_FILE_ATTRIBUTE_DATA data = {};
+	if (!GetFileAttributesEx(pathWide.data(), GetFileExInfoStandard, &data)) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	ULARGE_INTEGER fileSize = {};
+	fileSize.HighPart = data.nFileSizeHigh;
+	fileSize.LowPart = data.nFileSizeLow;
+
+	*size = fileSize.QuadPart;
+	return S_OK;
+}
+
+HRESULT seekFile(FILE *file, uint64_t offset) {
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0 ? S_OK : E_FAIL;
+}
+
+HRESULT replaceFile(const char *sourcePath, const char *targetPath) {
+	auto sourceWide = toWide(sourcePath);
+	auto targetWide = toWide(targetPath);
+	if (!MoveFileEx(sourceWide.data(), targetWide.data(), MOVEFILE_REPLACE_EXISTING)) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+	return S_OK;
+}
+
+HRESULT mapFile(const char *path, MappedFile *file) {
+	auto pathWide = toWide(path);
+
+	HANDLE handle = CreateFile(
+		pathWide.data(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL
+	);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	LARGE_INTEGER size = {};
+	if (!GetFileSizeEx(handle, &size)) {
+		auto hr = HRESULT_FROM_WIN32(GetLastError());
+		CloseHandle(handle);
+		return hr;
+	}
+
+	file->data = NULL;
+	file->size = (uint64_t)size.QuadPart;
+	file->mapping = NULL;
+	if (file->size > 0) {
+		file->mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+		auto data = file->mapping ? MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (data == NULL) {
+			auto hr = HRESULT_FROM_WIN32(GetLastError());
+			if (file->mapping) {
+				CloseHandle(file->mapping);
+			}
+			CloseHandle(handle);
+			return hr;
+		}
+		file->data = (const char*)data;
+	}
+
+	// the mapping keeps the file open
+	CloseHandle(handle);
+	return S_OK;
+}
+
+void unmapFile(MappedFile *file) {
+	if (file->data) {
+		UnmapViewOfFile(file->data);
+		CloseHandle(file->mapping);
+	}
+	file->data = NULL;
+	file->size = 0;
+	file->mapping = NULL;
+}
+
+void releaseMappedPages(MappedFile *file) {
+	// unlocking pages that aren't locked takes them out of the working set
+	if (file->data) {
+		VirtualUnlock((void*)file->data, (SIZE_T)file->size);
+	}
+}
+
+HRESULT runProcess(const char *const *args, int *exitCode) {
+	// every argument is quoted, which is all paths and flags need
+	std::string commandLine;
+	for (auto arg = args; *arg; arg++) {
+		commandLine += arg == args ? "\"" : " \"";
+		commandLine += *arg;
+		commandLine += '"';
+	}
+	auto commandLineWide = toWide(commandLine.c_str());
+
+	STARTUPINFO si = {};
+	si.cb = sizeof(si);
+	PROCESS_INFORMATION pi = {};
+	if (!CreateProcess(
+		NULL, commandLineWide.data(), NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi
+	)) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	WaitForSingleObject(pi.hProcess, INFINITE);
+	DWORD code = 0;
+	GetExitCodeProcess(pi.hProcess, &code);
+	CloseHandle(pi.hThread);
+	CloseHandle(pi.hProcess);
+
+	*exitCode = (int)code;
+	return S_OK;
+}
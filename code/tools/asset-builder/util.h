@@ -1,14 +1,46 @@
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "platform.h"
+#include <cstdint>
+#include <cstdio>
 #include <vector>
 
 void printWindowsError(HRESULT error);
 
+#ifdef _WIN32
 std::vector<WCHAR> toWide(const char *str);
 std::vector<char> fromWide(const WCHAR *str);
+#endif
 
 HRESULT getEnv(const char *name, std::vector<char> *value);
 HRESULT makeDir(const char *path);
 
 HRESULT getFileExists(const char *path, bool *fileExists);
 HRESULT getLastWriteTime(const char *path, uint64_t *lastWriteTime);
+HRESULT getFileSize(const char *path, uint64_t *size);
+
+// Moves to an offset from the start of an open file. fseek takes a long, which is 32 bits on
+// Windows, so this is how to get past 2 GiB.
+HRESULT seekFile(FILE *file, uint64_t offset);
+
+// Moves a file over target. Readers that have the old file open or mapped keep it on POSIX, and on
+// Windows can only have opened it with delete sharing.
+HRESULT replaceFile(const char *sourcePath, const char *targetPath);
+
+// A whole file mapped for reading. Empty files can't be mapped, and have NULL data.
+struct MappedFile {
+	const char *data;
+	uint64_t size;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+};
+
+HRESULT mapFile(const char *path, MappedFile *file);
+void unmapFile(MappedFile *file);
+
+// Takes the pages of a mapped file out of the process's working set. The mapping stays where it
+// is, and pages are read back from the file when they're touched again.
+void releaseMappedPages(MappedFile *file);
+
+// Runs a program found on the path with the arguments, the first of which is its name, and waits
+// for it. Fails when it can't be started, and otherwise returns the code it exited with.
+HRESULT runProcess(const char *const *args, int *exitCode);
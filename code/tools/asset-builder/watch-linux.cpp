@@ -0,0 +1,113 @@
+#include "watch.h"
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+	stopRequested = 1;
+}
+
+void catchStopRequests() {
+	struct sigaction action = {};
+	action.sa_handler = requestStop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+}
+
+bool getStopRequested() {
+	return stopRequested != 0;
+}
+
+static HRESULT getInotifyError(int error) {
+	switch (error) {
+	case ENOENT:
+		return HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+	case EACCES:
+		return HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED);
+	case ENOMEM:
+	case EMFILE:
+	case ENFILE:
+	case ENOSPC:
+		return E_OUTOFMEMORY;
+	default:
+		return E_FAIL;
+	}
+}
+
+HRESULT FileWatcher::create(FileWatcher *watcher) {
+	watcher->directories.clear();
+	watcher->overflowed = false;
+	watcher->descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->descriptor < 0) {
+		return getInotifyError(errno);
+	}
+	return S_OK;
+}
+
+HRESULT FileWatcher::addDirectory(const char *dir) {
+	for (auto &directory : this->directories) {
+		if (directory.second == dir) {
+			return S_OK;
+		}
+	}
+
+	// editors either write a file in place, or write it elsewhere and move it over the old one
+	auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_ONLYDIR;
+	auto watch = inotify_add_watch(this->descriptor, dir, mask);
+	if (watch < 0) {
+		return getInotifyError(errno);
+	}
+	this->directories.push_back(std::make_pair(watch, std::string(dir)));
+	return S_OK;
+}
+
+HRESULT FileWatcher::wait(uint32_t milliseconds, std::vector<std::string> *paths) {
+	struct pollfd descriptor = {};
+	descriptor.fd = this->descriptor;
+	descriptor.events = POLLIN;
+	auto ready = poll(&descriptor, 1, (int)milliseconds);
+	if (ready < 0) {
+		// a signal, which may have been a stop request
+		return errno == EINTR ? S_OK : getInotifyError(errno);
+	}
+
+	alignas(struct inotify_event) char buffer[16 * 1024];
+	while (ready > 0) {
+		auto size = read(this->descriptor, buffer, sizeof(buffer));
+		if (size <= 0) {
+			break;
+		}
+
+		for (auto next = buffer; next < buffer + size;) {
+			auto event = (const struct inotify_event*)next;
+			next += sizeof(*event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW) {
+				this->overflowed = true;
+			}
+			if (event->len == 0) {
+				continue;
+			}
+
+			for (auto &directory : this->directories) {
+				if (directory.first == event->wd) {
+					paths->push_back(directory.second + event->name);
+					break;
+				}
+			}
+		}
+	}
+	return S_OK;
+}
+
+void FileWatcher::close() {
+	if (this->descriptor >= 0) {
+		::close(this->descriptor);
+	}
+	this->descriptor = -1;
+	this->directories.clear();
+}
@@ -0,0 +1,131 @@
+#include "watch.h"
+#include "util.h"
+
+static volatile LONG stopRequested = 0;
+
+static BOOL WINAPI handleControl(DWORD type) {
+	InterlockedExchange(&stopRequested, 1);
+	return TRUE;
+}
+
+void catchStopRequests() {
+	SetConsoleCtrlHandler(handleControl, TRUE);
+}
+
+bool getStopRequested() {
+	return InterlockedCompareExchange(&stopRequested, 0, 0) != 0;
+}
+
+static BOOL readChanges(FileWatcher::Directory *directory) {
+	ResetEvent(directory->overlapped.hEvent);
+	return ReadDirectoryChangesW(
+		directory->handle, directory->buffer, sizeof(directory->buffer), FALSE,
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE, NULL,
+		&directory->overlapped, NULL
+	);
+}
+
+HRESULT FileWatcher::create(FileWatcher *watcher) {
+	watcher->directories.clear();
+	watcher->overflowed = false;
+	return S_OK;
+}
+
+HRESULT FileWatcher::addDirectory(const char *dir) {
+	for (auto &directory : this->directories) {
+		if (directory->path == dir) {
+			return S_OK;
+		}
+	}
+
+	std::unique_ptr<Directory> directory(new Directory());
+	directory->path = dir;
+	auto dirWide = toWide(dir);
+	directory->handle = CreateFile(
+		dirWide.data(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL
+	);
+	if (directory->handle == INVALID_HANDLE_VALUE) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	directory->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (directory->overlapped.hEvent == NULL || !readChanges(directory.get())) {
+		auto hr = HRESULT_FROM_WIN32(GetLastError());
+		if (directory->overlapped.hEvent) {
+			CloseHandle(directory->overlapped.hEvent);
+		}
+		CloseHandle(directory->handle);
+		return hr;
+	}
+
+	this->directories.push_back(std::move(directory));
+	return S_OK;
+}
+
+HRESULT FileWatcher::wait(uint32_t milliseconds, std::vector<std::string> *paths) {
+	std::vector<HANDLE> events;
+	for (auto &directory : this->directories) {
+		events.push_back(directory->overlapped.hEvent);
+	}
+	if (events.empty()) {
+		Sleep(milliseconds);
+		return S_OK;
+	}
+
+	auto result = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, milliseconds);
+	if (result == WAIT_TIMEOUT) {
+		return S_OK;
+	}
+	if (result == WAIT_FAILED) {
+		return HRESULT_FROM_WIN32(GetLastError());
+	}
+
+	for (auto &directory : this->directories) {
+		DWORD size = 0;
+		if (!GetOverlappedResult(directory->handle, &directory->overlapped, &size, FALSE)) {
+			if (GetLastError() == ERROR_IO_INCOMPLETE) {
+				continue;
+			}
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+
+		// nothing read means the changes didn't fit in the buffer
+		if (size == 0) {
+			this->overflowed = true;
+		}
+		auto next = (const char*)directory->buffer;
+		while (size > 0) {
+			auto info = (const FILE_NOTIFY_INFORMATION*)next;
+			if (info->Action != FILE_ACTION_RENAMED_OLD_NAME) {
+				std::vector<WCHAR> name(
+					info->FileName, info->FileName + info->FileNameLength / sizeof(WCHAR)
+				);
+				name.push_back(L'\0');
+				paths->push_back(directory->path + fromWide(name.data()).data());
+			}
+			if (info->NextEntryOffset == 0) {
+				break;
+			}
+			next += info->NextEntryOffset;
+		}
+
+		if (!readChanges(directory.get())) {
+			return HRESULT_FROM_WIN32(GetLastError());
+		}
+	}
+	return S_OK;
+}
+
+void FileWatcher::close() {
+	for (auto &directory : this->directories) {
+		// the read has to finish before its buffer goes away
+		DWORD size;
+		CancelIo(directory->handle);
+		GetOverlappedResult(directory->handle, &directory->overlapped, &size, TRUE);
+		CloseHandle(directory->handle);
+		CloseHandle(directory->overlapped.hEvent);
+	}
+	this->directories.clear();
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "platform.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reports the files that are written, created, moved or deleted in a set of directories, through
+// inotify on Linux and ReadDirectoryChangesW on Windows. Each change is reported as the directory
+// as it was added followed by the file's name, so paths compare equal to the ones in the build.
+struct FileWatcher {
+#ifdef _WIN32
+	struct Directory {
+		std::string path;
+		HANDLE handle;
+		OVERLAPPED overlapped;
+		DWORD buffer[16 * 1024];
+	};
+	std::vector<std::unique_ptr<Directory>> directories;
+#else
+	int descriptor;
+	std::vector<std::pair<int, std::string>> directories;
+#endif
+
+	// set when the OS dropped changes, after which any file might have changed
+	bool overflowed;
+
+	static HRESULT create(FileWatcher *watcher);
+
+	// dir has to end in a path separator. Adding a directory again does nothing.
+	HRESULT addDirectory(const char *dir);
+
+	// Waits up to the given time for changes and appends the paths that changed, possibly the
+	// same one more than once. Returns without any when the time runs out or a stop is requested.
+	HRESULT wait(uint32_t milliseconds, std::vector<std::string> *paths);
+
+	void close();
+};
+
+// Makes Ctrl+C and requests to terminate set a flag instead of ending the process, so that a
+// long running build can finish the step it's in and save what it knows.
+void catchStopRequests();
+bool getStopRequested();
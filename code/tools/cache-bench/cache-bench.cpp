@@ -0,0 +1,383 @@
+#include "cache.h"
+#include "hash.h"
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ftw.h>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Options {
+	uint32_t assets = 500;
+	uint32_t size = 64;
+	uint32_t work = 20;
+	const char *dir = NULL;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--assets") == 0) {
+			options->assets = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--size") == 0) {
+			options->size = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--work") == 0) {
+			options->work = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--dir") == 0) {
+			options->dir = value;
+		} else {
+			return false;
+		}
+	}
+	return options->assets >= 10 && options->size > 0;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	auto complete = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && complete;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+// Stands in for a build stage, with a few passes over the source to make it cost something.
+static void transform(
+	const std::vector<uint8_t> &source, uint32_t work, std::vector<uint8_t> *out
+) {
+	out->assign(source.begin(), source.end());
+	for (uint32_t pass = 0; pass < work; pass++) {
+		auto h = hash64(out->data(), out->size(), pass);
+		for (size_t i = 0; i < out->size(); i++) {
+			h = h * 6364136223846793005ull + (*out)[i];
+			(*out)[i] = (uint8_t)(h >> 56);
+		}
+	}
+}
+
+// The sources of the assets. The last fifth are skinned like meshes, and read the skeleton as
+// well as their own source, so that editing it rebuilds them and nothing else.
+struct Sources {
+	std::vector<std::string> paths;
+	std::string skeleton;
+
+	uint32_t getNumSkinned() const {
+		return (uint32_t)this->paths.size() / 5;
+	}
+
+	void getInputs(uint32_t asset, std::vector<std::string> *inputs) const {
+		inputs->assign(1, this->paths[asset]);
+		if (asset >= this->paths.size() - this->getNumSkinned()) {
+			inputs->push_back(this->skeleton);
+		}
+	}
+};
+
+// Reads what an asset is built from, its inputs one after the other.
+static bool readInputs(const Sources *sources, uint32_t asset, std::vector<uint8_t> *data) {
+	std::vector<std::string> inputs;
+	sources->getInputs(asset, &inputs);
+	data->clear();
+	std::vector<uint8_t> input;
+	for (auto &path : inputs) {
+		if (!readFile(path, &input)) {
+			return false;
+		}
+		data->insert(data->end(), input.begin(), input.end());
+	}
+	return true;
+}
+
+// A checkout of the assets: its own outputs and manifest, sharing the sources and the cache.
+struct Checkout {
+	std::string dataDir;
+	BuildCache cache;
+};
+
+struct StepResult {
+	CacheStats stats;
+	uint32_t built;
+	double milliseconds;
+};
+
+static bool build(
+	const Options *options, const Sources *sources, Checkout *checkout, StepResult *result
+) {
+	auto &cache = checkout->cache;
+	auto before = cache.getStats();
+	result->built = 0;
+
+	// every build is a new run of the builder, which hashes each source afresh
+	cache.fileHashes.clear();
+
+	std::vector<std::string> inputs;
+	std::vector<uint8_t> source;
+	std::vector<uint8_t> output;
+	auto start = Clock::now();
+	for (uint32_t i = 0; i < options->assets; i++) {
+		auto target = checkout->dataDir + std::to_string(i) + ".out";
+
+		uint64_t key;
+		sources->getInputs(i, &inputs);
+		if (!cache.getKey("bench", inputs.data(), inputs.size(), &key)) {
+			fprintf(stderr, "couldn't hash %s\n", inputs[0].c_str());
+			return false;
+		}
+		if (cache.isUpToDate(key, &target, 1) || cache.fetch(key, &target, 1)) {
+			continue;
+		}
+
+		if (!readInputs(sources, i, &source)) {
+			return false;
+		}
+		transform(source, options->work, &output);
+		if (!writeFile(target, output) || !cache.store(key, &target, 1)) {
+			return false;
+		}
+		result->built++;
+	}
+	result->milliseconds = getMilliseconds(start, Clock::now());
+
+	auto after = cache.getStats();
+	result->stats.upToDate = after.upToDate - before.upToDate;
+	result->stats.hits = after.hits - before.hits;
+	result->stats.misses = after.misses - before.misses;
+	result->stats.fetchedBytes = after.fetchedBytes - before.fetchedBytes;
+	result->stats.storedBytes = after.storedBytes - before.storedBytes;
+	result->stats.hashedBytes = after.hashedBytes - before.hashedBytes;
+	return cache.saveManifest();
+}
+
+// Whether every output matches what building its source from scratch gives.
+static bool verify(const Options *options, const Sources *sources, const Checkout *checkout) {
+	std::vector<uint8_t> source;
+	std::vector<uint8_t> expected;
+	std::vector<uint8_t> output;
+	for (uint32_t i = 0; i < options->assets; i++) {
+		auto target = checkout->dataDir + std::to_string(i) + ".out";
+		if (!readInputs(sources, i, &source) || !readFile(target, &output)) {
+			return false;
+		}
+		transform(source, options->work, &expected);
+		if (output != expected) {
+			fprintf(stderr, "%s doesn't match its source\n", target.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check(
+	const char *name, const StepResult *result, uint32_t upToDate, uint32_t hits, uint32_t misses
+) {
+	auto &stats = result->stats;
+	printf(
+		"%-28s %8.1f ms  %5" PRIu64 " up to date %5" PRIu64 " hits %5" PRIu64 " misses"
+		"  %6.1f MB hashed %6.1f MB fetched\n",
+		name, result->milliseconds, stats.upToDate, stats.hits, stats.misses,
+		stats.hashedBytes / 1048576.0, stats.fetchedBytes / 1048576.0
+	);
+	if (stats.upToDate != upToDate || stats.hits != hits || stats.misses != misses) {
+		fprintf(
+			stderr, "  expected %u up to date, %u hits and %u misses\n", upToDate, hits, misses
+		);
+		return false;
+	}
+	return true;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+static bool makeDirectory(const std::string &path) {
+	return mkdir(path.c_str(), 0777) == 0;
+}
+
+static bool run(const Options *options, const std::string &root) {
+	auto sourceDir = root + "assets/";
+	auto cacheDir = root + "cache/";
+	Checkout a;
+	Checkout b;
+	a.dataDir = root + "a/";
+	b.dataDir = root + "b/";
+	if (
+		!makeDirectory(sourceDir) || !makeDirectory(cacheDir) ||
+		!makeDirectory(a.dataDir) || !makeDirectory(b.dataDir)
+	) {
+		fprintf(stderr, "couldn't create the directories under %s\n", root.c_str());
+		return false;
+	}
+
+	std::mt19937 random(1);
+	Sources sources;
+	sources.paths.resize(options->assets);
+	for (uint32_t i = 0; i < options->assets; i++) {
+		sources.paths[i] = sourceDir + std::to_string(i) + ".src";
+	}
+	sources.skeleton = sourceDir + "skeleton.bvh";
+
+	// the skeleton's contents come after the assets'
+	std::vector<std::vector<uint8_t>> contents(options->assets + 1);
+	for (uint32_t i = 0; i <= options->assets; i++) {
+		contents[i].resize((size_t)options->size * 1024);
+		for (auto &byte : contents[i]) {
+			byte = (uint8_t)random();
+		}
+		auto &path = i < options->assets ? sources.paths[i] : sources.skeleton;
+		if (!writeFile(path, contents[i])) {
+			return false;
+		}
+	}
+	auto &skeleton = contents[options->assets];
+
+	const uint64_t VERSION = 1;
+	auto n = options->assets;
+	auto changed = n / 10;
+	BuildCache::create(cacheDir.c_str(), (a.dataDir + "build.manifest").c_str(), VERSION, &a.cache);
+	BuildCache::create(cacheDir.c_str(), (b.dataDir + "build.manifest").c_str(), VERSION, &b.cache);
+
+	StepResult result;
+	if (
+		!build(options, &sources, &a, &result) ||
+		!check("cold", &result, 0, 0, n) ||
+		!build(options, &sources, &a, &result) ||
+		!check("no changes", &result, n, 0, 0)
+	) {
+		return false;
+	}
+
+	// a checkout touches every file without changing it, which used to rebuild everything
+	for (uint32_t i = 0; i < n; i++) {
+		if (!writeFile(sources.paths[i], contents[i])) {
+			return false;
+		}
+	}
+	if (!build(options, &sources, &a, &result) || !check("touched", &result, n, 0, 0)) {
+		return false;
+	}
+
+	// a branch that changes a tenth of the assets
+	for (uint32_t i = 0; i < changed; i++) {
+		auto edited = contents[i];
+		edited[0] ^= 0xff;
+		if (!writeFile(sources.paths[i], edited)) {
+			return false;
+		}
+	}
+	if (
+		!build(options, &sources, &a, &result) ||
+		!check("edited a tenth", &result, n - changed, 0, changed) ||
+		!verify(options, &sources, &a)
+	) {
+		return false;
+	}
+
+	// a fresh checkout of the same branch, or another machine, finds everything built
+	if (
+		!build(options, &sources, &b, &result) ||
+		!check("fresh checkout", &result, 0, n, 0) ||
+		!verify(options, &sources, &b)
+	) {
+		return false;
+	}
+
+	// switching back only fetches the outputs of the original sources
+	for (uint32_t i = 0; i < changed; i++) {
+		if (!writeFile(sources.paths[i], contents[i])) {
+			return false;
+		}
+	}
+	if (
+		!build(options, &sources, &a, &result) ||
+		!check("switched back", &result, n - changed, changed, 0) ||
+		!verify(options, &sources, &a)
+	) {
+		return false;
+	}
+
+	// an edit to the skeleton rebuilds what is skinned to it, whose sources didn't change
+	auto skinned = sources.getNumSkinned();
+	auto editedSkeleton = skeleton;
+	editedSkeleton[0] ^= 0xff;
+	if (
+		!writeFile(sources.skeleton, editedSkeleton) ||
+		!build(options, &sources, &a, &result) ||
+		!check("edited the skeleton", &result, n - skinned, 0, skinned) ||
+		!verify(options, &sources, &a)
+	) {
+		return false;
+	}
+
+	// a new builder version invalidates every entry
+	BuildCache::create(
+		cacheDir.c_str(), (a.dataDir + "build.manifest").c_str(), VERSION + 1, &a.cache
+	);
+	if (
+		!build(options, &sources, &a, &result) ||
+		!check("new builder version", &result, 0, 0, n) ||
+		!verify(options, &sources, &a)
+	) {
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr, "usage: %s [--assets n] [--size kb] [--work passes] [--dir path]\n", argv[0]
+		);
+		return 1;
+	}
+
+	// everything goes in a new directory, which is removed afterwards
+	std::string base = options.dir ? options.dir : "/tmp";
+	std::vector<char> root(base.begin(), base.end());
+	const char suffix[] = "/cache-bench-XXXXXX";
+	root.insert(root.end(), suffix, suffix + sizeof(suffix));
+	if (mkdtemp(root.data()) == NULL) {
+		fprintf(stderr, "couldn't create a directory in %s\n", base.c_str());
+		return 1;
+	}
+
+	printf(
+		"%u assets of %u KB, %u passes each, in %s\n",
+		options.assets, options.size, options.work, root.data()
+	);
+	auto succeeded = run(&options, std::string(root.data()) + "/");
+	nftw(root.data(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,626 @@
+#include "mesh.h"
+#include "util.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ftw.h>
+#include <string>
+#include <vector>
+
+// Builds a kitbashed scene, where a few pieces are placed over and over, with every kind of
+// deduplication, and reports what each saves. Copies have to be found where the corpus has them
+// and nowhere else, and every mesh has to draw what the mesh built without deduplication does.
+struct Options {
+	uint32_t copies = 64;
+	const char *dir = NULL;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--copies") == 0) {
+			options->copies = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--dir") == 0) {
+			options->dir = value;
+		} else {
+			return false;
+		}
+	}
+	return options->copies > 0;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+static bool readFile(const std::string &path, std::vector<char> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+static bool writeFile(const std::string &path, const char *text) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		return false;
+	}
+	auto complete = fputs(text, file) >= 0;
+	return fclose(file) == 0 && complete;
+}
+
+// A piece is a list of corners, each with its own position, normal and texcoord, and faces of
+// three or four of them.
+struct Corner {
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+};
+
+struct Piece {
+	const char *name;
+	std::vector<Corner> corners;
+	std::vector<std::vector<uint32_t>> faces;
+};
+
+static void addQuad(Piece *piece, const float *corners, const float *normal) {
+	const float texcoords[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+	std::vector<uint32_t> face;
+	for (int i = 0; i < 4; i++) {
+		Corner corner;
+		memcpy(corner.position, corners + 3 * i, sizeof(corner.position));
+		memcpy(corner.normal, normal, sizeof(corner.normal));
+		memcpy(corner.texcoord, texcoords[i], sizeof(corner.texcoord));
+		face.push_back((uint32_t)piece->corners.size());
+		piece->corners.push_back(corner);
+	}
+	piece->faces.push_back(face);
+}
+
+static void makeBox(const char *name, const float *size, Piece *piece) {
+	piece->name = name;
+	for (int axis = 0; axis < 3; axis++) {
+		for (int sign = -1; sign <= 1; sign += 2) {
+			// the four corners of the side facing along the axis, counter-clockwise from outside
+			auto u = (axis + 1) % 3;
+			auto v = (axis + 2) % 3;
+			const float steps[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+			float corners[12];
+			for (int i = 0; i < 4; i++) {
+				auto c = corners + 3 * i;
+				c[axis] = 0.5f * sign * size[axis];
+				c[u] = 0.5f * steps[i][sign < 0 ? 1 : 0] * size[u];
+				c[v] = 0.5f * steps[i][sign < 0 ? 0 : 1] * size[v];
+			}
+			float normal[3] = {};
+			normal[axis] = (float)sign;
+			addQuad(piece, corners, normal);
+		}
+	}
+}
+
+static void makeCylinder(const char *name, float radius, float height, int sides, Piece *piece) {
+	piece->name = name;
+	const float PI = 3.14159265f;
+	for (int i = 0; i < sides; i++) {
+		float corners[12];
+		float normal[3];
+		for (int j = 0; j < 4; j++) {
+			auto angle = 2.0f * PI * (i + (j == 1 || j == 2 ? 1 : 0)) / sides;
+			corners[3 * j + 0] = radius * cosf(angle);
+			corners[3 * j + 1] = j < 2 ? 0.0f : height;
+			corners[3 * j + 2] = radius * sinf(angle);
+		}
+		auto middle = 2.0f * PI * (i + 0.5f) / sides;
+		normal[0] = cosf(middle);
+		normal[1] = 0.0f;
+		normal[2] = sinf(middle);
+		addQuad(piece, corners, normal);
+	}
+}
+
+// A deterministic generator, so that every run builds the same corpus.
+struct Random {
+	uint32_t state;
+
+	float next() {
+		this->state = this->state * 1664525u + 1013904223u;
+		return (this->state >> 8) / 16777216.0f;
+	}
+};
+
+// A rotation about a random axis, a translation, and optionally a mirror in x first.
+static void makePlacement(Random *random, bool mirrored, float *m) {
+	float axis[3] = { random->next() - 0.5f, random->next() - 0.5f, random->next() - 0.5f };
+	auto length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	for (auto &a : axis) {
+		a /= std::max(length, 1e-3f);
+	}
+	auto angle = 6.2831853f * random->next();
+	auto c = cosf(angle);
+	auto s = sinf(angle);
+	auto t = 1.0f - c;
+	auto x = axis[0], y = axis[1], z = axis[2];
+	const float rotation[9] = {
+		t * x * x + c, t * x * y - s * z, t * x * z + s * y,
+		t * x * y + s * z, t * y * y + c, t * y * z - s * x,
+		t * x * z - s * y, t * y * z + s * x, t * z * z + c,
+	};
+	for (int r = 0; r < 3; r++) {
+		for (int k = 0; k < 3; k++) {
+			m[4 * r + k] = rotation[3 * r + k] * (mirrored && k == 0 ? -1.0f : 1.0f);
+		}
+		m[4 * r + 3] = 100.0f * (random->next() - 0.5f);
+	}
+}
+
+struct Placement {
+	const Piece *piece;
+	float transform[12];
+
+	// nudges every corner of the piece by up to this much, so no other group can match it
+	float jitter;
+};
+
+static bool writeGroup(
+	FILE *file, const Placement *placement, uint32_t index, Random *random, size_t *numCorners
+) {
+	auto piece = placement->piece;
+	auto m = placement->transform;
+	auto complete = fprintf(file, "g %s_%u\n", piece->name, index) > 0;
+	for (auto &corner : piece->corners) {
+		auto p = corner.position;
+		auto n = corner.normal;
+		float jitter[3];
+		for (auto &j : jitter) {
+			j = placement->jitter * (random->next() - 0.5f);
+		}
+		complete = complete && fprintf(
+			file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+			m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3] + jitter[0],
+			m[4] * p[0] + m[5] * p[1] + m[6] * p[2] + m[7] + jitter[1],
+			m[8] * p[0] + m[9] * p[1] + m[10] * p[2] + m[11] + jitter[2],
+			corner.texcoord[0], corner.texcoord[1],
+			m[0] * n[0] + m[1] * n[1] + m[2] * n[2],
+			m[4] * n[0] + m[5] * n[1] + m[6] * n[2],
+			m[8] * n[0] + m[9] * n[1] + m[10] * n[2]
+		) > 0;
+	}
+
+	// OBJ indices count from 1 over the whole file
+	for (auto &face : piece->faces) {
+		complete = complete && fprintf(file, "f") > 0;
+		for (auto corner : face) {
+			auto i = *numCorners + corner + 1;
+			complete = complete && fprintf(file, " %zu/%zu/%zu", i, i, i) > 0;
+		}
+		complete = complete && fprintf(file, "\n") > 0;
+	}
+	*numCorners += piece->corners.size();
+	return complete;
+}
+
+// What the corpus is made of, and so which copies there are to find.
+struct Corpus {
+	size_t numGroups;
+	size_t numExactCopies;
+	size_t numStoredRigid;
+};
+
+// Every piece is placed the given number of times, turned and moved. Every fourth placement
+// repeats an earlier one exactly, and every eighth is mirrored, which no rigid transform gives,
+// though it keeps the winding so the geometry is what tells them apart. Jittered boxes stand in
+// for one-off geometry.
+static bool writeCorpus(const Options *options, const std::string &path, Corpus *corpus) {
+	Piece pieces[3];
+	const float crate[3] = { 1.0f, 1.0f, 1.0f };
+	const float beam[3] = { 4.0f, 0.2f, 0.3f };
+	makeBox("crate", crate, &pieces[0]);
+	makeBox("beam", beam, &pieces[1]);
+	makeCylinder("pipe", 0.25f, 3.0f, 24, &pieces[2]);
+
+	Random random = { 1 };
+	std::vector<Placement> placements;
+	*corpus = Corpus();
+	for (auto &piece : pieces) {
+		auto first = placements.size();
+		auto mirrored = false;
+		for (uint32_t i = 0; i < options->copies; i++) {
+			Placement placement = { &piece, {}, 0.0f };
+			if (i % 4 == 3) {
+				auto repeated = first + (size_t)(random.next() * (placements.size() - first));
+				placement = placements[repeated];
+				corpus->numExactCopies++;
+			} else {
+				makePlacement(&random, i % 8 == 6, placement.transform);
+				mirrored = mirrored || i % 8 == 6;
+			}
+			placements.push_back(placement);
+		}
+
+		// the first placement, and the first mirrored one, are all rigid deduplication keeps
+		corpus->numStoredRigid += mirrored ? 2 : 1;
+	}
+	for (uint32_t i = 0; i < options->copies / 4; i++) {
+		Placement placement = { &pieces[0], {}, 0.05f };
+		makePlacement(&random, false, placement.transform);
+		placements.push_back(placement);
+		corpus->numStoredRigid++;
+	}
+	corpus->numGroups = placements.size();
+
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		return false;
+	}
+	size_t numCorners = 0;
+	auto complete = true;
+	for (size_t i = 0; i < placements.size(); i++) {
+		complete = complete && writeGroup(file, &placements[i], (uint32_t)i, &random, &numCorners);
+	}
+	return fclose(file) == 0 && complete;
+}
+
+// A static scene is skinned to a single bone, so that skinning is the same wherever a piece is.
+static const char STATIC_SKELETON[] =
+	"HIERARCHY\n"
+	"ROOT Root\n"
+	"{\n"
+	"\tOFFSET 0.0000 0.0000 0.0000\n"
+	"\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n"
+	"\tEnd Site\n"
+	"\t{\n"
+	"\t\tOFFSET 0.0000 1.0000 0.0000\n"
+	"\t}\n"
+	"}\n"
+	"MOTION\n"
+	"Frames: 1\n"
+	"Frame Time: 0.033333\n"
+	"0.0000 0.0000 0.0000 0.0000 0.0000 0.0000\n";
+
+static const uint32_t MESH_VERSION_SPLIT = 2;
+static const uint32_t MESH_VERSION_INSTANCED = 3;
+static const uint32_t MESH_VERSION_SPLIT_INSTANCED = 4;
+
+struct Vertex {
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	uint8_t joints[4];
+	uint8_t weights[4];
+};
+
+struct MeshInstance {
+	uint32_t source;
+	float transform[12];
+};
+
+struct Group {
+	std::vector<Vertex> vertices;
+	std::vector<uint16_t> indices;
+};
+
+// What a mesh draws, with every copy expanded, and how it was stored.
+struct Expanded {
+	std::vector<Group> groups;
+	size_t numExact;
+	size_t numRigid;
+
+	// what the game's geometry arena holds, where exact copies share their source's geometry and
+	// rigid ones are expanded as they're uploaded
+	uint64_t arenaBytes;
+};
+
+static uint64_t getGroupSize(const Group *group) {
+	return group->vertices.size() * sizeof(Vertex) + group->indices.size() * sizeof(uint16_t);
+}
+
+// Reads a mesh of any version the way the game does, and fails for one that doesn't add up.
+static bool expandMesh(const std::vector<char> &data, Expanded *expanded) {
+	*expanded = Expanded();
+	uint32_t header[2];
+	size_t numGroups;
+	size_t offset = sizeof(header) + sizeof(numGroups);
+	if (data.size() < offset) {
+		return false;
+	}
+	memcpy(header, data.data(), sizeof(header));
+	memcpy(&numGroups, data.data() + sizeof(header), sizeof(numGroups));
+	auto split = header[1] == MESH_VERSION_SPLIT || header[1] == MESH_VERSION_SPLIT_INSTANCED;
+	auto instanced = header[1] >= MESH_VERSION_INSTANCED;
+	auto entrySize = 2 * sizeof(size_t) + (instanced ? sizeof(MeshInstance) : 0);
+	if (numGroups > (data.size() - offset) / entrySize) {
+		return false;
+	}
+
+	std::vector<size_t> counts(2 * numGroups);
+	memcpy(counts.data(), data.data() + offset, counts.size() * sizeof(size_t));
+	offset += counts.size() * sizeof(size_t);
+
+	auto end = data.size();
+	std::vector<MeshInstance> instances(numGroups);
+	for (size_t i = 0; i < numGroups; i++) {
+		instances[i].source = (uint32_t)i;
+	}
+	if (instanced) {
+		end -= numGroups * sizeof(MeshInstance);
+		memcpy(instances.data(), data.data() + end, numGroups * sizeof(MeshInstance));
+	}
+
+	for (size_t i = 0; i < numGroups; i++) {
+		auto numVertices = counts[2 * i];
+		auto numIndices = counts[2 * i + 1];
+		auto &instance = instances[i];
+		Group group;
+		if (instance.source == i) {
+			auto size = numVertices * sizeof(Vertex) + numIndices * sizeof(uint16_t);
+			if (size > end - offset) {
+				return false;
+			}
+			group.vertices.resize(numVertices);
+			auto vertices = data.data() + offset;
+			for (size_t v = 0; v < numVertices && split; v++) {
+				auto &vertex = group.vertices[v];
+				auto attributes = vertices + numVertices * sizeof(vertex.position);
+				auto attributeSize = sizeof(Vertex) - sizeof(vertex.position);
+				auto position = vertices + v * sizeof(vertex.position);
+				memcpy(vertex.position, position, sizeof(vertex.position));
+
+				// everything after the position, which is how the attribute stream has them
+				memcpy(vertex.normal, attributes + v * attributeSize, attributeSize);
+			}
+			if (!split) {
+				memcpy(group.vertices.data(), vertices, numVertices * sizeof(Vertex));
+			}
+			group.indices.resize(numIndices);
+			auto indices = vertices + numVertices * sizeof(Vertex);
+			memcpy(group.indices.data(), indices, numIndices * sizeof(uint16_t));
+			offset += size;
+			expanded->arenaBytes += size;
+		} else {
+			if (instance.source > i || instances[instance.source].source != instance.source) {
+				return false;
+			}
+			group = expanded->groups[instance.source];
+			if (group.vertices.size() != numVertices || group.indices.size() != numIndices) {
+				return false;
+			}
+
+			auto m = instance.transform;
+			const float identity[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+			auto exact = memcmp(m, identity, sizeof(identity)) == 0;
+			expanded->numExact += exact ? 1 : 0;
+			expanded->numRigid += exact ? 0 : 1;
+			expanded->arenaBytes += exact ? 0 : getGroupSize(&group);
+			for (auto &vertex : group.vertices) {
+				auto p = vertex.position;
+				auto n = vertex.normal;
+				float position[3];
+				float normal[3];
+				for (int r = 0; r < 3; r++) {
+					position[r] = m[4 * r] * p[0] + m[4 * r + 1] * p[1] + m[4 * r + 2] * p[2] +
+						m[4 * r + 3];
+					normal[r] = m[4 * r] * n[0] + m[4 * r + 1] * n[1] + m[4 * r + 2] * n[2];
+				}
+				memcpy(vertex.position, position, sizeof(position));
+				memcpy(vertex.normal, normal, sizeof(normal));
+			}
+		}
+		expanded->groups.push_back(std::move(group));
+	}
+	return offset == end;
+}
+
+// Every group has to come out with the indices, texcoords and skinning it was built with, and
+// positions and normals within what rigid copies are allowed to move them.
+static bool matches(const Expanded *built, const Expanded *expected) {
+	if (built->groups.size() != expected->groups.size()) {
+		return false;
+	}
+	for (size_t g = 0; g < built->groups.size(); g++) {
+		auto &a = built->groups[g];
+		auto &b = expected->groups[g];
+		if (a.indices != b.indices || a.vertices.size() != b.vertices.size()) {
+			return false;
+		}
+
+		auto size = 0.0f;
+		for (auto &vertex : b.vertices) {
+			for (int i = 0; i < 3; i++) {
+				size = std::max(size, fabsf(vertex.position[i] - b.vertices[0].position[i]));
+			}
+		}
+		auto tolerance = MESH_RIGID_TOLERANCE * std::max(2.0f * size, 1.0f);
+		for (size_t v = 0; v < a.vertices.size(); v++) {
+			auto &x = a.vertices[v];
+			auto &y = b.vertices[v];
+			auto shared = sizeof(Vertex) - offsetof(Vertex, texcoord);
+			if (memcmp(x.texcoord, y.texcoord, shared) != 0) {
+				return false;
+			}
+			for (int i = 0; i < 3; i++) {
+				if (
+					fabsf(x.position[i] - y.position[i]) > tolerance ||
+					fabsf(x.normal[i] - y.normal[i]) > 1e-3f
+				) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+struct Result {
+	const char *name;
+	uint64_t bytes;
+	size_t numGroups;
+	size_t numExact;
+	size_t numRigid;
+	uint64_t arenaBytes;
+};
+
+// Builds a mesh with every kind of deduplication, in memory and streamed, and checks each draws
+// what the mesh without it does.
+static bool buildAll(
+	const std::string &sourcePath, const std::string &root, MeshLayout layout,
+	std::vector<Result> *results, Expanded *plain
+) {
+	const MeshDedup dedups[] = { MESH_DEDUP_NONE, MESH_DEDUP_EXACT, MESH_DEDUP_RIGID };
+	const char *names[] = { "none", "exact", "rigid" };
+	auto succeeded = true;
+	for (int i = 0; i < 3; i++) {
+		auto inMemoryPath = root + names[i] + ".mesh";
+		auto streamedPath = root + names[i] + "-streamed.mesh";
+		std::vector<char> inMemory;
+		std::vector<char> streamed;
+		if (
+			FAILED(buildMeshInMemory(
+				sourcePath.c_str(), inMemoryPath.c_str(), layout, dedups[i]
+			)) ||
+			FAILED(buildMeshStreaming(
+				sourcePath.c_str(), streamedPath.c_str(), layout, dedups[i]
+			)) ||
+			!readFile(inMemoryPath, &inMemory) || !readFile(streamedPath, &streamed)
+		) {
+			fprintf(stderr, "%s: couldn't build the mesh\n", names[i]);
+			return false;
+		}
+		if (streamed != inMemory) {
+			fprintf(
+				stderr, "%s: the streamed mesh differs from the one built in memory\n", names[i]
+			);
+			succeeded = false;
+		}
+
+		Expanded expanded;
+		if (!expandMesh(inMemory, &expanded)) {
+			fprintf(stderr, "%s: the mesh doesn't add up\n", names[i]);
+			return false;
+		}
+		if (dedups[i] == MESH_DEDUP_NONE) {
+			*plain = expanded;
+		} else if (!matches(&expanded, plain)) {
+			fprintf(stderr, "%s: the mesh doesn't draw what it was built from\n", names[i]);
+			succeeded = false;
+		}
+
+		Result result = {
+			names[i], inMemory.size(), expanded.groups.size(), expanded.numExact,
+			expanded.numRigid, expanded.arenaBytes,
+		};
+		results->push_back(result);
+	}
+	return succeeded;
+}
+
+static void printResults(const char *title, const std::vector<Result> &results) {
+	printf(
+		"%-24s %10s %8s %8s %8s %12s %8s\n", title, "bytes", "groups", "exact", "rigid",
+		"arena bytes", "saved"
+	);
+	auto plain = results[0].bytes;
+	for (auto &result : results) {
+		printf(
+			"  %-22s %10llu %8zu %8zu %8zu %12llu %7.1f%%\n", result.name,
+			(unsigned long long)result.bytes, result.numGroups, result.numExact, result.numRigid,
+			(unsigned long long)result.arenaBytes, 100.0 * (plain - result.bytes) / plain
+		);
+	}
+}
+
+static bool run(const Options *options, const std::string &root) {
+	auto objPath = root + "kitbash.obj";
+	Corpus corpus;
+	if (
+		!writeCorpus(options, objPath, &corpus) ||
+		!writeFile(root + "kitbash.bvh", STATIC_SKELETON)
+	) {
+		fprintf(stderr, "couldn't write the corpus\n");
+		return false;
+	}
+
+	auto succeeded = true;
+	for (auto layout : { MESH_INTERLEAVED, MESH_SPLIT }) {
+		std::vector<Result> results;
+		Expanded plain;
+		succeeded = buildAll(objPath, root, layout, &results, &plain) && succeeded;
+		if (results.size() != 3) {
+			return false;
+		}
+		printResults(layout == MESH_SPLIT ? "kitbash.obj, split" : "kitbash.obj", results);
+
+		auto &exact = results[1];
+		auto &rigid = results[2];
+		if (exact.numExact != corpus.numExactCopies || exact.numRigid != 0) {
+			fprintf(
+				stderr, "exact deduplication found %zu copies, instead of %zu\n", exact.numExact,
+				corpus.numExactCopies
+			);
+			succeeded = false;
+		}
+		auto numStored = rigid.numGroups - rigid.numExact - rigid.numRigid;
+		if (numStored != corpus.numStoredRigid) {
+			fprintf(
+				stderr, "rigid deduplication stored %zu groups, instead of %zu\n", numStored,
+				corpus.numStoredRigid
+			);
+			succeeded = false;
+		}
+	}
+
+	// the meshes the game ships have no copies, and come out as they always have
+	std::vector<Result> results;
+	Expanded plain;
+	auto humanPath = std::string(ASSET_DIR) + "/human.obj";
+	auto humanRoot = root + "human-";
+	succeeded = buildAll(humanPath, humanRoot, MESH_INTERLEAVED, &results, &plain) && succeeded;
+	if (results.size() == 3) {
+		printResults("human.obj", results);
+		for (auto &result : results) {
+			if (result.bytes != results[0].bytes) {
+				fprintf(stderr, "human.obj changed with %s deduplication\n", result.name);
+				succeeded = false;
+			}
+		}
+	}
+	printf("rigid copies are within %g of their size of where they were\n", MESH_RIGID_TOLERANCE);
+	return succeeded;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(stderr, "usage: %s [--copies n] [--dir path]\n", argv[0]);
+		return 1;
+	}
+
+	// everything goes in a new directory, which is removed afterwards
+	std::string base = options.dir ? options.dir : "/tmp";
+	std::vector<char> root(base.begin(), base.end());
+	const char suffix[] = "/dedup-bench-XXXXXX";
+	root.insert(root.end(), suffix, suffix + sizeof(suffix));
+	if (mkdtemp(root.data()) == NULL) {
+		fprintf(stderr, "couldn't create a directory in %s\n", base.c_str());
+		return 1;
+	}
+
+	auto succeeded = run(&options, std::string(root.data()) + "/");
+	nftw(root.data(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return succeeded ? 0 : 1;
+}
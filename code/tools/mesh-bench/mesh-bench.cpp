@@ -0,0 +1,302 @@
+#include "mesh.h"
+#include "util.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ftw.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Options {
+	uint32_t size = 1024;
+	uint32_t rows = 64;
+	uint32_t limit = 32;
+	const char *dir = NULL;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--size") == 0) {
+			options->size = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--rows") == 0) {
+			options->rows = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--limit") == 0) {
+			options->limit = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--dir") == 0) {
+			options->dir = value;
+		} else {
+			return false;
+		}
+	}
+	return options->size > 1 && options->rows > 0 && options->limit > 0;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+static bool readFile(const std::string &path, std::vector<char> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+static bool copyFile(const std::string &sourcePath, const std::string &targetPath) {
+	std::vector<char> data;
+	if (!readFile(sourcePath, &data)) {
+		return false;
+	}
+	FILE *file = fopen(targetPath.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	auto complete = fwrite(data.data(), 1, data.size(), file) == data.size();
+	return fclose(file) == 0 && complete;
+}
+
+// the most memory the process has had resident so far, in MB
+static double getPeakRss() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+// Stands in for a scan: a heightfield of size * size vertices in quads, with every attribute
+// written first and then the faces in groups of rows, each of which has more corners than one
+// mesh group can take.
+static bool writeGrid(const Options *options, const std::string &path, uint64_t *numQuads) {
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	auto size = options->size;
+	auto complete = true;
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			auto height = 0.05f * (float)((x * 7 + y * 13) % 11);
+			complete = complete && fprintf(
+				file, "v %.4f %.4f %.4f\n", x * 0.01f - 0.5f * size * 0.01f, height, y * 0.01f
+			) > 0;
+		}
+	}
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			complete = complete && fprintf(
+				file, "vt %.6f %.6f\n", (float)x / (size - 1), (float)y / (size - 1)
+			) > 0;
+		}
+	}
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			complete = complete && fprintf(file, "vn 0.0000 1.0000 0.0000\n") > 0;
+		}
+	}
+
+	*numQuads = 0;
+	for (uint32_t y = 0; y + 1 < size; y++) {
+		if (y % options->rows == 0) {
+			complete = complete && fprintf(file, "g rows_%u\n", y) > 0;
+		}
+		for (uint32_t x = 0; x + 1 < size; x++) {
+			uint32_t corners[4] = {
+				y * size + x + 1, (y + 1) * size + x + 1, (y + 1) * size + x + 2, y * size + x + 2,
+			};
+			complete = complete && fprintf(
+				file, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n",
+				corners[0], corners[0], corners[0], corners[1], corners[1], corners[1],
+				corners[2], corners[2], corners[2], corners[3], corners[3], corners[3]
+			) > 0;
+			(*numQuads)++;
+		}
+	}
+	return fclose(file) == 0 && complete;
+}
+
+// position, normal, texcoord, joints and weights
+static const size_t VERTEX_SIZE = 3 * 4 + 3 * 4 + 2 * 4 + 4 + 4;
+
+// Checks the table of a built mesh adds up to its size, and that no group has more vertices than
+// 16-bit indices reach.
+static bool checkMesh(const std::vector<char> &data, uint64_t numIndices) {
+	size_t numGroups = 0;
+	size_t offset = 2 * sizeof(uint32_t) + sizeof(numGroups);
+	if (data.size() < offset) {
+		return false;
+	}
+	memcpy(&numGroups, data.data() + 2 * sizeof(uint32_t), sizeof(numGroups));
+	if (numGroups > (data.size() - offset) / (2 * sizeof(size_t))) {
+		return false;
+	}
+
+	uint64_t size = offset + numGroups * 2 * sizeof(size_t);
+	uint64_t totalIndices = 0;
+	for (size_t i = 0; i < numGroups; i++) {
+		size_t counts[2];
+		memcpy(counts, data.data() + offset + i * sizeof(counts), sizeof(counts));
+		if (counts[0] > UINT16_MAX) {
+			return false;
+		}
+		size += counts[0] * VERTEX_SIZE + counts[1] * sizeof(uint16_t);
+		totalIndices += counts[1];
+	}
+	return size == data.size() && totalIndices == numIndices;
+}
+
+static bool run(const Options *options, const std::string &root) {
+	auto objPath = root + "grid.obj";
+	uint64_t numQuads;
+	if (
+		!writeGrid(options, objPath, &numQuads) ||
+		!copyFile(std::string(ASSET_DIR) + "/human.bvh", root + "grid.bvh")
+	) {
+		fprintf(stderr, "couldn't write the grid\n");
+		return false;
+	}
+
+	uint64_t objSize = 0;
+	getFileSize(objPath.c_str(), &objSize);
+	printf(
+		"%u x %u grid, %llu quads, %.1f MB of OBJ\n", options->size, options->size,
+		(unsigned long long)numQuads, objSize / 1048576.0
+	);
+
+	// streaming goes first, as the peak only ever goes up
+	auto baseline = getPeakRss();
+	auto streamedPath = root + "grid-streamed.mesh";
+	auto start = Clock::now();
+	auto hr = buildMeshStreaming(
+		objPath.c_str(), streamedPath.c_str(), MESH_INTERLEAVED, MESH_DEDUP_EXACT
+	);
+	auto streamMilliseconds = getMilliseconds(start, Clock::now());
+	auto streamPeak = getPeakRss();
+	if (FAILED(hr)) {
+		fprintf(stderr, "streaming: ");
+		printWindowsError(hr);
+		return false;
+	}
+
+	auto inMemoryPath = root + "grid.mesh";
+	start = Clock::now();
+	hr = buildMeshInMemory(
+		objPath.c_str(), inMemoryPath.c_str(), MESH_INTERLEAVED, MESH_DEDUP_EXACT
+	);
+	auto inMemoryMilliseconds = getMilliseconds(start, Clock::now());
+	auto inMemoryPeak = getPeakRss();
+	if (FAILED(hr)) {
+		fprintf(stderr, "in memory: ");
+		printWindowsError(hr);
+		return false;
+	}
+
+	printf("%-12s %10s %14s %10s\n", "", "ms", "peak RSS MB", "MB/s");
+	printf(
+		"%-12s %10.1f %14.1f %10.0f\n%-12s %10.1f %14.1f %10.0f\n",
+		"streamed", streamMilliseconds, streamPeak,
+		objSize / 1048576.0 / (streamMilliseconds / 1000.0),
+		"in memory", inMemoryMilliseconds, inMemoryPeak,
+		objSize / 1048576.0 / (inMemoryMilliseconds / 1000.0)
+	);
+	printf("the process was at %.1f MB before either\n", baseline);
+
+	auto succeeded = true;
+	if (streamPeak > options->limit) {
+		fprintf(stderr, "streaming peaked at %.1f MB, over %u MB\n", streamPeak, options->limit);
+		succeeded = false;
+	}
+
+	std::vector<char> streamed;
+	std::vector<char> inMemory;
+	if (!readFile(streamedPath, &streamed) || !readFile(inMemoryPath, &inMemory)) {
+		fprintf(stderr, "couldn't read the meshes back\n");
+		return false;
+	}
+	if (!checkMesh(streamed, 6 * numQuads)) {
+		fprintf(stderr, "the streamed mesh doesn't add up\n");
+		succeeded = false;
+	}
+	if (streamed != inMemory) {
+		fprintf(stderr, "the streamed mesh differs from the one built in memory\n");
+		succeeded = false;
+	}
+
+	// split meshes are written by the same passes, and come out the same size
+	auto splitPath = root + "grid-split.mesh";
+	if (
+		FAILED(buildMeshStreaming(
+			objPath.c_str(), splitPath.c_str(), MESH_SPLIT, MESH_DEDUP_EXACT
+		)) ||
+		!readFile(splitPath, &streamed) || !checkMesh(streamed, 6 * numQuads)
+	) {
+		fprintf(stderr, "the streamed split mesh doesn't add up\n");
+		succeeded = false;
+	}
+
+	// and on the meshes the game ships, which fit in a group each
+	auto humanPath = std::string(ASSET_DIR) + "/human.obj";
+	auto humanStreamedPath = root + "human-streamed.mesh";
+	auto humanInMemoryPath = root + "human.mesh";
+	for (auto layout : { MESH_INTERLEAVED, MESH_SPLIT }) {
+		if (
+			FAILED(buildMeshStreaming(
+				humanPath.c_str(), humanStreamedPath.c_str(), layout, MESH_DEDUP_EXACT
+			)) ||
+			FAILED(buildMeshInMemory(
+				humanPath.c_str(), humanInMemoryPath.c_str(), layout, MESH_DEDUP_EXACT
+			)) ||
+			!readFile(humanStreamedPath, &streamed) || !readFile(humanInMemoryPath, &inMemory) ||
+			streamed != inMemory
+		) {
+			fprintf(stderr, "human.obj doesn't stream to the mesh it builds to in memory\n");
+			succeeded = false;
+		}
+	}
+
+	return succeeded;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr, "usage: %s [--size vertices] [--rows n] [--limit mb] [--dir path]\n", argv[0]
+		);
+		return 1;
+	}
+
+	// everything goes in a new directory, which is removed afterwards
+	std::string base = options.dir ? options.dir : "/tmp";
+	std::vector<char> root(base.begin(), base.end());
+	const char suffix[] = "/mesh-bench-XXXXXX";
+	root.insert(root.end(), suffix, suffix + sizeof(suffix));
+	if (mkdtemp(root.data()) == NULL) {
+		fprintf(stderr, "couldn't create a directory in %s\n", base.c_str());
+		return 1;
+	}
+
+	auto succeeded = run(&options, std::string(root.data()) + "/");
+	nftw(root.data(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return succeeded ? 0 : 1;
+}
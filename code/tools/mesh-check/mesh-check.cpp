@@ -0,0 +1,269 @@
+#include "hash.h"
+#include "mesh.h"
+#include "util.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef HRESULT (*BuildFunction)(const char *sourcePath, const char *targetPath);
+
+// position, normal, texcoord, joints and weights, of which a split mesh keeps positions apart
+static const size_t VERTEX_SIZE = 3 * 4 + 3 * 4 + 2 * 4 + 4 + 4;
+static const size_t POSITION_SIZE = 3 * 4;
+static const uint32_t MESH_VERSION_SPLIT = 2;
+
+// Builds meshes and checks they come out as the same bytes on every platform and compiler, against
+// digests that are checked in next to this file. A mesh that differs on one platform would give
+// every machine there a cache miss, and the game different geometry depending on who built it.
+struct Options {
+	const char *assetDir = ASSET_DIR;
+	const char *referencePath = REFERENCE_PATH;
+	const char *tempDir = ".";
+	bool update = false;
+};
+
+struct Reference {
+	std::string name;
+	uint64_t size;
+	uint64_t hash;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		if (strcmp(arg, "--update") == 0) {
+			options->update = true;
+			continue;
+		}
+
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--assets") == 0) {
+			options->assetDir = value;
+		} else if (strcmp(arg, "--reference") == 0) {
+			options->referencePath = value;
+		} else if (strcmp(arg, "--temp") == 0) {
+			options->tempDir = value;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+// one "name size hash" line per mesh
+static bool readReferences(const char *path, std::vector<Reference> *references) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	char name[256];
+	Reference reference;
+	auto format = "%255s %" SCNu64 " %" SCNx64;
+	while (fscanf(file, format, name, &reference.size, &reference.hash) == 3) {
+		reference.name = name;
+		references->push_back(reference);
+	}
+	auto complete = feof(file) != 0;
+	fclose(file);
+	return complete && !references->empty();
+}
+
+static bool writeReferences(const char *path, const std::vector<Reference> *references) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	auto complete = true;
+	for (auto &reference : *references) {
+		complete = complete && fprintf(
+			file, "%s %" PRIu64 " %016" PRIx64 "\n",
+			reference.name.c_str(), reference.size, reference.hash
+		) > 0;
+	}
+	return fclose(file) == 0 && complete;
+}
+
+static bool readFile(const std::string &path, std::vector<char> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+// Builds a mesh twice, so that anything that depends on addresses or timing shows up as well.
+static bool buildTwice(
+	const Options *options, const std::string &name, BuildFunction build,
+	std::vector<char> *data
+) {
+	auto sourcePath = std::string(options->assetDir) + PATH_SEPARATOR + name;
+	sourcePath.replace(sourcePath.size() - 4, 4, "obj");
+
+	std::vector<char> runs[2];
+	for (int i = 0; i < 2; i++) {
+		auto targetPath =
+			std::string(options->tempDir) + PATH_SEPARATOR + "mesh-check-" + std::to_string(i) +
+			"-" + name;
+		auto hr = build(sourcePath.c_str(), targetPath.c_str());
+		auto read = SUCCEEDED(hr) && readFile(targetPath, &runs[i]);
+		remove(targetPath.c_str());
+		if (FAILED(hr)) {
+			fprintf(stderr, "%s: ", name.c_str());
+			printWindowsError(hr);
+			return false;
+		}
+		if (!read) {
+			fprintf(stderr, "%s: couldn't read what was built\n", name.c_str());
+			return false;
+		}
+	}
+
+	if (runs[0] != runs[1]) {
+		fprintf(stderr, "%s: two builds of the same source differ\n", name.c_str());
+		return false;
+	}
+	*data = std::move(runs[0]);
+	return true;
+}
+
+// Splits each group's vertices in an interleaved mesh into positions and the rest, which has to
+// give the bytes the builder writes for a split mesh. Counts the vertices on the way.
+static bool splitMesh(
+	const std::vector<char> &interleaved, std::vector<char> *split, size_t *numVertices
+) {
+	size_t numGroups = 0;
+	size_t offset = 2 * sizeof(uint32_t) + sizeof(numGroups);
+	if (interleaved.size() < offset) {
+		return false;
+	}
+	memcpy(&numGroups, interleaved.data() + 2 * sizeof(uint32_t), sizeof(numGroups));
+	if (numGroups > (interleaved.size() - offset) / (2 * sizeof(size_t))) {
+		return false;
+	}
+
+	std::vector<size_t> counts(2 * numGroups);
+	memcpy(counts.data(), interleaved.data() + offset, counts.size() * sizeof(size_t));
+	offset += counts.size() * sizeof(size_t);
+	*split = std::vector<char>(interleaved.begin(), interleaved.begin() + offset);
+	memcpy(split->data() + sizeof(uint32_t), &MESH_VERSION_SPLIT, sizeof(MESH_VERSION_SPLIT));
+
+	*numVertices = 0;
+	for (size_t i = 0; i < numGroups; i++) {
+		auto groupVertices = counts[2 * i];
+		auto indexSize = counts[2 * i + 1] * sizeof(uint16_t);
+		if (
+			groupVertices > (interleaved.size() - offset) / VERTEX_SIZE ||
+			indexSize > interleaved.size() - offset - groupVertices * VERTEX_SIZE
+		) {
+			return false;
+		}
+
+		auto vertices = interleaved.data() + offset;
+		for (size_t v = 0; v < groupVertices; v++) {
+			auto vertex = vertices + v * VERTEX_SIZE;
+			split->insert(split->end(), vertex, vertex + POSITION_SIZE);
+		}
+		for (size_t v = 0; v < groupVertices; v++) {
+			auto vertex = vertices + v * VERTEX_SIZE;
+			split->insert(split->end(), vertex + POSITION_SIZE, vertex + VERTEX_SIZE);
+		}
+		offset += groupVertices * VERTEX_SIZE;
+		split->insert(
+			split->end(), interleaved.begin() + offset, interleaved.begin() + offset + indexSize
+		);
+		offset += indexSize;
+		*numVertices += groupVertices;
+	}
+	return offset == interleaved.size();
+}
+
+// Checks the split build of a mesh against the interleaved one, whose bytes are checked against
+// the reference, and reports what a pass that only reads positions fetches from either.
+static bool checkSplit(
+	const Options *options, const Reference *reference, const std::vector<char> &interleaved
+) {
+	std::vector<char> built;
+	if (!buildTwice(options, reference->name, buildSplitMesh, &built)) {
+		return false;
+	}
+
+	std::vector<char> expected;
+	size_t numVertices;
+	if (!splitMesh(interleaved, &expected, &numVertices) || numVertices == 0) {
+		fprintf(stderr, "%s: the mesh doesn't add up\n", reference->name.c_str());
+		return false;
+	}
+	if (built != expected) {
+		fprintf(
+			stderr, "%s: the split mesh isn't the interleaved one split\n",
+			reference->name.c_str()
+		);
+		return false;
+	}
+
+	// a position-only pass reads the position stream alone, rather than whole interleaved vertices
+	printf(
+		"%-24s %10zu vertices  position-only passes fetch %zu bytes a vertex, down from %zu\n",
+		"  split", numVertices, POSITION_SIZE, VERTEX_SIZE
+	);
+	return true;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr, "usage: %s [--assets dir] [--reference path] [--temp dir] [--update]\n",
+			argv[0]
+		);
+		return 1;
+	}
+
+	std::vector<Reference> references;
+	if (!readReferences(options.referencePath, &references)) {
+		fprintf(stderr, "couldn't read %s\n", options.referencePath);
+		return 1;
+	}
+
+	auto matched = true;
+	for (auto &reference : references) {
+		std::vector<char> data;
+		if (!buildTwice(&options, reference.name, buildMesh, &data)) {
+			return 1;
+		}
+
+		auto size = (uint64_t)data.size();
+		auto hash = hash64(data.data(), data.size(), 0);
+		auto matches = size == reference.size && hash == reference.hash;
+		printf(
+			"%-24s %10" PRIu64 " bytes  %016" PRIx64 "  %s\n", reference.name.c_str(), size, hash,
+			matches ? "matches" : options.update ? "updated" : "differs from the reference"
+		);
+		matched = matched && matches && checkSplit(&options, &reference, data);
+		reference.size = size;
+		reference.hash = hash;
+	}
+
+	if (options.update) {
+		if (!writeReferences(options.referencePath, &references)) {
+			fprintf(stderr, "couldn't write %s\n", options.referencePath);
+			return 1;
+		}
+		return 0;
+	}
+	return matched ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+#include "game/archive.h"
+#include "game/reload.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <ftw.h>
+#include <spawn.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Runs the asset builder in watch mode on a copy of the assets, edits them the way an artist
+// would, and checks that a listener like the game's hears about exactly the outputs each edit
+// changes, soon enough to feel immediate.
+struct Options {
+	const char *builderPath = BUILDER_PATH;
+	const char *assetDir = ASSET_DIR;
+	const char *dir = NULL;
+	uint32_t limit = 1000;
+};
+
+struct Check {
+	const char *name;
+	double milliseconds;
+	bool passed;
+};
+
+static const char *SOURCES[] = {
+	"human.obj", "human.bvh", "human-idle.bvh", "human.tga", "human-normal.tga",
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--builder") == 0) {
+			options->builderPath = value;
+		} else if (strcmp(arg, "--assets") == 0) {
+			options->assetDir = value;
+		} else if (strcmp(arg, "--dir") == 0) {
+			options->dir = value;
+		} else if (strcmp(arg, "--limit") == 0) {
+			options->limit = (uint32_t)atoi(value);
+		} else {
+			return false;
+		}
+	}
+	return options->limit > 0;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+	return remove(path);
+}
+
+static bool readFile(const std::string &path, std::vector<char> *data) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	data->resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	auto complete = fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return complete;
+}
+
+// Written beside the file and moved over it, as editors save, so the builder never reads half.
+static bool saveFile(const std::string &path, const std::vector<char> &data) {
+	auto tempPath = path + ".saving";
+	FILE *file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	auto complete = fwrite(data.data(), 1, data.size(), file) == data.size();
+	complete = fclose(file) == 0 && complete;
+	return complete && rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+static pid_t startBuilder(const Options *options, const std::string &root, uint16_t port) {
+	auto assetDir = root + "assets/";
+	auto dataDir = root + "data/";
+	auto cacheDir = root + "cache/";
+	auto portText = std::to_string(port);
+	setenv("AssetDir", assetDir.c_str(), 1);
+	setenv("DataDir", dataDir.c_str(), 1);
+	setenv("AssetCache", cacheDir.c_str(), 1);
+	setenv("ShaderCompiler", "none", 1);
+	setenv("ReloadPort", portText.c_str(), 1);
+
+	// what the builder prints goes to a log, which is shown when something fails
+	auto logPath = root + "builder.log";
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 2, logPath.c_str(), O_WRONLY | O_CREAT, 0644);
+
+	pid_t pid;
+	const char *args[] = { options->builderPath, "--watch", NULL };
+	auto error = posix_spawn(&pid, args[0], &actions, NULL, (char *const *)args, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	return error == 0 ? pid : -1;
+}
+
+// Polls the listener until the builder reports the given generation.
+static bool waitForBuild(
+	ReloadListener *listener, uint64_t generation, uint32_t milliseconds,
+	ReloadRequest *request
+) {
+	auto start = Clock::now();
+	while (getMilliseconds(start, Clock::now()) < milliseconds) {
+		listener->poll(request);
+		if (request->generation >= generation) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	return false;
+}
+
+static std::string joinNames(const std::vector<std::string> &names) {
+	std::string joined;
+	for (auto &name : names) {
+		joined += joined.empty() ? "" : " ";
+		joined += name;
+	}
+	return joined.empty() ? "nothing" : joined;
+}
+
+// Makes an edit and checks the next build reports exactly the expected outputs, in any order.
+static bool checkEdit(
+	const Options *options, ReloadListener *listener, uint64_t *generation, const char *name,
+	const std::string &path, const std::vector<char> &data, std::vector<std::string> expected,
+	std::vector<Check> *checks
+) {
+	ReloadRequest request;
+	auto start = Clock::now();
+	if (!saveFile(path, data)) {
+		fprintf(stderr, "%s: couldn't write %s\n", name, path.c_str());
+		return false;
+	}
+
+	// a slow build is waited out, so that it fails on how long it took rather than going unheard
+	auto received = waitForBuild(listener, *generation + 1, 10 * options->limit, &request);
+	Check check = { name, getMilliseconds(start, Clock::now()), false };
+	if (!received) {
+		fprintf(stderr, "%s: no build was reported\n", name);
+		checks->push_back(check);
+		return false;
+	}
+	*generation = request.generation;
+
+	std::sort(request.names.begin(), request.names.end());
+	std::sort(expected.begin(), expected.end());
+	check.passed = request.names == expected && check.milliseconds <= options->limit;
+	if (request.names != expected) {
+		fprintf(
+			stderr, "%s: %s was reported, instead of %s\n", name,
+			joinNames(request.names).c_str(), joinNames(expected).c_str()
+		);
+	}
+	checks->push_back(check);
+	return check.passed;
+}
+
+// The archive the game would open next holds what the builder wrote for name.
+static bool checkArchive(const std::string &root, const char *name) {
+	std::vector<char> built;
+	std::vector<char> packed;
+	Archive archive;
+	if (!Archive::open((root + "data/assets.pak").c_str(), &archive)) {
+		return false;
+	}
+	auto entry = archive.find(name);
+	auto read = entry && archive.read(entry, &packed);
+	archive.close();
+	return read && readFile(root + "data/" + name, &built) && built == packed;
+}
+
+static bool run(const Options *options, const std::string &root) {
+	auto assetDir = root + "assets/";
+	if (mkdir(assetDir.c_str(), 0755) != 0) {
+		fprintf(stderr, "couldn't create %s\n", assetDir.c_str());
+		return false;
+	}
+	for (auto source : SOURCES) {
+		std::vector<char> data;
+		if (
+			!readFile(std::string(options->assetDir) + "/" + source, &data) ||
+			!saveFile(assetDir + source, data)
+		) {
+			fprintf(stderr, "couldn't copy %s\n", source);
+			return false;
+		}
+	}
+
+	ReloadListener listener;
+	if (!ReloadListener::create(0, &listener)) {
+		fprintf(stderr, "couldn't listen on the loopback interface\n");
+		return false;
+	}
+
+	auto pid = startBuilder(options, root, listener.port);
+	if (pid < 0) {
+		fprintf(stderr, "couldn't start %s\n", options->builderPath);
+		listener.close();
+		return false;
+	}
+
+	std::vector<Check> checks;
+	auto succeeded = true;
+
+	// the first build builds everything, and is only checked for what it reports
+	ReloadRequest request;
+	auto start = Clock::now();
+	uint64_t generation = 0;
+	if (waitForBuild(&listener, 1, 60000, &request)) {
+		generation = request.generation;
+		Check check = { "first build", getMilliseconds(start, Clock::now()), true };
+		std::sort(request.names.begin(), request.names.end());
+		const char *expected[] = {
+			"assets.pak", "human-idle.anim", "human-normal.dds", "human.anim", "human.dds",
+			"human.mesh",
+		};
+		check.passed = std::equal(
+			request.names.begin(), request.names.end(), std::begin(expected), std::end(expected)
+		);
+		if (!check.passed) {
+			fprintf(
+				stderr, "the first build reported %s\n", joinNames(request.names).c_str()
+			);
+		}
+		succeeded = check.passed;
+		checks.push_back(check);
+	} else {
+		fprintf(stderr, "the first build wasn't reported\n");
+		succeeded = false;
+	}
+
+	std::vector<char> mesh;
+	std::vector<char> texture;
+	std::vector<char> animation;
+	readFile(assetDir + "human.obj", &mesh);
+	readFile(assetDir + "human.tga", &texture);
+	readFile(assetDir + "human.bvh", &animation);
+
+	// the x of the first vertex
+	auto edited = mesh;
+	auto vertex = std::search(edited.begin(), edited.end(), "\nv ", "\nv " + 3);
+	if (succeeded && vertex != edited.end()) {
+		auto digit = std::find_if(vertex + 3, edited.end(), [](char c) { return isdigit(c); });
+		*digit = *digit == '9' ? '1' : *digit + 1;
+		succeeded = checkEdit(
+			options, &listener, &generation, "mesh edit", assetDir + "human.obj", edited,
+			{ "human.mesh", "assets.pak" }, &checks
+		);
+		if (succeeded && !checkArchive(root, "human.mesh")) {
+			fprintf(stderr, "the archive doesn't hold the edited mesh\n");
+			succeeded = false;
+		}
+	}
+
+	// a few texels in the middle of the image
+	auto painted = texture;
+	for (size_t i = painted.size() / 2; i < painted.size() / 2 + 48 && i < painted.size(); i++) {
+		painted[i] = ~painted[i];
+	}
+	succeeded = succeeded && checkEdit(
+		options, &listener, &generation, "texture edit", assetDir + "human.tga", painted,
+		{ "human.dds", "assets.pak" }, &checks
+	);
+
+	// going back to what was built before comes out of the cache
+	succeeded = succeeded && checkEdit(
+		options, &listener, &generation, "mesh revert", assetDir + "human.obj", mesh,
+		{ "human.mesh", "assets.pak" }, &checks
+	);
+	if (succeeded && !checkArchive(root, "human.mesh")) {
+		fprintf(stderr, "the archive doesn't hold the reverted mesh\n");
+		succeeded = false;
+	}
+
+	// saving without changing anything builds nothing, but is still reported
+	succeeded = succeeded && checkEdit(
+		options, &listener, &generation, "unchanged save", assetDir + "human.bvh", animation,
+		{}, &checks
+	);
+
+	// the mesh is skinned to the skeleton, so moving a joint rebuilds it along with the animation
+	auto moved = animation;
+	const char chest[] = "OFFSET 0.0000 0.2000";
+	auto joint = std::search(moved.begin(), moved.end(), chest, chest + sizeof(chest) - 1);
+	if (succeeded && joint != moved.end()) {
+		joint[sizeof(chest) - 5] = '5';
+		succeeded = checkEdit(
+			options, &listener, &generation, "skeleton edit", assetDir + "human.bvh", moved,
+			{ "human.anim", "human.mesh", "assets.pak" }, &checks
+		);
+		if (succeeded && !checkArchive(root, "human.mesh")) {
+			fprintf(stderr, "the archive doesn't hold the mesh skinned to the edited skeleton\n");
+			succeeded = false;
+		}
+		succeeded = succeeded && checkEdit(
+			options, &listener, &generation, "skeleton revert", assetDir + "human.bvh",
+			animation, { "human.anim", "human.mesh", "assets.pak" }, &checks
+		);
+	} else if (joint == moved.end()) {
+		fprintf(stderr, "human.bvh has no joint to move\n");
+		succeeded = false;
+	}
+
+	// a request to stop ends the builder cleanly
+	kill(pid, SIGTERM);
+	int status;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "the builder didn't exit cleanly when asked to stop\n");
+		succeeded = false;
+	}
+	listener.close();
+
+	printf("%-16s %10s\n", "", "ms");
+	for (auto &check : checks) {
+		printf(
+			"%-16s %10.1f  %s\n", check.name, check.milliseconds, check.passed ? "ok" : "failed"
+		);
+	}
+	printf("edits have to be reported within %u ms\n", options->limit);
+
+	if (!succeeded) {
+		std::vector<char> log;
+		readFile(root + "builder.log", &log);
+		fprintf(stderr, "the builder printed:\n%.*s", (int)log.size(), log.data());
+	}
+	return succeeded;
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(
+			stderr, "usage: %s [--builder path] [--assets dir] [--dir path] [--limit ms]\n",
+			argv[0]
+		);
+		return 1;
+	}
+
+	// everything goes in a new directory, which is removed afterwards
+	std::string base = options.dir ? options.dir : "/tmp";
+	std::vector<char> root(base.begin(), base.end());
+	const char suffix[] = "/reload-check-XXXXXX";
+	root.insert(root.end(), suffix, suffix + sizeof(suffix));
+	if (mkdtemp(root.data()) == NULL) {
+		fprintf(stderr, "couldn't create a directory in %s\n", base.c_str());
+		return 1;
+	}
+
+	auto succeeded = run(&options, std::string(root.data()) + "/");
+	nftw(root.data(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "bc.h"
+#include "image.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static double getMilliseconds(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Options {
+	uint32_t size = 1024;
+	uint32_t threads = 0;
+	const char *image = NULL;
+};
+
+static bool parseOptions(int argc, const char *argv[], Options *options) {
+	for (int i = 1; i < argc; i++) {
+		auto arg = argv[i];
+		auto value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (value == NULL) {
+			return false;
+		}
+		i++;
+
+		if (strcmp(arg, "--size") == 0) {
+			options->size = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--threads") == 0) {
+			options->threads = (uint32_t)atoi(value);
+		} else if (strcmp(arg, "--image") == 0) {
+			options->image = value;
+		} else {
+			return false;
+		}
+	}
+	return options->size >= 4;
+}
+
+// Smooth gradients with noise, hard edges and a few flat areas, roughly what albedo maps mix.
+static void makeColorImage(uint32_t size, Image *image) {
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int> noise(-12, 12);
+
+	image->width = size;
+	image->height = size;
+	image->pixels.resize(4 * (size_t)size * size);
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			auto u = (float)x / size;
+			auto v = (float)y / size;
+			float color[3] = {
+				0.5f + 0.4f * sinf(6.0f * u + 2.0f * v),
+				0.4f + 0.3f * cosf(5.0f * v),
+				0.3f + 0.2f * sinf(9.0f * u * v),
+			};
+			if ((x / 64 + y / 64) % 5 == 0) {
+				color[0] = 0.8f;
+				color[1] = 0.1f;
+				color[2] = 0.1f;
+			}
+
+			auto pixel = &image->pixels[4 * ((size_t)y * size + x)];
+			for (int c = 0; c < 3; c++) {
+				auto value = (int)(255.0f * color[c]) + noise(random);
+				pixel[c] = (uint8_t)std::min(std::max(value, 0), 255);
+			}
+			pixel[3] = 255;
+		}
+	}
+}
+
+// The normals of a field of overlapping bumps.
+static void makeNormalImage(uint32_t size, Image *image) {
+	auto height = [size](float x, float y) {
+		auto u = 2.0f * 3.14159265f * x / size;
+		auto v = 2.0f * 3.14159265f * y / size;
+		return 4.0f * sinf(8.0f * u) * sinf(8.0f * v) + 1.5f * sinf(29.0f * u + 13.0f * v);
+	};
+
+	image->width = size;
+	image->height = size;
+	image->pixels.resize(4 * (size_t)size * size);
+	for (uint32_t y = 0; y < size; y++) {
+		for (uint32_t x = 0; x < size; x++) {
+			auto dx = height(x + 1.0f, (float)y) - height(x - 1.0f, (float)y);
+			auto dy = height((float)x, y + 1.0f) - height((float)x, y - 1.0f);
+			float normal[3] = {-dx, -dy, 2.0f};
+			auto length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + 4.0f);
+
+			auto pixel = &image->pixels[4 * ((size_t)y * size + x)];
+			for (int c = 0; c < 3; c++) {
+				pixel[c] = (uint8_t)(127.5f * (normal[c] / length + 1.0f) + 0.5f);
+			}
+			pixel[3] = 255;
+		}
+	}
+}
+
+// Encodes every level of a mip chain and reports throughput, quality against the source levels
+// and the size against uncompressed RGBA8.
+static void benchmarkFormat(
+	const char *name, const std::vector<Image> *mips, TextureFormat format, uint32_t numChannels,
+	uint32_t numThreads
+) {
+	size_t numPixels = 0;
+	size_t rawSize = 0;
+	for (auto &mip : *mips) {
+		numPixels += (size_t)mip.width * mip.height;
+		rawSize += getEncodedSize(TEXTURE_FORMAT_RGBA8, mip.width, mip.height);
+	}
+
+	for (int quality = TEXTURE_QUALITY_FAST; quality <= TEXTURE_QUALITY_BEST; quality++) {
+		std::vector<std::vector<uint8_t>> encoded(mips->size());
+		auto start = Clock::now();
+		for (size_t i = 0; i < mips->size(); i++) {
+			encodeImage(&(*mips)[i], format, (TextureQuality)quality, numThreads, &encoded[i]);
+		}
+		auto milliseconds = getMilliseconds(start, Clock::now());
+
+		size_t encodedSize = 0;
+		for (auto &data : encoded) {
+			encodedSize += data.size();
+		}
+
+		// only the top level, since the smallest levels are too few pixels to say much
+		Image decoded;
+		auto &top = (*mips)[0];
+		decodeImage(encoded[0].data(), format, top.width, top.height, &decoded);
+
+		printf(
+			"%-6s %-4s %-6s %8.1f Mpix/s  %6.2f dB  %9zu bytes (%.1fx smaller)\n",
+			name, getTextureFormatName(format), getTextureQualityName((TextureQuality)quality),
+			numPixels / milliseconds / 1000.0, computePsnr(&top, &decoded, numChannels),
+			encodedSize, (double)rawSize / encodedSize
+		);
+	}
+}
+
+int main(int argc, const char *argv[]) {
+	Options options;
+	if (!parseOptions(argc, argv, &options)) {
+		fprintf(stderr, "usage: %s [--size n] [--threads n] [--image path.tga]\n", argv[0]);
+		return 1;
+	}
+
+	Image color;
+	if (options.image) {
+		std::ifstream file(options.image, std::ios::binary);
+		std::vector<uint8_t> data(
+			(std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()
+		);
+		if (!decodeTga(data.data(), data.size(), &color)) {
+			fprintf(stderr, "couldn't read %s\n", options.image);
+			return 1;
+		}
+	} else {
+		makeColorImage(options.size, &color);
+	}
+	Image normal;
+	makeNormalImage(options.size, &normal);
+
+	MipSettings colorSettings = {true, false, true};
+	MipSettings normalSettings = {false, true, true};
+	std::vector<Image> colorMips;
+	std::vector<Image> normalMips;
+	auto start = Clock::now();
+	generateMips(&color, &colorSettings, &colorMips);
+	generateMips(&normal, &normalSettings, &normalMips);
+	printf(
+		"mips: %ux%u color and %ux%u normal, %zu and %zu levels in %.1f ms\n",
+		color.width, color.height, normal.width, normal.height, colorMips.size(),
+		normalMips.size(), getMilliseconds(start, Clock::now())
+	);
+
+	benchmarkFormat("color", &colorMips, TEXTURE_FORMAT_BC1, 3, options.threads);
+	benchmarkFormat("color", &colorMips, TEXTURE_FORMAT_BC7, 4, options.threads);
+	benchmarkFormat("normal", &normalMips, TEXTURE_FORMAT_BC5, 2, options.threads);
+	return 0;
+}